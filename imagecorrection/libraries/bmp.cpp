@@ -33,6 +33,7 @@ BMP::BMP(const char* path) {
         rows[i].pixels = new Pixel[width];
         fread(rows[i].pixels, sizeof(Pixel), width, f);
         // dynamically allocate row padding and read it in
+        rows[i].padding = NULL;
         if (_rowPadding > 0) {
             rows[i].padding = new unsigned char[_rowPadding];
             fread(rows[i].padding, sizeof(unsigned char), _rowPadding, f);
@@ -45,10 +46,10 @@ BMP::BMP(const char* path) {
 // destructor
 BMP::~BMP() {
     for (int r=0; r < _dibHead._height.be(); r++) {
-        delete rows[r].pixels;
-        delete rows[r].padding;
+        delete[] rows[r].pixels;
+        delete[] rows[r].padding;
     }
-    delete rows;
+    delete[] rows;
 }
 
 // writes to a BMP class to a BMP file
@@ -110,108 +111,5 @@ void BMP::average_surrounding(int x, int y) {
 
 // FAST corner detection algorithm
 Corners BMP::fast() {
-    int corners[4][2] = {{0}}; // intialized to 0
-    
-    int min_x = 13;
-    int max_x = this->width() - 13;
-    int min_y = 13;
-    int max_y = this->height() - 13;
-        
-    this->fast(min_x, max_x/2, min_y, max_y/2, corners[0], &BMP::fast_sw);
-    this->fast(min_x, max_x/2, max_y/2, max_y, corners[1], &BMP::fast_nw);
-    this->fast(max_x/2, max_x, max_y/2, max_y, corners[2], &BMP::fast_ne);
-    this->fast(max_x/2, max_x, min_y, max_y/2, corners[3], &BMP::fast_se);
-
-    // return the Corners object
-    return Corners(corners);
-}
-
-// FAST corner detection for quadrants of the image
-void BMP::fast(int x_min, int x_max, int y_min, int y_max, int* corner, bool(BMP::*condit)(int,int,int,int)){
-    for (int y=y_min; y < y_max; y++)
-        for (int x=x_min; x < x_max; x++) {
-            if (this->is_corner(x,y)) {
-                if ((!corner[0] && !corner[1]) || (this->*condit)(x, y, corner[0], corner[1])) {
-                    corner[0] = x;
-                    corner[1] = y;
-                }
-            }
-        }
-}
-
-// SW quadrant condition to compare current corner
-bool BMP::fast_sw(int x, int y, int xCorner, int yCorner) {    
-    return (x+y) < (xCorner+yCorner);
-}
-
-// NW quadrant condition to compare current corner
-bool BMP::fast_nw(int x, int y, int xCorner, int yCorner) {
-    return (y-x) > (yCorner-xCorner);
-}
-
-// NE quadrant condition to compare current corner
-bool BMP::fast_ne(int x, int y, int xCorner, int yCorner) {
-    return (x+y) > (xCorner+yCorner);
-}
-
-// SE quadrant condition to compare current corner
-bool BMP::fast_se(int x, int y, int xCorner, int yCorner) {
-    return (x-y) > (xCorner-yCorner);
-}
-
-// if the luminance of n contiguous of the 16 surrounding pixels
-// are above or below the threshold luminance then a
-// corner is detected.
-bool BMP::is_corner(int x, int y) {
-    // luminances limits for selected pixels
-    float lum = this->rows[y].pixels[x].luminance();
-    float max_lum = lum + FAST_THRESHOLD;
-    float min_lum = lum - FAST_THRESHOLD;
-    float temp_lum = 0;
-    
-    // count of pixels below or above
-    int cnt = 0;
-    // this is used to keep track of the first
-    // count we get to add it back to the last
-    // count we get to keep continuity around the
-    // ends of the circle
-    int begin_cnt = 0;
-    
-    y -= 3; // start with bottom center pixel
-    for (int i=0; i<16; i++){
-
-        // if it is outside of bounds count it, otherwise reset count
-        temp_lum = this->rows[y].pixels[x].luminance();
-        if (temp_lum < min_lum || temp_lum > max_lum) {
-            if (i == 0)
-                begin_cnt--;
-            cnt++;
-        } else {
-            if (begin_cnt == -1)
-                begin_cnt = cnt;
-            cnt = 0;
-        }
-        
-        // corner detected
-        if (cnt >= FAST_CONTIG)
-            return true;
-        
-        // these rules follow a pattern to make a cirlce
-        // of 16 pixels around the selected pixel
-        if (i < 3 || i > 12)
-            x++;
-        if (i > 4 && i < 11)
-            x--;
-        if (i > 8)
-            y--;
-        if (i > 0 && i < 7)
-            y++;
-    }
-    
-    // if no corner at this point, see if there
-    // are enough contiguous from end and begining
-    if ((begin_cnt + cnt) >= FAST_CONTIG)
-        return true;
-    
-    return false;
+    return fast_corners(*this);
 }
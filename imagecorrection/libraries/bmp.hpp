@@ -6,6 +6,7 @@
 #include "utils.hpp"
 #include "corner.hpp"
 #include "matrix.hpp"
+#include "fast.hpp"
 
 // default color for empty pixel
 const uint32_t DEFAULT_COLOR = 0xFF69B4;
@@ -13,12 +14,6 @@ const char DEFAULT_RED = (DEFAULT_COLOR) & 0xFF;
 const char DEFAULT_GREEN = (DEFAULT_COLOR >> 8) & 0xFF;
 const char DEFAULT_BLUE = (DEFAULT_COLOR >> 16) & 0xFF;
 
-// values for the fast algorithm
-// these values have been adjusted using trial and error
-// threshold of luminance value
-const float FAST_THRESHOLD = 20;
-const int FAST_CONTIG = 8;
-
 // 2-Bytes
 struct Word {
     unsigned char b1;
@@ -123,15 +118,9 @@ private:
     DIBHead _dibHead;
     int _rowPadding;
     Row* rows;
-    bool is_corner(int,int);
     template<typename T>
     void transform(const BMP*, const Matrix<T>&, const Corners&, const Corners&);
     void average_surrounding(int, int);
-    void fast(int,int,int,int,int*,bool(BMP::*)(int,int,int,int));
-    bool fast_sw(int,int,int,int);
-    bool fast_nw(int,int,int,int);
-    bool fast_ne(int,int,int,int);
-    bool fast_se(int,int,int,int);
     
 public:
     BMP(const char*);
@@ -140,6 +129,7 @@ public:
     ~BMP();
     int32_t width() const { return _dibHead._width.be(); }
     int32_t height() const { return _dibHead._height.be(); }
+    float luminance(int x, int y) const { return rows[y].pixels[x].luminance(); }
     void write(const char*);
     Corners fast();
 };
@@ -178,8 +168,9 @@ inline BMP::BMP(const BMP* bmp, const Matrix<T>& H, const Corners& orig, const C
         // dynamically allocate pixels
         rows[i].pixels = new Pixel[width];
         // dynamically allocate row padding
+        rows[i].padding = NULL;
         if (_rowPadding > 0) {
-            rows[i].padding = new unsigned char[_rowPadding];
+            rows[i].padding = new unsigned char[_rowPadding]();
         }
     }
 
@@ -0,0 +1,127 @@
+#ifndef FAST_HPP
+#define FAST_HPP
+
+#include "corner.hpp"
+
+// values for the fast algorithm
+// these values have been adjusted using trial and error
+// threshold of luminance value
+const float FAST_THRESHOLD = 20;
+const int FAST_CONTIG = 8;
+
+// FAST corner detection works on anything that has width(), height()
+// and luminance(x, y) with y going up from the bottom row, so a BMP
+// and the luma plane straight from the camera share the same code
+
+// SW quadrant condition to compare current corner
+inline bool fast_sw(int x, int y, int xCorner, int yCorner) {
+    return (x+y) < (xCorner+yCorner);
+}
+
+// NW quadrant condition to compare current corner
+inline bool fast_nw(int x, int y, int xCorner, int yCorner) {
+    return (y-x) > (yCorner-xCorner);
+}
+
+// NE quadrant condition to compare current corner
+inline bool fast_ne(int x, int y, int xCorner, int yCorner) {
+    return (x+y) > (xCorner+yCorner);
+}
+
+// SE quadrant condition to compare current corner
+inline bool fast_se(int x, int y, int xCorner, int yCorner) {
+    return (x-y) > (xCorner-yCorner);
+}
+
+// if the luminance of n contiguous of the 16 surrounding pixels
+// are above or below the threshold luminance then a
+// corner is detected.
+template<typename Image>
+bool fast_is_corner(const Image& img, int x, int y) {
+    // luminances limits for selected pixels
+    float lum = img.luminance(x, y);
+    float max_lum = lum + FAST_THRESHOLD;
+    float min_lum = lum - FAST_THRESHOLD;
+    float temp_lum = 0;
+    
+    // count of pixels below or above
+    int cnt = 0;
+    // this is used to keep track of the first
+    // count we get to add it back to the last
+    // count we get to keep continuity around the
+    // ends of the circle
+    int begin_cnt = 0;
+    
+    y -= 3; // start with bottom center pixel
+    for (int i=0; i<16; i++){
+
+        // if it is outside of bounds count it, otherwise reset count
+        temp_lum = img.luminance(x, y);
+        if (temp_lum < min_lum || temp_lum > max_lum) {
+            if (i == 0)
+                begin_cnt--;
+            cnt++;
+        } else {
+            if (begin_cnt == -1)
+                begin_cnt = cnt;
+            cnt = 0;
+        }
+        
+        // corner detected
+        if (cnt >= FAST_CONTIG)
+            return true;
+        
+        // these rules follow a pattern to make a cirlce
+        // of 16 pixels around the selected pixel
+        if (i < 3 || i > 12)
+            x++;
+        if (i > 4 && i < 11)
+            x--;
+        if (i > 8)
+            y--;
+        if (i > 0 && i < 7)
+            y++;
+    }
+    
+    // if no corner at this point, see if there
+    // are enough contiguous from end and begining
+    if ((begin_cnt + cnt) >= FAST_CONTIG)
+        return true;
+    
+    return false;
+}
+
+// FAST corner detection for quadrants of the image
+template<typename Image>
+void fast_quadrant(const Image& img, int x_min, int x_max, int y_min, int y_max, int* corner, bool(*condit)(int,int,int,int)) {
+    for (int y=y_min; y < y_max; y++)
+        for (int x=x_min; x < x_max; x++) {
+            if (fast_is_corner(img, x, y)) {
+                if ((!corner[0] && !corner[1]) || condit(x, y, corner[0], corner[1])) {
+                    corner[0] = x;
+                    corner[1] = y;
+                }
+            }
+        }
+}
+
+// FAST corner detection algorithm
+template<typename Image>
+Corners fast_corners(const Image& img) {
+    int corners[4][2] = {{0}}; // intialized to 0
+    
+    int min_x = 13;
+    int max_x = img.width() - 13;
+    int min_y = 13;
+    int max_y = img.height() - 13;
+        
+    fast_quadrant(img, min_x, max_x/2, min_y, max_y/2, corners[0], fast_sw);
+    fast_quadrant(img, min_x, max_x/2, max_y/2, max_y, corners[1], fast_nw);
+    fast_quadrant(img, max_x/2, max_x, max_y/2, max_y, corners[2], fast_ne);
+    fast_quadrant(img, max_x/2, max_x, min_y, max_y/2, corners[3], fast_se);
+
+    // return the Corners object
+    return Corners(corners);
+}
+
+#endif
@@ -1,7 +1,8 @@
 #include "imglib.hpp"
 
-// this runs the complete image transformation process
-void transformGusset(const char* source_file, const char* destination_file, bool assisted) {
+// this runs the complete image transformation process and returns the
+// warp it performed
+Warp transformGusset(const char* source_file, const char* destination_file, bool assisted) {
     printf("\nReading %s\n", source_file);
     BMP* bmp = new BMP(source_file);
     
@@ -12,12 +13,52 @@ void transformGusset(const char* source_file, const char* destination_file, bool
     else
         original = bmp->fast();
 
-    Corners destination = original.findDest();
+    return warpGusset(bmp, original, destination_file);
+}
+
+// transforms with corners that were already found, e.g. on the
+// camera's luma plane, so only the warp touches the color image
+Warp transformGusset(const char* source_file, const char* destination_file, Corners original) {
+    printf("\nReading %s\n", source_file);
+    BMP* bmp = new BMP(source_file);
+
+    return warpGusset(bmp, original, destination_file);
+}
+
+// solves for the transformation matrix and warps the image
+Warp warpGusset(BMP* bmp, Corners original, const char* destination_file) {
+    Warp warp = solveWarp(original);
+    applyWarp(bmp, warp, destination_file);
+    return warp;
+}
+
+// reads an image and finds the warp of its gusset without performing it
+Warp findWarp(const char* source_file, bool assisted) {
+    printf("\nReading %s\n", source_file);
+    BMP* bmp = new BMP(source_file);
+
+    printf("Finding Corners\n");
+    Corners original;
+    if (assisted)
+        original = getCornerInput();
+    else
+        original = bmp->fast();
+    delete bmp;
+
+    return solveWarp(original);
+}
+
+// solves for the transformation matrix that takes the corners to the
+// rectangle of the gusset's proportions
+Warp solveWarp(Corners original) {
+    Warp warp;
+    warp.original = original;
+    warp.destination = original.findDest();
 
     printf("Finding Transformation Matrix\n");
-    Matrix<float> U(original, destination);
+    Matrix<float> U(warp.original, warp.destination);
     Matrix<float> L(U);
-    Matrix<float> B(destination);
+    Matrix<float> B(warp.destination);
 
     Matrix<float> P = U.lu();
     L.lu(false);
@@ -27,11 +68,77 @@ void transformGusset(const char* source_file, const char* destination_file, bool
 
     H.reshape(3, 3);
 
+    for (int r=0; r < 3; r++)
+        for (int c=0; c < 3; c++)
+            warp.H[3*r + c] = H(r, c);
+
+    return warp;
+}
+
+// warps an image with a transformation matrix solved earlier, maybe on
+// another machine
+void applyWarp(BMP* bmp, const Warp& warp, const char* destination_file) {
+    Matrix<float> H(3, 3);
+
+    for (int r=0; r < 3; r++)
+        for (int c=0; c < 3; c++)
+            H(r, c) = warp.H[3*r + c];
+
     printf("Performing Transformation\n");
-    BMP* final = new BMP(bmp, H, original, destination);
+    BMP* final = new BMP(bmp, H, warp.original, warp.destination);
 
     printf("Writing %s\n\n", destination_file);
     final->write(destination_file);
+    delete final;
+}
+
+// the warp as a sidecar for the capture it belongs to, a few lines of
+// text:
+//
+//   warp 1
+//   corners <sw x y> <nw x y> <ne x y> <se x y>
+//   size <width> <height>
+//   H <9 values, row by row>
+//
+// the size is that of the corrected image, whose corners are those of
+// findDest.  the values are printed so they read back the same
+std::vector<unsigned char> Warp_to_sidecar(const Warp& warp) {
+    const Corners& o = warp.original;
+    const Corners& d = warp.destination;
+    char text[512];
+    int length = snprintf(text, sizeof(text),
+                          "warp 1\ncorners %d %d %d %d %d %d %d %d\nsize %d %d\nH",
+                          o._sw._x, o._sw._y, o._nw._x, o._nw._y, o._ne._x, o._ne._y, o._se._x, o._se._y,
+                          1 + d._ne._x - d._nw._x, 1 + d._nw._y - d._sw._y);
+
+    for (int i=0; i < 9; i++)
+        length += snprintf(text + length, sizeof(text) - length, " %.9g", warp.H[i]);
+    length += snprintf(text + length, sizeof(text) - length, "\n");
+
+    return std::vector<unsigned char>(text, text + length);
+}
+
+// reads a sidecar written by Warp_to_sidecar
+Warp sidecar_to_Warp(std::string sidecar_path) {
+    Warp warp;
+    int c[4][2];
+    int version, width, height;
+
+    FILE* f = openFile(sidecar_path.c_str(), "r");
+    int count = fscanf(f, "warp %d corners %d %d %d %d %d %d %d %d size %d %d H",
+                       &version, &c[0][0], &c[0][1], &c[1][0], &c[1][1], &c[2][0], &c[2][1], &c[3][0], &c[3][1],
+                       &width, &height);
+    for (int i=0; i < 9 && count == 11 + i; i++)
+        count += fscanf(f, "%f", &warp.H[i]);
+    fclose(f);
+
+    if (count != 20 || version != 1 || width < 1 || height < 1)
+        throw std::runtime_error("Not a warp sidecar: " + sidecar_path);
+
+    warp.original = Corners(c);
+    warp.destination = Corners(Corner(0, 0), Corner(0, height - 1), Corner(width - 1, height - 1), Corner(width - 1, 0));
+
+    return warp;
 }
 
 // this converts an image from JPEG to BMP
@@ -53,3 +160,58 @@ void BMP_to_JPEG(std::string b_image_path, std::string j_image_path) {
 
     printf("Conversion complete.\n\n");
 }
+
+// the output of a command in memory, empty on failure
+static std::vector<unsigned char> commandOutput(std::string command) {
+    std::vector<unsigned char> output;
+    unsigned char buffer[65536];
+    size_t count;
+
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe)
+        return output;
+
+    while ((count = fread(buffer, 1, sizeof(buffer), pipe)) > 0)
+        output.insert(output.end(), buffer, buffer + count);
+
+    if (pclose(pipe) != 0)
+        output.clear();
+
+    return output;
+}
+
+// this converts an image from BMP to JPEG in memory, empty on failure.
+// the JPEG is progressive so the base station can show the first scans
+// while the rest are still on the way
+std::vector<unsigned char> BMP_to_JPEG(std::string b_image_path) {
+    printf("Converting %s to JPEG in memory.\n", b_image_path.c_str());
+
+    std::vector<unsigned char> jpeg = commandOutput("cjpeg -progressive " + b_image_path);
+
+    printf("Conversion complete, %u bytes.\n\n", (unsigned)jpeg.size());
+    return jpeg;
+}
+
+// this rewrites a JPEG as progressive in memory without decoding it, so
+// nothing is lost.  empty on failure
+std::vector<unsigned char> JPEG_to_progressive(std::string j_image_path) {
+    printf("Converting %s to progressive JPEG in memory.\n", j_image_path.c_str());
+
+    std::vector<unsigned char> jpeg = commandOutput("jpegtran -progressive " + j_image_path);
+
+    printf("Conversion complete, %u bytes.\n\n", (unsigned)jpeg.size());
+    return jpeg;
+}
+
+// this makes a small copy of a JPEG in memory for a quick look, scale
+// times narrower and lower (2, 4 or 8).  djpeg scales while it decodes,
+// so it costs a fraction of a full conversion.  empty on failure
+std::vector<unsigned char> JPEG_thumbnail(std::string j_image_path, int scale) {
+    printf("Making a 1/%d thumbnail of %s in memory.\n", scale, j_image_path.c_str());
+
+    std::vector<unsigned char> jpeg = commandOutput("djpeg -scale 1/" + std::to_string(scale) + " " +
+                                                    j_image_path + " | cjpeg -optimize");
+
+    printf("Thumbnail complete, %u bytes.\n\n", (unsigned)jpeg.size());
+    return jpeg;
+}
@@ -8,9 +8,30 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string>
+#include <vector>
+#include <stdexcept>
 
-void transformGusset(const char*, const char*, bool = false);
+// what it takes to correct a capture: the corners of the gusset in it, the
+// rectangle they go to and the transformation matrix between them.  it is
+// small enough to go with the capture, so the warp can be done elsewhere
+struct Warp {
+    Corners original;
+    Corners destination;
+    float H[9]; // row by row
+};
+
+Warp transformGusset(const char*, const char*, bool = false);
+Warp transformGusset(const char*, const char*, Corners);
+Warp warpGusset(BMP*, Corners, const char*);
+Warp findWarp(const char*, bool = false);
+Warp solveWarp(Corners);
+void applyWarp(BMP*, const Warp&, const char*);
+std::vector<unsigned char> Warp_to_sidecar(const Warp&);
+Warp sidecar_to_Warp(std::string);
 void JPEG_to_BMP(std::string, std::string);
 void BMP_to_JPEG(std::string, std::string);
+std::vector<unsigned char> BMP_to_JPEG(std::string);
+std::vector<unsigned char> JPEG_to_progressive(std::string);
+std::vector<unsigned char> JPEG_thumbnail(std::string, int);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,25 @@
+#ifndef LUMA_HPP
+#define LUMA_HPP
+
+#include "fast.hpp"
+
+// Holds a view of an 8-bit luminance plane, such as the Y samples of
+// a YUYV (step 2) or NV12 (step 1) frame from the camera. It does not
+// own the data, which stays in the capture buffer.
+struct LumaView {
+    const unsigned char* data;
+    int _width;
+    int _height;
+    int stride; // bytes from one row to the next
+    int step;   // bytes from one pixel to the next
+
+    LumaView(const unsigned char* d, int w, int h, int s, int p = 1): data(d), _width(w), _height(h), stride(s), step(p) { }
+    int width() const { return _width; }
+    int height() const { return _height; }
+    // camera rows are top down and BMP rows are bottom up,
+    // y is flipped so the corners come out the same way
+    float luminance(int x, int y) const { return data[(_height - 1 - y)*stride + x*step]; }
+    Corners fast() const { return fast_corners(*this); }
+};
+
+#endif
@@ -233,6 +233,32 @@ Matrix<T> Matrix<T>::back_sub(const Matrix<T>& m) {
     return result;
 }
 
+// returns the transpose of a matrix
+template<typename T>
+Matrix<T> Matrix<T>::transpose() const {
+    Matrix<T> result(_width, _height);
+
+    for (int r = 0; r < _height; r++)
+        for (int c = 0; c < _width; c++)
+            result._values[c][r] = _values[r][c];
+
+    return result;
+}
+
+// solves Ax = b for a square matrix using the
+// same LU steps that find the transformation matrix
+template<typename T>
+Matrix<T> Matrix<T>::solve(const Matrix<T>& b) const {
+    Matrix<T> U(*this);
+    Matrix<T> L(U);
+
+    Matrix<T> P = U.lu();
+    L.lu(false);
+
+    Matrix<T> Y = L.forward_sub(P*b);
+    return U.back_sub(Y);
+}
+
 // this reshapes a matrix into a bigger or equal matrix
 template<typename T>
 void Matrix<T>::reshape(int height, int width, int defaults) {
@@ -300,3 +326,4 @@ Matrix<T> Matrix<T>::operator* (const Matrix<T>& m) const {
 http://stackoverflow.com/questions/312115/c-linking-errors-undefined-symbols-using-a-templated-class/312402#312402
 */
 template class Matrix<float>;
+template class Matrix<double>;
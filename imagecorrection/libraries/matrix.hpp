@@ -36,6 +36,12 @@ public:
     Matrix<T> lu(bool = true);
     Matrix<T> forward_sub(const Matrix<T>&);
     Matrix<T> back_sub(const Matrix<T>&);
+    Matrix<T> transpose() const;
+    Matrix<T> solve(const Matrix<T>&) const;
+    int height() const { return _height; }
+    int width() const { return _width; }
+    T& operator() (int r, int c) { return _values[r][c]; }
+    const T& operator() (int r, int c) const { return _values[r][c]; }
     void reshape(int, int, int = 1);
     Point get_3v_point();
     Matrix<T> operator* (const Matrix<T>&) const;
@@ -0,0 +1,538 @@
+#include "imglib.hpp"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <map>
+#include <stdexcept>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+
+//the base station's image correction, beside xbeeDaemon
+//
+//usage: correctionDaemon [-i dir] [-o dir] [-w workers] [-e]
+//
+//watches the directories xbeeDaemon puts each radio's images in, one per
+//device under -i (default "."), and corrects every capture a field unit
+//sends (temp<n>.jpeg) into the same device directory under -o (default
+//<in>/corrected).  a capture that came with the sidecar of a field unit in
+//remote warp mode (temp<n>.warp of the same session, see Warp_to_sidecar)
+//is warped as the sidecar says, any other is decoded, its corners found
+//and the warp solved here.  a capture whose corrected image came in the
+//same session (temp_out<n>.jpeg) is left as it is
+//
+//the captures are spread over the workers (default one per core), each
+//with its own queue.  a worker takes from the front of its own and, when
+//it is empty, from the back of another's, so a worker left with the slow
+//captures does not hold up the rest.  a corrected image is written next
+//to its place and renamed into it, so it is never seen half written, and
+//one that is there is not done again.  images per second are reported
+//whenever the queues run dry, and for the whole run at the end
+//
+//with -e the captures already there are corrected and it exits.
+//otherwise SIGINT or SIGTERM stops after the images under way, those
+//still queued are done at the next start
+
+struct Job {
+	std::string device;	//the device directory's name
+	std::string input;	//the capture
+	std::string output;	//the corrected image
+};
+
+struct Worker {
+	int index;
+	pthread_t thread;
+	pthread_mutex_t lock;	//guards jobs
+	std::deque<Job> jobs;	//its own taken from the front, others' from the back
+	int done;		//images corrected
+	int failed;
+	int stolen;		//of those, taken from another worker
+};
+
+static std::string inDir = ".";
+static std::string outDir = "";
+static std::string workDir;		//the workers' decoded and warped BMPs
+static std::vector<Worker*> workers;
+
+//how much work there is, for the workers to sleep on and the rate
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t poolChanged = PTHREAD_COND_INITIALIZER;
+static int pending = 0;			//queued, not taken yet
+static int active = 0;			//being corrected
+static bool stopping = false;
+static struct timespec burstStart;	//when the queues last stopped being dry
+static int burstImages = 0;		//corrected since then
+static int totalImages = 0;
+static double totalSeconds = 0;		//spent with work queued or under way
+
+//the workers print whole lines
+static pthread_mutex_t logLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void report(const std::string& device, const std::string& line){
+	pthread_mutex_lock(&logLock);
+	std::cout << device << ": " << line << std::endl;
+	pthread_mutex_unlock(&logLock);
+}
+
+static double secondsSince(const struct timespec& start){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static bool makeDir(const std::string& path){
+	return mkdir(path.c_str(), 0775) == 0 || errno == EEXIST;
+}
+
+static bool isDir(const std::string& path){
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+static bool sameDir(const std::string& a, const std::string& b){
+	struct stat sa, sb;
+	return stat(a.c_str(), &sa) == 0 && stat(b.c_str(), &sb) == 0 && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+static long fileSize(const std::string& path){
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 ? (long)st.st_size : -1;
+}
+
+static bool endsWith(const std::string& s, const std::string& end){
+	return s.size() >= end.size() && s.compare(s.size() - end.size(), end.size(), end) == 0;
+}
+
+//xbeeDaemon names a file <yyyymmdd-hhmmss>-<session>-<name>, the time it
+//was received.  what follows the time is the same for the files of a
+//session, whenever each came
+static std::string sessionName(const std::string& file){
+	if(file.size() > 16 && file[8] == '-' && file[15] == '-')
+		return file.substr(16);
+	return file;
+}
+
+//whether a file is a capture: temp<n>.jpeg, maybe carried over from an
+//earlier cycle under a name with its time in front
+static bool isCapture(const std::string& file){
+	size_t start = file.rfind("temp");
+	size_t digits = start + 4;
+
+	if(start == std::string::npos || (start > 0 && file[start - 1] != '-') || !endsWith(file, ".jpeg"))
+		return false;
+
+	size_t end = file.size() - 5;
+	if(digits == end)
+		return false;
+	for(size_t i = digits; i < end; i++)
+		if(file[i] < '0' || file[i] > '9')
+			return false;
+	return true;
+}
+
+//the file in dir from the same session as file and named like it, with
+//from in its name replaced by to.  empty if there is none
+static std::string sibling(const std::string& dir, const std::string& file, const std::string& from, const std::string& to){
+	std::string name = sessionName(file);
+	size_t at = name.rfind(from);
+
+	if(at == std::string::npos)
+		return "";
+	name.replace(at, from.size(), to);
+
+	DIR* d = opendir(dir.c_str());
+	std::string found;
+	struct dirent* entry;
+
+	while(d && found.empty() && (entry = readdir(d)))
+		if(sessionName(entry->d_name) == name)
+			found = dir + "/" + entry->d_name;
+	if(d)
+		closedir(d);
+	return found;
+}
+
+//writes data in a temporary file next to path that is renamed into place
+static bool writeAtomic(const std::string& path, const std::vector<unsigned char>& data){
+	std::string temp = path + ".tmp";
+	FILE* f = fopen(temp.c_str(), "wb");
+
+	if(!f)
+		return false;
+
+	bool ok = fwrite(&data[0], 1, data.size(), f) == data.size();
+	ok = fflush(f) == 0 && fsync(fileno(f)) == 0 && ok;
+	fclose(f);
+
+	if(!ok || rename(temp.c_str(), path.c_str())){
+		unlink(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+//decodes, finds the warp unless the field unit sent it, warps and
+//encodes.  the reason it could not, or empty
+static std::string correct(Worker* worker, const Job& job){
+	std::ostringstream prefix;
+	prefix << workDir << "/" << worker->index;
+	std::string decoded = prefix.str() + "-in.bmp";
+	std::string warped = prefix.str() + "-out.bmp";
+	std::string dir = job.input.substr(0, job.input.find_last_of('/'));
+	std::string file = job.input.substr(job.input.find_last_of('/') + 1);
+
+	JPEG_to_BMP(job.input, decoded);
+	if(fileSize(decoded) <= 54)
+		return "unable to decode";
+
+	BMP bmp(decoded.c_str());
+	Warp warp;
+	std::string sidecar = sibling(dir, file, ".jpeg", ".warp");
+	bool solved = true;
+
+	if(!sidecar.empty()){
+		try{
+			warp = sidecar_to_Warp(sidecar);
+			solved = false;
+		}
+		catch(const std::exception& e){
+			report(job.device, e.what());
+		}
+	}
+	if(solved)
+		warp = solveWarp(bmp.fast());
+
+	applyWarp(&bmp, warp, warped.c_str());
+	std::vector<unsigned char> jpeg = BMP_to_JPEG(warped);
+	unlink(decoded.c_str());
+	unlink(warped.c_str());
+
+	if(jpeg.empty())
+		return "unable to encode";
+	if(!writeAtomic(job.output, jpeg))
+		return "unable to write " + job.output;
+
+	report(job.device, "corrected " + file + (solved ? "" : " with its sidecar") + " into " + job.output);
+	return "";
+}
+
+//the next job, from the front of the worker's own queue or else from the
+//back of another's
+static bool take(Worker* worker, Job& job){
+	for(size_t i = 0; i < workers.size(); i++){
+		Worker* from = workers[(worker->index + i) % workers.size()];
+		bool found = false;
+
+		pthread_mutex_lock(&from->lock);
+		if(!from->jobs.empty()){
+			if(from == worker){
+				job = from->jobs.front();
+				from->jobs.pop_front();
+			}
+			else{
+				job = from->jobs.back();
+				from->jobs.pop_back();
+			}
+			found = true;
+		}
+		pthread_mutex_unlock(&from->lock);
+
+		if(found){
+			if(from != worker)
+				worker->stolen++;
+			pthread_mutex_lock(&poolLock);
+			pending--;
+			active++;
+			pthread_mutex_unlock(&poolLock);
+			return true;
+		}
+	}
+	return false;
+}
+
+//a job is finished.  once the queues are dry the rate since they filled
+//is reported
+static void finished(bool ok){
+	pthread_mutex_lock(&poolLock);
+	active--;
+	if(ok){
+		burstImages++;
+		totalImages++;
+	}
+	if(!pending && !active){
+		double seconds = secondsSince(burstStart);
+		totalSeconds += seconds;
+		if(burstImages){
+			std::ostringstream oss;
+			oss << burstImages << " images in " << seconds << " s, " << burstImages / seconds << " images/s";
+			report("all", oss.str());
+		}
+		burstImages = 0;
+	}
+	pthread_cond_broadcast(&poolChanged);
+	pthread_mutex_unlock(&poolLock);
+}
+
+static void* work(void* arg){
+	Worker* worker = (Worker*)arg;
+	Job job;
+
+	for(;;){
+		pthread_mutex_lock(&poolLock);
+		while(!pending && !stopping)
+			pthread_cond_wait(&poolChanged, &poolLock);
+		bool stop = stopping;
+		pthread_mutex_unlock(&poolLock);
+
+		if(stop)
+			break;
+		if(!take(worker, job))
+			continue;	//another worker was quicker
+
+		std::string error;
+		try{
+			error = correct(worker, job);
+		}
+		catch(const std::exception& e){
+			error = e.what();
+		}
+
+		if(error.empty())
+			worker->done++;
+		else{
+			worker->failed++;
+			report(job.device, error + ", " + job.input + " left as it is");
+		}
+		finished(error.empty());
+	}
+	return NULL;
+}
+
+//the captures already queued, so an event and a scan do not queue one twice
+static std::set<std::string> queued;
+static size_t nextWorker = 0;
+
+//queues a capture that has no corrected image yet
+static void consider(const std::string& device, const std::string& file){
+	std::string dir = inDir + "/" + device;
+	std::string output = outDir + "/" + device + "/" + file;
+
+	if(!isCapture(file) || queued.count(output) || fileSize(output) >= 0)
+		return;
+
+	queued.insert(output);
+	if(!sibling(dir, file, "temp", "temp_out").empty()){
+		report(device, file + " was corrected on the field unit");
+		return;
+	}
+
+	Job job;
+	job.device = device;
+	job.input = dir + "/" + file;
+	job.output = output;
+
+	//round robin, the workers even it out
+	Worker* worker = workers[nextWorker++ % workers.size()];
+	pthread_mutex_lock(&poolLock);
+	pthread_mutex_lock(&worker->lock);
+	worker->jobs.push_back(job);
+	pthread_mutex_unlock(&worker->lock);
+	if(!pending && !active)
+		clock_gettime(CLOCK_MONOTONIC, &burstStart);
+	pending++;
+	pthread_cond_signal(&poolChanged);
+	pthread_mutex_unlock(&poolLock);
+}
+
+//a device directory to correct the captures of, and watch if inotifyFd
+//is open
+static int inotifyFd = -1;
+static std::map<int, std::string> watches;
+
+static void addDevice(const std::string& device){
+	std::string dir = inDir + "/" + device;
+
+	if(device.empty() || device[0] == '.' || !isDir(dir) || sameDir(dir, outDir) || !makeDir(outDir + "/" + device))
+		return;
+
+	//watched first, so nothing comes between the scan and the watch
+	if(inotifyFd >= 0){
+		int wd = inotify_add_watch(inotifyFd, dir.c_str(), IN_MOVED_TO | IN_CLOSE_WRITE);
+		if(wd < 0){
+			report(device, "unable to watch " + dir);
+			return;
+		}
+		if(watches.count(wd))
+			return;
+		watches[wd] = device;
+		report(device, "watching " + dir);
+	}
+
+	DIR* d = opendir(dir.c_str());
+	struct dirent* entry;
+	while(d && (entry = readdir(d)))
+		consider(device, entry->d_name);
+	if(d)
+		closedir(d);
+}
+
+static void scanDevices(){
+	DIR* d = opendir(inDir.c_str());
+	std::vector<std::string> names;
+	struct dirent* entry;
+
+	while(d && (entry = readdir(d)))
+		names.push_back(entry->d_name);
+	if(d)
+		closedir(d);
+
+	for(size_t i = 0; i < names.size(); i++)
+		addDevice(names[i]);
+}
+
+//the events that have come on inotifyFd
+static void readEvents(int rootWd){
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+
+	for(char* p = buffer; length > 0 && p < buffer + length; ){
+		struct inotify_event* event = (struct inotify_event*)p;
+		p += sizeof(struct inotify_event) + event->len;
+
+		if(!event->len)
+			continue;
+		if(event->wd == rootWd)
+			addDevice(event->name);
+		else if(watches.count(event->wd))
+			consider(watches[event->wd], event->name);
+	}
+}
+
+int main(int argc, char* argv[]){
+	int count = 0;
+	bool once = false;
+	int opt;
+
+	while((opt = getopt(argc, argv, "i:o:w:e")) != -1){
+		if(opt == 'i')
+			inDir = optarg;
+		else if(opt == 'o')
+			outDir = optarg;
+		else if(opt == 'w')
+			count = atoi(optarg);
+		else if(opt == 'e')
+			once = true;
+		else{
+			std::cout << "usage: correctionDaemon [-i dir] [-o dir] [-w workers] [-e]\n";
+			return 1;
+		}
+	}
+
+	//one worker per core unless told otherwise
+	if(count < 1)
+		count = sysconf(_SC_NPROCESSORS_ONLN);
+	if(count < 1)
+		count = 1;
+
+	if(outDir.empty())
+		outDir = inDir + "/corrected";
+	workDir = outDir + "/.work";
+	if(!makeDir(outDir) || !makeDir(workDir)){
+		std::cout << "unable to make " << workDir << "\n";
+		return 1;
+	}
+
+	//SIGINT and SIGTERM arrive through poll like the events
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+	int signalFd = signalfd(-1, &mask, SFD_CLOEXEC);
+
+	//new device directories show up in the input directory
+	int rootWd = -1;
+	if(!once){
+		inotifyFd = inotify_init1(IN_CLOEXEC);
+		if(inotifyFd >= 0)
+			rootWd = inotify_add_watch(inotifyFd, inDir.c_str(), IN_CREATE | IN_MOVED_TO | IN_ONLYDIR);
+		if(signalFd < 0 || rootWd < 0){
+			std::cout << "unable to watch " << inDir << "\n";
+			return 1;
+		}
+	}
+
+	for(int i = 0; i < count; i++){
+		Worker* worker = new Worker;
+		worker->index = i;
+		pthread_mutex_init(&worker->lock, NULL);
+		worker->done = worker->failed = worker->stolen = 0;
+		workers.push_back(worker);
+	}
+	for(int i = 0; i < count; i++)
+		pthread_create(&workers[i]->thread, NULL, work, workers[i]);
+
+	scanDevices();
+
+	if(once){
+		pthread_mutex_lock(&poolLock);
+		while(pending || active)
+			pthread_cond_wait(&poolChanged, &poolLock);
+		pthread_mutex_unlock(&poolLock);
+	}
+	else{
+		struct pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {signalFd, POLLIN, 0}};
+		bool stop = false;
+
+		while(!stop){
+			if(poll(fds, 2, -1) < 0 && errno != EINTR)
+				break;
+			if(fds[0].revents & POLLIN)
+				readEvents(rootWd);
+			if(fds[1].revents & POLLIN){
+				struct signalfd_siginfo info;
+				if(read(signalFd, &info, sizeof(info)) == sizeof(info))
+					stop = true;
+			}
+		}
+		std::cout << "stopping after the images under way\n";
+	}
+
+	pthread_mutex_lock(&poolLock);
+	stopping = true;
+	pthread_cond_broadcast(&poolChanged);
+	pthread_mutex_unlock(&poolLock);
+	for(int i = 0; i < count; i++)
+		pthread_join(workers[i]->thread, NULL);
+
+	for(int i = 0; i < count; i++){
+		Worker* worker = workers[i];
+		std::cout << "worker " << i << ": " << worker->done << " corrected, " << worker->failed << " failed, "
+		          << worker->stolen << " taken from others\n";
+		pthread_mutex_destroy(&worker->lock);
+		delete worker;
+	}
+	if(totalImages)
+		std::cout << totalImages << " images in " << totalSeconds << " s of work, "
+		          << totalImages / totalSeconds << " images/s with " << count << " workers\n";
+
+	rmdir(workDir.c_str());
+	if(inotifyFd >= 0)
+		close(inotifyFd);
+	if(signalFd >= 0)
+		close(signalFd);
+	return 0;
+}
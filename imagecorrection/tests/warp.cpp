@@ -0,0 +1,114 @@
+// The base station's half of remote warping: corrects a capture with the
+// sidecar the field unit sent along with it, see Warp_to_sidecar.
+//
+//   warp -i temp0.jpeg -w temp0.warp -o out.bmp
+//
+// With -b it times, on the image given, the correction done on the field
+// unit against the field unit finding the warp and the base station
+// performing it, -n times each.
+
+#include "imglib.hpp"
+
+#include <vector>
+#include <string>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+
+typedef std::chrono::steady_clock Clock;
+
+double since(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool endsWith(const std::string& s, const std::string& end) {
+	return s.size() >= end.size() && s.compare(s.size() - end.size(), end.size(), end) == 0;
+}
+
+// on-device correction against finding the warp on the device and
+// performing it on the base station
+void benchmark(const std::string& in_file, int runs) {
+	double device = 0, remote = 0, station = 0;
+	size_t sidecar_size = 0;
+
+	for (int i=0; i < runs; i++) {
+		Clock::time_point start = Clock::now();
+		transformGusset(in_file.c_str(), "warp_bench_device.bmp");
+		device += since(start);
+
+		start = Clock::now();
+		std::vector<unsigned char> sidecar = Warp_to_sidecar(findWarp(in_file.c_str()));
+		remote += since(start);
+		sidecar_size = sidecar.size();
+
+		std::ofstream("warp_bench.warp", std::ios::binary).write((const char*)&sidecar[0], sidecar.size());
+
+		start = Clock::now();
+		BMP bmp(in_file.c_str());
+		applyWarp(&bmp, sidecar_to_Warp("warp_bench.warp"), "warp_bench_station.bmp");
+		station += since(start);
+	}
+
+	printf("--- %d RUNS OF %s ---\n", runs, in_file.c_str());
+	printf("on the field unit, corrected  %10.3f s\n", device/runs);
+	printf("on the field unit, warp only  %10.3f s, %u byte sidecar\n", remote/runs, (unsigned)sidecar_size);
+	printf("on the base station, warped   %10.3f s\n", station/runs);
+	printf("field unit time saved         %10.1f %%\n", device > 0 ? 100*(device - remote)/device : 0.0);
+
+	remove("warp_bench_device.bmp");
+	remove("warp_bench_station.bmp");
+	remove("warp_bench.warp");
+}
+
+int main(int argc, char* argv[])
+{
+	bool bench = false;
+	int runs = 3;
+	std::vector<std::string> args;
+	std::string in_file = "";
+	std::string warp_file = "";
+	std::string out_file = "out.bmp";
+
+	// make all arguments strings
+	for (int i=0; i < argc; i++)
+		args.push_back(argv[i]);
+
+	// check arguments
+	for (int i=0; i < args.size(); i++) {
+		if (args[i] == "-b")
+			bench = true;
+		else if (args[i] == "-n")
+			runs = std::stoi(args[++i]);
+		else if (args[i] == "-i")
+			in_file = args[++i];
+		else if (args[i] == "-w")
+			warp_file = args[++i];
+		else if (args[i] == "-o")
+			out_file = args[++i];
+	}
+
+	if (in_file == "")
+		throw std::runtime_error("Must specify input file name using the -i command line flag.");
+
+	// the capture comes as the camera's JPEG
+	std::string bmp_file = in_file;
+	if (endsWith(in_file, ".jpeg") || endsWith(in_file, ".jpg")) {
+		bmp_file = "warp_in.bmp";
+		JPEG_to_BMP(in_file, bmp_file);
+	}
+
+	if (bench) {
+		benchmark(bmp_file, runs > 0 ? runs : 1);
+	} else {
+		if (warp_file == "")
+			throw std::runtime_error("Must specify the sidecar using the -w command line flag.");
+
+		BMP bmp(bmp_file.c_str());
+		applyWarp(&bmp, sidecar_to_Warp(warp_file), out_file.c_str());
+	}
+
+	if (bmp_file != in_file)
+		remove(bmp_file.c_str());
+
+	return 0;
+}
@@ -0,0 +1,77 @@
+// Times capture to corners for the two detection paths:
+// MJPEG frame -> jpeg file -> djpeg -> BMP -> fast()
+// YUYV frame -> luma plane -> fast()
+
+#include "imglib.hpp"
+#include "luma.hpp"
+extern "C"
+{
+#include "camera.h"
+}
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+typedef std::chrono::steady_clock Clock;
+
+double since(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<std::string> args;
+	std::string jpeg_device = "/dev/video0";
+	std::string luma_device = "/dev/video0";
+	CAMFRAME frame;
+	CAMERA* cam;
+
+	// make all arguments strings
+	for (int i=0; i < argc; i++)
+		args.push_back(argv[i]);
+
+	// -j and -y pick the device for each path, e.g. a mock
+	for (int i=0; i < args.size(); i++) {
+		if (args[i] == "-j")
+			jpeg_device = args[++i];
+		else if (args[i] == "-y")
+			luma_device = args[++i];
+	}
+
+	// JPEG path, what the wake cycle does today
+	cam = Cam_Open(jpeg_device.c_str(), 2592, 1944, V4L2_PIX_FMT_MJPEG);
+	if (cam && Cam_Grab(cam, &frame) == 0) {
+		Clock::time_point start = Clock::now();
+
+		Cam_Save(&frame, "corners_test.jpeg");
+		Cam_Release(cam, &frame);
+		JPEG_to_BMP("corners_test.jpeg", "corners_test.bmp");
+		BMP bmp("corners_test.bmp");
+		Corners corners = bmp.fast();
+
+		std::cout << "jpeg path: " << since(start) << " s capture to corners (" << bmp.width() << "x" << bmp.height() << ")" << std::endl;
+		corners.print();
+	}
+	Cam_Close(cam);
+
+	// luma path, the Y samples go straight to the detector
+	cam = Cam_Open(luma_device.c_str(), 2592, 1944, V4L2_PIX_FMT_YUYV);
+	if (cam && Cam_Grab(cam, &frame) == 0) {
+		Clock::time_point start = Clock::now();
+
+		LumaView luma(frame.data, frame.width, frame.height, frame.width*2, 2);
+		Corners corners = luma.fast();
+
+		std::cout << "luma path: " << since(start) << " s capture to corners (" << frame.width << "x" << frame.height << ")" << std::endl;
+		corners.print();
+		Cam_Release(cam, &frame);
+	}
+	Cam_Close(cam);
+
+	remove("corners_test.jpeg");
+	remove("corners_test.bmp");
+
+	return 0;
+}
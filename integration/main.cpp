@@ -1,5 +1,9 @@
 #include "imglib.hpp"
 #include "xMessage.hpp"
+#include "xlog.h"
+#include "xasync.h"
+#include "xoutbox.h"
+#include "xframe.h"
 #include "calibration.cpp"
 extern "C"
 {
@@ -9,18 +13,73 @@ extern "C"
 #include <iostream>
 #include <string>
 #include <vector>
+#include <deque>
+#include <chrono>
+#include <iomanip>
+#include <fstream>
+#include <iterator>
+#include <ctime>
+#include <sys/stat.h>
 
 #define JUMPER 18
+#define LOCATIONS "../motorcontrols/locations/locations.txt"
+#define LINK_LOG "../xbee/link.log" // what each transfer cost, see xlog.h
+#define OUTBOX "../images/outbox"   // what a cycle did not get across, see xoutbox.h
+#define WAKE_SECONDS 600            // the longest the unit stays up in a cycle, -w to change
+#define SHUTDOWN_SECONDS 30         // kept at the end for the outbox and the shutdown
+#define THUMBNAIL_SCALE 8           // thumbnails are an eighth of the width and height
 
-void transmitImageToBase(const char*);
+typedef std::chrono::steady_clock Clock;
+
+// what goes to the base station first when the wake time runs short: a
+// quick look at every gusset, then the corrected images, then the captures
+// they came from.  lower goes first, see xasync.h
+enum Priority { THUMBNAIL = 0, CORRECTED = 1, RAW = 2 };
+
+// a file for the base station, the data in memory or, if there is none,
+// the file at path
+struct Outgoing {
+	std::string name;
+	std::string path;
+	std::vector<unsigned char> data;
+	int priority;
+	bool carried; // from the outbox of an earlier cycle
+	XMODEM_STREAM stream;
+	XMODEM_ITEM item;
+};
+
+// the radio side, used by the transfer thread only while it runs
+struct Radio {
+	Serial& xbee;
+	Message msg;
+	Clock::time_point lastBatch;
+	Radio(Serial& serial) : xbee(serial), msg(serial) {}
+};
+
+// what the transfer thread has, a deque so that the items stay put
+typedef std::deque<Outgoing> Outbox;
+
+XASYNC* startTransmission(Radio&, Clock::time_point);
+void queueFile(XASYNC*, Outbox&, const std::string&, const std::string&, std::vector<unsigned char>, int, bool = false);
+void queueCarried(XASYNC*, Outbox&);
+std::vector<unsigned char> makeFrame(int, const int*, int, const Warp*, bool, std::vector<unsigned char>, const std::string&);
+void finishTransmission(XASYNC*, Outbox&);
 void calibrationNeeded();
 std::string imgPath(std::string, int, std::string);
+void stageDone(const std::string&, Clock::time_point&);
+void printStageTimes();
+
+// wall clock seconds spent in each stage, in the order first seen
+static std::vector<std::pair<std::string, double> > stage_times;
 
 int main(int argc, char* argv[])
 {
-	int locations = 4; // max locations 4
+	int locations = 0;
 	std::vector<std::string> args;
 	bool assisted = false;
+	bool remote = false;
+	bool frames = false;
+	int wakeSeconds = WAKE_SECONDS;
 
 	// make all arguments strings
 	for (int i=0; i < argc; i++)
@@ -30,17 +89,26 @@ int main(int argc, char* argv[])
 	for (int i=0; i < args.size(); i++) {
 		if (args[i] == "-a")
 			assisted = true;
+		else if (args[i] == "-r")
+			remote = true;
+		else if (args[i] == "-f")
+			frames = true;
+		else if (args[i] == "-w" && i + 1 < args.size())
+			wakeSeconds = std::stoi(args[++i]);
 	}
 
-	// remove amx of 4 existing images
-	for (int i=0; i < locations; i++)
-	  remove(imgPath("temp", i, ".jpeg").c_str());
+	Clock::time_point start = Clock::now();
+	// the radio is done by then, leaving time to save what it did not send
+	Clock::time_point deadline = start + std::chrono::seconds(wakeSeconds - SHUTDOWN_SECONDS);
 
 	calibrationNeeded(); // checks if jumper is set to calibrate system
+	stageDone("calibration check", start);
 
 	//Captures all the images from the locations in locations.txt
-	//saves images in image folder called testing0.jpeg, testing1.jpeg, etc.
-	locations = CaptureSavedLocations("../motorcontrols/locations/locations.txt");
+	//saves images in image folder called temp0.jpeg, temp1.jpeg, etc.
+	//the locations are visited in the order with the least servo travel
+	locations = CaptureSavedLocations(LOCATIONS);
+	stageDone("move and capture", start);
 
 	std::cout << "locations " << locations << std::endl;
 	if (locations == 0) {
@@ -48,29 +116,97 @@ int main(int argc, char* argv[])
 		return 1;
 	}
 
+	// where the servos were sent for each, for the frames
+	int positionCount = 0;
+	int* positions = frames ? getPositions(&positionCount, LOCATIONS) : NULL;
+
+	// one serial session to the base station for all the images, each is
+	// sent while the next location is processed
+	Serial xbee((char *)"/dev/ttyUSB0", XBAUD_DEFAULT);
+	Radio radio(xbee);
+	Outbox outbox;
+	XASYNC* queue = startTransmission(radio, deadline);
+
+	// what earlier cycles did not get across, and a thumbnail of every
+	// gusset, which decodes at a fraction of the size
+	queueCarried(queue, outbox);
+	for (int i=0; i < locations; i++)
+		queueFile(queue, outbox, "thumb" + std::to_string(i) + ".jpeg", "",
+		          JPEG_thumbnail(imgPath("temp", i, ".jpeg"), THUMBNAIL_SCALE), THUMBNAIL);
+	stageDone("thumbnails", start);
+
 	for (int i=0; i < locations; i++ ) {
 
+	    // out of time the captures are kept for the next cycle as they are
+	    if (Clock::now() >= deadline) {
+	        queueFile(queue, outbox, "temp" + std::to_string(i) + ".jpeg", imgPath("temp", i, ".jpeg"),
+	                  std::vector<unsigned char>(), RAW);
+	        continue;
+	    }
+
 	   //fucntions to convert .jpeg to .bmp
 	   JPEG_to_BMP(imgPath("temp", i, ".jpeg").c_str(), imgPath("temp_in", i, ".bmp").c_str());
+	   stageDone("jpeg to bmp", start);
 
-	    // in assisted mode the captured images are simply transmitted
-	    // otherwise the transformation is performed and that is transmitted
-	    if (!assisted) {
-	        //transforms gussets
-	        transformGusset(imgPath("temp_in", i, ".bmp").c_str(), imgPath("temp_out", i, ".bmp").c_str());
+	    // in assisted mode the captured images are simply transmitted.  in
+	    // remote mode the capture goes with the warp the base station is to
+	    // perform, which spares the unit the transformation.  otherwise the
+	    // transformation is performed and that is transmitted, with the
+	    // capture after it if there is time.  with -f each location's image
+	    // goes in a gusset frame with what is known about it
+	    if (remote && !assisted) {
+	        //finds the corners and solves for the transformation matrix
+	        Warp warp = findWarp(imgPath("temp_in", i, ".bmp").c_str());
+	        stageDone("find warp", start);
 
-	        //function to convert .bmp to .jpeg
-	        BMP_to_JPEG(imgPath("temp_out", i, ".bmp").c_str(), imgPath("temp_out", i, ".jpeg").c_str());
+	        if (frames) {
+	            queueFile(queue, outbox, "temp" + std::to_string(i) + ".frame", "",
+	                      makeFrame(i, positions, positionCount, &warp, false,
+	                                JPEG_to_progressive(imgPath("temp", i, ".jpeg")), imgPath("temp", i, ".jpeg")), CORRECTED);
+	        } else {
+	            queueFile(queue, outbox, "temp" + std::to_string(i) + ".warp", "", Warp_to_sidecar(warp), CORRECTED);
+	            queueFile(queue, outbox, "temp" + std::to_string(i) + ".jpeg", imgPath("temp", i, ".jpeg"),
+	                      JPEG_to_progressive(imgPath("temp", i, ".jpeg")), CORRECTED);
+	        }
+	        stageDone("progressive jpeg", start);
+	    } else if (!assisted) {
+	        //transforms gussets
+	        Warp warp = transformGusset(imgPath("temp_in", i, ".bmp").c_str(), imgPath("temp_out", i, ".bmp").c_str());
+	        stageDone("transform", start);
 
-	        //transmits all images to base station
-	        transmitImageToBase(imgPath("temp_out", i, ".jpeg").c_str());
+	        //function to convert .bmp to .jpeg, kept in memory for the radio
+	        if (frames)
+	            queueFile(queue, outbox, "temp_out" + std::to_string(i) + ".frame", "",
+	                      makeFrame(i, positions, positionCount, &warp, true,
+	                                BMP_to_JPEG(imgPath("temp_out", i, ".bmp")), imgPath("temp", i, ".jpeg")), CORRECTED);
+	        else
+	            queueFile(queue, outbox, "temp_out" + std::to_string(i) + ".jpeg", imgPath("temp_out", i, ".jpeg"),
+	                      BMP_to_JPEG(imgPath("temp_out", i, ".bmp")), CORRECTED);
+	        queueFile(queue, outbox, "temp" + std::to_string(i) + ".jpeg", imgPath("temp", i, ".jpeg"),
+	                  std::vector<unsigned char>(), RAW);
+	        stageDone("bmp to jpeg", start);
+	    } else if (frames) {
+	        //the camera's JPEG in a frame without a warp
+	        queueFile(queue, outbox, "temp" + std::to_string(i) + ".frame", "",
+	                  makeFrame(i, positions, positionCount, NULL, false,
+	                            JPEG_to_progressive(imgPath("temp", i, ".jpeg")), imgPath("temp", i, ".jpeg")), CORRECTED);
+	        stageDone("progressive jpeg", start);
 	    } else {
-	        //transmits all images to base station
-	        transmitImageToBase(imgPath("temp", i, ".jpeg").c_str());
+	        //the camera's JPEG made progressive, or sent as it is
+	        queueFile(queue, outbox, "temp" + std::to_string(i) + ".jpeg", imgPath("temp", i, ".jpeg"),
+	                  JPEG_to_progressive(imgPath("temp", i, ".jpeg")), CORRECTED);
+	        stageDone("progressive jpeg", start);
             }
-
 	}
 
+	//waits for the images still on their way, the time the radio needed
+	//beyond the processing
+	finishTransmission(queue, outbox);
+	stageDone("transmit", start);
+	free(positions);
+
+	printStageTimes();
+
         //send PIC micro command to cut power after R Pi shutdown
 	SPI_shutdown();
 
@@ -78,29 +214,197 @@ int main(int argc, char* argv[])
 }
 
 
-void transmitImageToBase(const char* file_path)
+// appends what the last batch cost to the link log
+static void logBatch(int result)
+{
+	XMODEM_STATS stats;
+
+	XGetStats(&stats);
+	XLogStats(LINK_LOG, "batch", result, &stats);
+	std::cout << stats.lBytes << " bytes in " << stats.lMillis << " ms, " << stats.lRate << " bytes/s, "
+	          << stats.lResent << " blocks sent again\n";
+}
+
+// before each batch: the images go at the fastest serial rate the base
+// station also takes, which it forgets once the link has been quiet for
+// XBAUD_SILENCE ms
+static void beginBatch(void* ctx, int fd)
+{
+	Radio* radio = (Radio*)ctx;
+
+	if (radio->xbee.GetBaud() != XBAUD_DEFAULT &&
+	    Clock::now() - radio->lastBatch > std::chrono::milliseconds(XBAUD_SILENCE))
+		radio->xbee.SetBaud(XBAUD_DEFAULT);
+
+	if (radio->xbee.GetBaud() == XBAUD_DEFAULT)
+		std::cout << "Serial rate " << radio->msg.negotiateBaud(XBAUD_MAX) << "\n";
+
+	std::cout << "Send Batch signal\n";
+	radio->msg.sendingBatch();
+}
+
+// after each batch: a base station that wants the link log asks right
+// after one that went through
+static void endBatch(void* ctx, int fd, int result)
+{
+	Radio* radio = (Radio*)ctx;
+
+	logBatch(result);
+	if (result == 0 && radio->msg.answerLogRequest(LINK_LOG, XLOG_WAIT))
+		std::cout << "Link log sent\n";
+
+	radio->lastBatch = Clock::now();
+}
+
+// starts the transfer thread, the serial port is its own until
+// finishTransmission.  the thread sends a failed batch again, resuming the
+// image it broke off in, and starts no file that would not be across by
+// the deadline (see xasync.h)
+XASYNC* startTransmission(Radio& radio, Clock::time_point deadline)
+{
+	static const XASYNC_CALLS calls = { beginBatch, endBatch, NULL };
+	XASYNC* queue = XAsyncOpen(radio.xbee.Fd(), &calls, &radio);
+	long left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+
+	if (queue)
+		XAsyncDeadline(queue, left > 0 ? left : 0);
+	else
+		std::cout << "Unable to start the transfer thread\n";
+
+	return queue;
+}
+
+// hands a file to the transfer thread, which has it until
+// finishTransmission returns.  data is sent if there is any, else the file
+// at path
+void queueFile(XASYNC* queue, Outbox& outbox, const std::string& name, const std::string& path,
+               std::vector<unsigned char> data, int priority, bool carried)
+{
+	if (data.empty() && path.empty()) // a thumbnail that could not be made
+		return;
+
+	outbox.push_back(Outgoing());
+	Outgoing& file = outbox.back();
+
+	file.name = name;
+	file.path = path;
+	file.data.swap(data);
+	file.priority = priority;
+	file.carried = carried;
+
+	memset(&file.item, 0, sizeof(file.item));
+	file.item.iResult = -10; // not sent
+	file.item.szName = file.name.c_str();
+	if (file.data.empty()) {
+		file.item.szPath = file.path.c_str();
+	} else {
+		XBufferStream(&file.stream, &file.data[0], file.data.size());
+		file.item.pStream = &file.stream;
+	}
+
+	if (queue && XAsyncSend(queue, &file.item, priority) == 0)
+		std::cout << name << " queued for transmission\n";
+}
+
+// queues what earlier cycles left in the outbox, it stays there until it
+// is across
+void queueCarried(XASYNC* queue, Outbox& outbox)
+{
+	XOUTBOX_ENTRY entries[XOUTBOX_MAX];
+	int count = XOutboxList(OUTBOX, entries, XOUTBOX_MAX);
+
+	for (int i=0; i < count; i++)
+		queueFile(queue, outbox, entries[i].szName, std::string(OUTBOX) + "/" + entries[i].szName,
+		          std::vector<unsigned char>(), entries[i].iPriority, true);
+}
+
+// a location's image in a gusset frame (see xframe.h) with where the
+// servos were sent for it, when it was captured and the warp if there is
+// one.  image is the payload, or if it is empty the capture as it is.
+// there is no battery reading on this side of the power system, so the
+// voltage is left unknown
+std::vector<unsigned char> makeFrame(int location, const int* positions, int positionCount, const Warp* warp,
+                                     bool corrected, std::vector<unsigned char> image, const std::string& capture)
+{
+	XFRAME_HEADER head;
+	struct stat st;
+
+	if (image.empty()) {
+		std::ifstream in(capture.c_str(), std::ios::binary);
+		image.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+		corrected = false;
+	}
+	if (image.empty())
+		return image;
+
+	memset(&head, 0, sizeof(head));
+	head.iLocation = location;
+	if (positions && 2*location + 1 < positionCount) {
+		head.iPan = positions[2*location];
+		head.iTilt = positions[2*location + 1];
+	}
+	head.ulCaptured = stat(capture.c_str(), &st) == 0 ? st.st_mtime : time(NULL);
+
+	if (warp) {
+		const Corners& o = warp->original;
+		const Corners& d = warp->destination;
+		int corners[8] = { o._sw._x, o._sw._y, o._nw._x, o._nw._y, o._ne._x, o._ne._y, o._se._x, o._se._y };
+
+		head.iFlags = XFRAME_WARP | (corrected ? XFRAME_CORRECTED : 0);
+		memcpy(head.aiCorners, corners, sizeof(corners));
+		head.iWidth = 1 + d._ne._x - d._nw._x;
+		head.iHeight = 1 + d._nw._y - d._sw._y;
+		memcpy(head.afH, warp->H, sizeof(head.afH));
+	}
+
+	std::vector<unsigned char> frame(XFrameBuild(NULL, &head, NULL, 0, &image[0], image.size()));
+	XFrameBuild(&frame[0], &head, NULL, 0, &image[0], image.size());
+	return frame;
+}
+
+// keeps a file that did not go across for the next cycle, under a name
+// with the time of this one so it does not meet that cycle's own
+static bool carryOver(const Outgoing& file)
+{
+	static std::string stamp;
+	std::vector<unsigned char> data = file.data;
+
+	if (stamp.empty()) {
+		char text[32];
+		time_t now = time(NULL);
+		strftime(text, sizeof(text), "%Y%m%d-%H%M%S-", localtime(&now));
+		stamp = text;
+	}
+
+	if (data.empty()) {
+		std::ifstream in(file.path.c_str(), std::ios::binary);
+		data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+
+	return !data.empty() &&
+	       XOutboxPut(OUTBOX, (stamp + file.name).c_str(), file.priority, &data[0], data.size()) == 0;
+}
+
+// waits until every file is across, given up on or left for lack of time,
+// and keeps what did not go in the outbox
+void finishTransmission(XASYNC* queue, Outbox& outbox)
 {
-        char *device = (char *)"/dev/ttyUSB0";
-	int result;
-        Serial xbee(device, 57600);
-        Message msg(device);
-
-        int fd = xbee.Open();
-//TRANSMIT IMAGE 1
-        std::cout << "Send Image signal\n";
-        msg.sendingImage();
-
-        std::cout << "Attempting to Transmit Image\n";
-        result = XSend(fd, file_path);
-
-        if(result == 0){
-                std::cout << "Image transmitted successfully\n";
-        }
-        else{
-                std::cout << "Error during image transmission\nError code: " << result << "\n";
-        }
-
-        xbee.Close();
+	if (queue)
+		XAsyncClose(queue);
+
+	for (int i=0; i < outbox.size(); i++) {
+		const Outgoing& file = outbox[i];
+
+		if (file.item.iResult == 0) {
+			std::cout << file.name << " transmitted successfully\n";
+			if (file.carried)
+				XOutboxRemove(OUTBOX, file.name.c_str());
+		} else {
+			std::cout << "Error during " << file.name << " transmission\nError code: " << file.item.iResult << "\n";
+			if (!file.carried && carryOver(file))
+				std::cout << file.name << " kept for the next cycle\n";
+		}
+	}
 }
 
 void calibrationNeeded()
@@ -120,3 +424,30 @@ std::string imgPath(std::string name, int index, std::string extension) {
 
 	return path + name + std::to_string(index) + extension;
 }
+
+// adds the time since start to a stage and restarts the clock
+void stageDone(const std::string& stage, Clock::time_point& start) {
+	Clock::time_point now = Clock::now();
+	double seconds = std::chrono::duration<double>(now - start).count();
+	int i = 0;
+
+	while (i < stage_times.size() && stage_times[i].first != stage)
+		i++;
+
+	if (i == stage_times.size())
+		stage_times.push_back(std::make_pair(stage, 0.0));
+
+	stage_times[i].second += seconds;
+	start = now;
+}
+
+void printStageTimes() {
+	double total = 0;
+
+	std::cout << "--- STAGE TIMES ---" << std::endl;
+	for (int i=0; i < stage_times.size(); i++) {
+		std::cout << std::left << std::setw(20) << stage_times[i].first << std::right << std::fixed << std::setprecision(3) << std::setw(10) << stage_times[i].second << " s" << std::endl;
+		total += stage_times[i].second;
+	}
+	std::cout << std::left << std::setw(20) << "total" << std::right << std::setw(10) << total << " s" << std::endl;
+}
@@ -19,7 +19,7 @@ void calibrateLocations(const char* location_file_path) {
 }
 
 void printMenu() {
-    printf("--- MENU ---\n'c' capture current position\n'p' print locations\n's' save locations\n'r' remove a location\n'q' quit the program\n\n");
+    printf("--- MENU ---\n'c' capture current position\n'p' print locations\n's' save locations\n'r' remove a location\n'f' fit feedback to pulse width\n'q' quit the program\n\n");
 }
 
 short processInput(char i, const char* location_file_path) {
@@ -41,6 +41,9 @@ short processInput(char i, const char* location_file_path) {
         case 'r':
             removeLocation();
             break;
+        case 'f':
+            fitFeedback(FIT_FILE);
+            break;
         default:
             printf("That is not a know command, enter 'M' for menu.\n\n");
     }
@@ -119,12 +122,139 @@ void printLocations() {
 }
 
 void captureLocation() {
-    if (locations.size() > 4) {
-        printf("You can only save up to 4 locations.\n\n");
-        return;
-    }
-
     locations.push_back(std::vector<int>());
     locations[locations.size()-1].push_back(ADC_Rd(0x83C5));
     locations[locations.size()-1].push_back(ADC_Rd(0x83D5));
 }
+
+// sweeps both servos, fits the feedback to pulse width polynomial
+// by least squares and saves it for FB_to_PW to use
+void fitFeedback(const char* fit_file_path) {
+    double coeffs[2][4];
+    std::vector<std::vector<int> > samples[2];
+
+    for (int m = 0; m < 2; m++) {
+        printf("Sweeping %s servo...\n", (m == 0 ? "pan" : "tilt"));
+        samples[m] = sweepServo(m, sweep_min[m], sweep_max[m], sweep_step);
+
+        if (!fitPolynomial(samples[m], coeffs[m])) {
+            printf("Not enough samples to fit the %s servo.\n\n", (m == 0 ? "pan" : "tilt"));
+            return;
+        }
+    }
+
+    // report against the old fit before switching over
+    for (int m = 0; m < 2; m++) {
+        printf("%s servo before:\n", (m == 0 ? "Pan" : "Tilt"));
+        reportFit(m, samples[m]);
+        setFeedbackFit(m, coeffs[m]);
+        printf("%s servo after:\n", (m == 0 ? "Pan" : "Tilt"));
+        reportFit(m, samples[m]);
+    }
+
+    // moving to a few of the sampled positions shows how
+    // many correction rounds the new fit needs
+    for (int m = 0; m < 2; m++) {
+        int rounds = 0, moves = 0;
+        int n = samples[m].size();
+
+        for (int i = n/8; i < n; i += n/4 + 1) {
+            rounds += move_and_check_Position(samples[m][i][0], m);
+            moves++;
+        }
+
+        printf("%s servo: %.2f correction rounds per move\n", (m == 0 ? "Pan" : "Tilt"), (float)rounds/moves);
+    }
+
+    saveFit(fit_file_path, coeffs);
+}
+
+// steps a servo through its range and records (feedback, echo) pairs
+std::vector<std::vector<int> > sweepServo(int motor, int echo_min, int echo_max, int step) {
+    std::vector<std::vector<int> > samples;
+    unsigned short address = (motor == 0 ? 0x83C5 : 0x83D5);
+
+    Set_Servo(motor, echo_min);
+    sleep(2); // the first move can be a long one
+
+    for (int echo = echo_min; echo <= echo_max; echo += step) {
+        int feedback = 0;
+
+        Set_Servo(motor, echo);
+        delayMicroseconds(300000); // let the servo settle
+
+        // average a few reads to keep ADC noise out of the fit
+        for (int i = 0; i < 4; i++)
+            feedback += ADC_Rd(address);
+
+        samples.push_back(std::vector<int>());
+        samples.back().push_back(feedback/4);
+        samples.back().push_back(echo);
+    }
+
+    return samples;
+}
+
+// least squares fit of echo = c0 + c1*fb + c2*fb^2 + c3*fb^3 using the
+// normal equations, feedback is scaled to 0-1 to keep them well conditioned
+bool fitPolynomial(const std::vector<std::vector<int> >& samples, double coeffs[4]) {
+    const double scale = 4096.0; // 12 bit ADC
+    int n = samples.size();
+
+    if (n < 4)
+        return false;
+
+    Matrix<double> A(n, 4);
+    Matrix<double> y(n, 1);
+
+    for (int i = 0; i < n; i++) {
+        double x = samples[i][0]/scale;
+        A(i, 0) = 1;
+        A(i, 1) = x;
+        A(i, 2) = x*x;
+        A(i, 3) = x*x*x;
+        y(i, 0) = samples[i][1];
+    }
+
+    Matrix<double> At = A.transpose();
+    Matrix<double> c = (At*A).solve(At*y);
+
+    // undo the scaling so FB_to_PW can use raw feedback values
+    double s = 1;
+    for (int k = 0; k < 4; k++) {
+        coeffs[k] = c(k, 0)/s;
+        s *= scale;
+    }
+
+    return true;
+}
+
+// prints predicted against actual echo values for the current fit
+void reportFit(int motor, const std::vector<std::vector<int> >& samples) {
+    double sum_sq = 0;
+    int max_err = 0;
+
+    for (int i = 0; i < samples.size(); i++) {
+        int err = FB_to_PW(samples[i][0], motor) - samples[i][1];
+        sum_sq += err*err;
+        if (abs(err) > max_err)
+            max_err = abs(err);
+    }
+
+    printf("  %d samples, rms error %.2f echo, max error %d echo\n", (int)samples.size(), sqrt(sum_sq/samples.size()), max_err);
+}
+
+void saveFit(const char* fit_file_path, const double coeffs[2][4]) {
+    FILE* f = fopen(fit_file_path, "w");
+
+    if (!f) {
+        printf("Unable to save the fit to %s\n\n", fit_file_path);
+        return;
+    }
+
+    for (int m = 0; m < 2; m++)
+        fprintf(f, "%d %.10e %.10e %.10e %.10e\n", m, coeffs[m][0], coeffs[m][1], coeffs[m][2], coeffs[m][3]);
+
+    fclose(f);
+    printf("fit saved!\n\n");
+}
@@ -5,6 +5,8 @@ extern "C" {
 #include "servo.h"
 }
 
+#include "matrix.hpp"
+
 #include <stdio.h>
 #include <ctype.h>
 #include <vector>
@@ -22,6 +24,17 @@ void saveLocations(const char*);
 void removeLocation();
 void printLocations();
 void captureLocation();
+void fitFeedback(const char*);
+std::vector<std::vector<int> > sweepServo(int, int, int, int);
+bool fitPolynomial(const std::vector<std::vector<int> >&, double[4]);
+void reportFit(int, const std::vector<std::vector<int> >&);
+void saveFit(const char*, const double[2][4]);
+
+// echo ranges swept by the calibration, kept inside the
+// travel of each servo (1 echo is a 10 microsecond pulse width)
+const int sweep_min[2] = {60, 60};
+const int sweep_max[2] = {240, 200};
+const int sweep_step = 4;
 
 static std::vector<std::vector<int> > locations;
 
@@ -0,0 +1,341 @@
+#define _GNU_SOURCE
+#include "camera.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+/* The camera is opened once for the whole tour and keeps streaming
+into mmap'd buffers while the servos move. A grab throws away the
+frames that were exposed before it was asked for, so the image is
+always from the current location without warming the camera up again.
+*/
+
+static int xioctl(int fd, unsigned long request, void* arg)
+{
+    int r;
+
+    do {
+        r = ioctl(fd, request, arg);
+    } while (r == -1 && errno == EINTR);
+
+    return r;
+}
+
+static double monotonicSeconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// turns a recorded 24 bit BMP into the raw YUYV or NV12 frame a camera
+// would deliver, using the same full range luminance as Pixel::luminance.
+// BMP::read keeps the file's first byte of a pixel, blue, in _red, so the
+// weights go on the bytes in the order Pixel::luminance sees them
+static void mockConvert(CAMERA* cam)
+{
+    const unsigned char* bmp = cam->mockData;
+    const unsigned char* src;
+    unsigned char* raw;
+    unsigned char* y;
+    int offset, width, height, padded, row, col;
+    size_t size;
+
+    if (cam->mockSize < 54 || bmp[0] != 'B' || bmp[1] != 'M' || bmp[28] != 24)
+        return;
+
+    offset = bmp[10] | bmp[11] << 8 | bmp[12] << 16 | bmp[13] << 24;
+    width = bmp[18] | bmp[19] << 8 | bmp[20] << 16 | bmp[21] << 24;
+    height = bmp[22] | bmp[23] << 8 | bmp[24] << 16 | bmp[25] << 24;
+    padded = (width*3 + 3) & ~3;
+    width &= ~1; // both formats share chroma between pixel pairs
+    height &= ~1;
+
+    size = (cam->format == V4L2_PIX_FMT_YUYV ? (size_t)width*height*2 : (size_t)width*height*3/2);
+    raw = (unsigned char*)malloc(size);
+    memset(raw, 128, size); // neutral chroma
+
+    for (row = 0; row < height; row++) {
+        // BMP rows are stored bottom up
+        src = bmp + offset + (size_t)(height - 1 - row)*padded;
+        for (col = 0; col < width; col++) {
+            if (cam->format == V4L2_PIX_FMT_YUYV)
+                y = raw + (size_t)row*width*2 + col*2;
+            else
+                y = raw + (size_t)row*width + col;
+            *y = (unsigned char)(0.299f*src[3*col] + 0.587f*src[3*col+1] + 0.114f*src[3*col+2] + 0.5f);
+        }
+    }
+
+    free(cam->mockData);
+    cam->mockData = raw;
+    cam->mockSize = size;
+    cam->width = width;
+    cam->height = height;
+}
+
+// loads the recording the next grab serves, wrapping around the files
+static int mockLoad(CAMERA* cam)
+{
+    char path[300];
+    FILE* f;
+    long size;
+
+    snprintf(path, sizeof(path), cam->pattern, cam->grabs % cam->recordings);
+    f = fopen(path, "rb");
+    if (!f)
+        return -1;
+
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    free(cam->mockData);
+    cam->mockData = (unsigned char*)malloc(size);
+    cam->mockSize = fread(cam->mockData, 1, size, f);
+    fclose(f);
+
+    if (cam->format == V4L2_PIX_FMT_YUYV || cam->format == V4L2_PIX_FMT_NV12)
+        mockConvert(cam);
+
+    return 0;
+}
+
+static CAMERA* mockOpen(const char* pattern, int width, int height, unsigned int format)
+{
+    CAMERA* cam = (CAMERA*)calloc(1, sizeof(CAMERA));
+
+    cam->fd = -1;
+    cam->width = width;
+    cam->height = height;
+    cam->format = format;
+    strncpy(cam->pattern, pattern, sizeof(cam->pattern) - 1);
+
+    // the recordings are numbered from 0 without gaps, a pattern without
+    // a number is a single recording
+    for (;;) {
+        char path[300], first[300];
+
+        snprintf(path, sizeof(path), cam->pattern, cam->recordings);
+        snprintf(first, sizeof(first), cam->pattern, 0);
+        if (access(path, R_OK) || (cam->recordings && !strcmp(path, first)))
+            break;
+        cam->recordings++;
+    }
+
+    if (!cam->recordings || mockLoad(cam)) {
+        fprintf(stderr, "Mock camera has no frames at \"%s\"\n", pattern);
+        Cam_Close(cam);
+        return NULL;
+    }
+
+    return cam;
+}
+
+CAMERA* Cam_Open(const char* device, int width, int height, unsigned int format)
+{
+    struct v4l2_format fmt;
+    struct v4l2_requestbuffers req;
+    struct v4l2_buffer buf;
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    CAMERA* cam;
+    int i;
+
+    if (strncmp(device, "mock:", 5) == 0)
+        return mockOpen(device + 5, width, height, format);
+
+    cam = (CAMERA*)calloc(1, sizeof(CAMERA));
+    cam->fd = open(device, O_RDWR | O_NONBLOCK);
+    if (cam->fd < 0) {
+        fprintf(stderr, "Unable to open camera %s, errno=%d\n", device, errno);
+        free(cam);
+        return NULL;
+    }
+
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width = width;
+    fmt.fmt.pix.height = height;
+    fmt.fmt.pix.pixelformat = format;
+    fmt.fmt.pix.field = V4L2_FIELD_ANY;
+    if (xioctl(cam->fd, VIDIOC_S_FMT, &fmt) == -1 || fmt.fmt.pix.pixelformat != format) {
+        fprintf(stderr, "Camera %s does not support the requested format\n", device);
+        Cam_Close(cam);
+        return NULL;
+    }
+
+    // the driver may pick the closest size it has
+    cam->width = fmt.fmt.pix.width;
+    cam->height = fmt.fmt.pix.height;
+    cam->format = format;
+
+    memset(&req, 0, sizeof(req));
+    req.count = camBuffers;
+    req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(cam->fd, VIDIOC_REQBUFS, &req) == -1 || req.count < 2) {
+        fprintf(stderr, "Camera %s can not mmap buffers\n", device);
+        Cam_Close(cam);
+        return NULL;
+    }
+
+    if (req.count > camBuffers)
+        req.count = camBuffers;
+
+    for (i = 0; i < (int)req.count; i++) {
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index = i;
+        if (xioctl(cam->fd, VIDIOC_QUERYBUF, &buf) == -1)
+            break;
+
+        cam->length[i] = buf.length;
+        cam->start[i] = mmap(NULL, buf.length, PROT_READ | PROT_WRITE, MAP_SHARED, cam->fd, buf.m.offset);
+        if (cam->start[i] == MAP_FAILED)
+            break;
+
+        cam->nbuffers++;
+        xioctl(cam->fd, VIDIOC_QBUF, &buf);
+    }
+
+    if (cam->nbuffers != (int)req.count || xioctl(cam->fd, VIDIOC_STREAMON, &type) == -1) {
+        fprintf(stderr, "Camera %s failed to start streaming\n", device);
+        Cam_Close(cam);
+        return NULL;
+    }
+
+    // let the exposure settle once for the whole tour
+    for (i = 0; i < camWarmupFrames; i++) {
+        CAMFRAME frame;
+        if (Cam_Grab(cam, &frame))
+            break;
+        Cam_Release(cam, &frame);
+    }
+
+    return cam;
+}
+
+int Cam_Grab(CAMERA* cam, CAMFRAME* frame)
+{
+    struct v4l2_buffer buf;
+    struct pollfd pfd;
+    double requested = monotonicSeconds();
+    double stamp;
+
+    if (cam->fd < 0) {
+        // the mock hands out the next recording at the frame rate
+        usleep(1000000 / 15);
+        if (mockLoad(cam))
+            return -1;
+        cam->grabs++;
+
+        frame->data = cam->mockData;
+        frame->size = cam->mockSize;
+        frame->width = cam->width;
+        frame->height = cam->height;
+        frame->format = cam->format;
+        frame->index = -1;
+        return 0;
+    }
+
+    pfd.fd = cam->fd;
+    pfd.events = POLLIN;
+
+    for (;;) {
+        if (poll(&pfd, 1, 2000) <= 0) {
+            fprintf(stderr, "Camera timed out waiting for a frame\n");
+            return -1;
+        }
+
+        memset(&buf, 0, sizeof(buf));
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (xioctl(cam->fd, VIDIOC_DQBUF, &buf) == -1) {
+            if (errno == EAGAIN)
+                continue;
+            return -1;
+        }
+
+        // frames that were already in the queue were exposed while
+        // the servos were still moving, give them back to the driver
+        stamp = buf.timestamp.tv_sec + buf.timestamp.tv_usec / 1e6;
+        if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC && stamp < requested) {
+            xioctl(cam->fd, VIDIOC_QBUF, &buf);
+            continue;
+        }
+
+        break;
+    }
+
+    frame->data = (const unsigned char*)cam->start[buf.index];
+    frame->size = buf.bytesused;
+    frame->width = cam->width;
+    frame->height = cam->height;
+    frame->format = cam->format;
+    frame->index = buf.index;
+    return 0;
+}
+
+void Cam_MockFrame(CAMERA* cam, int index)
+{
+    if (cam->fd < 0 && index >= 0)
+        cam->grabs = index;
+}
+
+void Cam_Release(CAMERA* cam, CAMFRAME* frame)
+{
+    struct v4l2_buffer buf;
+
+    if (cam->fd < 0 || frame->index < 0)
+        return;
+
+    memset(&buf, 0, sizeof(buf));
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index = frame->index;
+    xioctl(cam->fd, VIDIOC_QBUF, &buf);
+    frame->index = -1;
+}
+
+int Cam_Save(const CAMFRAME* frame, const char* path)
+{
+    FILE* f = fopen(path, "wb");
+    size_t written;
+
+    if (!f)
+        return -1;
+
+    written = fwrite(frame->data, 1, frame->size, f);
+    fclose(f);
+
+    return (written == frame->size ? 0 : -1);
+}
+
+void Cam_Close(CAMERA* cam)
+{
+    enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    int i;
+
+    if (!cam)
+        return;
+
+    if (cam->fd >= 0) {
+        xioctl(cam->fd, VIDIOC_STREAMOFF, &type);
+        for (i = 0; i < cam->nbuffers; i++)
+            munmap(cam->start[i], cam->length[i]);
+        close(cam->fd);
+    }
+
+    free(cam->mockData);
+    free(cam);
+}
@@ -0,0 +1,54 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <stddef.h>
+#include <sys/time.h>
+#include <linux/videodev2.h>
+
+// fswebcam used to skip this many frames on every capture,
+// now it is only done once when the camera is opened
+static const int camWarmupFrames = 13;
+static const int camBuffers = 4;
+
+// frame handed out by Cam_Grab, valid until Cam_Release
+typedef struct _CAMFRAME_
+{
+  const unsigned char* data; ///< points into the mmap'd buffer
+  size_t size;               ///< bytes used in the buffer
+  int width, height;
+  unsigned int format;       ///< V4L2 fourcc, e.g. V4L2_PIX_FMT_MJPEG
+  int index;                 ///< buffer to queue again
+} CAMFRAME;
+
+typedef struct _CAMERA_
+{
+  int fd;                    ///< V4L2 device, -1 for the mock
+  int width, height;
+  unsigned int format;
+  int nbuffers;
+  void* start[4];            ///< mmap'd buffers
+  size_t length[4];
+
+  // mock device, serves files matching a printf pattern
+  char pattern[256];
+  int grabs;                 ///< recording the next grab serves
+  int recordings;            ///< files 0 to recordings-1 exist
+  unsigned char* mockData;
+  size_t mockSize;
+} CAMERA;
+
+// opens and starts streaming, a device of "mock:<pattern>" serves
+// recorded frames from files instead, e.g. "mock:../images/testing%d.jpeg",
+// for YUYV and NV12 the recordings are 24 bit BMPs converted on load
+CAMERA* Cam_Open(const char* device, int width, int height, unsigned int format);
+// waits for the first frame exposed after this call
+int Cam_Grab(CAMERA* cam, CAMFRAME* frame);
+void Cam_Release(CAMERA* cam, CAMFRAME* frame);
+// the mock serves recording index, modulo how many there are, on the
+// next grab and counts on from there, a real camera ignores it
+void Cam_MockFrame(CAMERA* cam, int index);
+// writes a frame as is, an MJPEG frame is already a JPEG file
+int Cam_Save(const CAMFRAME* frame, const char* path);
+void Cam_Close(CAMERA* cam);
+
+#endif
@@ -36,8 +36,8 @@ int CaptureSavedLocations(const char* location_file_path) {
 
     system("echo ./servod --p1pins=7, 11, 0, 0, 0, 0, 0, 0");
     system("echo ./servod --step-size=1us");
-    system("sudo echo 0=150 > /dev/servoblaster");
-    system("sudo echo 1=135 > /dev/servoblaster");
+    Servo_Write("0=150");
+    Servo_Write("1=135");
     wiringPiSetupGpio();
     pinMode(butPin, INPUT);
     pullUpDnControl(butPin, PUD_DOWN);
@@ -48,23 +48,35 @@ int CaptureSavedLocations(const char* location_file_path) {
         //if (digitalRead(butPin)==1)
         {
             int i = 0;
+            int travel;
             int* positions;
+            int* order;
             positions = getPositions(&length, location_file_path);
 
            if (positions == NULL)
 	   {
 		printf("Null locations returning");
-                return;
+                return 0;
 	   }
-           while (i < length) {
-                move_and_check_Position(positions[i], 0); //Pan Motor
-                i++;
-                move_and_check_Position(positions[i], 1); //Tilt Motor
+
+           // visit the locations in the order with the least servo travel
+           order = (int*)malloc((length/2) * sizeof(int));
+           travel = planTour(positions, length/2, ADC_Rd(0x83C5), ADC_Rd(0x83D5), order);
+           printf("Tour of %d locations, %d steps of travel\n", length/2, travel);
+
+           while (i < length/2) {
+                int loc = order[i];
+                move_and_check_Position(positions[2*loc], 0); //Pan Motor
+                move_and_check_Position(positions[2*loc+1], 1); //Tilt Motor
+				move_and_check_Position(positions[2*loc], 0);//Double check Pan Motor
+				move_and_check_Position(positions[2*loc+1], 1);//Double check Tilt Motor
+                Cap_Image(loc); // images keep the location number, not the tour position
                 i++;
-				move_and_check_Position(positions[i-2], 0);//Double check Pan Motor
-				move_and_check_Position(positions[i-1], 1);//Double check Tilt Motor
-                Cap_Image();
             }
+
+            Cap_Close();
+            free(order);
+            free(positions);
             break;
         }
     }
@@ -95,9 +107,58 @@ int FB_to_PW_Conv(int Servo, int feedback_target)
     }
 }
 
+// coefficients from the calibration sweep, lowest order first
+static double fitCoeffs[2][4];
+static int fitLoaded[2] = {0, 0};
+static int fitChecked = 0;
+
+// loads fitted polynomials for both motors, one line per
+// motor as "motor c0 c1 c2 c3"; returns the number loaded
+int loadFeedbackFit(const char* fit_file_path)
+{
+    FILE* f;
+    int motor, loaded = 0;
+    double c[4];
+
+    fitChecked = 1;
+
+    f = fopen(fit_file_path, "r");
+    if (!f)
+        return 0;
+
+    while (fscanf(f, "%d %lf %lf %lf %lf", &motor, &c[0], &c[1], &c[2], &c[3]) == 5) {
+        if (motor == 0 || motor == 1) {
+            setFeedbackFit(motor, c);
+            loaded++;
+        }
+    }
+
+    fclose(f);
+    return loaded;
+}
+
+void setFeedbackFit(int motor, const double coeffs[4])
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        fitCoeffs[motor][i] = coeffs[i];
+    fitLoaded[motor] = 1;
+    fitChecked = 1;
+}
+
 int FB_to_PW(int feedback, int motor){
 	float fb= (float)feedback;
 	float new_echo;
+
+	if (!fitChecked)
+		loadFeedbackFit(FIT_FILE);
+
+	if ((motor==0 || motor==1) && fitLoaded[motor]){
+		//Fitted polynomial from the calibration sweep
+		double x = feedback;
+		return (int)lround(fitCoeffs[motor][0] + x*(fitCoeffs[motor][1] + x*(fitCoeffs[motor][2] + x*fitCoeffs[motor][3])));
+	}
 	if (motor==0){
 		//Second order Algorithm For Tilt Motor Pulse Width Value
 		new_echo=-0.000000006994*fb*fb*fb+0.000041253*fb*fb+0.019523*fb+34.879; 
@@ -110,6 +171,28 @@ int FB_to_PW(int feedback, int motor){
 	return roundf(new_echo); //Returns the current Pulse Width Value Equivalent
 }
 
+// moves a servo straight to an absolute echo value
+void Set_Servo(int motor, int echo)
+{
+    char command[16];
+
+    snprintf(command, sizeof(command), "%d=%d", motor, echo);
+    Servo_Write(command);
+}
+
+// sends a command such as "0=+1" to servoblaster
+void Servo_Write(const char* servo_command)
+{
+#ifdef SIMULATION
+    simServoblaster(servo_command);
+#else
+    char command[64];
+
+    snprintf(command, sizeof(command), "sudo echo %s > /dev/servoblaster", servo_command);
+    system(command);
+#endif
+}
+
 void Pan_Gusset(int feedbackTarget)
 {
     printf("Pan Gusset....\n");
@@ -127,7 +210,7 @@ void Pan_Gusset(int feedbackTarget)
 	for (i=0; i<change_in_echo; i++)
             {
 			//Move the Servo a 10 microsecond PW
-            system("sudo echo 0=-1 > /dev/servoblaster"); 
+            Servo_Write("0=-1");
 	    delayMicroseconds(30000);
             }
         }
@@ -137,11 +220,11 @@ void Pan_Gusset(int feedbackTarget)
 	for (i=0; i<change_in_echo; i++)
             {
 			//Move the Servo a 10 microsecond PW
-            system("sudo echo 0=+1 > /dev/servoblaster");
+            Servo_Write("0=+1");
 	    delayMicroseconds(30000);
             }
         }
-    sleep(3);
+    delay(3000);
 }
 
 void Tilt_Gusset(int feedbackTarget)
@@ -158,7 +241,7 @@ void Tilt_Gusset(int feedbackTarget)
 	for (i=0; i < change_in_echo; i++)
             {
 			//Move the Servo a 10 microsecond PW
-            system("sudo echo 1=-1 > /dev/servoblaster");
+            Servo_Write("1=-1");
             delayMicroseconds(30000);
             }
         }
@@ -168,15 +251,17 @@ void Tilt_Gusset(int feedbackTarget)
 	for (i=0; i < change_in_echo; i++)
             {
 			//Move the Servo a 10 microsecond PW
-            system("sudo echo 1=+1 > /dev/servoblaster");
+            Servo_Write("1=+1");
             delayMicroseconds(30000);
             }
         }
-        sleep(3);
+        delay(3000);
 }
 
-void move_and_check_Position(int feedbackTarget, int motor)
+// returns the number of correction rounds it took to reach the target
+int move_and_check_Position(int feedbackTarget, int motor)
 {
+    int rounds;
     int i=0;
     int Read=-1;
     if (motor==0)
@@ -193,6 +278,7 @@ void move_and_check_Position(int feedbackTarget, int motor)
             break;
             }
         }
+	rounds=i;
 	i=0;
     }
     else
@@ -209,28 +295,73 @@ void move_and_check_Position(int feedbackTarget, int motor)
             break;
             }
         }
+	rounds=i;
 	i=0;
     }
-	sleep(1);
+	delay(1000);
 	printf("Exiting move and pan/tilt\n");
+	return rounds;
+}
+
+// the camera stays open for the whole tour, see Cap_Close
+static CAMERA* camera = NULL;
+static int cameraFailed = 0;
+
+static const char* cameraDevice(void)
+{
+#ifdef SIMULATION
+    static char device[300];
+
+    snprintf(device, sizeof(device), "mock:%s", simEnvString("SIM_IMAGES", "../images/testing%d.jpeg"));
+    return device;
+#else
+    return "/dev/video0";
+#endif
 }
 
-void Cap_Image()
+void Cap_Image(int location)
 {
     int n=90;
     int cx=0;
-    int j=0;
-    static int i=0;
-    char command[n];
     char file_path[n];
+    CAMFRAME frame;
 
-    cx=snprintf(file_path, n, "../images/temp%d.jpeg", i);
+    cx=snprintf(file_path, n, "../images/temp%d.jpeg", location);
     if(cx>n) {
 	printf("Command Length for File Too Long");
 	return;
     }
-    while (!fopen(file_path, "r")) {
-        cx=snprintf(command, n, "fswebcam -r 2592x1944 --jpeg 100 -D 1 -S 13 --no-banner 1 ../images/temp%d.jpeg", i); //assigns the echo call as the command, with the limit of n characters
+    remove(file_path); // an old capture would stop the retries below
+
+    if (!camera && !cameraFailed) {
+        camera = Cam_Open(cameraDevice(), 2592, 1944, V4L2_PIX_FMT_MJPEG);
+        cameraFailed = !camera;
+    }
+
+    // in simulation each location has its own recording whatever the
+    // order of the tour
+    if (camera)
+        Cam_MockFrame(camera, location);
+
+    // MJPEG frames are written straight out as the JPEG capture
+    if (camera && Cam_Grab(camera, &frame) == 0) {
+        cx = Cam_Save(&frame, file_path);
+        Cam_Release(camera, &frame);
+        if (cx == 0)
+            return;
+    }
+
+#ifdef SIMULATION
+    // the mock stands in for the camera, there is no fswebcam to fall back to
+    printf("Mock camera failed to capture %s\n", file_path);
+#else
+    int j=0;
+    char command[n];
+    FILE* f;
+
+    // fall back to fswebcam if the camera can not be streamed
+    while (!(f = fopen(file_path, "r"))) {
+        cx=snprintf(command, n, "fswebcam -r 2592x1944 --jpeg 100 -D 1 -S 13 --no-banner 1 ../images/temp%d.jpeg", location); //assigns the echo call as the command, with the limit of n characters
         if(cx>n)
             printf("Command Length Too Long");
         else
@@ -240,69 +371,50 @@ void Cap_Image()
 	    break;
     }
 
-    i++;
+    if (f)
+        fclose(f);
+#endif
 }
 
-// gets the locations from the save file
+void Cap_Close()
+{
+    Cam_Close(camera);
+    camera = NULL;
+    cameraFailed = 0;
+}
+
+// gets the locations from the save file, the returned
+// array holds pan,tilt pairs and must be freed by the caller
 int* getPositions(int* length, const char* location_file_path) {
     FILE* f;
-    char buffer[1024];
+    int value;
+    int size = 16;
+    int* positions;
 
     f = fopen(location_file_path, "r");
 
     if (!f)
         return NULL;
 
-    if (fgets(buffer, sizeof(buffer), f) == NULL) {
-        printf("problem with reading the locations file.\n");
-        return NULL;
-    }
-
-    *length = numPositions(buffer);
+    positions = (int*)malloc(size * sizeof(int));
+    *length = 0;
 
-    // this is twice the size because it includes both servo positions
-    // this is hard coded into captureLocation() of calibration.cpp
-    static int positions[8];
-
-    for (int i=0; i < *length; i++) {
-        positions[i] = nextPosition(buffer);
-    }
-
-    return positions;
-}
-
-// determine number of positions
-int numPositions(char buffer[buffSize]) {
-    int i = 0, commas = 0;
-
-    while (buffer[i] != '\0') {
-        if (buffer[i] == ',')
-            commas++;
-
-        i++;
+    // values are separated by commas, any number of locations is allowed
+    while (fscanf(f, " %d ,", &value) == 1) {
+        if (*length == size) {
+            size *= 2;
+            positions = (int*)realloc(positions, size * sizeof(int));
+        }
+        positions[(*length)++] = value;
     }
 
-    return ++commas;
-}
+    fclose(f);
 
-// get next position number
-int nextPosition(char buffer[buffSize]) {
-    static int end = 0, begin = 0;
-    char tempBuff[10];
-
-    // make sure tempBuff has nothing in it
-    for (int i = 0; i < 10; i++)
-        tempBuff[i] = 0;
-
-    while (buffer[end] != '\0') {
-        if (buffer[end] == ',') {
-            begin = ++end;
-            break;
-        }
-
-        tempBuff[end-begin] = buffer[end];
-        end++;
+    if (*length == 0 || *length%2 != 0) {
+        printf("problem with reading the locations file.\n");
+        free(positions);
+        return NULL;
     }
 
-    return atoi(tempBuff);
+    return positions;
 }
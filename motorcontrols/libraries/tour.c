@@ -0,0 +1,175 @@
+#include "tour.h"
+#include "servo.h"
+
+/* The servos are moved one echo step (10 us) at a time with a fixed delay,
+pan first and then tilt, so the time to travel between two locations is
+proportional to the sum of the pulse width changes of both servos.
+*/
+
+static void exactTour(const int* dist, int count, int* order);
+static void heuristicTour(const int* dist, int count, int* order);
+
+int tourCost(int pan1, int tilt1, int pan2, int tilt2)
+{
+    return abs(FB_to_PW(pan1, 0) - FB_to_PW(pan2, 0)) + abs(FB_to_PW(tilt1, 1) - FB_to_PW(tilt2, 1));
+}
+
+int tourLength(const int* positions, const int* order, int count, int startPan, int startTilt)
+{
+    int i, total = 0;
+    int pan = startPan, tilt = startTilt;
+
+    for (i = 0; i < count; i++) {
+        total += tourCost(pan, tilt, positions[2*order[i]], positions[2*order[i]+1]);
+        pan = positions[2*order[i]];
+        tilt = positions[2*order[i]+1];
+    }
+
+    return total;
+}
+
+int planTour(const int* positions, int count, int startPan, int startTilt, int* order)
+{
+    int i, j, n = count + 1;
+    int* dist;
+
+    if (count <= 0)
+        return 0;
+
+    // distance matrix, the last row/column is the starting position
+    dist = (int*)malloc(n * n * sizeof(int));
+    if (!dist)
+        return -1;
+
+    for (i = 0; i < n; i++)
+        for (j = 0; j < n; j++) {
+            int pi = (i == count ? startPan : positions[2*i]);
+            int ti = (i == count ? startTilt : positions[2*i+1]);
+            int pj = (j == count ? startPan : positions[2*j]);
+            int tj = (j == count ? startTilt : positions[2*j+1]);
+            dist[i*n + j] = tourCost(pi, ti, pj, tj);
+        }
+
+    if (count <= tourExactMax)
+        exactTour(dist, count, order);
+    else
+        heuristicTour(dist, count, order);
+
+    free(dist);
+
+    return tourLength(positions, order, count, startPan, startTilt);
+}
+
+// Held-Karp dynamic program over subsets of locations, the path
+// starts at the current position and does not have to return
+static void exactTour(const int* dist, int count, int* order)
+{
+    int n = count + 1;
+    int full = (1 << count) - 1;
+    int mask, last, next, best, bestLast, cost;
+    int* dp = (int*)malloc((full + 1) * count * sizeof(int));
+    int* parent = (int*)malloc((full + 1) * count * sizeof(int));
+
+    if (!dp || !parent) {
+        free(dp);
+        free(parent);
+        heuristicTour(dist, count, order);
+        return;
+    }
+
+    for (mask = 0; mask <= full; mask++)
+        for (last = 0; last < count; last++)
+            dp[mask*count + last] = -1;
+
+    for (last = 0; last < count; last++) {
+        dp[(1 << last)*count + last] = dist[count*n + last];
+        parent[(1 << last)*count + last] = -1;
+    }
+
+    for (mask = 1; mask <= full; mask++)
+        for (last = 0; last < count; last++) {
+            if (dp[mask*count + last] < 0)
+                continue;
+
+            for (next = 0; next < count; next++) {
+                if (mask & (1 << next))
+                    continue;
+
+                cost = dp[mask*count + last] + dist[last*n + next];
+                if (dp[(mask | (1 << next))*count + next] < 0 || cost < dp[(mask | (1 << next))*count + next]) {
+                    dp[(mask | (1 << next))*count + next] = cost;
+                    parent[(mask | (1 << next))*count + next] = last;
+                }
+            }
+        }
+
+    // pick the cheapest end point and walk the parents back
+    bestLast = 0;
+    best = dp[full*count];
+    for (last = 1; last < count; last++)
+        if (dp[full*count + last] < best) {
+            best = dp[full*count + last];
+            bestLast = last;
+        }
+
+    mask = full;
+    last = bestLast;
+    for (next = count - 1; next >= 0; next--) {
+        order[next] = last;
+        best = parent[mask*count + last];
+        mask &= ~(1 << last);
+        last = best;
+    }
+
+    free(dp);
+    free(parent);
+}
+
+// nearest neighbor tour improved with 2-opt segment reversals
+static void heuristicTour(const int* dist, int count, int* order)
+{
+    int n = count + 1;
+    int i, j, k, current, best, improved;
+    int before, after, prev;
+    char* visited = (char*)calloc(count, sizeof(char));
+
+    current = count;
+    for (i = 0; i < count; i++) {
+        best = -1;
+        for (j = 0; j < count; j++)
+            if (!visited[j] && (best < 0 || dist[current*n + j] < dist[current*n + best]))
+                best = j;
+
+        order[i] = best;
+        visited[best] = 1;
+        current = best;
+    }
+
+    free(visited);
+
+    // reversing order[i..j] only changes the edge into i and the edge out of j,
+    // the path is open so reversing up to the end only changes the edge into i
+    do {
+        improved = 0;
+        for (i = 0; i < count - 1; i++) {
+            prev = (i == 0 ? count : order[i-1]);
+            for (j = i + 1; j < count; j++) {
+                before = dist[prev*n + order[i]];
+                after = dist[prev*n + order[j]];
+                if (j < count - 1) {
+                    before += dist[order[j]*n + order[j+1]];
+                    after += dist[order[i]*n + order[j+1]];
+                }
+
+                if (after < before) {
+                    for (k = 0; k < (j - i + 1)/2; k++) {
+                        int temp = order[i+k];
+                        order[i+k] = order[j-k];
+                        order[j-k] = temp;
+                    }
+                    improved = 1;
+                }
+            }
+        }
+    } while (improved);
+}
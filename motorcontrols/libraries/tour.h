@@ -0,0 +1,19 @@
+#ifndef TOUR_H
+#define TOUR_H
+
+#include <stdlib.h>
+
+// tours with up to this many locations are solved exactly,
+// anything bigger uses nearest neighbor followed by 2-opt
+static const int tourExactMax = 12;
+
+// orders the saved locations so the total pan and tilt travel is
+// as small as possible starting from the current servo position.
+// positions holds pan,tilt pairs and order receives the location indices
+int planTour(const int* positions, int count, int startPan, int startTilt, int* order);
+// travel between two pan/tilt feedback positions, in servoblaster steps
+int tourCost(int pan1, int tilt1, int pan2, int tilt2);
+// total travel of a tour starting from the current servo position
+int tourLength(const int* positions, const int* order, int count, int startPan, int startTilt);
+
+#endif
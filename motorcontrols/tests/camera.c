@@ -0,0 +1,48 @@
+// Camera capture test
+// grabs frames from a V4L2 device, or "mock:<pattern>", and times them
+
+#include "camera.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+static double seconds(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main(int argc, char* argv[]) {
+  const char* device = (argc > 1 ? argv[1] : "/dev/video0");
+  int frames = (argc > 2 ? atoi(argv[2]) : 4);
+  double start = seconds();
+  CAMFRAME frame;
+  CAMERA* cam;
+  int i;
+
+  cam = Cam_Open(device, 2592, 1944, V4L2_PIX_FMT_MJPEG);
+  if (!cam)
+    return 1;
+
+  printf("open and warm up: %.3f s (%dx%d)\n", seconds() - start, cam->width, cam->height);
+
+  for (i = 0; i < frames; i++) {
+    start = seconds();
+    if (Cam_Grab(cam, &frame)) {
+      printf("grab %d failed\n", i);
+      break;
+    }
+    printf("grab %d: %.3f s, %lu bytes\n", i, seconds() - start, (unsigned long)frame.size);
+
+    if (i == frames - 1)
+      Cam_Save(&frame, "camera_test.jpeg");
+    Cam_Release(cam, &frame);
+  }
+
+  Cam_Close(cam);
+
+  return 0;
+}
@@ -17,7 +17,11 @@ void SPI_shutdown(void)
 	delay(1); // 1 ms
 	digitalWrite(SPI_CS, HIGH); // set CS high
 
+#ifdef SIMULATION
+	printf("[sim] poweroff\n");
+#else
 	system("sudo poweroff");
+#endif
 
 	return;
 }
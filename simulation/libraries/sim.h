@@ -0,0 +1,54 @@
+#ifndef SIM_H
+#define SIM_H
+
+/* Simulated hardware for running the full wake cycle without a Pi.
+
+Everything is configured through environment variables so the same
+binaries can be profiled on any Linux machine:
+
+SIM_SEED        seed for the ADC noise (default 1)
+SIM_SPEEDUP     divides every delay()/delayMicroseconds() (default 1)
+SIM_ADC_NOISE   standard deviation of the ADC noise in counts (default 2)
+SIM_DRIFT       offset in echo steps between the real servos and the
+                hard-coded FB_to_PW curves (default 0)
+SIM_SLEW        how fast the servos move toward their command, in echo
+                steps per second before SIM_SPEEDUP (default 400)
+SIM_GPIO_LOW    comma separated pins that read low, e.g. "18" for the
+                calibration jumper
+SIM_IMAGES      printf pattern of recorded captures served by the mock
+                camera, each location gets the one with its number,
+                modulo how many there are (default ../images/testing%d.jpeg)
+SIM_RADIO       path of the radio link (see simserial.c)
+SIM_BAUD        overrides the baud rate of the radio link
+SIM_LATENCY     one way latency of the radio link in microseconds (default 0)
+SIM_LOSS        probability of losing each chunk of up to 64 bytes on the
+                radio link, or each try of a packet between the API mode
+                radios (default 0)
+SIM_JITTER      up to this many more microseconds of latency, random for
+                each chunk, the bytes still arrive in order (default 0)
+SIM_BER         probability of flipping each bit on the radio link (default 0)
+SIM_DROP        probability of losing each byte on the radio link (default 0)
+SIM_RECEIVE_DIR where the built-in base station stores images (default /tmp)
+*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// servoblaster command such as "0=150" or "1=+1"
+void simServoblaster(const char* command);
+// current simulated feedback of a servo before ADC noise
+int simFeedback(int motor);
+
+// configuration helpers shared by the simulation sources
+long simEnvLong(const char* name, long def);
+double simEnvDouble(const char* name, double def);
+const char* simEnvString(const char* name, const char* def);
+// monotonic time in microseconds
+unsigned long long simMicros(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,179 @@
+#include "wiringPi.h"
+#include "wiringPiSPI.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+/* GPIO, timing, the ADS1015 ADC on I2C and SPI of the simulated Pi.
+*/
+
+#define SIM_PINS 64
+#define ADS_ADDRESS 0x48
+#define ADS_FD 1000 // fake handle returned for the ADC
+
+static int pullState[SIM_PINS];
+static int outputState[SIM_PINS];
+static int adcChannel = 0;
+static unsigned int noiseSeed = 0;
+
+long simEnvLong(const char* name, long def)
+{
+    const char* value = getenv(name);
+
+    return (value && *value ? strtol(value, NULL, 0) : def);
+}
+
+double simEnvDouble(const char* name, double def)
+{
+    const char* value = getenv(name);
+
+    return (value && *value ? strtod(value, NULL) : def);
+}
+
+const char* simEnvString(const char* name, const char* def)
+{
+    const char* value = getenv(name);
+
+    return (value && *value ? value : def);
+}
+
+unsigned long long simMicros(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+int wiringPiSetup(void)
+{
+    return 0;
+}
+
+int wiringPiSetupGpio(void)
+{
+    return 0;
+}
+
+void pinMode(int pin, int mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+void pullUpDnControl(int pin, int pud)
+{
+    if (pin >= 0 && pin < SIM_PINS)
+        pullState[pin] = pud;
+}
+
+// pins listed in SIM_GPIO_LOW read low, otherwise the pull resistor decides
+int digitalRead(int pin)
+{
+    const char* low = simEnvString("SIM_GPIO_LOW", "");
+    char* end;
+
+    while (*low) {
+        if (strtol(low, &end, 10) == pin && end != low)
+            return LOW;
+        low = (*end ? end + 1 : end);
+    }
+
+    if (pin >= 0 && pin < SIM_PINS)
+        return (pullState[pin] == PUD_UP ? HIGH : outputState[pin]);
+
+    return LOW;
+}
+
+void digitalWrite(int pin, int value)
+{
+    if (pin >= 0 && pin < SIM_PINS)
+        outputState[pin] = value;
+}
+
+void delay(unsigned int howLong)
+{
+    delayMicroseconds(howLong * 1000);
+}
+
+void delayMicroseconds(unsigned int howLong)
+{
+    long speedup = simEnvLong("SIM_SPEEDUP", 1);
+
+    usleep(howLong / (speedup > 0 ? speedup : 1));
+}
+
+unsigned int millis(void)
+{
+    return (unsigned int)(simMicros() / 1000);
+}
+
+int wiringPiI2CSetup(const int devId)
+{
+    if (devId != ADS_ADDRESS)
+        return -1;
+
+    if (!noiseSeed)
+        noiseSeed = (unsigned int)simEnvLong("SIM_SEED", 1);
+
+    return ADS_FD;
+}
+
+// the config register is written byte swapped, the low byte holds
+// the multiplexer bits that select the single ended input
+int wiringPiI2CWriteReg16(int fd, int reg, int data)
+{
+    if (fd != ADS_FD)
+        return -1;
+
+    if (reg == 0x01)
+        adcChannel = ((data >> 4) & 0x7) - 4;
+
+    return 0;
+}
+
+// gaussian noise using the Box-Muller transform
+static double adcNoise(void)
+{
+    double u1 = (rand_r(&noiseSeed) + 1.0) / (RAND_MAX + 2.0);
+    double u2 = (rand_r(&noiseSeed) + 1.0) / (RAND_MAX + 2.0);
+
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+// returns the 12 bit conversion in the byte swapped
+// layout that Rd_Rev in servo.c undoes
+int wiringPiI2CReadReg16(int fd, int reg)
+{
+    int value;
+
+    if (fd != ADS_FD || reg != 0x00)
+        return -1;
+
+    value = simFeedback(adcChannel) + (int)lround(adcNoise() * simEnvDouble("SIM_ADC_NOISE", 2));
+    if (value < 0)
+        value = 0;
+    if (value > 0x0FFF)
+        value = 0x0FFF;
+
+    return ((value >> 4) | ((value & 0xF) << 12)) & 0xFFFF;
+}
+
+int wiringPiSPISetup(int channel, int speed)
+{
+    (void)speed;
+    return channel;
+}
+
+// the power system PIC only listens, report what it was told
+int wiringPiSPIDataRW(int channel, unsigned char* data, int len)
+{
+    if (len > 0)
+        printf("[sim] SPI%d command %d to the power system\n", channel, data[0]);
+
+    return len;
+}
@@ -0,0 +1,341 @@
+#define _GNU_SOURCE
+#include "simlink.h"
+#include "sim.h"
+#include "xbaud.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <termios.h>
+
+#define SIMLINK_GUARD 1000000   /* microseconds of silence around "+++", the XBee GT */
+#define SIMLINK_COMMAND 10000   /* ms command mode lasts without a command, the XBee CT */
+
+void simLinkRaw(int fd)
+{
+  struct termios options;
+
+  if (tcgetattr(fd, &options))
+    return;
+
+  cfmakeraw(&options);
+  options.c_cflag |= (CLOCAL | CREAD);
+  options.c_cc[VMIN] = 0;
+  options.c_cc[VTIME] = 100; // ten seconds, the same as wiringSerial
+
+  tcsetattr(fd, TCSANOW, &options);
+}
+
+int simLinkOpenPty(int* master, int* hold, char* path, int size)
+{
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+
+  if (fd < 0 || grantpt(fd) || unlockpt(fd) || !ptsname(fd))
+    return -1;
+
+  strncpy(path, ptsname(fd), size - 1);
+  *master = fd;
+
+  *hold = open(path, O_RDWR | O_NOCTTY);
+  if (*hold < 0)
+    return -1;
+
+  simLinkRaw(*hold);
+  return 0;
+}
+
+static int openPty(SIMLINK* link, int side)
+{
+  return simLinkOpenPty(&link->master[side], &link->hold[side], link->path[side], sizeof(link->path[side]));
+}
+
+// true with probability 'chance'
+static int happens(SIMLINK_DIR* dir, double chance)
+{
+  return chance > 0 && rand_r(&dir->seed) < chance * ((double)RAND_MAX + 1);
+}
+
+// drops bytes and flips bits of a chunk, returns the bytes left
+static int damage(SIMLINK_DIR* dir, unsigned char* buf, int n)
+{
+  SIMLINK* link = dir->link;
+  double drop = link->drop, ber = link->ber;
+  int i, bit, kept = 0;
+
+  if (drop <= 0 && ber <= 0)
+    return n;
+
+  for (i = 0; i < n; i++) {
+    if (happens(dir, drop)) {
+      link->errors[dir - link->dir]++;
+      continue;
+    }
+
+    for (bit = 0; ber > 0 && bit < 8; bit++)
+      if (happens(dir, ber)) {
+        buf[i] ^= (unsigned char)(1 << bit);
+        link->errors[dir - link->dir]++;
+      }
+
+    buf[kept++] = buf[i];
+  }
+
+  return kept;
+}
+
+// "+++" after a guard time of silence, and then silence again
+static int escape(SIMLINK_DIR* dir, const unsigned char* buf, int n, unsigned long long now)
+{
+  struct pollfd pfd;
+
+  pfd.fd = dir->from;
+  pfd.events = POLLIN;
+
+  return n == 3 && !memcmp(buf, "+++", 3) && now - dir->quiet >= SIMLINK_GUARD &&
+         poll(&pfd, 1, SIMLINK_GUARD / 1000) == 0;
+}
+
+static void answer(SIMLINK_DIR* dir, const char* text)
+{
+  int n = strlen(text);
+
+  if (write(dir->from, text, n) != n)
+    fprintf(stderr, "[sim] radio answer lost\n");
+}
+
+// the radio's command mode, until ATCN or a while without a command
+static void commandMode(SIMLINK_DIR* dir)
+{
+  SIMLINK* link = dir->link;
+  int side = dir - link->dir;
+  long rate = link->rate[side];
+  struct pollfd pfd;
+  char line[32], text[16], *end;
+  unsigned char c;
+  int length = 0;
+  long code;
+
+  pfd.fd = dir->from;
+  pfd.events = POLLIN;
+  answer(dir, "OK\r");
+
+  while (link->running && poll(&pfd, 1, SIMLINK_COMMAND) > 0 && read(dir->from, &c, 1) == 1) {
+    if (c != '\r') {
+      if (length < (int)sizeof(line) - 1)
+        line[length++] = c;
+      continue;
+    }
+
+    line[length] = 0;
+    length = 0;
+
+    if (strncmp(line, "AT", 2)) {
+      answer(dir, "ERROR\r");
+    } else if (!strcmp(line + 2, "BD")) {
+      snprintf(text, sizeof(text), "%X\r", XBaudCode(rate));
+      answer(dir, text);
+    } else if (!strncmp(line + 2, "BD", 2)) {
+      code = strtol(line + 4, &end, 16);
+      if (*end || !XBaudRate(code)) {
+        answer(dir, "ERROR\r");
+      } else {
+        rate = XBaudRate(code);
+        answer(dir, "OK\r");
+      }
+    } else if (!strcmp(line + 2, "CN")) {
+      answer(dir, "OK\r");
+      break;
+    } else {
+      answer(dir, "OK\r");
+    }
+  }
+
+  // the new rate holds once command mode is over
+  link->rate[side] = rate;
+}
+
+// reads what one end sent and works out when it arrives at the other,
+// the radio sends no faster than the baud rate and the air adds latency
+static void* relayReader(void* p)
+{
+  SIMLINK_DIR* dir = (SIMLINK_DIR*)p;
+  SIMLINK* link = dir->link;
+  SIMLINK_CHUNK_BUF* chunk;
+  unsigned char buf[SIMLINK_CHUNK];
+  unsigned long long now;
+  struct pollfd pfd;
+  long rate;
+  int n, lost;
+
+  pfd.fd = dir->from;
+  pfd.events = POLLIN;
+
+  while (link->running) {
+    if (poll(&pfd, 1, 100) <= 0)
+      continue;
+
+    n = read(dir->from, buf, sizeof(buf));
+    if (n <= 0)
+      continue;
+
+    now = simMicros();
+    if (escape(dir, buf, n, now)) {
+      commandMode(dir);
+      dir->quiet = simMicros();
+      continue;
+    }
+    dir->quiet = now;
+
+    // lost on the air, the radio still spent the time sending it
+    lost = happens(dir, link->loss);
+
+    pthread_mutex_lock(&dir->lock);
+    while (dir->count == SIMLINK_QUEUE && link->running)
+      pthread_cond_wait(&dir->cond, &dir->lock);
+
+    // each byte takes 10 bit times, start plus 8 data plus stop, at the
+    // rate of the slower radio
+    rate = link->rate[0] < link->rate[1] ? link->rate[0] : link->rate[1];
+    now = simMicros();
+    if (dir->next < now)
+      dir->next = now;
+    dir->next += (unsigned long long)n * 10 * 1000000ULL / rate;
+
+    if (!lost)
+      n = damage(dir, buf, n);
+    else
+      link->errors[dir - link->dir]++;
+
+    if (lost || n == 0) {
+      pthread_mutex_unlock(&dir->lock);
+      continue;
+    }
+
+    // the jitter delays a chunk but never lets it overtake the one before
+    chunk = &dir->queue[(dir->head + dir->count) % SIMLINK_QUEUE];
+    chunk->due = dir->next + (link->latency > 0 ? link->latency : 0);
+    if (link->jitter > 0)
+      chunk->due += (unsigned long long)(link->jitter * (rand_r(&dir->seed) / ((double)RAND_MAX + 1)));
+    if (chunk->due < dir->due)
+      chunk->due = dir->due;
+    dir->due = chunk->due;
+    chunk->length = n;
+    memcpy(chunk->data, buf, n);
+    dir->count++;
+
+    pthread_cond_broadcast(&dir->cond);
+    pthread_mutex_unlock(&dir->lock);
+  }
+
+  return NULL;
+}
+
+// hands the chunks to the other end once they are due
+static void* relayWriter(void* p)
+{
+  SIMLINK_DIR* dir = (SIMLINK_DIR*)p;
+  SIMLINK* link = dir->link;
+  SIMLINK_CHUNK_BUF chunk;
+  unsigned long long now;
+
+  for (;;) {
+    pthread_mutex_lock(&dir->lock);
+    while (dir->count == 0 && link->running)
+      pthread_cond_wait(&dir->cond, &dir->lock);
+
+    if (dir->count == 0) {
+      pthread_mutex_unlock(&dir->lock);
+      break;
+    }
+
+    chunk = dir->queue[dir->head];
+    dir->head = (dir->head + 1) % SIMLINK_QUEUE;
+    dir->count--;
+
+    pthread_cond_broadcast(&dir->cond);
+    pthread_mutex_unlock(&dir->lock);
+
+    now = simMicros();
+    if (chunk.due > now)
+      usleep(chunk.due - now);
+
+    if (write(dir->to, chunk.data, chunk.length) != chunk.length)
+      fprintf(stderr, "[sim] radio link dropped %d bytes, errno=%d\n", chunk.length, errno);
+  }
+
+  return NULL;
+}
+
+SIMLINK* simLinkCreate(long baud)
+{
+  SIMLINK* link = (SIMLINK*)calloc(1, sizeof(SIMLINK));
+  int i;
+
+  if (!link)
+    return NULL;
+
+  link->baud = (baud > 0 ? baud : 57600);
+  link->rate[0] = link->rate[1] = link->baud;
+  link->latency = simEnvLong("SIM_LATENCY", 0);
+  link->loss = simEnvDouble("SIM_LOSS", 0);
+  link->jitter = simEnvLong("SIM_JITTER", 0);
+  link->ber = simEnvDouble("SIM_BER", 0);
+  link->drop = simEnvDouble("SIM_DROP", 0);
+
+  if (openPty(link, 0) || openPty(link, 1)) {
+    simLinkDestroy(link);
+    return NULL;
+  }
+
+  // the ports start at the rate of the radios, when it is one they take
+  XBaudSetPort(link->hold[0], link->baud);
+  XBaudSetPort(link->hold[1], link->baud);
+
+  link->running = 1;
+  for (i = 0; i < 2; i++) {
+    link->dir[i].link = link;
+    link->dir[i].from = link->master[i];
+    link->dir[i].to = link->master[1 - i];
+    link->dir[i].seed = (unsigned int)simEnvLong("SIM_SEED", 1) + i;
+    pthread_mutex_init(&link->dir[i].lock, NULL);
+    pthread_cond_init(&link->dir[i].cond, NULL);
+    pthread_create(&link->dir[i].reader, NULL, relayReader, &link->dir[i]);
+    pthread_create(&link->dir[i].writer, NULL, relayWriter, &link->dir[i]);
+  }
+
+  return link;
+}
+
+void simLinkDestroy(SIMLINK* link)
+{
+  int i;
+
+  if (!link)
+    return;
+
+  if (link->running) {
+    link->running = 0;
+    for (i = 0; i < 2; i++) {
+      pthread_mutex_lock(&link->dir[i].lock);
+      pthread_cond_broadcast(&link->dir[i].cond);
+      pthread_mutex_unlock(&link->dir[i].lock);
+      pthread_join(link->dir[i].reader, NULL);
+      pthread_join(link->dir[i].writer, NULL);
+      pthread_mutex_destroy(&link->dir[i].lock);
+      pthread_cond_destroy(&link->dir[i].cond);
+    }
+  }
+
+  for (i = 0; i < 2; i++) {
+    if (link->hold[i] > 0)
+      close(link->hold[i]);
+    if (link->master[i] > 0)
+      close(link->master[i]);
+  }
+
+  free(link);
+}
@@ -0,0 +1,85 @@
+#ifndef SIMLINK_H
+#define SIMLINK_H
+
+/* A radio link made of two pseudo-terminal pairs with a relay in
+between that paces the bytes to the configured baud rate, delays them
+by the one way latency of the radios plus some jitter, and loses or
+damages some of them: whole chunks, single bytes or single bits. Each
+end opens one of the slave paths like a serial device.
+
+The bytes move at the lower of the serial rates of the two radios, which
+start at the baud rate. Like an XBee, a radio goes into command mode on a
+second of silence, "+++" and another second of silence, and then takes
+ATBD to change its rate when ATCN ends command mode. Other commands are
+answered OK.
+*/
+
+#include <pthread.h>
+
+struct _SIMLINK_;
+
+#define SIMLINK_CHUNK 64   /* bytes moved per read */
+#define SIMLINK_QUEUE 256  /* chunks in flight per direction */
+
+// bytes in flight and when they reach the far end
+typedef struct _SIMLINK_CHUNK_
+{
+  unsigned long long due; ///< simMicros() when the chunk is delivered
+  int length;
+  unsigned char data[SIMLINK_CHUNK];
+} SIMLINK_CHUNK_BUF;
+
+// one direction of the relay, a reader stamps the chunks and a writer
+// delivers them when they are due
+typedef struct _SIMLINK_DIR_
+{
+  struct _SIMLINK_* link;
+  int from, to;           ///< masters the bytes move between
+  unsigned long long next; ///< when the radio finishes sending what it has
+  unsigned long long due;  ///< when the last chunk queued is delivered
+  unsigned long long quiet; ///< when the end last sent something
+  pthread_t reader, writer;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  SIMLINK_CHUNK_BUF queue[SIMLINK_QUEUE];
+  int head, count;        ///< oldest chunk and number of chunks queued
+  unsigned int seed;      ///< losses are repeatable for a given SIM_SEED
+} SIMLINK_DIR;
+
+typedef struct _SIMLINK_
+{
+  long baud;              ///< bits per second, 10 bits per byte on the wire
+  volatile long rate[2];  ///< serial rate of each end's radio, baud until ATBD
+  volatile long latency;  ///< one way delay in microseconds, may be changed while running
+  volatile double loss;   ///< probability of losing each chunk of up to 64 bytes
+  volatile long jitter;   ///< up to this many microseconds more latency per chunk
+  volatile double ber;    ///< probability of flipping each bit
+  volatile double drop;   ///< probability of losing each byte
+  long errors[2];         ///< chunks lost, bytes dropped and bits flipped each way
+  int master[2];          ///< master side of each pty pair
+  int hold[2];            ///< slave side kept open so the masters never see EIO
+  char path[2][64];       ///< slave paths handed to each end
+  volatile int running;   ///< cleared to stop the relay threads
+  SIMLINK_DIR dir[2];     ///< relay of each direction
+} SIMLINK;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// creates both pty pairs and starts relaying, NULL on failure.  the
+// latency, loss, jitter, bit and byte errors start at SIM_LATENCY,
+// SIM_LOSS, SIM_JITTER, SIM_BER and SIM_DROP
+SIMLINK* simLinkCreate(long baud);
+void simLinkDestroy(SIMLINK* link);
+// puts a tty file descriptor in raw 8N1 mode
+void simLinkRaw(int fd);
+// opens a raw pty pair, the slave stays open in hold so the master never
+// sees EIO while the real end is closed. returns 0 or -1
+int simLinkOpenPty(int* master, int* hold, char* path, int size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,227 @@
+#define _GNU_SOURCE
+#include "wiringSerial.h"
+#include "simlink.h"
+#include "sim.h"
+#include "xmodem.h"
+#include "xpreview.h"
+#include "xbaud.h"
+#include "xlog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+
+/* Serial ports of the simulated Pi. Whatever device is asked for, the
+radio link is used instead:
+
+- SIM_RADIO unset: a link is created and a built-in base station on the
+  far end receives every image ('1' followed by XMODEM, or '7' followed by
+  a YMODEM batch) into SIM_RECEIVE_DIR.  It answers the offer of a faster
+  serial rate ('8', see xbaud.h) and goes back to the usual one once the
+  field unit is quiet.  While a progressive JPEG arrives it keeps
+  sim_image<N>.preview.jpeg up to date with the scans it has, and removes
+  it once the whole image is there.  After a batch it asks for the link
+  log ('5', see xlog.h) and keeps it as sim_link.log.
+- SIM_RADIO names a path that does not exist: a link is created and its
+  far end is linked at that path for another simulated program to open.
+- SIM_RADIO names an existing path: that device is opened directly.
+
+So "SIM_RADIO=/tmp/radio ./main" and "SIM_RADIO=/tmp/radio ./xbeeRead"
+talk to each other at the simulated baud rate.
+*/
+
+static SIMLINK* radio = NULL;
+static pthread_t baseStation;
+static int images = 0;
+static XPREVIEW preview;
+
+static void removeRadioPath(void)
+{
+    unlink(simEnvString("SIM_RADIO", ""));
+}
+
+// where the preview of the image arriving is kept
+static void previewPath(char* path, size_t size, const char* dir)
+{
+    snprintf(path, size, "%s/sim_image%d.preview.jpeg", dir, images);
+}
+
+static void previewImage(void* p, const char* received, const char* name, long done, long size)
+{
+    char path[256];
+    int scans;
+
+    if (!received[0])
+        return;
+
+    previewPath(path, sizeof(path), (const char*)p);
+    scans = XPreviewUpdate(&preview, received, done, path);
+    if (scans)
+        printf("[sim] base station preview %s, %d scans in %ld of %ld bytes\n", path, scans, done, size);
+}
+
+// numbers the files of a batch like single images
+static void batchImage(void* p, const char* received, long size)
+{
+    char path[256];
+
+    previewPath(path, sizeof(path), (const char*)p);
+    unlink(path);
+    XPreviewInit(&preview); // the next file arrives under the same name
+
+    snprintf(path, sizeof(path), "%s/sim_image%d.jpeg", (const char*)p, images++);
+    if (!rename(received, path))
+        printf("[sim] base station received %s, %ld bytes\n", path, size);
+}
+
+// stands in for xbeeRead on the far end of the link
+static void* baseStationLoop(void* p)
+{
+    const char* dir = simEnvString("SIM_RECEIVE_DIR", "/tmp");
+    char path[256];
+    unsigned char c;
+    int result;
+    long usual, rate;
+    int fd = open((const char*)p, O_RDWR | O_NOCTTY);
+
+    if (fd < 0)
+        return NULL;
+
+    simLinkRaw(fd);
+    XSetProgress(previewImage, (void*)dir);
+    usual = rate = XBaudPort(fd);
+
+    for (;;) {
+        if (read(fd, &c, 1) != 1) {
+            // ten seconds of silence, the field unit is done
+            if (rate != usual && !XBaudSet(fd, usual))
+                rate = usual;
+            continue;
+        }
+
+        if (c == '1') {
+            snprintf(path, sizeof(path), "%s/sim_image%d.jpeg", dir, images);
+            printf("[sim] base station receiving %s\n", path);
+            result = XReceive(fd, path, 0664);
+            printf("[sim] base station receive returned %d\n", result);
+            if (result == 0) {
+                previewPath(path, sizeof(path), dir);
+                unlink(path);
+            }
+            images++;
+        } else if (c == '7') {
+            printf("[sim] base station receiving a batch\n");
+            result = XReceiveBatch(fd, dir, 0664, batchImage, (void*)dir);
+            printf("[sim] base station receive returned %d\n", result);
+
+            // the field unit's link log, once the batch is in
+            if (result == 0) {
+                snprintf(path, sizeof(path), "%s/sim_link.log", dir);
+                usleep(XLOG_ASK * 1000);
+                c = '5';
+                if (write(fd, &c, 1) == 1)
+                    printf("[sim] base station link log returned %d\n", XReceive(fd, path, 0664));
+            }
+        } else if (c == '8') {
+            rate = XBaudAnswer(fd, XBAUD_MAX);
+            printf("[sim] base station serial rate %ld\n", rate);
+        }
+    }
+
+    return NULL;
+}
+
+static const char* radioPath(int baud)
+{
+    const char* path = simEnvString("SIM_RADIO", NULL);
+
+    if (path && access(path, F_OK) == 0 && !radio)
+        return path; // the other end created the link
+
+    if (!radio) {
+        radio = simLinkCreate(simEnvLong("SIM_BAUD", baud));
+        if (!radio)
+            return NULL;
+
+        if (path) {
+            unlink(path);
+            if (symlink(radio->path[1], path) == 0)
+                atexit(removeRadioPath);
+            printf("[sim] radio link at %s, %ld baud\n", path, radio->baud);
+        } else {
+            pthread_create(&baseStation, NULL, baseStationLoop, radio->path[1]);
+            printf("[sim] radio link to the built-in base station, %ld baud\n", radio->baud);
+        }
+    }
+
+    return radio->path[0];
+}
+
+int serialOpen(const char* device, const int baud)
+{
+    const char* path = radioPath(baud);
+    int fd;
+
+    (void)device;
+
+    if (!path)
+        return -1;
+
+    fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0)
+        return -1;
+
+    // same settings as wiringSerial, raw and blocking with a timeout
+    fcntl(fd, F_SETFL, O_RDWR);
+    simLinkRaw(fd);
+
+    return fd;
+}
+
+void serialClose(const int fd)
+{
+    close(fd);
+}
+
+void serialFlush(const int fd)
+{
+    tcflush(fd, TCIOFLUSH);
+}
+
+void serialPutchar(const int fd, const unsigned char c)
+{
+    if (write(fd, &c, 1) != 1)
+        fprintf(stderr, "[sim] serialPutchar failed\n");
+}
+
+void serialPuts(const int fd, const char* s)
+{
+    int n = strlen(s);
+
+    if (write(fd, s, n) != n)
+        fprintf(stderr, "[sim] serialPuts failed\n");
+}
+
+int serialDataAvail(const int fd)
+{
+    int result;
+
+    if (ioctl(fd, FIONREAD, &result) == -1)
+        return -1;
+
+    return result;
+}
+
+int serialGetchar(const int fd)
+{
+    unsigned char c;
+
+    if (read(fd, &c, 1) != 1)
+        return -1;
+
+    return c;
+}
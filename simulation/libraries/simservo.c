@@ -0,0 +1,123 @@
+#include "sim.h"
+#include "wiringPi.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/* Servo dynamics of the simulated Pi.
+
+Each servo slews toward its commanded echo value at a fixed rate. The
+feedback potentiometer follows the hard-coded FB_to_PW curves from
+servo.c (shifted by SIM_DRIFT), so with no drift a move lands on target
+the first time, and a drift shows up the way a worn servo would.
+*/
+
+#define ECHO_MIN 50
+#define ECHO_MAX 250
+
+// feedback range where each curve is monotonic
+static const double fbLow[2] = {0, 1150};
+static const double fbHigh[2] = {4095, 1850};
+
+static double position[2] = {150, 135}; // matches the startup commands
+static int commanded[2] = {150, 135};
+static unsigned long long lastUpdate[2] = {0, 0};
+
+// the curves FB_to_PW uses, echo value for a feedback value
+static double curve(int motor, double fb)
+{
+    if (motor == 0)
+        return -0.000000006994*fb*fb*fb + 0.000041253*fb*fb + 0.019523*fb + 34.879;
+
+    return -.00000018924*fb*fb*fb + .00084797*fb*fb - 1.1654*fb + 615.19;
+}
+
+// moves the servo toward its command for the time passed since the last look
+static void updateServo(int motor)
+{
+    unsigned long long now = simMicros();
+    double slew = simEnvDouble("SIM_SLEW", 400); // echo per second
+    double step;
+
+    if (lastUpdate[motor]) {
+        step = slew * simEnvLong("SIM_SPEEDUP", 1) * (now - lastUpdate[motor]) / 1e6;
+
+        if (fabs(commanded[motor] - position[motor]) <= step)
+            position[motor] = commanded[motor];
+        else if (commanded[motor] > position[motor])
+            position[motor] += step;
+        else
+            position[motor] -= step;
+    }
+
+    lastUpdate[motor] = now;
+}
+
+int simFeedback(int motor)
+{
+    double target, lo, hi, mid, slope;
+    double fb;
+
+    if (motor < 0 || motor > 1)
+        return 0;
+
+    updateServo(motor);
+    target = position[motor] - simEnvDouble("SIM_DRIFT", 0);
+    lo = fbLow[motor];
+    hi = fbHigh[motor];
+
+    if (target <= curve(motor, lo)) {
+        slope = curve(motor, lo + 1) - curve(motor, lo);
+        fb = lo - (curve(motor, lo) - target) / slope;
+    } else if (target >= curve(motor, hi)) {
+        slope = curve(motor, hi) - curve(motor, hi - 1);
+        fb = hi + (target - curve(motor, hi)) / slope;
+    } else {
+        // bisection, both curves increase over their range
+        while (hi - lo > 0.25) {
+            mid = (lo + hi) / 2;
+            if (curve(motor, mid) < target)
+                lo = mid;
+            else
+                hi = mid;
+        }
+        fb = (lo + hi) / 2;
+    }
+
+    if (fb < 0)
+        fb = 0;
+    if (fb > 4095)
+        fb = 4095;
+
+    return (int)lround(fb);
+}
+
+// accepts the servoblaster syntax "servo=value", "servo=+delta" or "servo=-delta"
+void simServoblaster(const char* command)
+{
+    int motor;
+    char sign = 0;
+    int value;
+
+    if (sscanf(command, " %d = %c", &motor, &sign) != 2 || motor < 0 || motor > 1) {
+        fprintf(stderr, "[sim] bad servoblaster command \"%s\"\n", command);
+        return;
+    }
+
+    if (sscanf(strchr(command, '=') + 1, "%d", &value) != 1)
+        return;
+
+    updateServo(motor);
+
+    if (sign == '+' || sign == '-')
+        commanded[motor] += value;
+    else
+        commanded[motor] = value;
+
+    if (commanded[motor] < ECHO_MIN)
+        commanded[motor] = ECHO_MIN;
+    if (commanded[motor] > ECHO_MAX)
+        commanded[motor] = ECHO_MAX;
+}
@@ -0,0 +1,243 @@
+#define _GNU_SOURCE
+#include "simxbee.h"
+#include "simlink.h"
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+
+// microseconds the serial port needs for n bytes
+static unsigned long long serialTime(SIMXBEE* pair, int n)
+{
+  return (unsigned long long)n * 10 * 1000000ULL / pair->baud;
+}
+
+// queues frame data for an end, paced behind what the radio already has
+// for it. called with the lock held
+static void queueFrame(SIMXBEE_RADIO* radio, unsigned long long ready, const unsigned char* frame, int length)
+{
+  SIMXBEE* pair = radio->pair;
+  SIMXBEE_OUT* out;
+  int i;
+
+  if (radio->count == SIMXBEE_QUEUE) {
+    pair->dropped++; // the radio's buffer overflowed
+    return;
+  }
+
+  // encode into the free slot, the length decides when it is due
+  out = &radio->out[radio->count];
+  out->length = XApiEncode(frame, length, pair->escaped, out->data);
+
+  if (radio->serialOut < ready)
+    radio->serialOut = ready;
+  radio->serialOut += serialTime(pair, out->length);
+  out->due = radio->serialOut;
+
+  // keep the queue sorted by due
+  for (i = radio->count; i > 0 && radio->out[i - 1].due > out->due; i--) {
+    SIMXBEE_OUT t = radio->out[i];
+    radio->out[i] = radio->out[i - 1];
+    radio->out[i - 1] = t;
+  }
+
+  radio->count++;
+}
+
+// a TX request from the end has been read by the radio at ready
+static void transmit(SIMXBEE_RADIO* radio, unsigned long long ready)
+{
+  SIMXBEE* pair = radio->pair;
+  SIMXBEE_RADIO* far = &pair->radio[1 - radio->side];
+  const unsigned char* frame = radio->decoder.aFrame;
+  unsigned char reply[XAPI_MAX_FRAME];
+  unsigned long long start, airtime, latency = (pair->latency > 0 ? pair->latency : 0);
+  int cbPayload = radio->decoder.cbFrame - XAPI_TX_OVERHEAD, tries, length;
+
+  if (frame[0] != XAPI_TX_REQUEST || cbPayload < 0)
+    return;
+
+  if (cbPayload > XAPI_RF_PAYLOAD) {
+    // too big for one packet, the real radio reports a payload error
+    if (frame[1]) {
+      length = XApiTxStatus(frame[1], 0, 0x74, reply);
+      queueFrame(radio, ready, reply, length);
+    }
+    return;
+  }
+
+  // the packet adds about 30 bytes of MAC and network headers on the air
+  airtime = (unsigned long long)(cbPayload + 30) * 8 * 1000000ULL / SIMXBEE_RF_RATE;
+  start = (radio->air > ready ? radio->air : ready);
+  pair->packets++;
+
+  for (tries = 0; tries <= SIMXBEE_RETRIES; tries++) {
+    pair->tries++;
+
+    // the air is busy until the MAC acknowledgment arrives, or times out
+    start += airtime + SIMXBEE_ACK_WAIT;
+
+    if (pair->loss > 0 && rand_r(&radio->seed) < pair->loss * ((double)RAND_MAX + 1))
+      continue;
+
+    length = XApiRxPacket(radio->address, frame + XAPI_TX_OVERHEAD, cbPayload, reply);
+    queueFrame(far, start + latency, reply, length);
+    break;
+  }
+
+  radio->air = start;
+
+  if (tries > SIMXBEE_RETRIES)
+    pair->failed++;
+
+  // the status reflects the far end's acknowledgment, which takes the
+  // latency to get there and again to come back
+  if (frame[1]) {
+    length = XApiTxStatus(frame[1], (unsigned char)(tries > SIMXBEE_RETRIES ? SIMXBEE_RETRIES : tries),
+                          (unsigned char)(tries > SIMXBEE_RETRIES ? 0x01 : XAPI_DELIVERED), reply);
+    queueFrame(radio, start + 2 * latency, reply, length);
+  }
+}
+
+// reads what the end writes and acts on each complete frame
+static void* radioReader(void* p)
+{
+  SIMXBEE_RADIO* radio = (SIMXBEE_RADIO*)p;
+  SIMXBEE* pair = radio->pair;
+  unsigned char buf[256];
+  unsigned long long now;
+  struct pollfd pfd;
+  int n, i;
+
+  pfd.fd = radio->master;
+  pfd.events = POLLIN;
+
+  while (pair->running) {
+    if (poll(&pfd, 1, 100) <= 0)
+      continue;
+
+    n = read(radio->master, buf, sizeof(buf));
+    if (n <= 0)
+      continue;
+
+    pthread_mutex_lock(&pair->lock);
+
+    now = simMicros();
+    if (radio->serialIn < now)
+      radio->serialIn = now;
+
+    for (i = 0; i < n; i++) {
+      radio->serialIn += serialTime(pair, 1);
+      if (XApiDecode(&radio->decoder, buf[i]))
+        transmit(radio, radio->serialIn);
+    }
+
+    pthread_mutex_unlock(&pair->lock);
+  }
+
+  return NULL;
+}
+
+// hands the queued frames to the end once they are due
+static void* radioWriter(void* p)
+{
+  SIMXBEE_RADIO* radio = (SIMXBEE_RADIO*)p;
+  SIMXBEE* pair = radio->pair;
+  SIMXBEE_OUT out;
+  unsigned long long now;
+
+  while (pair->running) {
+    pthread_mutex_lock(&pair->lock);
+
+    now = simMicros();
+    if (radio->count == 0 || radio->out[0].due > now) {
+      // a new frame may become due sooner, so look again at least every 2 ms
+      unsigned long long wait = (radio->count ? radio->out[0].due - now : 2000);
+      pthread_mutex_unlock(&pair->lock);
+      usleep(wait < 2000 ? wait : 2000);
+      continue;
+    }
+
+    out = radio->out[0];
+    radio->count--;
+    memmove(&radio->out[0], &radio->out[1], radio->count * sizeof(SIMXBEE_OUT));
+
+    pthread_mutex_unlock(&pair->lock);
+
+    if (write(radio->master, out.data, out.length) != out.length)
+      fprintf(stderr, "[sim] xbee dropped a %d byte frame, errno=%d\n", out.length, errno);
+  }
+
+  return NULL;
+}
+
+SIMXBEE* simXbeeCreate(long baud, int escaped)
+{
+  SIMXBEE* pair = (SIMXBEE*)calloc(1, sizeof(SIMXBEE));
+  int i;
+
+  if (!pair)
+    return NULL;
+
+  pair->baud = (baud > 0 ? baud : 57600);
+  pair->latency = simEnvLong("SIM_LATENCY", 0);
+  pair->loss = simEnvDouble("SIM_LOSS", 0);
+  pair->escaped = escaped;
+  pthread_mutex_init(&pair->lock, NULL);
+
+  for (i = 0; i < 2; i++) {
+    SIMXBEE_RADIO* radio = &pair->radio[i];
+
+    radio->pair = pair;
+    radio->side = i;
+    radio->seed = (unsigned int)simEnvLong("SIM_SEED", 1) + i;
+    // the serial numbers of XBee modules start with 0013A200
+    radio->address[1] = 0x13;
+    radio->address[2] = 0xA2;
+    radio->address[7] = (unsigned char)(i + 1);
+    XApiDecoderInit(&radio->decoder, escaped);
+
+    if (simLinkOpenPty(&radio->master, &radio->hold, radio->path, sizeof(radio->path))) {
+      simXbeeDestroy(pair);
+      return NULL;
+    }
+  }
+
+  pair->running = 1;
+  for (i = 0; i < 2; i++) {
+    pthread_create(&pair->radio[i].reader, NULL, radioReader, &pair->radio[i]);
+    pthread_create(&pair->radio[i].writer, NULL, radioWriter, &pair->radio[i]);
+  }
+
+  return pair;
+}
+
+void simXbeeDestroy(SIMXBEE* pair)
+{
+  int i;
+
+  if (!pair)
+    return;
+
+  if (pair->running) {
+    pair->running = 0;
+    for (i = 0; i < 2; i++) {
+      pthread_join(pair->radio[i].reader, NULL);
+      pthread_join(pair->radio[i].writer, NULL);
+    }
+  }
+
+  for (i = 0; i < 2; i++) {
+    if (pair->radio[i].hold > 0)
+      close(pair->radio[i].hold);
+    if (pair->radio[i].master > 0)
+      close(pair->radio[i].master);
+  }
+
+  pthread_mutex_destroy(&pair->lock);
+  free(pair);
+}
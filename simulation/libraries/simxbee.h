@@ -0,0 +1,78 @@
+#ifndef SIMXBEE_H
+#define SIMXBEE_H
+
+/* A pair of XBee radios in API mode, each behind a pseudo-terminal.
+
+Each radio decodes the API frames its end writes. A TX request goes over
+the air to the other radio, which hands its end an RX packet, and the
+sending radio answers with a TX status. The air loses packets with the
+configured probability, and the radio retries a lost packet like the
+real MAC before reporting it as not delivered.
+
+The serial side of both radios is paced to the baud rate. Every try
+keeps the air busy for the packet and its MAC acknowledgment. The one
+way latency is added on top like on the transparent link, to the packet
+once and to its TX status twice, so several packets can be on their way.
+*/
+
+#include <pthread.h>
+#include "xbeeapi.h"
+
+struct _SIMXBEE_;
+
+#define SIMXBEE_QUEUE 128   /* frames waiting to be handed to an end */
+#define SIMXBEE_RETRIES 3   /* MAC retries after the first try, ATRR */
+#define SIMXBEE_RF_RATE 250000 /* bits per second on the air */
+#define SIMXBEE_ACK_WAIT 1000  /* microseconds for the MAC acknowledgment */
+
+// a frame for an end and when it has gone through the serial port
+typedef struct _SIMXBEE_OUT_
+{
+  unsigned long long due; ///< simMicros() when the last byte is written
+  int length;
+  unsigned char data[2 * (XAPI_MAX_FRAME + 4)];
+} SIMXBEE_OUT;
+
+typedef struct _SIMXBEE_RADIO_
+{
+  struct _SIMXBEE_* pair;
+  int side;
+  int master, hold;       ///< pty pair, hold keeps the slave open
+  char path[64];          ///< slave path handed to the end
+  unsigned char address[8];
+  unsigned long long serialIn;  ///< when the radio has read what its end wrote
+  unsigned long long serialOut; ///< when the radio has written what it has for its end
+  unsigned long long air;       ///< when the radio is done with its last packet
+  XAPI_DECODER decoder;
+  SIMXBEE_OUT out[SIMXBEE_QUEUE]; ///< sorted by due
+  int count;
+  pthread_t reader, writer;
+  unsigned int seed;      ///< losses are repeatable for a given SIM_SEED
+} SIMXBEE_RADIO;
+
+typedef struct _SIMXBEE_
+{
+  long baud;              ///< serial bits per second, 10 bits per byte
+  volatile long latency;  ///< one way delay in microseconds
+  volatile double loss;   ///< probability of losing each try of a packet
+  int escaped;            ///< ATAP=2
+  volatile int running;
+  pthread_mutex_t lock;   ///< guards both radios
+  SIMXBEE_RADIO radio[2];
+  long packets, tries, failed, dropped; ///< counters for benchmarks
+} SIMXBEE;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// creates both radios, NULL on failure. the latency and loss start at
+// SIM_LATENCY and SIM_LOSS
+SIMXBEE* simXbeeCreate(long baud, int escaped);
+void simXbeeDestroy(SIMXBEE* pair);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef SIM_WIRINGPI_H
+#define SIM_WIRINGPI_H
+
+// stand-in for wiringPi.h when building against the simulated hardware,
+// only the parts of wiringPi this project uses are provided
+
+#include "sim.h"
+
+#define INPUT 0
+#define OUTPUT 1
+
+#define LOW 0
+#define HIGH 1
+
+#define PUD_OFF 0
+#define PUD_DOWN 1
+#define PUD_UP 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int wiringPiSetup(void);
+int wiringPiSetupGpio(void);
+void pinMode(int pin, int mode);
+void pullUpDnControl(int pin, int pud);
+int digitalRead(int pin);
+void digitalWrite(int pin, int value);
+void delay(unsigned int howLong);
+void delayMicroseconds(unsigned int howLong);
+unsigned int millis(void);
+
+// real wiringPi declares these in wiringPiI2C.h, but servo.c
+// relies on them being visible through wiringPi.h
+int wiringPiI2CSetup(const int devId);
+int wiringPiI2CWriteReg16(int fd, int reg, int data);
+int wiringPiI2CReadReg16(int fd, int reg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
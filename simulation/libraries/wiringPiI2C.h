@@ -0,0 +1,7 @@
+#ifndef SIM_WIRINGPII2C_H
+#define SIM_WIRINGPII2C_H
+
+// the I2C functions are declared with the rest of the simulated wiringPi
+#include "wiringPi.h"
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef SIM_WIRINGPISPI_H
+#define SIM_WIRINGPISPI_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int wiringPiSPISetup(int channel, int speed);
+int wiringPiSPIDataRW(int channel, unsigned char* data, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
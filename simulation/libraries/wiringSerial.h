@@ -0,0 +1,23 @@
+#ifndef SIM_WIRINGSERIAL_H
+#define SIM_WIRINGSERIAL_H
+
+// stand-in for wiringSerial.h, every device opened is routed
+// to the simulated radio link (see simserial.c)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int serialOpen(const char* device, const int baud);
+void serialClose(const int fd);
+void serialFlush(const int fd);
+void serialPutchar(const int fd, const unsigned char c);
+void serialPuts(const int fd, const char* s);
+int serialDataAvail(const int fd);
+int serialGetchar(const int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1021 @@
+#include "simlink.h"
+#include "simxbee.h"
+#include "sim.h"
+#include "xmodem.h"
+#include "xbeeapi.h"
+#include "xpreview.h"
+#include "xbaud.h"
+#include "xasync.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+
+/* Sends a file across a simulated radio link and prints the goodput.
+
+usage: linkbench [blocks|window|api|resume|batch|preview|scenarios|fec|baud|async] [bytes] [baud]
+
+blocks compares plain XMODEM with stop-and-wait YMODEM-1K at several one
+way latencies. window sweeps the sliding window size at several round
+trip times and loss rates, window 1 being stop-and-wait YMODEM-1K. api
+compares the window mode in transparent mode with the API frame
+transport over the stand-in radios, at the same round trip times and
+loss rates. resume cuts the power to both ends partway through a
+transfer, by killing the process they run in, and compares the session
+that resumes it with sending the whole file again. batch sends four
+files of the given size the way main did before, each after its own '1'
+signal in its own session, and then in one YMODEM batch. preview encodes
+a generated picture of about the given size as a baseline and as a
+progressive JPEG with cjpeg, which has to be on the PATH, and times the
+previews the receiver writes of the progressive one against the time
+either takes to arrive. scenarios runs stop-and-wait and window 8 over
+links with jitter, bit errors, dropped bytes and lost chunks, and reports
+the completion time, goodput and what each end had to repeat. fec sends
+with window 8 at round trips of 200 ms and 1 s and several bit error
+rates, without parity, with a parity block after every 4 and every 2
+blocks and with the group picked from the losses. each is run over a few
+differently seeded links, a single timeout weighs a lot, and it reports
+the mean goodput with the blocks sent again, the timeouts, the parity
+sent and the blocks the receiver rebuilt, all per run. baud sends the
+file at the given rate and again after the ends agree on 115200, the
+time for that included, at round trips of 0 and 200 ms, then sends it
+stop-and-wait in 1K blocks, 128 byte blocks and the size picked from the
+errors over links with bit errors. async makes four files ready one after
+the other, a sleep standing in for the image processing, at several times
+each takes, and sends them in one batch once all are ready and then from
+the XAsyncSend queue as each one is.
+
+The xmodem library logs every block to stderr, run it with 2>/dev/null.
+*/
+
+static const char* sentPath = "/tmp/linkbench_sent.bin";
+static const char* receivedPath = "/tmp/linkbench_received.bin";
+
+static const long latencies[] = { 0, 10000, 50000, 100000 };
+
+static const long rtts[] = { 20000, 100000, 200000 };
+static const double losses[] = { 0, 0.002, 0.01 };
+static const int windows[] = { 1, 2, 4, 8, 16, 32 };
+
+static const double cuts[] = { 0.25, 0.5, 0.75 };
+
+#define BATCH_FILES 4
+static const char* batchDir = "/tmp/linkbench_batch";
+static const int resumeWindows[] = { 1, 8 };
+
+#define PREVIEW_SCANS 32
+static const char* previewBmp = "/tmp/linkbench_picture.bmp";
+static const char* previewPath = "/tmp/linkbench_preview.jpeg";
+static const char* firstPreviewPath = "/tmp/linkbench_first_preview.jpeg";
+
+// a link for the scenarios, on top of the baud rate
+typedef struct
+{
+    const char* name;
+    long latency;   // one way, microseconds
+    long jitter;    // up to this much more, microseconds
+    double ber;     // per bit
+    double drop;    // per byte
+    double loss;    // per chunk of up to 64 bytes
+} SCENARIO;
+
+static const SCENARIO scenarioList[] = {
+    { "clean",          0,     0, 0,    0,    0 },
+    { "rtt 100",    50000,     0, 0,    0,    0 },
+    { "jitter 50",  50000, 50000, 0,    0,    0 },
+    { "ber 1e-5",   50000,     0, 1e-5, 0,    0 },
+    { "ber 3e-5",   50000,     0, 3e-5, 0,    0 },
+    { "drop 1e-4",  50000,     0, 0,    1e-4, 0 },
+    { "loss 1%",    50000,     0, 0,    0,    0.01 },
+    { "mixed",      50000, 30000, 1e-5, 5e-5, 0.002 },
+};
+static const int scenarioWindows[] = { 1, 8 };
+
+static const long fecRtts[] = { 200000, 1000000 };
+static const double fecBers[] = { 0, 1e-5, 3e-5, 6e-5 };
+static const int fecGroups[] = { 0, 4, 2, XFEC_ADAPTIVE };
+#define FEC_SEEDS 3
+
+static const long asyncWork[] = { 1000000, 3000000, 6000000 };
+static const long baudRtts[] = { 0, 200000 };
+static const long sizeRtts[] = { 0, 100000 };
+static const double sizeBers[] = { 0, 2e-5, 5e-5 };
+static const int blockSizes[] = { 1024, 128, 0 };
+
+#define COUNT(a) ((long)(sizeof(a)/sizeof((a)[0])))
+
+// the impairments transfer() adds to the link besides latency and loss
+static long jitter = 0;
+static double ber = 0, drop = 0;
+
+// the ends of transfer() agree on a rate up to this first, 0 to keep the baud rate
+static long maxBaud = 0;
+
+// what the last transfer() cost each end, the errors the link made and its rate
+static XMODEM_STATS sentStats, receivedStats;
+static long linkErrors, linkBaud;
+
+typedef struct
+{
+    const char* path;
+    int api;
+    int result;
+} RECEIVER;
+
+static void* receiver(void* p)
+{
+    RECEIVER* r = (RECEIVER*)p;
+    int fd = open(r->path, O_RDWR | O_NOCTTY);
+
+    if (fd < 0) {
+        r->result = -1;
+        return NULL;
+    }
+
+    simLinkRaw(fd);
+
+    // the '8' of the offer, the answer reads the rest
+    if (maxBaud) {
+        unsigned char c = 0;
+        while (read(fd, &c, 1) == 1 && c != '8')
+            ;
+        if (c == '8')
+            XBaudAnswer(fd, maxBaud);
+    }
+
+    r->result = (r->api ? XApiReceiveFile(fd, receivedPath, 0664) : XReceive(fd, receivedPath, 0664));
+    XGetStats(&receivedStats);
+    close(fd);
+
+    return NULL;
+}
+
+// plain XMODEM pads the last block with ctrl+z, so the received file may
+// be longer than the sent one
+static int sameFiles(const char* sent, const char* received)
+{
+    FILE* fs = fopen(sent, "rb");
+    FILE* fr = fopen(received, "rb");
+    int cs = 0, cr = 0;
+
+    if (fs && fr) {
+        do {
+            cs = fgetc(fs);
+            cr = fgetc(fr);
+        } while (cs == cr && cs != EOF);
+
+        while (cs == EOF && cr == 0x1a)
+            cr = fgetc(fr);
+    }
+
+    if (fs)
+        fclose(fs);
+    if (fr)
+        fclose(fr);
+
+    return fs && fr && cs == cr;
+}
+
+// one transfer, returns the seconds it took or a negative value on failure
+static double transfer(long baud, long latency, double loss, int ymodem, int window)
+{
+    SIMLINK* link = simLinkCreate(baud);
+    RECEIVER r;
+    pthread_t thread;
+    unsigned long long start;
+    int fd, result;
+
+    if (!link)
+        return -1;
+
+    link->latency = latency;
+    link->loss = loss;
+    link->jitter = jitter;
+    link->ber = ber;
+    link->drop = drop;
+    r.path = link->path[1];
+    r.api = 0;
+    r.result = -1;
+
+    fd = open(link->path[0], O_RDWR | O_NOCTTY);
+    simLinkRaw(fd);
+
+    XSetYmodem(ymodem);
+    XSetWindow(window);
+    start = simMicros();
+    pthread_create(&thread, NULL, receiver, &r);
+    if (maxBaud)
+        XBaudOffer(fd, maxBaud);
+    result = XSend(fd, sentPath);
+    XGetStats(&sentStats);
+    pthread_join(thread, NULL);
+
+    close(fd);
+    linkErrors = link->errors[0] + link->errors[1];
+    linkBaud = link->rate[0] < link->rate[1] ? link->rate[0] : link->rate[1];
+    simLinkDestroy(link);
+
+    if (result || r.result || !sameFiles(sentPath, receivedPath))
+        return -1;
+
+    return (simMicros() - start) / 1e6;
+}
+
+// one transfer over the API mode radios, the loss is per try of a packet
+static double transferApi(long baud, long latency, double loss, long* tries)
+{
+    SIMXBEE* pair = simXbeeCreate(baud, 1);
+    RECEIVER r;
+    pthread_t thread;
+    unsigned long long start;
+    int fd, result;
+
+    if (!pair)
+        return -1;
+
+    pair->latency = latency;
+    pair->loss = loss;
+    r.path = pair->radio[1].path;
+    r.api = 1;
+    r.result = -1;
+
+    fd = open(pair->radio[0].path, O_RDWR | O_NOCTTY);
+    simLinkRaw(fd);
+
+    XApiSetEscaped(1);
+    start = simMicros();
+    pthread_create(&thread, NULL, receiver, &r);
+    result = XApiSendFile(fd, sentPath, NULL);
+    pthread_join(thread, NULL);
+
+    close(fd);
+    *tries = pair->tries;
+    simXbeeDestroy(pair);
+
+    if (result || r.result || !sameFiles(sentPath, receivedPath))
+        return -1;
+
+    return (simMicros() - start) / 1e6;
+}
+
+// the progress records both ends keep for sentPath and receivedPath
+static void clearRecords(void)
+{
+    char record[300];
+
+    XResumeSenderRecord(sentPath, record, sizeof(record));
+    unlink(record);
+    XResumeReceiverRecord(receivedPath, record, sizeof(record));
+    unlink(record);
+    strcat(record, ".part");
+    unlink(record);
+}
+
+// starts a transfer in a child process and kills it after the given
+// seconds, then transfers again. returns the seconds the second session
+// took, and in *kept what the sender's record said was across
+static double resumed(long baud, long latency, int window, double cut, long* kept)
+{
+    unsigned long long start;
+    pid_t pid;
+
+    clearRecords();
+    unlink(receivedPath);
+    *kept = -1; // nothing was sent
+
+    pid = fork();
+    if (pid < 0)
+        return -1;
+
+    if (!pid) {
+        transfer(baud, latency, 0, 1, window);
+        _exit(0);
+    }
+
+    start = simMicros();
+    while (simMicros() - start < cut * 1e6)
+        usleep(1000);
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+
+    *kept = XSendProgress(sentPath);
+
+    return transfer(baud, latency, 0, 1, window);
+}
+
+typedef struct
+{
+    const char* path;
+    int batch;
+    int files;
+} BATCH_RECEIVER;
+
+// waits for the signal byte like xbeeRead, then receives one file or a batch
+static void* batchReceiver(void* p)
+{
+    BATCH_RECEIVER* r = (BATCH_RECEIVER*)p;
+    int fd = open(r->path, O_RDWR | O_NOCTTY);
+    char c, name[64];
+
+    simLinkRaw(fd);
+
+    while (r->files < BATCH_FILES && read(fd, &c, 1) == 1) {
+        if (r->batch && c == '7') {
+            if (!XReceiveBatch(fd, batchDir, 0664, NULL, NULL))
+                r->files = BATCH_FILES;
+            break;
+        } else if (!r->batch && c == '1') {
+            snprintf(name, sizeof(name), "%s/Image%d.jpeg", batchDir, r->files + 1);
+            if (XReceive(fd, name, 0664))
+                break;
+            r->files++;
+        }
+    }
+
+    close(fd);
+    return NULL;
+}
+
+// four files in one session or one session each, returns the seconds
+static double transferBatch(long baud, long latency, int batch)
+{
+    SIMLINK* link = simLinkCreate(baud);
+    BATCH_RECEIVER r;
+    XMODEM_ITEM items[BATCH_FILES];
+    pthread_t thread;
+    unsigned long long start;
+    int fd, i, result = 0;
+
+    if (!link)
+        return -1;
+
+    link->latency = latency;
+    r.path = link->path[1];
+    r.batch = batch;
+    r.files = 0;
+
+    fd = open(link->path[0], O_RDWR | O_NOCTTY);
+    simLinkRaw(fd);
+
+    start = simMicros();
+    pthread_create(&thread, NULL, batchReceiver, &r);
+
+    if (batch) {
+        memset(items, 0, sizeof(items));
+        for (i = 0; i < BATCH_FILES; i++)
+            items[i].szPath = sentPath;
+        write(fd, "7", 1);
+        result = XSendBatch(fd, items, BATCH_FILES);
+    } else {
+        for (i = 0; i < BATCH_FILES && !result; i++) {
+            write(fd, "1", 1);
+            result = XSend(fd, sentPath);
+        }
+    }
+
+    pthread_join(thread, NULL);
+
+    close(fd);
+    simLinkDestroy(link);
+
+    if (result || r.files != BATCH_FILES)
+        return -1;
+
+    return (simMicros() - start) / 1e6;
+}
+
+// the '7' ahead of each batch from the queue
+static void asyncBegin(void* ctx, int fd)
+{
+    write(fd, "7", 1);
+}
+
+// the four files made ready in work microseconds each and sent in one batch
+// after the last of them or from the queue as each one is, returns the seconds
+static double transferAsync(long baud, long work, int async)
+{
+    static const XASYNC_CALLS calls = { asyncBegin, NULL, NULL };
+    SIMLINK* link = simLinkCreate(baud);
+    BATCH_RECEIVER r;
+    XMODEM_ITEM items[BATCH_FILES];
+    XASYNC* queue = NULL;
+    pthread_t thread;
+    unsigned long long start;
+    int fd, i, result = 0;
+
+    if (!link)
+        return -1;
+
+    r.path = link->path[1];
+    r.batch = 1;
+    r.files = 0;
+
+    fd = open(link->path[0], O_RDWR | O_NOCTTY);
+    simLinkRaw(fd);
+
+    memset(items, 0, sizeof(items));
+    for (i = 0; i < BATCH_FILES; i++)
+        items[i].szPath = sentPath;
+
+    // the receiver gives up on a port that is silent for ten seconds
+    // (simLinkRaw), so it starts shortly before the first '7'
+    start = simMicros();
+
+    if (async) {
+        pthread_create(&thread, NULL, batchReceiver, &r);
+        queue = XAsyncOpen(fd, &calls, NULL);
+    }
+
+    for (i = 0; i < BATCH_FILES; i++) {
+        usleep(work);
+        if (queue)
+            XAsyncSend(queue, &items[i], 0);
+    }
+
+    if (!async)
+        pthread_create(&thread, NULL, batchReceiver, &r);
+
+    if (queue) {
+        result = XAsyncClose(queue);
+    } else if (async) {
+        result = -1; // the I/O thread did not start
+    } else {
+        write(fd, "7", 1);
+        result = XSendBatch(fd, items, BATCH_FILES);
+    }
+
+    pthread_join(thread, NULL);
+
+    close(fd);
+    simLinkDestroy(link);
+
+    if (result || r.files != BATCH_FILES)
+        return -1;
+
+    return (simMicros() - start) / 1e6;
+}
+
+// when the receiver's previews of the transfer under way were written
+static XPREVIEW preview;
+static unsigned long long previewStart;
+static double previewSeconds[PREVIEW_SCANS + 1];
+static long previewBytes[PREVIEW_SCANS + 1];
+
+static void previewProgress(void* p, const char* received, const char* name, long done, long size)
+{
+    unsigned long long now = simMicros();
+    int scans = XPreviewUpdate(&preview, received, done, previewPath);
+    int i;
+
+    if (scans == 1) {
+        // kept aside to see that the earliest preview decodes
+        FILE* in = fopen(previewPath, "rb");
+        FILE* out = fopen(firstPreviewPath, "wb");
+        int c;
+        while (in && out && (c = fgetc(in)) != EOF)
+            fputc(c, out);
+        if (in)
+            fclose(in);
+        if (out)
+            fclose(out);
+    }
+
+    // a block can complete more than one scan
+    for (i = 1; i <= scans && i <= PREVIEW_SCANS; i++)
+        if (previewSeconds[i] < 0) {
+            previewSeconds[i] = (now - previewStart) / 1e6;
+            previewBytes[i] = done;
+        }
+}
+
+// a picture with smooth shading, edges and some noise, roughly like a
+// photo of a gusset.  about 'bytes' once it is a JPEG
+static int writePicture(long bytes)
+{
+    FILE* f = fopen(previewBmp, "wb");
+    unsigned char header[54];
+    int width, height, pad, x, y;
+    long pixels = bytes * 8; // a JPEG of this kind of picture is about 1/8 byte per pixel
+
+    if (!f)
+        return -1;
+
+    width = 8;
+    while ((long)width * width * 3 / 4 < pixels)
+        width += 8;
+    height = width * 3 / 4;
+    pad = (4 - width * 3 % 4) % 4;
+
+    memset(header, 0, sizeof(header));
+    header[0] = 'B';
+    header[1] = 'M';
+    for (x = 0; x < 4; x++) {
+        header[2 + x] = (unsigned char)((54 + (long)(width * 3 + pad) * height) >> (8 * x));
+        header[18 + x] = (unsigned char)(width >> (8 * x));
+        header[22 + x] = (unsigned char)(height >> (8 * x));
+    }
+    header[10] = 54;
+    header[14] = 40;
+    header[26] = 1;
+    header[28] = 24;
+    fwrite(header, 1, sizeof(header), f);
+
+    srand(2);
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+            int plate = ((x / (width / 5)) + (y / (height / 4))) % 2;
+            int shade = 60 + 120 * x / width + 40 * y / height;
+            int noise = rand() % 24;
+            fputc(shade / 2 + noise, f);
+            fputc(shade + noise - (plate ? 30 : 0), f);
+            fputc(shade + noise + (plate ? 40 : 0), f);
+        }
+        for (x = 0; x < pad; x++)
+            fputc(0, f);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+// the picture as a JPEG in the file that is sent, returns its size
+static long encodePicture(int progressive)
+{
+    char command[256];
+    struct stat st;
+
+    snprintf(command, sizeof(command), "cjpeg %s%s > %s", progressive ? "-progressive " : "", previewBmp, sentPath);
+    if (system(command) || stat(sentPath, &st))
+        return -1;
+
+    return (long)st.st_size;
+}
+
+// sends the JPEG in the file that is sent with window 8, noting the previews
+static double transferPreview(long baud, long latency)
+{
+    double seconds;
+    int i;
+
+    XPreviewInit(&preview);
+    unlink(previewPath);
+    unlink(firstPreviewPath);
+    for (i = 0; i <= PREVIEW_SCANS; i++) {
+        previewSeconds[i] = -1;
+        previewBytes[i] = 0;
+    }
+
+    XSetProgress(previewProgress, NULL);
+    previewStart = simMicros();
+    seconds = transfer(baud, latency, 0, 1, 8);
+    XSetProgress(NULL, NULL);
+
+    return seconds;
+}
+
+static void blocks(long bytes, long baud)
+{
+    double seconds;
+    int ymodem;
+    long i;
+
+    printf("%-10s %12s %10s %14s %10s\n", "mode", "latency ms", "seconds", "goodput B/s", "of link");
+
+    for (i = 0; i < COUNT(latencies); i++)
+        for (ymodem = 0; ymodem < 2; ymodem++) {
+            seconds = transfer(baud, latencies[i], 0, ymodem, 1);
+
+            if (seconds < 0)
+                printf("%-10s %12ld %10s\n", ymodem ? "YMODEM-1K" : "XMODEM", latencies[i] / 1000, "failed");
+            else
+                printf("%-10s %12ld %10.2f %14.0f %9.0f%%\n", ymodem ? "YMODEM-1K" : "XMODEM",
+                       latencies[i] / 1000, seconds, bytes / seconds, 100.0 * bytes / seconds / (baud / 10.0));
+            fflush(stdout);
+        }
+}
+
+static void window(long bytes, long baud)
+{
+    double seconds;
+    long i, j, k;
+
+    printf("goodput in bytes/s\n%8s %8s", "rtt ms", "loss");
+    for (k = 0; k < COUNT(windows); k++)
+        printf(" %7s%-2d", "window ", windows[k]);
+    printf("\n");
+
+    for (i = 0; i < COUNT(rtts); i++)
+        for (j = 0; j < COUNT(losses); j++) {
+            printf("%8ld %7.1f%%", rtts[i] / 1000, losses[j] * 100);
+            for (k = 0; k < COUNT(windows); k++) {
+                seconds = transfer(baud, rtts[i] / 2, losses[j], 1, windows[k]);
+                if (seconds < 0)
+                    printf(" %9s", "failed");
+                else
+                    printf(" %9.0f", bytes / seconds);
+                fflush(stdout);
+            }
+            printf("\n");
+        }
+}
+
+static void api(long bytes, long baud)
+{
+    double seconds;
+    long i, j, tries;
+
+    printf("%8s %8s %16s %16s %10s\n", "rtt ms", "loss", "window 8 B/s", "api B/s", "RF tries");
+
+    for (i = 0; i < COUNT(rtts); i++)
+        for (j = 0; j < COUNT(losses); j++) {
+            printf("%8ld %7.1f%%", rtts[i] / 1000, losses[j] * 100);
+
+            seconds = transfer(baud, rtts[i] / 2, losses[j], 1, 8);
+            if (seconds < 0)
+                printf(" %16s", "failed");
+            else
+                printf(" %16.0f", bytes / seconds);
+
+            seconds = transferApi(baud, rtts[i] / 2, losses[j], &tries);
+            if (seconds < 0)
+                printf(" %16s\n", "failed");
+            else
+                printf(" %16.0f %10ld\n", bytes / seconds, tries);
+            fflush(stdout);
+        }
+}
+
+static void resume(long bytes, long baud)
+{
+    double full, seconds;
+    long i, j, kept;
+
+    printf("rtt 100 ms, the cut is at a share of the full transfer time\n");
+    printf("%8s %8s %12s %12s %14s %12s\n", "window", "cut", "full s", "kept bytes", "resumed s", "saved");
+
+    for (i = 0; i < COUNT(resumeWindows); i++) {
+        XSetResume(0);
+        full = transfer(baud, 50000, 0, 1, resumeWindows[i]);
+        XSetResume(1);
+
+        for (j = 0; j < COUNT(cuts); j++) {
+            printf("%8d %7.0f%%", resumeWindows[i], cuts[j] * 100);
+
+            if (full < 0) {
+                printf(" %12s\n", "failed");
+                continue;
+            }
+
+            seconds = resumed(baud, 50000, resumeWindows[i], full * cuts[j], &kept);
+            if (seconds < 0)
+                printf(" %12.2f %12ld %14s\n", full, kept, "failed");
+            else
+                printf(" %12.2f %12ld %14.2f %11.0f%%\n", full, kept, seconds, 100 * (1 - seconds / full));
+            fflush(stdout);
+        }
+    }
+
+    clearRecords();
+}
+
+static void batch(long bytes, long baud)
+{
+    double single, batched;
+    long i;
+
+    mkdir(batchDir, 0775);
+    XSetResume(0);
+
+    printf("%d files, window 8\n", BATCH_FILES);
+    printf("%8s %16s %16s %10s\n", "rtt ms", "one by one s", "batch s", "saved");
+
+    for (i = 0; i < COUNT(rtts); i++) {
+        printf("%8ld", rtts[i] / 1000);
+
+        single = transferBatch(baud, rtts[i] / 2, 0);
+        batched = transferBatch(baud, rtts[i] / 2, 1);
+
+        if (single < 0)
+            printf(" %16s", "failed");
+        else
+            printf(" %16.2f", single);
+
+        if (batched < 0)
+            printf(" %16s\n", "failed");
+        else if (single < 0)
+            printf(" %16.2f\n", batched);
+        else
+            printf(" %16.2f %9.0f%%\n", batched, 100 * (1 - batched / single));
+        fflush(stdout);
+    }
+
+    (void)bytes;
+}
+
+static void asyncs(long bytes, long baud)
+{
+    double after, queued;
+    long i;
+
+    mkdir(batchDir, 0775);
+    XSetResume(0);
+
+    printf("%d files, window 8\n", BATCH_FILES);
+    printf("%8s %16s %16s %10s\n", "work s", "after all s", "queued s", "saved");
+
+    for (i = 0; i < COUNT(asyncWork); i++) {
+        printf("%8.0f", asyncWork[i] / 1e6);
+
+        after = transferAsync(baud, asyncWork[i], 0);
+        queued = transferAsync(baud, asyncWork[i], 1);
+
+        if (after < 0)
+            printf(" %16s", "failed");
+        else
+            printf(" %16.2f", after);
+
+        if (queued < 0)
+            printf(" %16s\n", "failed");
+        else if (after < 0)
+            printf(" %16.2f\n", queued);
+        else
+            printf(" %16.2f %9.0f%%\n", queued, 100 * (1 - queued / after));
+        fflush(stdout);
+    }
+
+    (void)bytes;
+}
+
+static void previews(long bytes, long baud)
+{
+    double baseline, complete;
+    long baselineBytes, progressiveBytes, i;
+    int scans;
+
+    XSetResume(0);
+
+    if (writePicture(bytes) || (baselineBytes = encodePicture(0)) < 0) {
+        printf("unable to encode the picture, is cjpeg on the PATH?\n");
+        return;
+    }
+
+    printf("window 8, baseline JPEG %ld bytes\n", baselineBytes);
+    printf("%8s %14s %16s %14s %14s\n", "rtt ms", "baseline s", "first preview s", "3 scans s", "progressive s");
+
+    for (i = 0; i < COUNT(rtts); i++) {
+        encodePicture(0);
+        baseline = transferPreview(baud, rtts[i] / 2);
+
+        progressiveBytes = encodePicture(1);
+        complete = transferPreview(baud, rtts[i] / 2);
+
+        printf("%8ld", rtts[i] / 1000);
+        if (baseline < 0)
+            printf(" %14s", "failed");
+        else
+            printf(" %14.2f", baseline);
+
+        if (complete < 0)
+            printf(" %16s\n", "failed");
+        else
+            printf(" %16.2f %14.2f %14.2f\n", previewSeconds[1], previewSeconds[3], complete);
+        fflush(stdout);
+    }
+
+    // the last run, scan by scan
+    printf("\nprogressive JPEG %ld bytes, rtt %ld ms, the earliest preview %s\n", progressiveBytes,
+           rtts[COUNT(rtts) - 1] / 1000,
+           system("djpeg /tmp/linkbench_first_preview.jpeg > /dev/null 2>&1") ? "does not decode" : "decodes");
+    printf("%8s %12s %10s %10s\n", "scans", "bytes", "seconds", "of total");
+
+    for (scans = 1; scans <= PREVIEW_SCANS && previewSeconds[scans] >= 0; scans++)
+        printf("%8d %12ld %10.2f %9.0f%%\n", scans, previewBytes[scans], previewSeconds[scans],
+               100 * previewSeconds[scans] / complete);
+    printf("%8s %12ld %10.2f %9.0f%%\n", "all", progressiveBytes, complete, 100.0);
+
+    unlink(previewBmp);
+    unlink(previewPath);
+    unlink(firstPreviewPath);
+}
+
+static void scenarios(long bytes, long baud)
+{
+    const SCENARIO* sc;
+    double seconds;
+    long i, k;
+
+    XSetResume(0);
+
+    printf("%-11s %6s %9s %11s %7s %7s %9s %7s %7s\n", "scenario", "window", "seconds", "goodput B/s",
+           "blocks", "resent", "timeouts", "bad", "errors");
+
+    for (i = 0; i < COUNT(scenarioList); i++)
+        for (k = 0; k < COUNT(scenarioWindows); k++) {
+            sc = &scenarioList[i];
+            jitter = sc->jitter;
+            ber = sc->ber;
+            drop = sc->drop;
+
+            seconds = transfer(baud, sc->latency, sc->loss, 1, scenarioWindows[k]);
+
+            printf("%-11s %6d", sc->name, scenarioWindows[k]);
+            if (seconds < 0)
+                printf(" %9s %11s", "failed", "");
+            else
+                printf(" %9.2f %11.0f", seconds, bytes / seconds);
+            printf(" %7ld %7ld %9ld %7ld %7ld\n", sentStats.lBlocks, sentStats.lResent,
+                   sentStats.lTimeouts + receivedStats.lTimeouts, receivedStats.lBad, linkErrors);
+            fflush(stdout);
+        }
+
+    jitter = 0;
+    ber = drop = 0;
+}
+
+static void fec(long bytes, long baud)
+{
+    double seconds, goodput;
+    long resent, timeouts, parity, rebuilt;
+    long i, j, k, seed, runs;
+    char value[16];
+
+    XSetResume(0);
+
+    printf("window 8, the mean of %d links\n", FEC_SEEDS);
+    printf("%7s %7s %9s %11s %7s %9s %7s %8s\n", "rtt ms", "ber", "parity", "goodput B/s",
+           "resent", "timeouts", "parity", "rebuilt");
+
+    for (i = 0; i < COUNT(fecRtts); i++)
+        for (j = 0; j < COUNT(fecBers); j++)
+            for (k = 0; k < COUNT(fecGroups); k++) {
+                ber = fecBers[j];
+                XSetFec(fecGroups[k]);
+                goodput = 0;
+                resent = timeouts = parity = rebuilt = runs = 0;
+
+                for (seed = 1; seed <= FEC_SEEDS; seed++) {
+                    snprintf(value, sizeof(value), "%ld", seed * 7919);
+                    setenv("SIM_SEED", value, 1);
+
+                    seconds = transfer(baud, fecRtts[i] / 2, 0, 1, 8);
+                    if (seconds < 0)
+                        continue;
+
+                    goodput += bytes / seconds;
+                    resent += sentStats.lResent;
+                    timeouts += sentStats.lTimeouts + receivedStats.lTimeouts;
+                    parity += sentStats.lParity;
+                    rebuilt += receivedStats.lRepaired;
+                    runs++;
+                }
+
+                printf("%7ld %7.0e", fecRtts[i] / 1000, ber);
+                if (fecGroups[k] == XFEC_ADAPTIVE)
+                    printf(" %9s", "adaptive");
+                else if (!fecGroups[k])
+                    printf(" %9s", "none");
+                else
+                    printf(" %6s %-2d", "every", fecGroups[k]);
+                if (runs < FEC_SEEDS)
+                    printf(" %6ld failed\n", FEC_SEEDS - runs);
+                else
+                    printf(" %11.0f %7.1f %9.1f %7.1f %8.1f\n", goodput / runs, (double)resent / runs,
+                           (double)timeouts / runs, (double)parity / runs, (double)rebuilt / runs);
+                fflush(stdout);
+            }
+
+    unsetenv("SIM_SEED");
+    XSetFec(XFEC_ADAPTIVE);
+    ber = 0;
+}
+
+static void bauds(long bytes, long baud)
+{
+    double seconds, goodput;
+    long resent, timeouts;
+    long i, j, k, seed, runs;
+    char value[16];
+
+    XSetResume(0);
+
+    printf("%7s %10s %10s %9s %11s\n", "rtt ms", "offered", "used", "seconds", "goodput B/s");
+
+    for (i = 0; i < COUNT(baudRtts); i++)
+        for (k = 0; k < 2; k++) {
+            maxBaud = k ? XBAUD_MAX : 0;
+            seconds = transfer(baud, baudRtts[i] / 2, 0, 1, 8);
+
+            printf("%7ld %10ld", baudRtts[i] / 1000, k ? (long)XBAUD_MAX : baud);
+            if (seconds < 0)
+                printf(" %10s %9s\n", "", "failed");
+            else
+                printf(" %10ld %9.2f %11.0f\n", linkBaud, seconds, bytes / seconds);
+            fflush(stdout);
+        }
+
+    maxBaud = 0;
+
+    printf("\nstop-and-wait, the mean of %d links\n", FEC_SEEDS);
+    printf("%7s %7s %9s %11s %7s %9s\n", "rtt ms", "ber", "block", "goodput B/s", "resent", "timeouts");
+
+    for (i = 0; i < COUNT(sizeRtts); i++)
+        for (j = 0; j < COUNT(sizeBers); j++)
+            for (k = 0; k < COUNT(blockSizes); k++) {
+                ber = sizeBers[j];
+                XSetBlockSize(blockSizes[k]);
+                goodput = 0;
+                resent = timeouts = runs = 0;
+
+                for (seed = 1; seed <= FEC_SEEDS; seed++) {
+                    snprintf(value, sizeof(value), "%ld", seed * 7919);
+                    setenv("SIM_SEED", value, 1);
+
+                    seconds = transfer(baud, sizeRtts[i] / 2, 0, 1, 1);
+                    if (seconds < 0)
+                        continue;
+
+                    goodput += bytes / seconds;
+                    resent += sentStats.lResent;
+                    timeouts += sentStats.lTimeouts + receivedStats.lTimeouts;
+                    runs++;
+                }
+
+                printf("%7ld %7.0e", sizeRtts[i] / 1000, ber);
+                if (blockSizes[k])
+                    printf(" %9d", blockSizes[k]);
+                else
+                    printf(" %9s", "adaptive");
+                if (runs < FEC_SEEDS)
+                    printf(" %6ld failed\n", FEC_SEEDS - runs);
+                else
+                    printf(" %11.0f %7.1f %9.1f\n", goodput / runs, (double)resent / runs,
+                           (double)timeouts / runs);
+                fflush(stdout);
+            }
+
+    unsetenv("SIM_SEED");
+    XSetBlockSize(0);
+    ber = 0;
+}
+
+int main(int argc, char* argv[])
+{
+    int sweepWindow = (argc > 1 && !strcmp(argv[1], "window"));
+    int sweepApi = (argc > 1 && !strcmp(argv[1], "api"));
+    int sweepResume = (argc > 1 && !strcmp(argv[1], "resume"));
+    int sweepBatch = (argc > 1 && !strcmp(argv[1], "batch"));
+    int sweepPreview = (argc > 1 && !strcmp(argv[1], "preview"));
+    int sweepScenarios = (argc > 1 && !strcmp(argv[1], "scenarios"));
+    int sweepFec = (argc > 1 && !strcmp(argv[1], "fec"));
+    int sweepBaud = (argc > 1 && !strcmp(argv[1], "baud"));
+    int sweepAsync = (argc > 1 && !strcmp(argv[1], "async"));
+    long bytes = (argc > 2 ? atol(argv[2]) : 16300);
+    long baud = (argc > 3 ? atol(argv[3]) : 57600);
+    FILE* f = fopen(sentPath, "wb");
+    long i;
+
+    if (!f) {
+        printf("unable to create %s\n", sentPath);
+        return 1;
+    }
+
+    // random data, the default size leaves a short last block
+    srand(1);
+    for (i = 0; i < bytes; i++)
+        fputc(rand() & 0xFF, f);
+    fclose(f);
+
+    printf("%ld bytes at %ld baud, link limit %.0f bytes/s\n", bytes, baud, baud / 10.0);
+
+    if (sweepWindow)
+        window(bytes, baud);
+    else if (sweepApi)
+        api(bytes, baud);
+    else if (sweepResume)
+        resume(bytes, baud);
+    else if (sweepBatch)
+        batch(bytes, baud);
+    else if (sweepPreview)
+        previews(bytes, baud);
+    else if (sweepScenarios)
+        scenarios(bytes, baud);
+    else if (sweepFec)
+        fec(bytes, baud);
+    else if (sweepBaud)
+        bauds(bytes, baud);
+    else if (sweepAsync)
+        asyncs(bytes, baud);
+    else
+        blocks(bytes, baud);
+
+    unlink(sentPath);
+    unlink(receivedPath);
+
+    return 0;
+}
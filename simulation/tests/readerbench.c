@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+#include "simlink.h"
+#include "sim.h"
+#include "xreader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+
+/* Compares the CPU time and latency of reading xmodem blocks with the
+buffered reader against the one byte read() and usleep(1000) loop it
+replaced, over a pseudo-terminal.
+
+usage: readerbench [blocks] [baud]
+
+A writer thread delivers 133 byte blocks the way the radio does, a few
+bytes at a time at the baud rate with a pause between blocks, and notes
+when the last byte went out. The reader notes when it has the block.
+*/
+
+#define BLOCK 133
+#define PAUSE 20000 /* microseconds between blocks, like an ACK turnaround */
+
+typedef struct
+{
+    int fd;
+    long blocks, baud;
+    unsigned long long* sent; // when the last byte of each block was written
+} WRITER;
+
+static void* writer(void* p)
+{
+    WRITER* w = (WRITER*)p;
+    unsigned char block[BLOCK];
+    long i, j, chunk = w->baud / 10 / 1000 * 4; // bytes in 4 ms
+
+    if (chunk < 1)
+        chunk = 1;
+
+    memset(block, 0x55, sizeof(block));
+
+    for (i = 0; i < w->blocks; i++) {
+        usleep(PAUSE);
+
+        for (j = 0; j < BLOCK; j += chunk) {
+            if (j)
+                usleep(chunk * 10 * 1000000 / w->baud);
+            if (write(w->fd, block + j, (j + chunk > BLOCK ? BLOCK - j : chunk)) < 0)
+                return NULL;
+        }
+
+        w->sent[i] = simMicros();
+    }
+
+    return NULL;
+}
+
+// the reader xmodem used before, kept here as the reference
+static int legacyRead(int fd, unsigned char* buf, int size)
+{
+    unsigned long long start = simMicros();
+    int n = 0, r;
+
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+
+    while (n < size) {
+        while ((r = read(fd, buf + n, 1)) != 1) {
+            if (r < 0 && errno != EAGAIN)
+                return n;
+
+            usleep(1000); // 1 msec
+            if (simMicros() - start > 50000000ULL)
+                return n;
+        }
+        n++;
+    }
+
+    return n;
+}
+
+static double threadSeconds(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run(const char* name, int buffered, long blocks, long baud)
+{
+    int master = posix_openpt(O_RDWR | O_NOCTTY), fd;
+    unsigned long long* sent = (unsigned long long*)calloc(blocks, sizeof(unsigned long long));
+    unsigned long long* received = (unsigned long long*)calloc(blocks, sizeof(unsigned long long));
+    unsigned char buf[BLOCK];
+    double cpu, latency = 0, worst = 0, wall;
+    unsigned long long start;
+    pthread_t thread;
+    XREADER reader;
+    WRITER w;
+    long i;
+
+    grantpt(master);
+    unlockpt(master);
+    fd = open(ptsname(master), O_RDWR | O_NOCTTY);
+    simLinkRaw(fd);
+    XReaderInit(&reader, fd);
+
+    w.fd = master;
+    w.blocks = blocks;
+    w.baud = baud;
+    w.sent = sent;
+
+    start = simMicros();
+    cpu = threadSeconds();
+    pthread_create(&thread, NULL, writer, &w);
+
+    for (i = 0; i < blocks; i++) {
+        if ((buffered ? XReaderRead(&reader, buf, BLOCK, 5000) : legacyRead(fd, buf, BLOCK)) != BLOCK)
+            break;
+        received[i] = simMicros();
+    }
+
+    cpu = threadSeconds() - cpu;
+    wall = (simMicros() - start) / 1e6;
+    pthread_join(thread, NULL);
+
+    for (i = 0; i < blocks; i++) {
+        double l = (received[i] > sent[i] ? received[i] - sent[i] : 0) / 1000.0;
+        latency += l;
+        if (l > worst)
+            worst = l;
+    }
+
+    printf("%-10s %10.3f %9.1f%% %12.3f %12.3f\n", name, cpu, 100 * cpu / wall, latency / blocks, worst);
+
+    close(fd);
+    close(master);
+    free(sent);
+    free(received);
+}
+
+int main(int argc, char* argv[])
+{
+    long blocks = (argc > 1 ? atol(argv[1]) : 200);
+    long baud = (argc > 2 ? atol(argv[2]) : 57600);
+
+    printf("%ld blocks of %d bytes at %ld baud\n", blocks, BLOCK, baud);
+    printf("%-10s %10s %10s %12s %12s\n", "reader", "cpu s", "of wall", "latency ms", "worst ms");
+
+    run("usleep", 0, blocks, baud);
+    run("poll", 1, blocks, baud);
+
+    return 0;
+}
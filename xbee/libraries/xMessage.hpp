@@ -2,31 +2,35 @@
 #define XMESSAGE_HPP
 
 #include "xSerial.hpp"
+#include "xlog.h"
+#include <poll.h>
 
 //class for xbee to send messages
 class Message{
   private:
-	//USB device port from constructor
-	char* device;
+	//serial session shared with the xmodem transfers
+	Serial& xbee;
 	void sendMessage(char);
   public:
-	Message(char*);
+	Message(Serial&);
 	int sendConfigReport();
 	void receiveConfigReport();
 	int sendTimeSync();
-	void receiveLog();
+	int negotiateBaud(int);
+	int receiveLog(const char*);
+	bool answerLogRequest(const char*, int);
 	void sendingImage();
+	void sendingBatch();
 	void receiveReady();
 };
 
-Message::Message(char* dev){
-	this->device = dev;
+Message::Message(Serial& serial) : xbee(serial){
 }
 
 
 void Message::sendMessage(char type){
-        Serial xbee(this->device, 57600);
         xbee.PutChar(type);
+        xbee.Flush();
 }
 
 int Message::sendConfigReport(){
@@ -46,15 +50,39 @@ int Message::sendTimeSync(){
 	return 0;
 }
 
-void Message::receiveLog(){
+//offers the base station a faster serial rate for this session ('8', see
+//xbaud.h), returns the rate in use afterwards
+int Message::negotiateBaud(int maxBaud){
+	return XBaudOffer(xbee.Fd(), maxBaud);
+}
+
+//base station: asks the field unit for its link log (see xlog.h) and
+//receives it into path, returns what XReceive did.  after a batch, the
+//field unit only hears the request once XLOG_ASK ms have passed
+int Message::receiveLog(const char* path){
 	sendMessage('5');
-	//wait to receive logfile
+	return XReceive(xbee.Fd(), path, 0664);
+}
+
+//field unit: sends the link log at path if the base station asks for it
+//within wait ms, false if it did not ask or the log did not go across
+bool Message::answerLogRequest(const char* path, int wait){
+	struct pollfd radio = { xbee.Fd(), POLLIN, 0 };
+	int c = 0;
+	while(c >= 0 && c != '5' && poll(&radio, 1, wait) > 0)
+		c = xbee.GetChar();
+	return c == '5' && XSend(xbee.Fd(), path) == 0;
 }
 
 void Message::sendingImage(){
 	sendMessage('1');
 }
 
+//a YMODEM batch of images follows, see XSendBatch
+void Message::sendingBatch(){
+	sendMessage('7');
+}
+
 void Message::receiveReady(){
 	sendMessage('2');
 }
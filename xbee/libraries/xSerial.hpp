@@ -4,113 +4,195 @@
 #include <sstream>
 #include <wiringSerial.h>
 #include <unistd.h>
+#include <errno.h>
 #include <iostream>
 #include <string.h>
-#include "xmodem.c"
+#include "xmodem.h"
+#include "xbaud.h"
 #include <stdio.h>
 
-//class for xbee serial communication
+//class for xbee serial communication. the port is opened once by the
+//constructor and closed by the destructor, writes are buffered until
+//Flush() or until something is read back
 class Serial {
   private:
 	char* device;
 	int baud;
 	int fd;
+	//bytes written but not sent yet
+	char out[256];
+	size_t pending;
   public:
-	//constructor
+	//constructor, opens the serial port
 	Serial(char*, int);
-	//opens serial port
+	//destructor, sends anything buffered and closes the port
+	~Serial();
+	//one object per open port, a copy would close it twice
+	Serial(const Serial&) = delete;
+	Serial& operator=(const Serial&) = delete;
+	//opens serial port if it is not open yet, returns the descriptor or 0
 	int Open();
-	//closes serial port
+	//sends anything buffered and closes serial port
 	void Close();
+	//descriptor for the xmodem functions, anything buffered is sent first
+	int Fd();
+	//sends the buffered bytes, false on error
+	bool Flush();
+	//rate the port runs at
+	int GetBaud();
+	//puts the radio and then the port on another rate, false if the
+	//radio did not take it
+	bool SetBaud(int);
 	//sends single byte across serial port
 	void  PutChar (unsigned char c);
 	//send nul-terminated string across serial port
 	void  PutMsg (char *s);
 	//returns number of characters available for reading -1 for error
 	int   DataAvail ();
-	//returns next character available on serial device
+	//returns next character available on serial device, -1 if there is none
 	int   GetChar ();
 	//discards all data received waiting to be sent down the port
 	void  FlushData ();
 	//reads number of bytes of data
 	size_t Read(void *buf, size_t count);
 	//writes count num of bytes starting at buf
-	size_t Write(const void *buf, size_t count); 
+	size_t Write(const void *buf, size_t count);
 };
 
 Serial::Serial(char* usbDevice, int baudRate){
-	this->device = usbDevice;
-	this->baud   = baudRate;
+	this->device  = usbDevice;
+	this->baud    = baudRate;
+	this->fd      = -1;
+	this->pending = 0;
+	Open();
+}
+
+Serial::~Serial(){
+	if(this->fd >= 0){
+		Close();
+	}
 }
 
 int	Serial::Open (){
+		if(this->fd >= 0){
+			return this->fd;
+		}
+
 	        if ((this->fd = serialOpen (this->device, this->baud)) < 0)
 	        {
 			std::cout << "Unable to open serial device\n";
+			this->fd = -1;
        		   	return 0 ;
         	}
-		else
-		{
-			this->fd = serialOpen(this->device, this->baud);
-			return this->fd;
-	  	}
+
+		return this->fd;
 	}
 
 void 	Serial::Close(){
+		Flush();
+		//the radio stays on the rate it was put on
+		this->baud = GetBaud();
 		std::cout << "Serial port closed\n";
 		serialClose(this->fd);
+		this->fd = -1;
 	}
 
-void    Serial::PutChar(unsigned char c){
-		if(Open()){
-			serialPutchar(this->fd, c);
+int	Serial::Fd(){
+		Flush();
+		return this->fd;
+	}
+
+bool	Serial::Flush(){
+		size_t sent = 0;
+
+		while(sent < this->pending && this->fd >= 0){
+			ssize_t n = write(this->fd, this->out + sent, this->pending - sent);
+			if(n < 0 && errno == EINTR){
+				continue;
+			}
+			if(n <= 0){
+				std::cout << "Serial write failed\n";
+				this->pending = 0;
+				return false;
+			}
+			sent += n;
 		}
-		else{
-			std::cout << "Serial port not open\n";
+
+		this->pending = 0;
+		return this->fd >= 0;
+	}
+
+int	Serial::GetBaud(){
+		long rate = (this->fd >= 0 ? XBaudPort(this->fd) : 0);
+		return rate ? rate : this->baud;
+	}
+
+bool	Serial::SetBaud(int baudRate){
+		if(Fd() < 0 || XBaudSet(this->fd, baudRate)){
+			return false;
 		}
+		this->baud = baudRate;
+		return true;
+	}
+
+void    Serial::PutChar(unsigned char c){
+		Write(&c, 1);
 	}
 
 void    Serial::PutMsg (char *s){
-		if(Open()){
-			serialPuts(this->fd, s);
-		}
-        	else{
-        		std::cout << "Serial port not open\n";
-        	}
+		Write(s, strlen(s));
 	}
 
 int     Serial::DataAvail (){
-		if(serialDataAvail(this->fd) > 0){
-		return serialDataAvail(this->fd);
+		if(Fd() < 0){
+			return -1;
 		}
+		return serialDataAvail(this->fd);
 	}
 
 int	Serial::GetChar(){
-		if(serialDataAvail(this->fd) > 0){
-		return serialGetchar(this->fd);
+		if(DataAvail() > 0){
+			return serialGetchar(this->fd);
 		}
+		return -1;
 	}
 
 void	Serial::FlushData (){
-		serialFlush(this->fd);
+		this->pending = 0;
+		if(this->fd >= 0){
+			serialFlush(this->fd);
+		}
 	}
 
 size_t  Serial::Read(void *buf, size_t count){
-		if(Open()){
-			return read(this->fd, buf, count);
+		if(Fd() < 0){
+			std::cout << "Serial port not open\n";
+			return 0;
 		}
-        	else{
-        		std::cout << "Serial port not open\n";
-        	}
+
+		ssize_t n = read(this->fd, buf, count);
+		return n < 0 ? 0 : n;
 	}
 
 size_t  Serial::Write(const void *buf, size_t count){
-		if(Open()){
-			return write(this->fd, buf, count);
+		if(this->fd < 0){
+			std::cout << "Serial port not open\n";
+			return 0;
 		}
-        	else{
-        		std::cout << "Serial port not open\n";
-        	}
+
+		if(this->pending + count > sizeof(this->out)){
+			Flush();
+		}
+
+		//too big to buffer, goes straight out
+		if(count >= sizeof(this->out)){
+			ssize_t n = write(this->fd, buf, count);
+			return n < 0 ? 0 : n;
+		}
+
+		memcpy(this->out + this->pending, buf, count);
+		this->pending += count;
+		return count;
 	}
 
 #endif
@@ -0,0 +1,383 @@
+#include "xmodem.h"
+#include "xasync.h"
+#include "xreader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+// a file waiting in the queue
+typedef struct _XASYNC_ENTRY_
+{
+  XMODEM_ITEM *pItem;      ///< the file
+  int iPriority;           ///< lower goes first
+  long lSize;              ///< bytes still to send
+  unsigned long ulSeq;     ///< order of arrival among equals
+} XASYNC_ENTRY;
+
+struct _XASYNC_
+{
+  int fd;                  ///< the serial port, the thread's until it ends
+  XASYNC_CALLS calls;      ///< what to tell the caller
+  void *pCtx;              ///< passed to the calls
+
+  pthread_t thread;        ///< the I/O thread
+  pthread_mutex_t mutex;   ///< guards what follows
+  pthread_cond_t cond;     ///< signaled when a file comes, the queue closes or the deadline moves
+
+  XASYNC_ENTRY *aQueue;    ///< files not sent yet, in no order
+  int cQueue;              ///< room in aQueue
+  int nQueue;              ///< how many
+  unsigned long ulSeq;     ///< for the next one
+  int bClosed;             ///< XAsyncClose was called
+  int bDeadline;           ///< XAsyncDeadline was called
+  unsigned long ulDeadline; ///< XReaderMillis by which files are to be across
+
+  unsigned long ulTaken;   ///< when the file being sent was taken
+  long lSent;              ///< bytes of the files that went across
+  unsigned long ulSent;    ///< ms they took, header and all
+  int nFailed;             ///< failed batches in a row
+  int iResult;             ///< the first failure
+};
+
+// bytes of a file, or of what is left of a stream that broke off
+static long ItemSize(XMODEM_ITEM *pItem)
+{
+struct stat st;
+
+  if(pItem->pStream)
+  {
+    return pItem->pStream->lSize - pItem->pStream->lDone;
+  }
+
+  return stat(pItem->szPath, &st) ? 0 : (long)st.st_size; // XSendQueue finds out
+}
+
+// puts a file in the queue, called with the mutex held.  0 or -1 if there
+// was no memory
+static int Queue(XASYNC *pA, XMODEM_ITEM *pItem, int iPriority)
+{
+XASYNC_ENTRY *aNew;
+int cNew;
+
+  if(pA->nQueue >= pA->cQueue)
+  {
+    cNew = pA->cQueue * 2 + 8;
+    aNew = (XASYNC_ENTRY *)realloc(pA->aQueue, cNew * sizeof(*aNew));
+    if(!aNew)
+    {
+      return -1;
+    }
+
+    pA->aQueue = aNew;
+    pA->cQueue = cNew;
+  }
+
+  pA->aQueue[pA->nQueue].pItem = pItem;
+  pA->aQueue[pA->nQueue].iPriority = iPriority;
+  pA->aQueue[pA->nQueue].lSize = ItemSize(pItem);
+  pA->aQueue[pA->nQueue].ulSeq = pA->ulSeq++;
+  pA->nQueue++;
+
+  return 0;
+}
+
+// whether lSize bytes go across before the deadline at the rate seen so
+// far.  the first file is given the benefit of the doubt
+static int Fits(XASYNC *pA, long lSize)
+{
+long lLeft = (long)(pA->ulDeadline - XReaderMillis());
+
+  if(!pA->bDeadline)
+  {
+    return 1;
+  }
+
+  if(lLeft <= 0)
+  {
+    return 0;
+  }
+
+  return pA->lSent <= 0 || (double)lSize * pA->ulSent / pA->lSent <= lLeft;
+}
+
+// the entry to send next: the lowest priority, then the smallest, then
+// the first to come, of those that fit.  -1 if none does.  called with
+// the mutex held
+static int Pick(XASYNC *pA)
+{
+XASYNC_ENTRY *pE, *pBest = NULL;
+int i1;
+
+  for(i1=0; i1 < pA->nQueue; i1++)
+  {
+    pE = pA->aQueue + i1;
+
+    if(pBest &&
+       (pE->iPriority > pBest->iPriority ||
+        (pE->iPriority == pBest->iPriority &&
+         (pE->lSize > pBest->lSize || (pE->lSize == pBest->lSize && pE->ulSeq > pBest->ulSeq)))))
+    {
+      continue;
+    }
+
+    if(Fits(pA, pE->lSize))
+    {
+      pBest = pE;
+    }
+  }
+
+  return pBest ? (int)(pBest - pA->aQueue) : -1;
+}
+
+// takes an entry off the queue, called with the mutex held
+static XMODEM_ITEM *Take(XASYNC *pA, int iEntry)
+{
+XMODEM_ITEM *pItem = pA->aQueue[iEntry].pItem;
+
+  pA->aQueue[iEntry] = pA->aQueue[--pA->nQueue];
+
+  return pItem;
+}
+
+// a file is as sent as it is going to be
+static void Settle(XASYNC *pA, XMODEM_ITEM *pItem)
+{
+  if(pItem->iResult && !pA->iResult)
+  {
+    pA->iResult = pItem->iResult;
+  }
+
+  if(pA->calls.pfnDone)
+  {
+    pA->calls.pfnDone(pA->pCtx, pItem);
+  }
+}
+
+// waits until ulAt or until the cond is signaled, with the mutex held.
+// 0 once ulAt has passed
+static int WaitUntil(XASYNC *pA, unsigned long ulAt)
+{
+long lLeft = (long)(ulAt - XReaderMillis());
+struct timespec ts;
+
+  if(lLeft <= 0)
+  {
+    return 0;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ts.tv_sec += lLeft / 1000;
+  ts.tv_nsec += (lLeft % 1000) * 1000000L;
+  if(ts.tv_nsec >= 1000000000L)
+  {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
+
+  return pthread_cond_timedwait(&(pA->cond), &(pA->mutex), &ts) == 0;
+}
+
+// XMODEM_NEXT of the batch: waits for a file that fits until the queue
+// closes or nothing comes for XASYNC_IDLE ms
+static XMODEM_ITEM *NextItem(void *pCtx)
+{
+XASYNC *pA = (XASYNC *)pCtx;
+XMODEM_ITEM *pItem = NULL;
+unsigned long ulIdle = XReaderMillis() + XASYNC_IDLE;
+int iEntry;
+
+  pthread_mutex_lock(&(pA->mutex));
+
+  while((iEntry = Pick(pA)) < 0 && !pA->bClosed && WaitUntil(pA, ulIdle))
+  {
+  }
+
+  if(iEntry >= 0)
+  {
+    pItem = Take(pA, iEntry);
+    pA->ulTaken = XReaderMillis();
+  }
+
+  pthread_mutex_unlock(&(pA->mutex));
+
+  return pItem;
+}
+
+// XMODEM_SENT of the batch: a file that broke off goes first in the next
+// batch if the receiver kept some of it and there will be one
+static void SentItem(void *pCtx, XMODEM_ITEM *pItem)
+{
+XASYNC *pA = (XASYNC *)pCtx;
+long lDone;
+int iRval = -1;
+
+  if(!pItem->iResult)
+  {
+    pA->lSent += pItem->pStream ? pItem->pStream->lSize : ItemSize(pItem);
+    pA->ulSent += XReaderMillis() - pA->ulTaken;
+  }
+  else
+  {
+    lDone = pItem->pStream ? pItem->pStream->lDone : XSendProgress(pItem->szPath);
+
+    if(lDone > 0 && pA->nFailed < XASYNC_RETRIES)
+    {
+      pthread_mutex_lock(&(pA->mutex));
+      iRval = Queue(pA, pItem, INT_MIN);
+      pthread_mutex_unlock(&(pA->mutex));
+    }
+
+    if(!iRval)
+    {
+      pItem->iResult = -10; // not sent yet
+      return;
+    }
+  }
+
+  Settle(pA, pItem);
+}
+
+static void *AsyncThread(void *pParam)
+{
+XASYNC *pA = (XASYNC *)pParam;
+XMODEM_ITEM *pItem;
+int iRval;
+
+  for(;;)
+  {
+    pthread_mutex_lock(&(pA->mutex));
+
+    // a file that fits, or the end.  the deadline leaves files that do
+    // not fit waiting for XAsyncClose
+    while(Pick(pA) < 0 && !pA->bClosed)
+    {
+      pthread_cond_wait(&(pA->cond), &(pA->mutex));
+    }
+
+    if(Pick(pA) < 0 || pA->nFailed > XASYNC_RETRIES) // closed, or the link is gone
+    {
+      if(!pA->nQueue)
+      {
+        pthread_mutex_unlock(&(pA->mutex));
+        break;
+      }
+
+      pItem = Take(pA, 0);
+      pthread_mutex_unlock(&(pA->mutex));
+
+      Settle(pA, pItem); // not sent, iResult is still -10
+      continue;
+    }
+
+    pthread_mutex_unlock(&(pA->mutex));
+
+    if(pA->calls.pfnBegin)
+    {
+      pA->calls.pfnBegin(pA->pCtx, pA->fd);
+    }
+
+    iRval = XSendQueue(pA->fd, NextItem, SentItem, pA);
+
+    if(pA->calls.pfnEnd)
+    {
+      pA->calls.pfnEnd(pA->pCtx, pA->fd, iRval);
+    }
+
+    pA->nFailed = iRval ? pA->nFailed + 1 : 0;
+  }
+
+  return NULL;
+}
+
+XASYNC *XAsyncOpen(int fd, const XASYNC_CALLS *pCalls, void *pCtx)
+{
+pthread_condattr_t attr;
+XASYNC *pA;
+
+  pA = (XASYNC *)calloc(1, sizeof(*pA));
+  if(!pA)
+  {
+    return NULL;
+  }
+
+  pA->fd = fd;
+  pA->pCtx = pCtx;
+  if(pCalls)
+  {
+    pA->calls = *pCalls;
+  }
+
+  // the waits are not to jump with the clock
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&(pA->cond), &attr);
+  pthread_condattr_destroy(&attr);
+  pthread_mutex_init(&(pA->mutex), NULL);
+
+  if(pthread_create(&(pA->thread), NULL, AsyncThread, pA))
+  {
+    pthread_cond_destroy(&(pA->cond));
+    pthread_mutex_destroy(&(pA->mutex));
+    free(pA);
+    return NULL;
+  }
+
+  return pA;
+}
+
+int XAsyncSend(XASYNC *pA, XMODEM_ITEM *pItem, int iPriority)
+{
+int iRval = -1;
+
+  pItem->iResult = -10; // not sent
+
+  pthread_mutex_lock(&(pA->mutex));
+
+  if(!pA->bClosed)
+  {
+    iRval = Queue(pA, pItem, iPriority);
+    pthread_cond_signal(&(pA->cond));
+  }
+
+  pthread_mutex_unlock(&(pA->mutex));
+
+  return iRval;
+}
+
+void XAsyncDeadline(XASYNC *pA, unsigned long ulMillis)
+{
+  pthread_mutex_lock(&(pA->mutex));
+
+  pA->bDeadline = 1;
+  pA->ulDeadline = XReaderMillis() + ulMillis;
+  pthread_cond_signal(&(pA->cond));
+
+  pthread_mutex_unlock(&(pA->mutex));
+}
+
+int XAsyncClose(XASYNC *pA)
+{
+int iRval;
+
+  pthread_mutex_lock(&(pA->mutex));
+  pA->bClosed = 1;
+  pthread_cond_signal(&(pA->cond));
+  pthread_mutex_unlock(&(pA->mutex));
+
+  pthread_join(pA->thread, NULL);
+
+  iRval = pA->iResult;
+
+  pthread_cond_destroy(&(pA->cond));
+  pthread_mutex_destroy(&(pA->mutex));
+  free(pA->aQueue);
+  free(pA);
+
+  fprintf(stderr, "XAsyncClose returns %d\n", iRval);
+  return iRval;
+}
@@ -0,0 +1,70 @@
+#ifndef XASYNC_H
+#define XASYNC_H
+
+#include "xmodem.h"
+
+/* Transfers that go on beside the caller.
+
+XAsyncOpen starts a thread that owns the serial port from then on and
+sends what XAsyncSend hands it with XSendQueue.  XAsyncSend returns at
+once, so the caller can make the next file ready while the radio carries
+the last one.  Files that come while a batch is open go in it; the batch
+is closed once the queue has been empty for XASYNC_IDLE ms, well before
+the receiver stops asking for the next header, and the next file opens a
+new one.
+
+Of the files waiting, the one with the lowest priority number goes next,
+then the smallest, then the first to come.  After XAsyncDeadline only
+files that go across in the time left at the rate seen so far are
+started, the one under way is finished.  The rest wait for XAsyncClose,
+which hands them back unsent.
+
+When a batch fails, the file it broke off in goes first in the next one if
+the receiver kept some of it, so that it resumes.  The files behind it
+wait for that batch as well.  After XASYNC_RETRIES failed batches in a row
+the link is given up on, and whatever is left or comes later fails.
+
+The callbacks are all made on the I/O thread, where XGetStats describes
+the batch that just ended.  The port is the thread's until XAsyncClose
+returns, the callbacks may use it but the caller may not.
+*/
+
+#define XASYNC_IDLE 60000 /* ms with nothing to send before a batch is closed */
+#define XASYNC_RETRIES 2  /* failed batches in a row before giving up */
+
+typedef struct _XASYNC_ XASYNC;
+
+typedef struct _XASYNC_CALLS_
+{
+  void (*pfnBegin)(void *pCtx, int fd);                    ///< before each batch, to announce it, may be NULL
+  void (*pfnEnd)(void *pCtx, int fd, int iResult);         ///< after each batch with what XSendQueue returned, may be NULL
+  void (*pfnDone)(void *pCtx, XMODEM_ITEM *pItem);         ///< each file once its iResult is final, may be NULL
+} XASYNC_CALLS;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// starts the I/O thread on fd.  pCalls is copied.  NULL if it could not
+// be started
+XASYNC *XAsyncOpen(int fd, const XASYNC_CALLS *pCalls, void *pCtx);
+
+// queues a file, lower iPriority first.  the item and what it points to
+// must stay until pfnDone has it, its iResult is -10 until then.  0, or
+// -1 once the queue is closed
+int XAsyncSend(XASYNC *pA, XMODEM_ITEM *pItem, int iPriority);
+
+// files are to be across within ulMillis from now, see above
+void XAsyncDeadline(XASYNC *pA, unsigned long ulMillis);
+
+// no more files: waits until the queue is sent, or what does not fit
+// before the deadline is left, and the thread has ended, then frees pA.
+// every file has been through pfnDone, those left with iResult -10.  0 or
+// the first failure of any file
+int XAsyncClose(XASYNC *pA);
+
+#ifdef __cplusplus
+};
+#endif // __cplusplus
+
+#endif // XASYNC_H
@@ -0,0 +1,261 @@
+#include "xbaud.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <termios.h>
+
+#define XBAUD_PING 500 /* ms between the letters sent after the change */
+
+static const long aRates[] = { 1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200 };
+static const speed_t aSpeeds[] = { B1200, B2400, B4800, B9600, B19200, B38400, B57600, B115200 };
+
+#define XBAUD_CODES ((int)(sizeof(aRates) / sizeof(aRates[0])))
+
+int XBaudCode(long lBaud)
+{
+int i1;
+
+  for(i1=0; i1 < XBAUD_CODES; i1++)
+  {
+    if(aRates[i1] == lBaud)
+    {
+      return i1;
+    }
+  }
+
+  return -1;
+}
+
+long XBaudRate(int iCode)
+{
+  return iCode >= 0 && iCode < XBAUD_CODES ? aRates[iCode] : 0;
+}
+
+long XBaudPort(int fd)
+{
+struct termios options;
+speed_t speed;
+int i1;
+
+  if(tcgetattr(fd, &options))
+  {
+    return 0;
+  }
+
+  speed = cfgetospeed(&options);
+
+  for(i1=0; i1 < XBAUD_CODES; i1++)
+  {
+    if(aSpeeds[i1] == speed)
+    {
+      return aRates[i1];
+    }
+  }
+
+  return 0;
+}
+
+// the highest BD code at or below a rate
+static int CodeUpTo(long lMax)
+{
+int i1;
+
+  for(i1=XBAUD_CODES - 1; i1 >= 0 && aRates[i1] > lMax; i1--)
+  {
+  }
+
+  return i1;
+}
+
+// the next byte within iWait ms, -1 if none came
+static int ReadByte(int fd, int iWait)
+{
+struct pollfd pfd;
+unsigned char c;
+
+  pfd.fd = fd;
+  pfd.events = POLLIN;
+
+  if(poll(&pfd, 1, iWait) <= 0 || read(fd, &c, 1) != 1)
+  {
+    return -1;
+  }
+
+  return c;
+}
+
+// waits for the radio's "OK\r", passing over whatever the far end sends
+// meanwhile.  0 when it came
+static int RadioOK(int fd, int iWait)
+{
+const char *szOK = "OK\r";
+int c, i1 = 0;
+
+  while(szOK[i1] && (c = ReadByte(fd, iWait)) >= 0)
+  {
+    i1 = (c == szOK[i1]) ? i1 + 1 : (c == 'O');
+  }
+
+  return szOK[i1] ? -1 : 0;
+}
+
+static int RadioCommand(int fd, const char *szCommand)
+{
+int cb1 = strlen(szCommand);
+
+  if(write(fd, szCommand, cb1) != cb1)
+  {
+    return -1;
+  }
+
+  return RadioOK(fd, XBAUD_WAIT);
+}
+
+int XBaudSetPort(int fd, long lBaud)
+{
+struct termios options;
+int iCode = XBaudCode(lBaud);
+
+  if(iCode < 0 || tcgetattr(fd, &options))
+  {
+    return -1;
+  }
+
+  cfsetispeed(&options, aSpeeds[iCode]);
+  cfsetospeed(&options, aSpeeds[iCode]);
+
+  return tcsetattr(fd, TCSANOW, &options) ? -1 : 0;
+}
+
+int XBaudSet(int fd, long lBaud)
+{
+char szCommand[16];
+int iCode = XBaudCode(lBaud);
+
+  if(iCode < 0)
+  {
+    return -1;
+  }
+
+  // command mode takes silence, "+++" and silence again, after which the
+  // radio says OK
+  tcdrain(fd);
+  usleep(XBAUD_GUARD * 1000);
+
+  if(write(fd, "+++", 3) != 3 || RadioOK(fd, XBAUD_GUARD + XBAUD_WAIT))
+  {
+    return -1;
+  }
+
+  snprintf(szCommand, sizeof(szCommand), "ATBD%X\r", iCode);
+
+  if(RadioCommand(fd, szCommand))
+  {
+    RadioCommand(fd, "ATCN\r");
+    return -1;
+  }
+
+  if(RadioCommand(fd, "ATCN\r"))
+  {
+    return -1;
+  }
+
+  // the radio answers CN at the old rate and takes the new one after it
+  return XBaudSetPort(fd, lBaud);
+}
+
+long XBaudOffer(int fd, long lMax)
+{
+long lOld = XBaudPort(fd), lRate;
+unsigned char aMsg[2];
+int c, i1;
+
+  aMsg[0] = '8';
+  aMsg[1] = 'a' + CodeUpTo(lMax);
+
+  if(!lOld || aMsg[1] < 'a' || write(fd, aMsg, 2) != 2)
+  {
+    return lOld;
+  }
+
+  // the answer, a base station that does not know '8' sends none
+  while((c = ReadByte(fd, XBAUD_WAIT)) >= 0 && c != '8')
+  {
+  }
+
+  c = (c < 0) ? -1 : ReadByte(fd, XBAUD_WAIT);
+  lRate = XBaudRate(c - 'a');
+
+  if(!lRate || lRate == lOld || XBaudSet(fd, lRate))
+  {
+    return lOld;
+  }
+
+  // the base station is changing its radio as well, the letter comes back
+  // once it is done
+  aMsg[1] = (unsigned char)c;
+
+  for(i1=0; i1 < 2 * (XBAUD_GUARD + XBAUD_WAIT) / XBAUD_PING + 4; i1++)
+  {
+    if(write(fd, aMsg + 1, 1) != 1)
+    {
+      break;
+    }
+
+    if(ReadByte(fd, XBAUD_PING) == c)
+    {
+      return lRate;
+    }
+  }
+
+  XBaudSet(fd, lOld);
+
+  return XBaudPort(fd);
+}
+
+long XBaudAnswer(int fd, long lMax)
+{
+long lOld = XBaudPort(fd), lRate;
+unsigned char aMsg[2];
+int c, iCode;
+
+  c = ReadByte(fd, XBAUD_WAIT);
+
+  if(!lOld || !XBaudRate(c - 'a'))
+  {
+    return lOld;
+  }
+
+  iCode = CodeUpTo(lMax);
+  iCode = (c - 'a' < iCode) ? c - 'a' : iCode;
+
+  aMsg[0] = '8';
+  aMsg[1] = 'a' + iCode;
+
+  if(iCode < 0 || write(fd, aMsg, 2) != 2)
+  {
+    return lOld;
+  }
+
+  lRate = XBaudRate(iCode);
+
+  if(lRate == lOld || XBaudSet(fd, lRate))
+  {
+    return lOld;
+  }
+
+  // the field unit sends the letter until it hears it back
+  while((c = ReadByte(fd, XBAUD_SILENCE)) >= 0)
+  {
+    if(c == aMsg[1] && write(fd, aMsg + 1, 1) == 1)
+    {
+      return lRate;
+    }
+  }
+
+  XBaudSet(fd, lOld);
+
+  return XBaudPort(fd);
+}
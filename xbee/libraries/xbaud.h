@@ -0,0 +1,59 @@
+#ifndef XBAUD_H
+#define XBAUD_H
+
+/* Serial rate of the radios for one session.
+
+The field unit offers the highest rate it takes: message '8' and a
+letter, 'a' plus the XBee BD code of the rate, which base stations that
+do not know '8' pass over.  The base station answers with '8' and the
+letter of the lower of the two rates.  Both ends then put their own radio
+on that rate in AT command mode and change their port to match.  The
+rate is not written to the radio, so a power cycle brings back the one
+it is configured for.
+
+After the change the field unit sends the letter until the base station,
+at the new rate as well, sends it back.  If that never happens it goes
+back to the old rate.  The base station goes back to its usual rate once
+nothing has come for XBAUD_SILENCE milliseconds, so that a batch sent
+again after a failure still finds it on the new one.
+*/
+
+#define XBAUD_DEFAULT 57600 /* the rate the radios are configured for */
+#define XBAUD_MAX 115200    /* BD 7, the fastest rate all XBee firmware takes */
+#define XBAUD_GUARD 1100    /* ms of silence around "+++", the radio's GT is 1000 */
+#define XBAUD_WAIT 2000     /* ms for the far end to answer */
+#define XBAUD_SILENCE 10000 /* ms before a base station gives up on a session */
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// BD code of a rate (0 for 1200 up to 7 for 115200), -1 if the radio has none
+int XBaudCode(long lBaud);
+
+// the rate of a BD code, 0 if there is none
+long XBaudRate(int iCode);
+
+// rate the port is set to, 0 if it is not one of the BD rates
+long XBaudPort(int fd);
+
+// sets the port alone, for a radio that already runs at the rate.  0 or -1
+int XBaudSetPort(int fd, long lBaud);
+
+// puts the radio and then the port on the rate.  0, or -1 if the radio
+// did not take it, in which case both stay as they were
+int XBaudSet(int fd, long lBaud);
+
+// field unit: offers rates up to lMax and switches to the one the base
+// station picks.  returns the rate in use afterwards
+long XBaudOffer(int fd, long lMax);
+
+// base station, after reading '8': answers the offer with rates up to
+// lMax and switches.  returns the rate in use afterwards
+long XBaudAnswer(int fd, long lMax);
+
+#ifdef __cplusplus
+};
+#endif // __cplusplus
+
+#endif // XBAUD_H
@@ -0,0 +1,639 @@
+#include "xbeeapi.h"
+#include "xreader.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+// transport payloads are a type, a 16 bit sequence number and data
+#define XAPI_HEADER 'H' /* seq 0, name NUL size */
+#define XAPI_DATA   'D' /* seq 1..n */
+#define XAPI_END    'E' /* seq n, asks the receiver what is missing */
+#define XAPI_DONE   'F' /* receiver has everything */
+#define XAPI_NEED   'N' /* receiver lists missing sequence numbers */
+
+#define XAPI_CHUNK (XAPI_RF_PAYLOAD - 3) /* file bytes per frame */
+#define XAPI_WINDOW 16          /* TX requests waiting for their status */
+#define XAPI_STATUS_WAIT 3000   /* msecs before a TX request without status is sent again */
+#define XAPI_END_WAIT 5000      /* msecs to wait for the receiver's answer to an end frame */
+#define XAPI_SILENCE 5000       /* msecs without a frame before the receiver counts an error */
+#define XAPI_ERRORS 8
+
+static int bApiEscaped = 1;
+
+static const unsigned char aCoordinator[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+void XApiSetEscaped(int bEscaped)
+{
+  bApiEscaped = bEscaped;
+}
+
+static int XApiPut(unsigned char bVal, int bEscaped, unsigned char *pOut)
+{
+  if(bEscaped &&
+     (bVal == XAPI_START || bVal == XAPI_ESCAPE || bVal == XAPI_XON || bVal == XAPI_XOFF))
+  {
+    pOut[0] = XAPI_ESCAPE;
+    pOut[1] = bVal ^ 0x20;
+    return 2;
+  }
+
+  pOut[0] = bVal;
+  return 1;
+}
+
+int XApiEncode(const unsigned char *pData, int cbData, int bEscaped, unsigned char *pOut)
+{
+unsigned char bSum = 0;
+int i1, cbOut = 0;
+
+  pOut[cbOut++] = XAPI_START; // never escaped
+
+  cbOut += XApiPut((unsigned char)(cbData >> 8), bEscaped, pOut + cbOut);
+  cbOut += XApiPut((unsigned char)(cbData & 0xff), bEscaped, pOut + cbOut);
+
+  for(i1=0; i1 < cbData; i1++)
+  {
+    bSum += pData[i1];
+    cbOut += XApiPut(pData[i1], bEscaped, pOut + cbOut);
+  }
+
+  cbOut += XApiPut((unsigned char)(0xff - bSum), bEscaped, pOut + cbOut);
+
+  return cbOut;
+}
+
+void XApiDecoderInit(XAPI_DECODER *pD, int bEscaped)
+{
+  memset(pD, 0, sizeof(*pD));
+  pD->bEscaped = bEscaped;
+}
+
+int XApiDecode(XAPI_DECODER *pD, unsigned char bVal)
+{
+  if(bVal == XAPI_START && (pD->bEscaped || pD->iState == 0))
+  {
+    // with escaping a start byte is always a new frame, without it only
+    // between frames
+    if(pD->iState != 0)
+    {
+      pD->lErrors++; // the previous frame was cut short
+    }
+
+    pD->iState = 1;
+    pD->bEscapeNext = 0;
+    return 0;
+  }
+
+  if(pD->iState == 0)
+  {
+    return 0; // noise between frames
+  }
+
+  if(pD->bEscaped)
+  {
+    if(bVal == XAPI_ESCAPE)
+    {
+      pD->bEscapeNext = 1;
+      return 0;
+    }
+
+    if(pD->bEscapeNext)
+    {
+      bVal ^= 0x20;
+      pD->bEscapeNext = 0;
+    }
+  }
+
+  switch(pD->iState)
+  {
+    case 1:
+      pD->cbLength = bVal << 8;
+      pD->iState = 2;
+      break;
+
+    case 2:
+      pD->cbLength |= bVal;
+      pD->cbFrame = 0;
+      pD->bSum = 0;
+
+      if(pD->cbLength == 0 || pD->cbLength > XAPI_MAX_FRAME)
+      {
+        pD->lErrors++;
+        pD->iState = 0;
+      }
+      else
+      {
+        pD->iState = 3;
+      }
+      break;
+
+    case 3:
+      pD->aFrame[pD->cbFrame++] = bVal;
+      pD->bSum += bVal;
+
+      if(pD->cbFrame == pD->cbLength)
+      {
+        pD->iState = 4;
+      }
+      break;
+
+    default: // checksum
+      pD->iState = 0;
+
+      if((unsigned char)(pD->bSum + bVal) == 0xff)
+      {
+        return 1;
+      }
+
+      pD->lErrors++;
+      break;
+  }
+
+  return 0;
+}
+
+int XApiTxRequest(unsigned char bFrameId, const unsigned char *aDest64,
+                  const void *pPayload, int cbPayload, unsigned char *pFrame)
+{
+  pFrame[0] = XAPI_TX_REQUEST;
+  pFrame[1] = bFrameId; // 0 asks for no TX status
+  memcpy(pFrame + 2, aDest64 ? aDest64 : aCoordinator, 8);
+  pFrame[10] = 0xff; // 16 bit address unknown
+  pFrame[11] = 0xfe;
+  pFrame[12] = 0; // maximum hops
+  pFrame[13] = 0; // options
+  memcpy(pFrame + XAPI_TX_OVERHEAD, pPayload, cbPayload);
+
+  return XAPI_TX_OVERHEAD + cbPayload;
+}
+
+int XApiTxStatus(unsigned char bFrameId, unsigned char bRetries, unsigned char bDelivery,
+                 unsigned char *pFrame)
+{
+  pFrame[0] = XAPI_TX_STATUS;
+  pFrame[1] = bFrameId;
+  pFrame[2] = 0xff; // 16 bit address of the destination
+  pFrame[3] = 0xfe;
+  pFrame[4] = bRetries;
+  pFrame[5] = bDelivery;
+  pFrame[6] = 0; // no discovery overhead
+
+  return 7;
+}
+
+int XApiRxPacket(const unsigned char *aSource64, const void *pPayload, int cbPayload,
+                 unsigned char *pFrame)
+{
+  pFrame[0] = XAPI_RX_PACKET;
+  memcpy(pFrame + 1, aSource64, 8);
+  pFrame[9] = 0xff; // 16 bit address of the source
+  pFrame[10] = 0xfe;
+  pFrame[11] = 0x01; // packet acknowledged
+  memcpy(pFrame + XAPI_RX_OVERHEAD, pPayload, cbPayload);
+
+  return XAPI_RX_OVERHEAD + cbPayload;
+}
+
+int XApiParseTxStatus(const unsigned char *pFrame, int cbFrame, XAPI_STATUS *pStatus)
+{
+  if(cbFrame < 7 || pFrame[0] != XAPI_TX_STATUS)
+  {
+    return 0;
+  }
+
+  pStatus->bFrameId = pFrame[1];
+  pStatus->bRetries = pFrame[4];
+  pStatus->bDelivery = pFrame[5];
+
+  return 1;
+}
+
+int XApiParseRx(const unsigned char *pFrame, int cbFrame, XAPI_RX *pRx)
+{
+  if(cbFrame < XAPI_RX_OVERHEAD || pFrame[0] != XAPI_RX_PACKET)
+  {
+    return 0;
+  }
+
+  memcpy(pRx->aSource64, pFrame + 1, 8);
+  pRx->pData = pFrame + XAPI_RX_OVERHEAD;
+  pRx->cbData = cbFrame - XAPI_RX_OVERHEAD;
+
+  return 1;
+}
+
+
+// one end of a file transfer
+typedef struct _XAPI_LINK_
+{
+  int fd;
+  XREADER reader;
+  XAPI_DECODER decoder;
+  unsigned char aPeer[8]; ///< 64 bit address of the other radio
+} XAPI_LINK;
+
+// waits up to ulWait msecs for the next frame, 1 when it is in the decoder
+static int XApiNextFrame(XAPI_LINK *pL, unsigned long ulWait)
+{
+unsigned long ulEnd = XReaderMillis() + ulWait, ulNow;
+unsigned char bVal;
+
+  for(;;)
+  {
+    ulNow = XReaderMillis();
+    if((long)(ulEnd - ulNow) <= 0 ||
+       XReaderRead(&(pL->reader), &bVal, 1, ulEnd - ulNow) != 1)
+    {
+      return 0;
+    }
+
+    if(XApiDecode(&(pL->decoder), bVal))
+    {
+      return 1;
+    }
+  }
+}
+
+// sends one transport payload as a TX request
+static int XApiSendPayload(XAPI_LINK *pL, unsigned char bFrameId, unsigned char bType,
+                           long lSeq, const void *pData, int cbData)
+{
+unsigned char aPayload[XAPI_RF_PAYLOAD];
+unsigned char aFrame[XAPI_MAX_FRAME];
+unsigned char aOut[2 * (XAPI_MAX_FRAME + 4)];
+int cbFrame, cbOut;
+
+  aPayload[0] = bType;
+  aPayload[1] = (unsigned char)(lSeq >> 8);
+  aPayload[2] = (unsigned char)(lSeq & 0xff);
+  memcpy(aPayload + 3, pData, cbData);
+
+  cbFrame = XApiTxRequest(bFrameId, pL->aPeer, aPayload, cbData + 3, aFrame);
+  cbOut = XApiEncode(aFrame, cbFrame, bApiEscaped, aOut);
+
+  return write(pL->fd, aOut, cbOut) == cbOut ? 0 : -1;
+}
+
+static void XApiInit(XAPI_LINK *pL, int fd, const unsigned char *aPeer)
+{
+  memset(pL, 0, sizeof(*pL));
+  pL->fd = fd;
+  XReaderInit(&(pL->reader), fd);
+  XApiDecoderInit(&(pL->decoder), bApiEscaped);
+  memcpy(pL->aPeer, aPeer ? aPeer : aCoordinator, 8);
+}
+
+int XApiSendFile(int fd, const char *szFilename, const unsigned char *aDest64)
+{
+XAPI_LINK link;
+XAPI_STATUS status;
+XAPI_RX rx;
+long aSeq[256];            // sequence number in flight under each frame ID, -1 if none
+unsigned long aSent[256];  // when it was sent
+unsigned char *aPending;   // bit per sequence number still to be sent
+unsigned char aHeader[XAPI_CHUNK], aChunk[XAPI_CHUNK];
+unsigned char bFrameId = 0;
+unsigned long ulNow, ulEndSent = 0;
+long lSize, lFrames, lSeq, lScan, i1;
+int file, iFlight = 0, iEnds = 0, iErrors = 0, cbHeader, bHeader = 0, iRval = -2;
+const char *szName;
+
+  file = open(szFilename, O_RDONLY);
+  if(file < 0)
+  {
+    fprintf(stderr, "XApiSendFile fail \"%s\"  errno=%d\n", szFilename, errno);
+    return -9; // can't open file
+  }
+
+  lSize = (long)lseek(file, 0, SEEK_END);
+  lFrames = (lSize + XAPI_CHUNK - 1) / XAPI_CHUNK;
+  if(lSize < 0 || lFrames > 0xffff)
+  {
+    close(file);
+    return -1; // too big for 16 bit sequence numbers
+  }
+
+  aPending = (unsigned char *)calloc(lFrames / 8 + 1, 1);
+  if(!aPending)
+  {
+    close(file);
+    return -1;
+  }
+
+  XApiInit(&link, fd, aDest64);
+
+  for(i1=0; i1 < 256; i1++)
+  {
+    aSeq[i1] = -1;
+  }
+
+  // the header goes first and on its own, so the receiver knows the size
+  // before any data arrives
+
+  szName = strrchr(szFilename, '/') ? strrchr(szFilename, '/') + 1 : szFilename;
+  memset(aHeader, 0, sizeof(aHeader));
+  strncpy((char *)aHeader, szName, 60);
+  cbHeader = strlen((char *)aHeader) + 1;
+  cbHeader += sprintf((char *)aHeader + cbHeader, "%ld", lSize) + 1;
+
+  memset(aPending, 0xff, lFrames / 8 + 1); // seq 0 is the header, the rest data
+  lScan = 0;
+
+  for(;;)
+  {
+    // keep a few TX requests in flight, lowest sequence numbers first.
+    // the data waits until the header was delivered
+
+    while(iFlight < XAPI_WINDOW && (bHeader || !iFlight))
+    {
+      for(lSeq = lScan; lSeq <= lFrames && !(aPending[lSeq / 8] & (1 << (lSeq % 8))); lSeq++)
+      {
+      }
+
+      lScan = lSeq;
+      if(lSeq > lFrames)
+      {
+        break;
+      }
+
+      if(aSeq[bFrameId % 255 + 1] >= 0) // still waiting on the last use of this ID
+      {
+        break;
+      }
+
+      bFrameId = bFrameId % 255 + 1; // 1..255, 0 would mean no TX status
+
+      if(lSeq == 0)
+      {
+        XApiSendPayload(&link, bFrameId, XAPI_HEADER, 0, aHeader, cbHeader);
+      }
+      else
+      {
+        lseek(file, (lSeq - 1) * (long)XAPI_CHUNK, SEEK_SET);
+        i1 = read(file, aChunk, XAPI_CHUNK);
+        XApiSendPayload(&link, bFrameId, XAPI_DATA, lSeq, aChunk, i1 > 0 ? (int)i1 : 0);
+      }
+
+      aPending[lSeq / 8] &= ~(1 << (lSeq % 8));
+      aSeq[bFrameId] = lSeq;
+      aSent[bFrameId] = XReaderMillis();
+      iFlight++;
+    }
+
+    // everything delivered, ask the receiver if it has it all
+
+    ulNow = XReaderMillis();
+    if(!iFlight && lScan > lFrames && (!ulEndSent || ulNow - ulEndSent >= XAPI_END_WAIT))
+    {
+      if(++iEnds > XAPI_ERRORS)
+      {
+        break;
+      }
+
+      XApiSendPayload(&link, 0, XAPI_END, lFrames, NULL, 0);
+      ulEndSent = ulNow;
+    }
+
+    if(!XApiNextFrame(&link, 250))
+    {
+      // no status for a while, the radio lost the request or its status
+
+      ulNow = XReaderMillis();
+      for(i1=1; i1 < 256; i1++)
+      {
+        if(aSeq[i1] >= 0 && ulNow - aSent[i1] >= XAPI_STATUS_WAIT)
+        {
+          aPending[aSeq[i1] / 8] |= 1 << (aSeq[i1] % 8);
+          if(aSeq[i1] < lScan)
+          {
+            lScan = aSeq[i1];
+          }
+          aSeq[i1] = -1;
+          iFlight--;
+
+          if(++iErrors > 4 * XAPI_ERRORS)
+          {
+            goto the_end;
+          }
+        }
+      }
+      continue;
+    }
+
+    if(XApiParseTxStatus(link.decoder.aFrame, link.decoder.cbFrame, &status))
+    {
+      lSeq = aSeq[status.bFrameId];
+      if(lSeq < 0)
+      {
+        continue; // not one of mine, or already given up on
+      }
+
+      aSeq[status.bFrameId] = -1;
+      iFlight--;
+
+      if(status.bDelivery == XAPI_DELIVERED)
+      {
+        bHeader |= (lSeq == 0);
+      }
+      else
+      {
+        // the radio gave up after its own retries, send it again
+        aPending[lSeq / 8] |= 1 << (lSeq % 8);
+        if(lSeq < lScan)
+        {
+          lScan = lSeq;
+        }
+
+        if(++iErrors > 4 * XAPI_ERRORS)
+        {
+          break;
+        }
+      }
+    }
+    else if(XApiParseRx(link.decoder.aFrame, link.decoder.cbFrame, &rx) && rx.cbData >= 1)
+    {
+      if(rx.pData[0] == XAPI_DONE)
+      {
+        iRval = 0;
+        break;
+      }
+      else if(rx.pData[0] == XAPI_NEED)
+      {
+        // missing sequence numbers follow, two bytes each
+        for(i1=3; i1 + 1 < rx.cbData; i1 += 2)
+        {
+          lSeq = (rx.pData[i1] << 8) | rx.pData[i1 + 1];
+          if(lSeq >= 1 && lSeq <= lFrames)
+          {
+            aPending[lSeq / 8] |= 1 << (lSeq % 8);
+            if(lSeq < lScan)
+            {
+              lScan = lSeq;
+            }
+          }
+        }
+
+        ulEndSent = 0;
+        iEnds = 0;
+      }
+    }
+  }
+
+the_end:
+
+  free(aPending);
+  close(file);
+
+  fprintf(stderr, "XApiSendFile returns %d  (%ld frames, %d errors, %ld bad frames)\n",
+          iRval, lFrames, iErrors, link.decoder.lErrors);
+  return iRval;
+}
+
+// answers an end frame with done, or with the sequence numbers still
+// missing.  returns 1 if the file is complete
+static int XApiAnswerEnd(XAPI_LINK *pL, unsigned char bFrameId, const unsigned char *aHave, long lFrames)
+{
+unsigned char aList[XAPI_CHUNK];
+long lSeq;
+int cbList = 0;
+
+  for(lSeq = 1; lSeq <= lFrames && cbList + 2 <= (int)sizeof(aList); lSeq++)
+  {
+    if(!(aHave[lSeq / 8] & (1 << (lSeq % 8))))
+    {
+      aList[cbList++] = (unsigned char)(lSeq >> 8);
+      aList[cbList++] = (unsigned char)(lSeq & 0xff);
+    }
+  }
+
+  if(cbList)
+  {
+    XApiSendPayload(pL, 0, XAPI_NEED, 0, aList, cbList);
+    return 0;
+  }
+
+  // the sender stops once it has this, so ask the radio to confirm it
+  XApiSendPayload(pL, bFrameId, XAPI_DONE, 0, NULL, 0);
+  return 1;
+}
+
+int XApiReceiveFile(int fd, const char *szFilename, int nMode)
+{
+XAPI_LINK link;
+XAPI_RX rx;
+XAPI_STATUS status;
+unsigned char *aHave = NULL; // bit per sequence number received
+unsigned char bDoneId = 0;   // frame ID of the done answer, once the file is complete
+char szHeader[XAPI_RF_PAYLOAD];
+long lSize = -1, lFrames = 0, lSeq, lPos;
+int file, iErrors = 0, cbData, iRval = -2;
+
+  unlink(szFilename); // make sure it does not exist, first
+  file = open(szFilename, O_CREAT | O_TRUNC | O_WRONLY, nMode);
+  if(file < 0)
+  {
+    fprintf(stderr, "XApiReceiveFile fail \"%s\"  errno=%d\n", szFilename, errno);
+    return -9; // can't create file
+  }
+
+  XApiInit(&link, fd, NULL);
+
+  while(iErrors < XAPI_ERRORS)
+  {
+    if(!XApiNextFrame(&link, bDoneId ? XAPI_STATUS_WAIT : XAPI_SILENCE))
+    {
+      iErrors++;
+
+      if(bDoneId) // no status for the done answer, send it again
+      {
+        bDoneId = bDoneId % 255 + 1;
+        XApiAnswerEnd(&link, bDoneId, aHave, lFrames);
+      }
+      continue;
+    }
+
+    if(XApiParseTxStatus(link.decoder.aFrame, link.decoder.cbFrame, &status))
+    {
+      if(!bDoneId || status.bFrameId != bDoneId)
+      {
+        continue;
+      }
+
+      if(status.bDelivery == XAPI_DELIVERED)
+      {
+        iRval = 0; // the sender has been told
+        break;
+      }
+
+      bDoneId = bDoneId % 255 + 1;
+      XApiAnswerEnd(&link, bDoneId, aHave, lFrames);
+      iErrors++;
+      continue;
+    }
+
+    if(!XApiParseRx(link.decoder.aFrame, link.decoder.cbFrame, &rx) || rx.cbData < 3)
+    {
+      continue;
+    }
+
+    memcpy(link.aPeer, rx.aSource64, 8); // answers go back to the sender
+    lSeq = (rx.pData[1] << 8) | rx.pData[2];
+    cbData = rx.cbData - 3;
+
+    if(rx.pData[0] == XAPI_HEADER && !aHave)
+    {
+      // name NUL size NUL, only the size matters here
+      memset(szHeader, 0, sizeof(szHeader));
+      memcpy(szHeader, rx.pData + 3, cbData);
+      lSize = strtol(szHeader + strlen(szHeader) + 1, NULL, 10);
+      lFrames = (lSize + XAPI_CHUNK - 1) / XAPI_CHUNK;
+      aHave = (unsigned char *)calloc(lFrames / 8 + 1, 1);
+      if(!aHave)
+      {
+        break;
+      }
+    }
+    else if(rx.pData[0] == XAPI_DATA && aHave && lSeq >= 1 && lSeq <= lFrames)
+    {
+      // frames are written where they belong, so order does not matter
+      lPos = (lSeq - 1) * (long)XAPI_CHUNK;
+      if(lPos + cbData > lSize)
+      {
+        cbData = (int)(lSize - lPos);
+      }
+
+      lseek(file, lPos, SEEK_SET);
+      if(write(file, rx.pData + 3, cbData) != cbData)
+      {
+        break; // write error on output file
+      }
+
+      aHave[lSeq / 8] |= 1 << (lSeq % 8);
+    }
+    else if(rx.pData[0] == XAPI_END && aHave)
+    {
+      if(XApiAnswerEnd(&link, bDoneId % 255 + 1, aHave, lFrames))
+      {
+        bDoneId = bDoneId % 255 + 1;
+      }
+    }
+
+    iErrors = 0;
+  }
+
+  free(aHave);
+  close(file);
+
+  if(iRval)
+  {
+    unlink(szFilename); // delete file on error
+  }
+
+  fprintf(stderr, "XApiReceiveFile returns %d  (%ld bytes, %ld bad frames)\n",
+          iRval, lSize, link.decoder.lErrors);
+  return iRval;
+}
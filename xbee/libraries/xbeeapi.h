@@ -0,0 +1,100 @@
+#ifndef XBEEAPI_H
+#define XBEEAPI_H
+
+/* XBee API mode framing (ATAP=1, or ATAP=2 with escaping).
+
+Every frame is 0x7E, the length of the frame data (2 bytes, high first),
+the frame data starting with the frame type, and a checksum of 0xFF minus
+the low byte of the sum of the frame data. With escaping, 0x7E, 0x7D,
+0x11 and 0x13 after the start byte are sent as 0x7D followed by the byte
+XOR 0x20.
+
+The file transport packs the image into the largest payload the radio
+sends in one RF packet. Every frame is a TX request with a frame ID, so
+the radio answers with a TX status once the far radio acknowledged it.
+That status takes the place of the per-block ACK of XMODEM, and only the
+end of the file needs an answer from the receiving program.
+*/
+
+#define XAPI_START  0x7E
+#define XAPI_ESCAPE 0x7D
+#define XAPI_XON    0x11
+#define XAPI_XOFF   0x13
+
+// frame types
+#define XAPI_TX_REQUEST 0x10
+#define XAPI_TX_STATUS  0x8B
+#define XAPI_RX_PACKET  0x90
+
+#define XAPI_MAX_FRAME  128 /* frame data the decoder accepts */
+#define XAPI_RF_PAYLOAD 84  /* largest payload sent unfragmented, see ATNP */
+#define XAPI_TX_OVERHEAD 14 /* frame data of a TX request besides the payload */
+#define XAPI_RX_OVERHEAD 12 /* frame data of an RX packet besides the payload */
+
+// delivery status of a TX status frame
+#define XAPI_DELIVERED 0x00
+
+// decodes a byte stream one byte at a time
+typedef struct _XAPI_DECODER_
+{
+  int bEscaped;        ///< ATAP=2 escaping
+  int iState;          ///< 0 waiting for 0x7E, 1-2 length, 3 frame data, 4 checksum
+  int bEscapeNext;     ///< the previous byte was 0x7D
+  int cbLength;        ///< frame data length from the header
+  int cbFrame;         ///< frame data received so far
+  unsigned char bSum;  ///< running checksum
+  unsigned char aFrame[XAPI_MAX_FRAME]; ///< frame data of the last complete frame
+  long lErrors;        ///< frames dropped for a bad checksum or length
+} XAPI_DECODER;
+
+typedef struct _XAPI_STATUS_
+{
+  unsigned char bFrameId;  ///< frame ID of the TX request
+  unsigned char bRetries;  ///< transmit retries the radio needed
+  unsigned char bDelivery; ///< XAPI_DELIVERED or the failure reason
+} XAPI_STATUS;
+
+typedef struct _XAPI_RX_
+{
+  unsigned char aSource64[8];  ///< address of the sending radio
+  const unsigned char *pData;  ///< payload, points into the decoder
+  int cbData;
+} XAPI_RX;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// writes the frame for cbData bytes of frame data to pOut, which must
+// hold 2 * (cbData + 4) bytes.  returns the number of bytes written
+int XApiEncode(const unsigned char *pData, int cbData, int bEscaped, unsigned char *pOut);
+
+void XApiDecoderInit(XAPI_DECODER *pD, int bEscaped);
+// returns 1 when the byte completes a valid frame, now in pD->aFrame
+int XApiDecode(XAPI_DECODER *pD, unsigned char bVal);
+
+// frame data builders, each returns the frame data length
+int XApiTxRequest(unsigned char bFrameId, const unsigned char *aDest64,
+                  const void *pPayload, int cbPayload, unsigned char *pFrame);
+int XApiTxStatus(unsigned char bFrameId, unsigned char bRetries, unsigned char bDelivery,
+                 unsigned char *pFrame);
+int XApiRxPacket(const unsigned char *aSource64, const void *pPayload, int cbPayload,
+                 unsigned char *pFrame);
+
+// frame data parsers, return 0 if the frame is not of that type
+int XApiParseTxStatus(const unsigned char *pFrame, int cbFrame, XAPI_STATUS *pStatus);
+int XApiParseRx(const unsigned char *pFrame, int cbFrame, XAPI_RX *pRx);
+
+// ATAP=2 escaping unless cleared, both ends have to agree
+void XApiSetEscaped(int bEscaped);
+
+// sends a file to the radio at aDest64 (NULL for the coordinator)
+int XApiSendFile(int fd, const char *szFilename, const unsigned char *aDest64);
+// receives one file sent by XApiSendFile
+int XApiReceiveFile(int fd, const char *szFilename, int nMode);
+
+#ifdef __cplusplus
+};
+#endif // __cplusplus
+
+#endif // XBEEAPI_H
@@ -0,0 +1,365 @@
+#include "xcrc.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define XCRC_CLMUL
+#include <immintrin.h>
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__linux__)
+#define XCRC_PMULL
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif // x86, ARM64
+
+#define CRC16_POLY 0x1021
+
+// aTable[0] is the CRC of each byte from 0, aTable[k] of the byte followed by k zero bytes
+static unsigned short aTable[8][256];
+
+static XCRC16_ENGINE aEngines[] =
+{
+  { "bitwise", XCrc16Bitwise },
+  { "table", XCrc16Table },
+  { "slice8", XCrc16Slice8 },
+  { 0, 0 } // the carry-less multiply, if the CPU has it
+};
+
+static int nEngines = 3;
+static XCRC16_FN pfnBest = XCrc16Slice8;
+
+unsigned short XCrc16Bitwise(unsigned short wCRC, const void *pBuf, long cbBuf)
+{
+const unsigned char *p1 = (const unsigned char *)pBuf;
+long i1;
+int i2;
+
+  for(i1=0; i1 < cbBuf; i1++)
+  {
+    wCRC ^= (unsigned short)p1[i1] << 8;
+
+    for(i2=0; i2 < 8; i2++)
+    {
+      if(wCRC & 0x8000)
+      {
+        wCRC = (wCRC << 1) ^ CRC16_POLY;
+      }
+      else
+      {
+        wCRC <<= 1;
+      }
+    }
+  }
+
+  return wCRC;
+}
+
+unsigned short XCrc16Table(unsigned short wCRC, const void *pBuf, long cbBuf)
+{
+const unsigned char *p1 = (const unsigned char *)pBuf;
+long i1;
+
+  for(i1=0; i1 < cbBuf; i1++)
+  {
+    wCRC = (wCRC << 8) ^ aTable[0][(wCRC >> 8) ^ p1[i1]];
+  }
+
+  return wCRC;
+}
+
+unsigned short XCrc16Slice8(unsigned short wCRC, const void *pBuf, long cbBuf)
+{
+const unsigned char *p1 = (const unsigned char *)pBuf;
+
+  // the CRC so far goes into the first two bytes of each step
+  while(cbBuf >= 8)
+  {
+    wCRC = aTable[7][p1[0] ^ (wCRC >> 8)] ^ aTable[6][p1[1] ^ (wCRC & 0xff)] ^
+           aTable[5][p1[2]] ^ aTable[4][p1[3]] ^ aTable[3][p1[4]] ^
+           aTable[2][p1[5]] ^ aTable[1][p1[6]] ^ aTable[0][p1[7]];
+
+    p1 += 8;
+    cbBuf -= 8;
+  }
+
+  return XCrc16Table(wCRC, p1, cbBuf);
+}
+
+// x^n mod P, to fold n bits further along
+static unsigned long long XPow(int n)
+{
+unsigned short wR = 1;
+
+  while(n-- > 0)
+  {
+    wR = (wR & 0x8000) ? (wR << 1) ^ CRC16_POLY : wR << 1;
+  }
+
+  return wR;
+}
+
+/* The carry-less multiply engines fold the data 128 bits at a time: the
+   message so far, taken as a polynomial A, is replaced by something of
+   the same degree that has the same remainder mod P,
+
+     A * x^128 = A_hi * x^192 + A_lo * x^128 = A_hi * (x^192 mod P) + A_lo * (x^128 mod P)
+
+   which needs two 64x16 bit multiplies and no reduction.  Four such
+   folds run side by side on 64 byte steps to hide the multiply latency,
+   and the last 16 bytes left over go through the tables. */
+
+#ifdef XCRC_CLMUL
+
+static __m128i kFold128, kFold512;
+
+__attribute__((target("pclmul,ssse3")))
+static __m128i ClmulFold(__m128i a, __m128i k, const unsigned char *p1)
+{
+const __m128i swap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+
+  return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(a, k, 0x00), _mm_clmulepi64_si128(a, k, 0x11)),
+                       _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p1), swap));
+}
+
+__attribute__((target("pclmul,ssse3")))
+static unsigned short XCrc16Clmul(unsigned short wCRC, const void *pBuf, long cbBuf)
+{
+const __m128i swap = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+const unsigned char *p1 = (const unsigned char *)pBuf;
+unsigned char aLast[16];
+__m128i a0, a1, a2, a3;
+
+  if(cbBuf < 32)
+  {
+    return XCrc16Slice8(wCRC, p1, cbBuf);
+  }
+
+  a0 = _mm_xor_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p1), swap),
+                     _mm_set_epi64x((long long)((unsigned long long)wCRC << 48), 0));
+
+  if(cbBuf >= 128)
+  {
+    a1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p1 + 16)), swap);
+    a2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p1 + 32)), swap);
+    a3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p1 + 48)), swap);
+    p1 += 64;
+    cbBuf -= 64;
+
+    while(cbBuf >= 64)
+    {
+      a0 = ClmulFold(a0, kFold512, p1);
+      a1 = ClmulFold(a1, kFold512, p1 + 16);
+      a2 = ClmulFold(a2, kFold512, p1 + 32);
+      a3 = ClmulFold(a3, kFold512, p1 + 48);
+      p1 += 64;
+      cbBuf -= 64;
+    }
+
+    _mm_storeu_si128((__m128i *)aLast, _mm_shuffle_epi8(a1, swap));
+    a0 = ClmulFold(a0, kFold128, aLast);
+    _mm_storeu_si128((__m128i *)aLast, _mm_shuffle_epi8(a2, swap));
+    a0 = ClmulFold(a0, kFold128, aLast);
+    _mm_storeu_si128((__m128i *)aLast, _mm_shuffle_epi8(a3, swap));
+    a0 = ClmulFold(a0, kFold128, aLast);
+  }
+  else
+  {
+    p1 += 16;
+    cbBuf -= 16;
+  }
+
+  while(cbBuf >= 16)
+  {
+    a0 = ClmulFold(a0, kFold128, p1);
+    p1 += 16;
+    cbBuf -= 16;
+  }
+
+  _mm_storeu_si128((__m128i *)aLast, _mm_shuffle_epi8(a0, swap));
+
+  return XCrc16Slice8(XCrc16Slice8(0, aLast, sizeof(aLast)), p1, cbBuf);
+}
+
+static void InitClmul(void)
+{
+  __builtin_cpu_init();
+
+  if(!__builtin_cpu_supports("pclmul") || !__builtin_cpu_supports("ssse3"))
+  {
+    return;
+  }
+
+  kFold128 = _mm_set_epi64x((long long)XPow(192), (long long)XPow(128));
+  kFold512 = _mm_set_epi64x((long long)XPow(576), (long long)XPow(512));
+
+  aEngines[nEngines].szName = "clmul";
+  aEngines[nEngines].pfn = XCrc16Clmul;
+  pfnBest = aEngines[nEngines++].pfn;
+}
+
+#endif // XCRC_CLMUL
+
+#ifdef XCRC_PMULL
+
+static poly64_t kFold128[2], kFold512[2];
+
+// the 16 bytes at p1 as one polynomial, the first byte highest
+static uint64x2_t PmullLoad(const unsigned char *p1)
+{
+uint64x2_t a = vreinterpretq_u64_u8(vrev64q_u8(vld1q_u8(p1)));
+
+  return vextq_u64(a, a, 1);
+}
+
+__attribute__((target("+crypto")))
+static uint64x2_t PmullFold(uint64x2_t a, const poly64_t *k, const unsigned char *p1)
+{
+poly128_t lo = vmull_p64((poly64_t)vgetq_lane_u64(a, 0), k[0]);
+poly128_t hi = vmull_p64((poly64_t)vgetq_lane_u64(a, 1), k[1]);
+
+  return veorq_u64(veorq_u64(vreinterpretq_u64_p128(lo), vreinterpretq_u64_p128(hi)), PmullLoad(p1));
+}
+
+static void PmullStore(unsigned char *p1, uint64x2_t a)
+{
+  a = vextq_u64(a, a, 1);
+  vst1q_u8(p1, vrev64q_u8(vreinterpretq_u8_u64(a)));
+}
+
+__attribute__((target("+crypto")))
+static unsigned short XCrc16Pmull(unsigned short wCRC, const void *pBuf, long cbBuf)
+{
+const unsigned char *p1 = (const unsigned char *)pBuf;
+unsigned char aLast[16];
+uint64x2_t a0, a1, a2, a3;
+
+  if(cbBuf < 32)
+  {
+    return XCrc16Slice8(wCRC, p1, cbBuf);
+  }
+
+  a0 = veorq_u64(PmullLoad(p1), vcombine_u64(vcreate_u64(0), vcreate_u64((unsigned long long)wCRC << 48)));
+
+  if(cbBuf >= 128)
+  {
+    a1 = PmullLoad(p1 + 16);
+    a2 = PmullLoad(p1 + 32);
+    a3 = PmullLoad(p1 + 48);
+    p1 += 64;
+    cbBuf -= 64;
+
+    while(cbBuf >= 64)
+    {
+      a0 = PmullFold(a0, kFold512, p1);
+      a1 = PmullFold(a1, kFold512, p1 + 16);
+      a2 = PmullFold(a2, kFold512, p1 + 32);
+      a3 = PmullFold(a3, kFold512, p1 + 48);
+      p1 += 64;
+      cbBuf -= 64;
+    }
+
+    PmullStore(aLast, a1);
+    a0 = PmullFold(a0, kFold128, aLast);
+    PmullStore(aLast, a2);
+    a0 = PmullFold(a0, kFold128, aLast);
+    PmullStore(aLast, a3);
+    a0 = PmullFold(a0, kFold128, aLast);
+  }
+  else
+  {
+    p1 += 16;
+    cbBuf -= 16;
+  }
+
+  while(cbBuf >= 16)
+  {
+    a0 = PmullFold(a0, kFold128, p1);
+    p1 += 16;
+    cbBuf -= 16;
+  }
+
+  PmullStore(aLast, a0);
+
+  return XCrc16Slice8(XCrc16Slice8(0, aLast, sizeof(aLast)), p1, cbBuf);
+}
+
+static void InitPmull(void)
+{
+  if(!(getauxval(AT_HWCAP) & HWCAP_PMULL))
+  {
+    return;
+  }
+
+  kFold128[0] = XPow(128);
+  kFold128[1] = XPow(192);
+  kFold512[0] = XPow(512);
+  kFold512[1] = XPow(576);
+
+  aEngines[nEngines].szName = "pmull";
+  aEngines[nEngines].pfn = XCrc16Pmull;
+  pfnBest = aEngines[nEngines++].pfn;
+}
+
+#endif // XCRC_PMULL
+
+// builds the tables and picks the engine before main() runs, so that
+// threads never race to do it
+__attribute__((constructor))
+static void XCrc16Init(void)
+{
+int i1, i2;
+unsigned char b1;
+
+  for(i1=0; i1 < 256; i1++)
+  {
+    b1 = (unsigned char)i1;
+    aTable[0][i1] = XCrc16Bitwise(0, &b1, 1);
+  }
+
+  for(i2=1; i2 < 8; i2++)
+  {
+    for(i1=0; i1 < 256; i1++)
+    {
+      aTable[i2][i1] = (aTable[i2 - 1][i1] << 8) ^ aTable[0][aTable[i2 - 1][i1] >> 8];
+    }
+  }
+
+#ifdef XCRC_CLMUL
+  InitClmul();
+#endif // XCRC_CLMUL
+#ifdef XCRC_PMULL
+  InitPmull();
+#endif // XCRC_PMULL
+}
+
+unsigned short XCrc16(unsigned short wCRC, const void *pBuf, long cbBuf)
+{
+  return pfnBest(wCRC, pBuf, cbBuf);
+}
+
+int XCrc16Engines(const XCRC16_ENGINE **ppEngines)
+{
+  *ppEngines = aEngines;
+
+  return nEngines;
+}
+
+const char *XCrc16Name(void)
+{
+  return aEngines[nEngines - 1].szName;
+}
+
+unsigned char XCheckSum(unsigned char ucSum, const void *pBuf, long cbBuf)
+{
+const unsigned char *p1 = (const unsigned char *)pBuf;
+unsigned int uSum = ucSum;
+long i1;
+
+  // a wide sum of unsigned bytes, only the low byte of which matters
+  for(i1=0; i1 < cbBuf; i1++)
+  {
+    uSum += p1[i1];
+  }
+
+  return (unsigned char)uSum;
+}
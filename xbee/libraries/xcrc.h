@@ -0,0 +1,51 @@
+#ifndef XCRC_H
+#define XCRC_H
+
+/* CRC-16/XMODEM (polynomial 0x1021, starting at 0) and the XMODEM checksum.
+
+The CRCs carry on from a previous call, so a block can be checked in
+pieces: start with 0 and pass each result to the next call.  They return
+the CRC in host order; CalcCRC in xmodem.c turns it high endian for the
+wire.
+
+XCrc16 uses the fastest engine this CPU has, chosen when the program
+starts.  The others are there for the bench and the cross-checks.
+*/
+
+typedef unsigned short (*XCRC16_FN)(unsigned short wCRC, const void *pBuf, long cbBuf);
+
+typedef struct _XCRC16_ENGINE_
+{
+  const char *szName; ///< "bitwise", "table", "slice8", "clmul" or "pmull"
+  XCRC16_FN pfn;      ///< the engine itself
+} XCRC16_ENGINE;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+unsigned short XCrc16(unsigned short wCRC, const void *pBuf, long cbBuf);
+
+// one bit at a time, the way CalcCRC used to be
+unsigned short XCrc16Bitwise(unsigned short wCRC, const void *pBuf, long cbBuf);
+
+// one table lookup per byte
+unsigned short XCrc16Table(unsigned short wCRC, const void *pBuf, long cbBuf);
+
+// eight bytes per step through eight tables
+unsigned short XCrc16Slice8(unsigned short wCRC, const void *pBuf, long cbBuf);
+
+// the engines this CPU can run, slowest first.  returns how many
+int XCrc16Engines(const XCRC16_ENGINE **ppEngines);
+
+// name of the engine XCrc16 uses
+const char *XCrc16Name(void);
+
+// sum of the bytes, carrying on from ucSum
+unsigned char XCheckSum(unsigned char ucSum, const void *pBuf, long cbBuf);
+
+#ifdef __cplusplus
+};
+#endif // __cplusplus
+
+#endif // XCRC_H
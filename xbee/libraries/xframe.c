@@ -0,0 +1,299 @@
+#include "xframe.h"
+#include "xcrc.h"
+
+#include <string.h>
+
+// what the parser expects next
+#define FRAME_HEAD   0  ///< the first 8 bytes of the header, up to its size
+#define FRAME_REST   1  ///< the rest of the header
+#define FRAME_CHUNK  2  ///< a chunk header
+#define FRAME_DATA   3  ///< data of a chunk, lLeft of it to go
+#define FRAME_DONE   4  ///< the end chunk came
+
+static void Put16(unsigned char *pB, unsigned int uVal)
+{
+  pB[0] = (unsigned char)uVal;
+  pB[1] = (unsigned char)(uVal >> 8);
+}
+
+static void Put32(unsigned char *pB, unsigned long ulVal)
+{
+  Put16(pB, (unsigned int)(ulVal & 0xffff));
+  Put16(pB + 2, (unsigned int)((ulVal >> 16) & 0xffff));
+}
+
+static unsigned int Get16(const unsigned char *pB)
+{
+  return pB[0] | (pB[1] << 8);
+}
+
+static unsigned long Get32(const unsigned char *pB)
+{
+  return Get16(pB) | ((unsigned long)Get16(pB + 2) << 16);
+}
+
+int XFrameHeader(unsigned char *pBuf, const XFRAME_HEADER *pHead)
+{
+unsigned int uBits; // a float's bits, both are 4 bytes here
+int i1;
+
+  memset(pBuf, 0, XFRAME_HEADER_SIZE);
+  memcpy(pBuf, "GFRM", 4);
+  pBuf[4] = 1;
+  pBuf[5] = (unsigned char)pHead->iFlags;
+  Put16(pBuf + 6, XFRAME_HEADER_SIZE);
+  Put16(pBuf + 8, pHead->iLocation);
+  Put16(pBuf + 10, pHead->iPan);
+  Put16(pBuf + 12, pHead->iTilt);
+  Put16(pBuf + 14, pHead->iBatteryMv);
+  Put32(pBuf + 16, pHead->ulCaptured);
+
+  for(i1=0; i1 < 8; i1++)
+  {
+    Put16(pBuf + 20 + 2 * i1, (unsigned int)pHead->aiCorners[i1] & 0xffff);
+  }
+
+  Put16(pBuf + 36, pHead->iWidth);
+  Put16(pBuf + 38, pHead->iHeight);
+
+  for(i1=0; i1 < 9; i1++)
+  {
+    memcpy(&uBits, &(pHead->afH[i1]), sizeof(uBits));
+    Put32(pBuf + 40 + 4 * i1, uBits);
+  }
+
+  Put16(pBuf + XFRAME_HEADER_SIZE - 2, XCrc16(0, pBuf, XFRAME_HEADER_SIZE - 2));
+
+  return XFRAME_HEADER_SIZE;
+}
+
+int XFrameChunk(unsigned char *pBuf, int iType, unsigned long cbData)
+{
+  pBuf[0] = (unsigned char)iType;
+  pBuf[1] = 0;
+  Put32(pBuf + 2, cbData);
+
+  return XFRAME_CHUNK_SIZE;
+}
+
+// bytes of cbData in chunks of at most XFRAME_CHUNK_MAX, one chunk if
+// there is none
+static long ChunkedSize(long cbData)
+{
+  return cbData + XFRAME_CHUNK_SIZE * (cbData > 0 ? (cbData + XFRAME_CHUNK_MAX - 1) / XFRAME_CHUNK_MAX : 1);
+}
+
+// puts cbData of iType at pB in chunks of at most XFRAME_CHUNK_MAX.
+// returns where it ends
+static unsigned char *PutChunked(unsigned char *pB, int iType, const void *pData, long cbData)
+{
+const unsigned char *pD = (const unsigned char *)pData;
+long cbChunk;
+
+  do
+  {
+    cbChunk = cbData < XFRAME_CHUNK_MAX ? cbData : XFRAME_CHUNK_MAX;
+    pB += XFrameChunk(pB, iType, cbChunk);
+    if(cbChunk > 0)
+    {
+      memcpy(pB, pD, cbChunk);
+      pB += cbChunk;
+      pD += cbChunk;
+    }
+    cbData -= cbChunk;
+  } while(cbData > 0);
+
+  return pB;
+}
+
+long XFrameBuild(unsigned char *pBuf, const XFRAME_HEADER *pHead, const void *pThumb, long cbThumb,
+                 const void *pPayload, long cbPayload)
+{
+long lSize = XFRAME_HEADER_SIZE + (cbThumb > 0 ? ChunkedSize(cbThumb) : 0) +
+             ChunkedSize(cbPayload) + XFRAME_CHUNK_SIZE;
+unsigned char *pB = pBuf;
+
+  if(!pBuf)
+  {
+    return lSize;
+  }
+
+  pB += XFrameHeader(pB, pHead);
+
+  if(cbThumb > 0)
+  {
+    pB = PutChunked(pB, XFRAME_THUMBNAIL, pThumb, cbThumb);
+  }
+
+  pB = PutChunked(pB, XFRAME_PAYLOAD, pPayload, cbPayload);
+
+  XFrameChunk(pB, XFRAME_END, 0);
+
+  return lSize;
+}
+
+void XFrameParseInit(XFRAME_PARSER *pP, const XFRAME_CALLS *pCalls, void *pCtx)
+{
+  memset(pP, 0, sizeof(*pP));
+
+  if(pCalls)
+  {
+    pP->calls = *pCalls;
+  }
+  pP->pCtx = pCtx;
+  pP->iState = FRAME_HEAD;
+  pP->cbWant = 8;
+}
+
+// the header is all in abBuf.  0, or -1 if it is damaged
+static int ParseHeader(XFRAME_PARSER *pP)
+{
+const unsigned char *pB = pP->abBuf;
+XFRAME_HEADER *pH = &(pP->head);
+unsigned int uBits;
+int i1;
+
+  if(XCrc16(0, pB, pP->cbBuf - 2) != Get16(pB + pP->cbBuf - 2))
+  {
+    return -1;
+  }
+
+  pH->iFlags = pB[5];
+  pH->iLocation = Get16(pB + 8);
+  pH->iPan = Get16(pB + 10);
+  pH->iTilt = Get16(pB + 12);
+  pH->iBatteryMv = Get16(pB + 14);
+  pH->ulCaptured = Get32(pB + 16);
+
+  for(i1=0; i1 < 8; i1++)
+  {
+    pH->aiCorners[i1] = (short)Get16(pB + 20 + 2 * i1);
+  }
+
+  pH->iWidth = Get16(pB + 36);
+  pH->iHeight = Get16(pB + 38);
+
+  for(i1=0; i1 < 9; i1++)
+  {
+    uBits = (unsigned int)Get32(pB + 40 + 4 * i1);
+    memcpy(&(pH->afH[i1]), &uBits, sizeof(uBits));
+  }
+
+  if(pP->calls.pfnHeader)
+  {
+    pP->calls.pfnHeader(pP->pCtx, pH);
+  }
+
+  return 0;
+}
+
+// a chunk header is all in abBuf.  0, or -1 if it is damaged
+static int ParseChunk(XFRAME_PARSER *pP)
+{
+int iType = pP->abBuf[0];
+unsigned long ulSize = Get32(pP->abBuf + 2);
+long lSize = (long)ulSize;
+
+  // with a 32 bit long a damaged length could turn negative and take the
+  // parser backwards
+  if(ulSize > XFRAME_CHUNK_MAX)
+  {
+    return -1;
+  }
+
+  if((iType != XFRAME_THUMBNAIL && iType != XFRAME_PAYLOAD && iType != XFRAME_END) || pP->abBuf[1] ||
+     (pP->iType == XFRAME_PAYLOAD && iType == XFRAME_THUMBNAIL) || (iType == XFRAME_END && lSize))
+  {
+    return -1;
+  }
+
+  // the data of the type before is all in
+  if(pP->iType && pP->iType != iType && pP->calls.pfnEnd)
+  {
+    pP->calls.pfnEnd(pP->pCtx, pP->iType);
+  }
+
+  pP->iType = iType;
+  pP->lLeft = lSize;
+
+  if(iType == XFRAME_END && pP->calls.pfnEnd)
+  {
+    pP->calls.pfnEnd(pP->pCtx, XFRAME_END);
+  }
+
+  return 0;
+}
+
+int XFrameParse(XFRAME_PARSER *pP, const void *pData, long cbData)
+{
+const unsigned char *pB = (const unsigned char *)pData;
+long cbTake;
+
+  while(cbData > 0 && pP->iState >= 0 && pP->iState != FRAME_DONE)
+  {
+    if(pP->iState == FRAME_DATA)
+    {
+      cbTake = cbData < pP->lLeft ? cbData : pP->lLeft;
+      if(pP->calls.pfnData)
+      {
+        pP->calls.pfnData(pP->pCtx, pP->iType, pB, cbTake);
+      }
+
+      pP->lLeft -= cbTake;
+      if(!pP->lLeft)
+      {
+        pP->iState = FRAME_CHUNK;
+        pP->cbWant = XFRAME_CHUNK_SIZE;
+      }
+    }
+    else
+    {
+      cbTake = pP->cbWant - pP->cbBuf;
+      cbTake = cbData < cbTake ? cbData : cbTake;
+      memcpy(pP->abBuf + pP->cbBuf, pB, cbTake);
+      pP->cbBuf += cbTake;
+    }
+
+    pB += cbTake;
+    cbData -= cbTake;
+
+    if(pP->iState == FRAME_DATA || pP->cbBuf < pP->cbWant)
+    {
+      continue;
+    }
+
+    switch(pP->iState)
+    {
+      case FRAME_HEAD:
+        pP->cbWant = Get16(pP->abBuf + 6);
+        if(memcmp(pP->abBuf, "GFRM", 4) || pP->abBuf[4] < 1 ||
+           pP->cbWant < XFRAME_HEADER_SIZE || pP->cbWant > XFRAME_HEADER_MAX)
+        {
+          pP->iState = -1;
+          break;
+        }
+        pP->iState = FRAME_REST;
+        break;
+
+      case FRAME_REST:
+        pP->iState = ParseHeader(pP) ? -1 : FRAME_CHUNK;
+        pP->cbBuf = 0;
+        pP->cbWant = XFRAME_CHUNK_SIZE;
+        break;
+
+      case FRAME_CHUNK:
+        if(ParseChunk(pP))
+        {
+          pP->iState = -1;
+        }
+        else
+        {
+          pP->iState = pP->iType == XFRAME_END ? FRAME_DONE : pP->lLeft ? FRAME_DATA : FRAME_CHUNK;
+        }
+        pP->cbBuf = 0;
+        break;
+    }
+  }
+
+  return pP->iState < 0 ? -1 : pP->iState == FRAME_DONE ? 1 : 0;
+}
@@ -0,0 +1,112 @@
+#ifndef XFRAME_H
+#define XFRAME_H
+
+/* Gusset frames, a location's image in one file with what the field unit
+knows about it, laid out so the base station can start on it before all
+of it has arrived.
+
+A frame is a fixed header followed by chunks, every number little endian:
+
+  header, XFRAME_HEADER_SIZE bytes
+     0  "GFRM"
+     4  version (1), flags (XFRAME_CORRECTED, XFRAME_WARP)
+     6  header size, a later version may add fields before the CRC
+     8  location, pan feedback, tilt feedback, battery mV (0 if unknown)
+    16  capture time, unix seconds
+    20  corners in the capture, sw nw ne se, x then y, signed
+    36  width and height of the corrected image
+    40  H, 9 IEEE floats row by row, the capture to the corrected image
+    76  0
+    78  CRC-16 (see xcrc.h) of the header before it
+
+  chunk, XFRAME_CHUNK_SIZE bytes and then its data
+     0  type, XFRAME_THUMBNAIL, XFRAME_PAYLOAD or XFRAME_END
+     1  0
+     2  bytes of data, at most XFRAME_CHUNK_MAX
+
+The thumbnail, if there is one, comes before the payload.  Either may be
+split over several chunks in a row, so a writer need not know how big
+the payload will be when it starts.  Chunk headers have no CRC, a length
+over XFRAME_CHUNK_MAX is taken for damage.  An XFRAME_END chunk without data
+ends the frame.
+
+XFrameParse takes the frame in pieces as they come and reads each byte
+once.  The header is there as soon as its bytes are, and the thumbnail
+well before the payload.
+*/
+
+#define XFRAME_HEADER_SIZE 80
+#define XFRAME_HEADER_MAX 256  /* largest header a later version may have */
+#define XFRAME_CHUNK_SIZE 6
+#define XFRAME_CHUNK_MAX 0x4000000L  /* 64 MB, data of a chunk, more goes in several */
+
+#define XFRAME_CORRECTED 1     /* the payload is the corrected image, else the capture */
+#define XFRAME_WARP 2          /* the corners, size and H are there */
+
+#define XFRAME_THUMBNAIL 'T'
+#define XFRAME_PAYLOAD 'P'
+#define XFRAME_END 'E'
+
+typedef struct _XFRAME_HEADER_
+{
+  int iFlags;                ///< XFRAME_CORRECTED, XFRAME_WARP
+  int iLocation;             ///< number of the location in locations.txt
+  int iPan;                  ///< pan feedback at the capture
+  int iTilt;                 ///< tilt feedback at the capture
+  int iBatteryMv;            ///< battery voltage, 0 if not known
+  unsigned long ulCaptured;  ///< capture time, unix seconds
+  int aiCorners[8];          ///< sw nw ne se in the capture, x then y
+  int iWidth;                ///< of the corrected image
+  int iHeight;
+  float afH[9];              ///< capture to corrected image, row by row
+} XFRAME_HEADER;
+
+typedef struct _XFRAME_CALLS_
+{
+  void (*pfnHeader)(void *pCtx, const XFRAME_HEADER *pHead);                 ///< the header is in, may be NULL
+  void (*pfnData)(void *pCtx, int iType, const void *pData, long cbData);   ///< bytes of the thumbnail or payload as they come, may be NULL
+  void (*pfnEnd)(void *pCtx, int iType);                                     ///< all of a type is in, XFRAME_END for the frame, may be NULL
+} XFRAME_CALLS;
+
+typedef struct _XFRAME_PARSER_
+{
+  XFRAME_CALLS calls;        ///< what to tell the caller
+  void *pCtx;                ///< passed to the calls
+  int iState;                ///< what the parser expects next, -1 if this is not a frame
+  unsigned char abBuf[XFRAME_HEADER_MAX]; ///< the header or chunk header so far
+  int cbBuf;                 ///< bytes in abBuf
+  int cbWant;                ///< bytes abBuf is to have
+  int iType;                 ///< of the data under way, 0 before the first
+  long lLeft;                ///< bytes of the chunk's data to come
+  XFRAME_HEADER head;        ///< once it is in
+} XFRAME_PARSER;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// puts the header in pBuf, XFRAME_HEADER_SIZE bytes.  returns that
+int XFrameHeader(unsigned char *pBuf, const XFRAME_HEADER *pHead);
+
+// puts the header of a chunk with cbData bytes of iType in pBuf,
+// XFRAME_CHUNK_SIZE bytes.  returns that
+int XFrameChunk(unsigned char *pBuf, int iType, unsigned long cbData);
+
+// a whole frame in pBuf, the thumbnail left out if cbThumb is 0 and data
+// over XFRAME_CHUNK_MAX split over several chunks.  returns its size, pBuf
+// may be NULL to find that out
+long XFrameBuild(unsigned char *pBuf, const XFRAME_HEADER *pHead, const void *pThumb, long cbThumb,
+                 const void *pPayload, long cbPayload);
+
+// starts on a new frame.  pCalls is copied
+void XFrameParseInit(XFRAME_PARSER *pP, const XFRAME_CALLS *pCalls, void *pCtx);
+
+// the next cbData bytes of the frame.  1 once the end is in, 0 while more
+// is to come, -1 if it is not a frame or is damaged
+int XFrameParse(XFRAME_PARSER *pP, const void *pData, long cbData);
+
+#ifdef __cplusplus
+};
+#endif // __cplusplus
+
+#endif // XFRAME_H
@@ -0,0 +1,86 @@
+#include "xmodem.h"
+#include "xlog.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// keeps the newer half of a log that grew past XLOG_MAX, from the start of
+// a line.  the rest is written next to it and renamed over it, so a power
+// cut leaves one or the other
+static int TrimLog(const char *szPath, long cbLog)
+{
+char szTemp[300], *pBuf;
+FILE *pF;
+long cbKeep, i1;
+
+  pBuf = (char *)malloc(cbLog);
+  pF = fopen(szPath, "rb");
+
+  if(!pBuf || !pF || fread(pBuf, 1, cbLog, pF) != (size_t)cbLog)
+  {
+    free(pBuf);
+
+    if(pF)
+    {
+      fclose(pF);
+    }
+
+    return -1;
+  }
+
+  fclose(pF);
+
+  for(i1=cbLog - XLOG_MAX / 2; i1 < cbLog && pBuf[i1 - 1] != '\n'; i1++)
+  {
+  }
+
+  cbKeep = cbLog - i1;
+  snprintf(szTemp, sizeof(szTemp), "%s.tmp", szPath);
+  pF = fopen(szTemp, "wb");
+
+  if(!pF || fwrite(pBuf + i1, 1, cbKeep, pF) != (size_t)cbKeep || fclose(pF) ||
+     rename(szTemp, szPath))
+  {
+    free(pBuf);
+    remove(szTemp);
+    return -1;
+  }
+
+  free(pBuf);
+
+  return 0;
+}
+
+int XLogStats(const char *szPath, const char *szWhat, int iResult, const struct _XMODEM_STATS_ *pStats)
+{
+FILE *pF = fopen(szPath, "ab");
+long cbLog;
+int i1;
+
+  if(!pF)
+  {
+    return -1;
+  }
+
+  fprintf(pF, "%ld %s %d %ld %ld %ld %ld %ld %ld %ld %ld %ld %ld ",
+          (long)time(NULL), szWhat, iResult, pStats->lBytes, pStats->lMillis, pStats->lRate,
+          pStats->lBlocks, pStats->lResent, pStats->lNaks, pStats->lTimeouts, pStats->lBad,
+          pStats->lParity, pStats->lRepaired);
+
+  for(i1=0; i1 < XSTATS_RTT_BUCKETS; i1++)
+  {
+    fprintf(pF, i1 ? ",%ld" : "%ld", pStats->aRtt[i1]);
+  }
+
+  fputc('\n', pF);
+  cbLog = ftell(pF);
+
+  if(fclose(pF))
+  {
+    return -1;
+  }
+
+  return cbLog > XLOG_MAX ? TrimLog(szPath, cbLog) : 0;
+}
@@ -0,0 +1,39 @@
+#ifndef XLOG_H
+#define XLOG_H
+
+#include "xmodem.h"
+
+/* The link log the field unit keeps of its transfers, one line each:
+
+  <unix time> <what> <result> <bytes> <ms> <bytes/s> <blocks> <resent>
+  <naks> <timeouts> <bad> <parity> <repaired> <rtt histogram>
+
+the counts are those of XMODEM_STATS, and the histogram is the
+XSTATS_RTT_BUCKETS counts of aRtt joined by commas.  The file is kept
+under XLOG_MAX bytes by dropping its older half, so it fits on the SD card
+for good and goes across in a few seconds when the base station asks for
+it with message '5'.
+
+The base station asks after a batch that went through.  The sender drains
+its input until a second of silence at the end of a batch, so the '5'
+comes XLOG_ASK ms after the last ACK, and the field unit waits XLOG_WAIT ms
+for it after each batch.
+*/
+
+#define XLOG_MAX 16384
+#define XLOG_ASK 1500
+#define XLOG_WAIT 3000
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// appends the line for a transfer, szWhat names it without spaces ("batch",
+// "image").  0, or -1 if the log could not be written
+int XLogStats(const char *szPath, const char *szWhat, int iResult, const XMODEM_STATS *pStats);
+
+#ifdef __cplusplus
+};
+#endif // __cplusplus
+
+#endif // XLOG_H
@@ -11,11 +11,17 @@
 #endif // WIN32 vs THE REST OF THE WORLD
 
 #define _SOH_ 1 /* start of packet - note XMODEM-1K uses '2' */
+#define _STX_ 2 /* start of 1024 byte XMODEM-1K packet */
 #define _EOT_ 4
 #define _ENQ_ 5
 #define _ACK_ 6
 #define _NAK_ 21 /* NAK character */
 #define _CAN_ 24 /* CAN character CTRL+X */
+#define _WIN_ 23 /* ETB, start of a sliding window packet */
+#define _FEC_ 25 /* EM, start of a parity packet in window mode */
+
+#define WINDOW_MAX 32 /* blocks in flight, one bit each in the selective ACK */
+#define FEC_RING (2 * WINDOW_MAX) /* blocks the receiver keeps for rebuilding */
 
 typedef struct _XMODEM_BUF_
 {
@@ -33,6 +39,42 @@ typedef struct _XMODEMC_BUF_
    unsigned short wCRC;         ///< CRC gets 2 bytes, high endian
 } PACKED XMODEMC_BUF;
 
+typedef struct _XMODEM1K_BUF_
+{
+   char cSOH;                   ///< STX byte goes here
+   unsigned char aSEQ, aNotSEQ; ///< 1st byte = seq#, 2nd is ~seq#
+   char aDataBuf[1024];         ///< the actual data itself!
+   unsigned short wCRC;         ///< 1K blocks always use the CRC, high endian
+} PACKED XMODEM1K_BUF;
+
+typedef struct _XMODEMW_BUF_
+{
+   char cSOH;                   ///< _WIN_ byte goes here
+   unsigned short wSEQ, wNotSEQ; ///< 16 bit seq# and ~seq#, high endian
+   char aDataBuf[1024];         ///< the actual data itself!
+   unsigned short wCRC;         ///< CRC gets 2 bytes, high endian
+} PACKED XMODEMW_BUF;
+
+// XOR of a group of sliding window blocks, the same size as one
+typedef struct _XMODEMP_BUF_
+{
+   char cSOH;                   ///< _FEC_ byte goes here
+   unsigned short wFirst;       ///< seq# of the first block of the group, high endian
+   unsigned char bCount, bNotCount; ///< blocks in the group and ~count
+   char aDataBuf[1024];         ///< XOR of their data, padding included
+   unsigned short wCRC;         ///< CRC of wFirst through aDataBuf, high endian
+} PACKED XMODEMP_BUF;
+
+// sliding window acknowledgement, cumulative plus a bitmap of the blocks
+// that arrived after the first missing one
+typedef struct _XMODEMW_ACK_
+{
+   char cACK;                   ///< ACK byte goes here
+   unsigned short wNext;        ///< first block not received yet, high endian
+   unsigned char aMask[WINDOW_MAX / 8]; ///< bit n set when block wNext+1+n arrived
+   unsigned short wCRC;         ///< CRC of wNext and aMask, high endian
+} PACKED XMODEMW_ACK;
+
 #ifdef WIN32
 // restore default packing
 #pragma pack(pop)
@@ -47,13 +89,105 @@ typedef struct _XMODEM_
   {
     XMODEM_BUF xbuf;   ///< XMODEM CHECKSUM buffer
     XMODEMC_BUF xcbuf; ///< XMODEM CRC buffer
-  } buf;               ///< union of both buffers, total length 133 bytes
+    XMODEM1K_BUF x1kbuf; ///< XMODEM-1K buffer
+    XMODEMW_BUF xwbuf; ///< sliding window buffer
+    XMODEMP_BUF xpbuf; ///< parity buffer
+  } buf;               ///< union of all buffers, total length 1031 bytes
 
   unsigned char bCRC;  ///< non-zero for CRC, zero for checksum
+  unsigned char b1K;   ///< non-zero while 1024 byte blocks are being sent
+  unsigned char bYMODEM; ///< non-zero once a YMODEM header was accepted
+  unsigned char bWindow; ///< non-zero in sliding window mode
+  unsigned char bMore; ///< the sender has another file after this one
+  unsigned char bNext; ///< the receiver has the header of the next file in 'buf'
+  unsigned char bFec;  ///< the receiver rebuilds blocks from parity
+  int iFile;           ///< files before this one in the batch
+  long lFileSize;      ///< file size for (or from) the YMODEM header, -1 if unknown
+  char szName[64];     ///< file name for (or from) the YMODEM header
+  unsigned long long ullHash; ///< content hash in the YMODEM header, 0 if none
+  long lOffset;        ///< where in the file this session starts
+  long lDone;          ///< bytes the receiver has, counted from the start
+#ifndef ARDUINO
+  XREADER reader;      ///< buffered input from 'ser'
+  XMODEM_STREAM *pStream; ///< source or sink in place of 'file', or NULL
+  long lResumable;     ///< bytes the receiver kept from an earlier session
+  long lSaved;         ///< offset in the last progress record
+  char szPath[256];    ///< the file at this end
+  char szRecord[300];  ///< progress record, empty when not resuming
+  char aParity[1024];  ///< XOR of the blocks of the parity group being sent
+#endif // ARDUINO
+  XMODEM_STATS stats;  ///< what the link cost so far
+  unsigned long ulStart; ///< MyMillis() when the call began
 
 } XMODEM;
 
 
+// YMODEM-1K is offered to the receiver unless this is cleared
+static int bOfferYmodem = 1;
+
+// blocks the sender keeps in flight when the receiver allows a window
+static int iWindow = 8;
+
+// a YMODEM transfer that failed part way picks up where it left off
+static int bResume = 1;
+
+// blocks per parity block in window mode, 0 for none
+static int iFec = XFEC_ADAPTIVE;
+
+// stop-and-wait block size, 0 to pick it from the errors
+static int iBlockSize = 0;
+
+// told about the receiver's data as it arrives
+static XMODEM_PROGRESS pfnProgress = NULL;
+static void *pProgressCtx = NULL;
+
+// the counts of the last transfer, and the share of its blocks lost that
+// the next one starts from.  each thread has its own
+#ifdef ARDUINO
+static XMODEM_STATS lastStats;
+static unsigned long ulLastLoss;
+#else // ARDUINO
+static __thread XMODEM_STATS lastStats;
+static __thread unsigned long ulLastLoss;
+#endif // ARDUINO
+
+void XSetYmodem(int bEnable)
+{
+  bOfferYmodem = bEnable;
+}
+
+void XSetWindow(int nBlocks)
+{
+  iWindow = nBlocks < 1 ? 1 : nBlocks > WINDOW_MAX ? WINDOW_MAX : nBlocks;
+}
+
+void XSetResume(int bEnable)
+{
+  bResume = bEnable;
+}
+
+void XSetFec(int nGroup)
+{
+  iFec = nGroup < 0 ? XFEC_ADAPTIVE : nGroup > XFEC_GROUP_MAX ? XFEC_GROUP_MAX : nGroup;
+  ulLastLoss = 0;
+}
+
+void XSetBlockSize(int cbBlock)
+{
+  iBlockSize = cbBlock <= 0 ? 0 : cbBlock < 1024 ? 128 : 1024;
+}
+
+void XSetProgress(XMODEM_PROGRESS pfn, void *pCtx)
+{
+  pfnProgress = pfn;
+  pProgressCtx = pCtx;
+}
+
+void XGetStats(XMODEM_STATS *pStats)
+{
+  *pStats = lastStats;
+}
+
 #ifdef DEBUG_CODE
 static char szERR[32]; // place for error messages, up to 16 characters
 
@@ -146,6 +280,7 @@ const unsigned char *p1, *p2;
 
 unsigned char CalcCheckSum(const char *lpBuf, short cbBuf)
 {
+#ifdef ARDUINO
 short iC, i1;
 
   iC = 0;
@@ -156,6 +291,9 @@ short iC, i1;
   }
 
   return (unsigned char)(iC & 0xff);
+#else // ARDUINO
+  return XCheckSum(0, lpBuf, cbBuf);
+#endif // ARDUINO
 }
 
 static unsigned short my_htons(unsigned short sVal)
@@ -184,6 +322,7 @@ static unsigned short my_htons(unsigned short sVal)
 }
 unsigned short CalcCRC(const char *lpBuf, short cbBuf)
 {
+#ifdef ARDUINO
 unsigned short wCRC;
 short i1, i2, iAX;
 char cAL;
@@ -218,27 +357,51 @@ char cAL;
   }
 
   return my_htons(wCRC);
+#else // ARDUINO
+  // tables or the carry-less multiply, see xcrc.c
+  return my_htons(XCrc16(0, lpBuf, cbBuf));
+#endif // ARDUINO
 }
 
-#ifndef ARDUINO
+#ifdef ARDUINO
+#define MyMillis millis
+#else // ARDUINO
 #ifdef WIN32
 #define MyMillis GetTickCount
 #else // WIN32
 
 unsigned long MyMillis(void)
 {
-struct timeval tv;
-
-  gettimeofday(&tv, NULL); // 2nd parameter is obsolete anyway
-
+  // the monotonic clock, so deadlines don't move when the time is set.
   // NOTE:  this won't roll over the way 'GetTickCount' does in WIN32 so I'll truncate it
   //        down to a 32-bit value to make it happen.  Everything that uses 'MyGetTickCount'
   //        must handle this rollover properly using 'int' and not 'long' (or cast afterwards)
-  return((unsigned int)((unsigned long)tv.tv_sec * 1000L + (unsigned long)tv.tv_usec / 1000L));
+  return (unsigned int)XReaderMillis();
 }
 #endif // WIN32
 #endif // ARDUINO
 
+// counts a block the receiver ACKed ulMs after it was sent
+void CountRtt(XMODEM *pX, unsigned long ulMs)
+{
+int i1;
+
+  for(i1=0; i1 < XSTATS_RTT_BUCKETS - 1 && ulMs >= (32UL << i1); i1++)
+  {
+  }
+
+  pX->stats.aRtt[i1]++;
+}
+
+// the counts of the call that is ending, for XGetStats
+void KeepStats(XMODEM *pX)
+{
+  pX->stats.lMillis = (long)(MyMillis() - pX->ulStart);
+  pX->stats.lRate = pX->stats.lMillis > 0 ? (long)(pX->stats.lBytes * 1000.0 / pX->stats.lMillis) : 0;
+
+  lastStats = pX->stats;
+}
+
 void GenerateSEQ(XMODEM_BUF *pBuf, unsigned char bSeq)
 {
   pBuf->aSEQ = bSeq;
@@ -251,24 +414,25 @@ void GenerateSEQC(XMODEMC_BUF *pBuf, unsigned char bSeq)
   pBuf->aNotSEQ = (255 - bSeq);//~bSeq; these should be the same but for now I do this...
 }
 
-short GetXmodemBlock(SERIAL_TYPE ser, char *pBuf, short cbSize)
+// reads up to cbSize bytes, giving up after ulSilence msecs without any
+short GetXmodemBlockWait(XMODEM *pX, char *pBuf, short cbSize, unsigned long ulSilence)
 {
-unsigned long ulCur;
 short cb1;
-char *p1;
 
 #ifdef ARDUINO
+unsigned long ulCur;
+char *p1;
 short i1;
 
   p1 = pBuf;
   cb1 = 0;
 
   ulCur = millis();
-  ser->setTimeout(SILENCE_TIMEOUT); // 5 seconds [of silence]
+  pX->ser->setTimeout(ulSilence); // normally 5 seconds [of silence]
 
   for(i1=0; i1 < cbSize; i1++)
   {
-    if(ser->readBytes(p1, 1) != 1) // 5 seconds of "silence" is what fails this
+    if(pX->ser->readBytes(p1, 1) != 1) // 5 seconds of "silence" is what fails this
     {
       break;
     }
@@ -276,7 +440,7 @@ short i1;
     cb1++;
     p1++;
 
-    if((millis() - ulCur) > (unsigned long)(10L * SILENCE_TIMEOUT)) // 10 times SILENCE TIMEOUT for TOTAL TIMEOUT
+    if((millis() - ulCur) > 10L * ulSilence) // 10 times SILENCE TIMEOUT for TOTAL TIMEOUT
     {
       break; // took too long, I'm going now
     }
@@ -287,62 +451,9 @@ short i1;
 #error no win32 code yet
 
 #else // POSIX
-int i1, i2;
-unsigned long ulStart;
-
-
-  if(fcntl(ser, F_SETFL, O_NONBLOCK) == -1)
-  {
-    static int iFailFlag = 0;
-
-    if(!iFailFlag)
-    {
-      fprintf(stderr, "Warning:  'fcntl(O_NONBLOCK)' failed, errno = %d\n", errno);
-      fflush(stderr);
-      iFailFlag = 1;
-    }
-  }
-
-  p1 = pBuf;
-  cb1 = 0;
-
-  ulStart = ulCur = MyMillis();
-
-  for(i1=0; i1 < cbSize; i1++)
-  {
-    while((i2 = read(ser, p1, 1)) != 1)
-    {
-      if(i2 < 0 && errno != EAGAIN)
-      {
-        // read error - exit now
-//        return cb1; // how many bytes I actually read
-        goto the_end;
-      }
-      else
-      {
-        usleep(1000); // 1 msec
-
-        if((MyMillis() - ulCur) > SILENCE_TIMEOUT || // too much silence?
-           (MyMillis() - ulStart) > 10 * SILENCE_TIMEOUT) // too long for transfer
-        {
-//          return cb1; // finished (return how many bytes I actually read)
-          goto the_end;
-        }
-      }
-    }
 
-    // here it succeeds
-
-    cb1++;
-    p1++;
-
-    if((MyMillis() - ulStart) > 10 * SILENCE_TIMEOUT) // 10 times SILENCE TIMEOUT for TOTAL TIMEOUT
-    {
-      break; // took too long, I'm going now
-    }
-  }
-
-the_end:
+  // the reader waits in poll() and pulls in everything that has arrived
+  cb1 = XReaderRead(&(pX->reader), pBuf, cbSize, ulSilence);
 
 #ifdef STAND_ALONE
   fprintf(stderr, "GetXmodemBlock - request %d, read %d  errno=%d\n", cbSize, cb1, errno);
@@ -357,6 +468,11 @@ the_end:
   return cb1; // what I actually read
 }
 
+short GetXmodemBlock(XMODEM *pX, char *pBuf, short cbSize)
+{
+  return GetXmodemBlockWait(pX, pBuf, cbSize, SILENCE_TIMEOUT);
+}
+
 int WriteXmodemChar(SERIAL_TYPE ser, unsigned char bVal)
 {
 int iRval;
@@ -372,16 +488,7 @@ int iRval;
 #else // POSIX
 char buf[2]; // use size of '2' to avoid warnings about array size of '1'
 
-  if(fcntl(ser, F_SETFL, 0) == -1) // set blocking mode
-  {
-    static int iFailFlag = 0;
-
-    if(!iFailFlag)
-    {
-      fprintf(stderr, "Warning:  'fcntl(O_NONBLOCK)' failed, errno = %d\n", errno);
-      iFailFlag = 1;
-    }
-  }
+  // the port was left in blocking mode by XReaderInit
 
   buf[0] = bVal; // in case args are passed by register
 
@@ -413,18 +520,7 @@ int iRval;
 
 #else // POSIX
 
-
-  if(fcntl(ser, F_SETFL, 0) == -1) // set blocking mode
-  {
-    static int iFailFlag = 0;
-
-    if(!iFailFlag)
-    {
-      fprintf(stderr, "Warning:  'fcntl(O_NONBLOCK)' failed, errno = %d\n", errno);
-      fflush(stderr);
-      iFailFlag = 1;
-    }
-  }
+  // the port was left in blocking mode by XReaderInit
 
   iRval = write(ser, pBuf, cbSize);
 
@@ -442,18 +538,18 @@ int iRval;
   return iRval;
 }
 
-void XModemFlushInput(SERIAL_TYPE ser)
+void XModemFlushInput(XMODEM *pX)
 {
-unsigned long ulStart;
 #ifdef ARDUINO
+unsigned long ulStart;
 
   ulStart = millis();
 
   do
   {
-    if(ser->available())
+    if(pX->ser->available())
     {
-      ser->read(); // don't care about the data
+      pX->ser->read(); // don't care about the data
       ulStart = millis(); // reset time
     }
     else
@@ -468,66 +564,15 @@ unsigned long ulStart;
 #error no win32 code yet
 
 #else // POSIX
-int i1;
-#ifdef DEBUG_CODE
-unsigned char buf[16];
-int cbBuf;
-#else // DEBUG_CODE
-unsigned char buf[2];
-#endif // DEBUG_CODE  
-
-  if(fcntl(ser, F_SETFL, O_NONBLOCK) == -1)
-  {
-    static int iFailFlag = 0;
-
-    if(!iFailFlag)
-    {
-      fprintf(stderr, "Warning:  'fcntl(O_NONBLOCK)' failed, errno = %d\n", errno);
-      iFailFlag = 1;
-    }
-  }
 
-  ulStart = MyMillis();
-#ifdef DEBUG_CODE
-  cbBuf = 0;
-#endif // DEBUG_CODE
-  while((MyMillis() - ulStart) < 1000)
-  {
-#ifdef DEBUG_CODE
-    i1 = read(ser, &(buf[cbBuf]), 1);
-#else // DEBUG_CODE
-    i1 = read(ser, buf, 1);
-#endif // DEBUG_CODE
-    if(i1 == 1)
-    {
-#if defined(STAND_ALONE) && defined(DEBUG_CODE)
-      cbBuf++;
-      if(cbBuf >= sizeof(buf))
-      {
-        debug_dump_buffer(-1, buf, cbBuf);
-        cbBuf = 0;
-      }
-#endif // STAND_ALONE, DEBUG_CODE
-      ulStart = MyMillis();
-    }
-    else
-    {
-      usleep(1000);
-    }
-  }
+  XReaderDrain(&(pX->reader), 1000); // until a second without input
 
-#if defined(STAND_ALONE) && defined(DEBUG_CODE)
-  if(cbBuf > 0)
-  {
-    debug_dump_buffer(-1, buf, cbBuf);
-  }
-#endif // STAND_ALONE, DEBUG_CODE
 #endif // ARDUINO
 }
 
 void XmodemTerminate(XMODEM *pX)
 {
-  XModemFlushInput(pX->ser);
+  XModemFlushInput(pX);
 
   // TODO:  close files?
 }
@@ -544,636 +589,2598 @@ short ValidateSEQC(XMODEMC_BUF *pX, unsigned char bSeq)
          pX->aSEQ != bSeq; // returns TRUE if not valid
 }
 
-int ReceiveXmodem(XMODEM *pX)
+// returns TRUE if the block in pX->buf is damaged.  1K blocks are only
+// valid with a CRC
+short CorruptBlock(XMODEM *pX, int cbData)
 {
-int ecount, ec2;
-long etotal, filesize, block;
-unsigned char cY; // the char to send in response to a packet
-// NOTE:  to allow debugging the CAUSE of an xmodem block's failure, i1, i2, and i3
-//        are assigned to function return values and reported in error messages.
-#ifdef DEBUG_CODE
-short i1, i2, i3;
-#define DEBUG_I1 i1 =
-#define DEBUG_I2 i2 =
-#define DEBUG_I3 i3 =
-#else // DEBUG_CODE
-#define DEBUG_I1 /*normally does nothing*/
-#define DEBUG_I2 /*normally does nothing*/
-#define DEBUG_I3 /*normally does nothing*/
-#endif // DEBUG_CODE
+  if(pX->buf.xbuf.aSEQ != 255 - pX->buf.xbuf.aNotSEQ)
+  {
+    return 1;
+  }
 
-  ecount = 0;
-  etotal = 0;
-  filesize = 0;
-  block = 1;
+  if(cbData == sizeof(pX->buf.x1kbuf.aDataBuf))
+  {
+    return !pX->bCRC ||
+           CalcCRC(pX->buf.x1kbuf.aDataBuf, sizeof(pX->buf.x1kbuf.aDataBuf)) != pX->buf.x1kbuf.wCRC;
+  }
+
+  if(pX->bCRC)
+  {
+    return CalcCRC(pX->buf.xcbuf.aDataBuf, sizeof(pX->buf.xcbuf.aDataBuf)) != pX->buf.xcbuf.wCRC;
+  }
 
-  // ** already got the first 'SOH' character on entry to this function **
+  return CalcCheckSum(pX->buf.xbuf.aDataBuf, sizeof(pX->buf.xbuf.aDataBuf)) != pX->buf.xbuf.bCheckSum;
+}
 
-  //   Form2.Show 0      '** modeless show of form2 (CANSEND) **
-  //   Form2!Label1.FloodType = 0
-  //   Form2.Caption = "* XMODEM(Checksum) BINARY RECEIVE *"
-  //   Form2!Label1.Caption = "Errors: 0  Bytes: 0"
+// YMODEM block 0 holds the file name, a NUL, then the size in decimal.
+// for resuming, 'R' and the content hash in hex follow the size, and 'O'
+// and the offset the data starts at once both ends agreed on one.  an
+// empty name ends a batch
+void MakeYmodemHeader(XMODEM *pX, const char *szName, long lSize)
+{
+char *p1;
 
-  pX->buf.xbuf.cSOH = (char)1; // assumed already got this, put into buffer
+  memset(pX->buf.xcbuf.aDataBuf, 0, sizeof(pX->buf.xcbuf.aDataBuf));
 
-  do
+  if(szName && *szName)
   {
-    if(!pX->bCRC &&
-       ((DEBUG_I1 GetXmodemBlock(pX->ser, ((char *)&(pX->buf.xbuf)) + 1, sizeof(pX->buf.xbuf) - 1))
-        != sizeof(pX->buf.xbuf) - 1 ||
-        (DEBUG_I2 ValidateSEQ(&(pX->buf.xbuf), block & 255)) ||
-        (DEBUG_I3 CalcCheckSum(pX->buf.xbuf.aDataBuf, sizeof(pX->buf.xbuf.aDataBuf)) != pX->buf.xbuf.bCheckSum)))
+    strncpy(pX->buf.xcbuf.aDataBuf, szName, 64); // leaves room for the rest
+    p1 = pX->buf.xcbuf.aDataBuf + strlen(pX->buf.xcbuf.aDataBuf) + 1;
+    p1 += sprintf(p1, "%ld", lSize);
+
+    if(pX->ullHash)
     {
-      // did not receive properly
-      // TODO:  deal with repeated packet, sequence number for previous packet
+      p1 += sprintf(p1, " R%016llx", pX->ullHash);
 
-#ifdef DEBUG_CODE
-      sprintf(szERR,"A%ld,%d,%d,%d,%d,%d",block,i1,i2,i3,pX->buf.xbuf.aSEQ, pX->buf.xbuf.aNotSEQ);
-//#ifdef STAND_ALONE
-//      fprintf(stderr, "TEMPORARY (csum):  seq=%x, ~seq=%x  i1=%d, i2=%d, i3=%d\n", pX->buf.xbuf.aSEQ, pX->buf.xbuf.aNotSEQ, i1, i2, i3);
-//#endif // STAND_ALONE
-#endif // DEBUG_CODE
+      if(pX->lOffset)
+      {
+        sprintf(p1, " O%ld", pX->lOffset);
+      }
+    }
+  }
 
-      XModemFlushInput(pX->ser);  // necessary to avoid problems
+  pX->buf.xcbuf.cSOH = _SOH_;
+  GenerateSEQC(&(pX->buf.xcbuf), 0);
+  pX->buf.xcbuf.wCRC = CalcCRC(pX->buf.xcbuf.aDataBuf, sizeof(pX->buf.xcbuf.aDataBuf));
+}
 
-      cY = _NAK_; // send NAK (to get the checksum version)
-      ecount ++; // for this packet
-      etotal ++;
-    }
-    else if(pX->bCRC &&
-            ((DEBUG_I1 GetXmodemBlock(pX->ser, ((char *)&(pX->buf.xcbuf)) + 1, sizeof(pX->buf.xcbuf) - 1))
-             != sizeof(pX->buf.xcbuf) - 1 ||
-            (DEBUG_I2 ValidateSEQC(&(pX->buf.xcbuf), block & 255)) ||
-            (DEBUG_I3 CalcCRC(pX->buf.xcbuf.aDataBuf, sizeof(pX->buf.xbuf.aDataBuf)) != pX->buf.xcbuf.wCRC)))
-    {
-      // did not receive properly
-      // TODO:  deal with repeated packet, sequence number for previous packet
+void ParseYmodemHeader(XMODEM *pX)
+{
+char *p1;
 
-#ifdef DEBUG_CODE
-      sprintf(szERR,"B%ld,%d,%d,%d,%d,%d",block,i1,i2,i3,pX->buf.xcbuf.aSEQ, pX->buf.xcbuf.aNotSEQ);
-#endif // DEBUG_CODE
+  pX->buf.xcbuf.aDataBuf[sizeof(pX->buf.xcbuf.aDataBuf) - 1] = 0; // make sure
+
+  strncpy(pX->szName, pX->buf.xcbuf.aDataBuf, sizeof(pX->szName) - 1);
+  pX->szName[sizeof(pX->szName) - 1] = 0;
+
+  pX->ullHash = 0;
+  pX->lOffset = 0;
+
+  if(pX->buf.xcbuf.aDataBuf[0])
+  {
+    pX->lFileSize = strtol(pX->buf.xcbuf.aDataBuf + strlen(pX->buf.xcbuf.aDataBuf) + 1, &p1, 10);
 
-      XModemFlushInput(pX->ser);  // necessary to avoid problems
+    // the other YMODEM fields are octal numbers, so the letters stand out
+    while(*p1 == ' ')
+    {
+      p1++;
 
-      if(block > 1)
+      if(*p1 == 'R')
+      {
+        pX->ullHash = strtoull(p1 + 1, &p1, 16);
+      }
+      else if(*p1 == 'O')
       {
-        cY = _NAK_; // TODO do I need this?
+        pX->lOffset = strtol(p1 + 1, &p1, 10);
       }
       else
       {
-        cY = 'C'; // send 'CRC' NAK (the character 'C') (to get the CRC version)
+        strtol(p1, &p1, 8);
       }
-      ecount ++; // for this packet
-      etotal ++;
     }
-    else
-    {
+  }
+}
+
+// reads up to cbBuf bytes of the file at lPos, from the file or the
+// stream.  returns the bytes read
+int ReadXmodemData(XMODEM *pX, long lPos, void *pBuf, int cbBuf)
+{
 #ifdef ARDUINO
-      if(pX->file.write((const uint8_t *)&(pX->buf.xbuf.aDataBuf), sizeof(pX->buf.xbuf.aDataBuf)) != sizeof(pX->buf.xbuf.aDataBuf))
-      {
-        return -2; // write error on output file
-      }
+  pX->file.seek(lPos);
+  return pX->file.read(pBuf, cbBuf);
 #else // ARDUINO
-      if(write(pX->file, &(pX->buf.xbuf.aDataBuf), sizeof(pX->buf.xbuf.aDataBuf)) != sizeof(pX->buf.xbuf.aDataBuf))
-      {
-        XmodemTerminate(pX);
-        return -2; // write error on output file
-      }
-#endif // ARDUINO
-      cY = _ACK_; // send ACK
-      block ++;
-      filesize += sizeof(pX->buf.xbuf.aDataBuf); // TODO:  need method to avoid extra crap at end of file
-      ecount = 0; // zero out error count for next packet
+  if(pX->pStream)
+  {
+    if(cbBuf > pX->pStream->lSize - lPos) // the callback is never asked past the end
+    {
+      cbBuf = (int)(pX->pStream->lSize - lPos);
     }
 
-    fprintf(stderr, "block %ld  %ld bytes  %d errors\r\n", block, filesize, ecount);
+    return cbBuf > 0 ? pX->pStream->pfnRead(pX->pStream->pCtx, lPos, pBuf, cbBuf) : 0;
+  }
 
-    ec2 = 0;   //  ** error count #2 **
+  return (int)pread(pX->file, pBuf, cbBuf, lPos);
+#endif // ARDUINO
+}
 
-    while(ecount < TOTAL_ERROR_COUNT && ec2 < ACK_ERROR_COUNT) // ** loop to get SOH or EOT character **
-    {
-      WriteXmodemChar(pX->ser, cY); // ** output appropriate command char **
+// writes cbBuf bytes of the file at lPos, returns the bytes written
+int WriteXmodemData(XMODEM *pX, long lPos, const void *pBuf, int cbBuf)
+{
+#ifdef ARDUINO
+  pX->file.seek(lPos);
+  return pX->file.write((const uint8_t *)pBuf, cbBuf);
+#else // ARDUINO
+  if(pX->pStream)
+  {
+    return pX->pStream->pfnWrite(pX->pStream->pCtx, lPos, pBuf, cbBuf);
+  }
 
-      if(GetXmodemBlock(pX->ser, &(pX->buf.xbuf.cSOH), 1) == 1)
-      {
-        if(pX->buf.xbuf.cSOH == _CAN_) // ** CTRL-X 'CAN' - terminate
-        {
-          XmodemTerminate(pX);
-          return 1; // terminated
-        }
-        else if(pX->buf.xbuf.cSOH == _EOT_) // ** EOT - end
-        {
-          WriteXmodemChar(pX->ser, _ACK_); // ** send an ACK (most XMODEM protocols expect THIS)
-//          WriteXmodemChar(pX->ser, _ENQ_); // ** send an ENQ
+  return (int)pwrite(pX->file, pBuf, cbBuf, lPos);
+#endif // ARDUINO
+}
 
-          return 0; // I am done
-        }
-        else if(pX->buf.xbuf.cSOH == _SOH_) // ** SOH - sending next packet
-        {
-          break; // leave this loop
-        }
-        else
-        {
-          // TODO:  deal with repeated packet, i.e. previous sequence number
+#ifndef ARDUINO
 
-          XModemFlushInput(pX->ser);  // necessary to avoid problems (since the character was unexpected)
-          // if I was asking for the next block, and got an unexpected character, do a NAK; otherwise,
-          // just repeat what I did last time
+// notes how much of the file the receiver has.  the progress record is
+// rewritten every XRESUME_EVERY bytes, or right away with bForce
+void SaveProgress(XMODEM *pX, long lOffset, int bForce)
+{
+XRESUME r;
 
-          if(cY == _ACK_) // ACK
-          {
-            cY = _NAK_; // NACK
-          }
+  if(lOffset > pX->lDone)
+  {
+    pX->stats.lBytes += lOffset - pX->lDone;
+  }
 
-          ec2++;
-        }
-      }
-      else
-      {
-        ecount++; // increase total error count, and try writing the 'ACK' or 'NACK' again
-      }
-    }
+  pX->lDone = lOffset;
 
-    if(ec2 >= ACK_ERROR_COUNT) // wasn't able to get a packet
-    {
-      break;
-    }
+  // a path cut short to fit the record could name another file, which a
+  // later session would append to
+  if(!pX->szRecord[0] || lOffset <= pX->lSaved ||
+     (!bForce && lOffset - pX->lSaved < XRESUME_EVERY) ||
+     strlen(pX->szPath) >= sizeof(r.szPath))
+  {
+    return;
+  }
 
-  } while(ecount < TOTAL_ERROR_COUNT);
+  fsync(pX->file); // the data goes to the card before a record vouches for it
 
-  XmodemTerminate(pX);
-  return 1; // terminated
+  memset(&r, 0, sizeof(r));
+  r.ullHash = pX->ullHash;
+  r.lSize = pX->lFileSize;
+  r.lOffset = lOffset;
+  strcpy(r.szPath, pX->szPath);
+
+  if(!XResumeWrite(pX->szRecord, &r))
+  {
+    pX->lSaved = lOffset;
+  }
 }
 
+// tells the progress callback how much of the file the receiver has
+void ReportProgress(XMODEM *pX)
+{
+  if(pfnProgress)
+  {
+    pfnProgress(pProgressCtx, pX->pStream ? "" : pX->szPath, pX->szName, pX->lDone, pX->lFileSize);
+  }
+}
 
-int SendXmodem(XMODEM *pX)
+// moves the partial file the directory's record points at out of the way
+// of a new file with the same name
+void ResumeSetAside(const char *szFilename)
 {
-int ecount, ec2;
-short i1;
-long etotal, filesize, filepos, block;
+char szRecord[300];
+XRESUME r;
+size_t cbRecord;
 
+  XResumeReceiverRecord(szFilename, szRecord, sizeof(szRecord));
+  cbRecord = strlen(szRecord);
 
-  ecount = 0;
-  etotal = 0;
-  filesize = 0;
-  filepos = 0;
-  block = 1;
+  // the record keeps the new name, which must fit whole or ResumeOffer
+  // would not find the file.  without room it is left to be replaced
+  if(cbRecord + sizeof(".part") > sizeof(r.szPath) ||
+     XResumeRead(szRecord, &r) || strcmp(r.szPath, szFilename))
+  {
+    return;
+  }
 
-  pX->bCRC = 0; // MUST ASSIGN TO ZERO FIRST or XMODEM-CHECKSUM may not work properly
+  memcpy(r.szPath, szRecord, cbRecord);
+  strcpy(r.szPath + cbRecord, ".part");
 
-  // ** already got first 'NAK' character on entry as pX->buf.xbuf.cSOH  **
+  if(!rename(szFilename, r.szPath))
+  {
+    XResumeWrite(szRecord, &r);
+  }
+}
 
-#ifdef ARDUINO
+// called with the header of a file the sender can resume.  if the record
+// in this directory is for the same file, its data takes the place of the
+// new empty file and the receiver asks to start after it.  returns 1 when
+// it sent that request
+int ResumeOffer(XMODEM *pX)
+{
+unsigned char aMsg[7];
+unsigned short wCRC;
+XRESUME r;
+long lHave;
+int file;
 
-  filesize = pX->file.size();
+  pX->lResumable = 0;
+  pX->lSaved = 0;
+  pX->szRecord[0] = 0;
 
-#else // ARDUINO
+  if(!bResume || !pX->ullHash || pX->lFileSize < 0 || pX->pStream)
+  {
+    return 0;
+  }
 
-  filesize = (long)lseek(pX->file, 0, SEEK_END);
-  if(filesize < 0) // not allowed
+  XResumeReceiverRecord(pX->szPath, pX->szRecord, sizeof(pX->szRecord));
+
+  if(XResumeRead(pX->szRecord, &r) || r.ullHash != pX->ullHash || r.lSize != pX->lFileSize)
   {
-    fputs("SendXmodem fail (file size)\n", stderr);
-    return -1;
+    return 0;
   }
 
-  lseek(pX->file, 0, SEEK_SET); // position at beginning
+  lHave = r.lOffset - r.lOffset % (long)sizeof(pX->buf.xwbuf.aDataBuf); // whole blocks
 
-#endif // ARDUINO
+  file = lHave > 0 ? open(r.szPath, O_WRONLY) : -1;
+  if(file < 0 || lseek(file, 0, SEEK_END) < lHave || rename(r.szPath, pX->szPath))
+  {
+    if(file >= 0)
+    {
+      close(file);
+    }
+    return 0;
+  }
 
-  do
+  close(pX->file); // the empty file, which the rename replaced
+  pX->file = file;
+  pX->lResumable = pX->lSaved = lHave;
+
+  aMsg[0] = 'R';
+  aMsg[1] = (unsigned char)(lHave >> 24);
+  aMsg[2] = (unsigned char)(lHave >> 16);
+  aMsg[3] = (unsigned char)(lHave >> 8);
+  aMsg[4] = (unsigned char)lHave;
+  wCRC = CalcCRC((const char *)aMsg + 1, 4);
+  memcpy(aMsg + 5, &wCRC, 2);
+
+  WriteXmodemBlock(pX->ser, aMsg, sizeof(aMsg));
+
+  fprintf(stderr, "resume: have %ld of %ld bytes of %s\n", lHave, pX->lFileSize, pX->szName);
+  return 1;
+}
+
+// called once the header is accepted, with the offset it states.  returns
+// non-zero if the data the sender skips is not here
+int ResumeAccept(XMODEM *pX)
+{
+  if(pX->lOffset > pX->lResumable || pX->lOffset < 0)
   {
-    // ** depending on type of transfer, place the packet
-    // ** into pX->buf with all fields appropriately filled.
+    return 1;
+  }
 
-    if(filepos >= filesize) // end of transfer
+  if(!pX->lOffset && pX->lResumable)
+  {
+    if(ftruncate(pX->file, 0)) // the sender starts over after all
     {
-      for(i1=0; i1 < 8; i1++)
-      {
-        WriteXmodemChar(pX->ser, _EOT_); // ** send an EOT marking end of transfer
+      return 1;
+    }
+    pX->lSaved = 0;
+  }
 
-        if(GetXmodemBlock(pX->ser, &(pX->buf.xbuf.cSOH), 1) != 1) // this takes up to 5 seconds
-        {
-          // nothing returned - try again?
-          // break; // for now I loop, uncomment to bail out
-        }
-        else if(pX->buf.xbuf.cSOH == _ENQ_    // an 'ENQ' (apparently some expect this)
-                || pX->buf.xbuf.cSOH == _ACK_ // an 'ACK' (most XMODEM implementations expect this)
-                || pX->buf.xbuf.cSOH == _CAN_) // CTRL-X = TERMINATE
-        {
-          // both normal and 'abnormal' termination.
-          break;
-        }
-      }
+  pX->lDone = pX->lOffset;
 
-      XmodemTerminate(pX);
+  return 0;
+}
 
-      fprintf(stderr, "SendXmodem return %d\n", i1 >= 8 ? 1 : 0);
-      return i1 >= 8 ? 1 : 0; // return 1 if receiver choked on the 'EOT' marker, else 0 for 'success'
+#else // ARDUINO
+
+#define SaveProgress(pX, lOffset, bForce)
+#define ReportProgress(pX)
+#define ResumeOffer(pX) 0
+#define ResumeAccept(pX) ((pX)->lOffset != 0)
+
+#endif // ARDUINO
+
+// sends the sliding window ACK for everything up to lNext and the blocks
+// marked in aHave after it.  an all ones mask acknowledges the EOT.  cACK
+// is _ACK_, or _FEC_ for the answer to a parity block
+void SendWindowAck(XMODEM *pX, long lNext, const unsigned char *aHave, char cACK)
+{
+XMODEMW_ACK ack;
+int i1;
+
+  memset(&ack, 0, sizeof(ack));
+
+  ack.cACK = cACK;
+  ack.wNext = my_htons((unsigned short)lNext);
+
+  for(i1=0; i1 < WINDOW_MAX; i1++)
+  {
+    if(!aHave || aHave[(lNext + 1 + i1) % WINDOW_MAX])
+    {
+      ack.aMask[i1 / 8] |= 1 << (i1 % 8);
     }
+  }
 
-//  TODO:  progress indicator [can be LCD for arduino, blinky lights, ???  and of course stderr for everyone else]
-//  If filesize& <> 0 Then Form2!Label1.FloodPercent = 100 * filepos& / filesize&
+  ack.wCRC = CalcCRC(((char *)&ack) + 1, sizeof(ack) - 3);
 
-    if(ecount > 25)
+  WriteXmodemBlock(pX->ser, &ack, sizeof(ack));
+}
+
+// returns TRUE if the sliding window or parity block in pX->buf is damaged
+short CorruptWindowBlock(XMODEM *pX)
+{
+  if(pX->buf.xpbuf.cSOH == _FEC_)
+  {
+    return pX->buf.xpbuf.bCount != (unsigned char)~pX->buf.xpbuf.bNotCount ||
+           CalcCRC((const char *)&(pX->buf.xpbuf.wFirst),
+                   sizeof(pX->buf.xpbuf) - 3) != pX->buf.xpbuf.wCRC;
+  }
+
+  return pX->buf.xwbuf.wSEQ != (unsigned short)~pX->buf.xwbuf.wNotSEQ ||
+         CalcCRC(pX->buf.xwbuf.aDataBuf, sizeof(pX->buf.xwbuf.aDataBuf)) != pX->buf.xwbuf.wCRC;
+}
+
+// reads the rest of a sliding window block whose _WIN_ (or _FEC_, both are
+// the same size) is in pX->buf.  when bytes were lost the block runs into
+// the next one, so with bResync, rather than flushing the input, the next
+// _WIN_ or _FEC_ in what was read is tried as the block start.  returns 0
+// for a good block, -1 for silence, 1 for a damaged block
+int GetWindowBlock(XMODEM *pX, int bResync)
+{
+char *pBuf = (char *)&(pX->buf.xwbuf);
+int cbHave = 1, i1;
+
+  for(;;)
+  {
+    i1 = GetXmodemBlock(pX, pBuf + cbHave, sizeof(pX->buf.xwbuf) - cbHave);
+    if(i1 != (int)sizeof(pX->buf.xwbuf) - cbHave)
     {
-	return 99;
+      return -1;
     }
-    fprintf(stderr, "block %ld  %ld of %ld bytes  %d errors\r\n", block, filepos, filesize, ecount);
 
-    if(pX->buf.xbuf.cSOH != 'C' // XMODEM CRC
-       && pX->buf.xbuf.cSOH != (char)_NAK_) // NAK
+    if(!CorruptWindowBlock(pX))
     {
-      // increase error count, bail if it's too much
+      return 0;
+    }
 
-      ec2++;
+    if(!bResync)
+    {
+      return 1;
     }
 
+    for(i1=1; i1 < (int)sizeof(pX->buf.xwbuf) && pBuf[i1] != _WIN_ && pBuf[i1] != _FEC_; i1++)
+    {
+    }
 
-#ifdef ARDUINO
-    pX->file.seek(filepos); // in case I'm doing a 'retry' and I have to re-read part of the file
-#else  // ARDUINO
-    lseek(pX->file, filepos, SEEK_SET); // same reason as above
-#endif // ARDUINO
+    if(i1 >= (int)sizeof(pX->buf.xwbuf))
+    {
+      return 1;
+    }
+
+    cbHave = sizeof(pX->buf.xwbuf) - i1;
+    memmove(pBuf, pBuf + i1, cbHave);
+  }
+}
+
+// after each file a YMODEM sender waits for 'C' and sends the header of
+// the next one, or closes the batch with an empty block 0.  the header of
+// a next file is left in pX->buf with bNext set and not acknowledged yet
+void ReceiveYmodemEnd(XMODEM *pX)
+{
+int i1;
 
-    // fortunately, xbuf and xcbuf are the same through the end of 'aDataBuf' so
-    // I can read the file NOW using 'xbuf' for both CRC and CHECKSUM versions
+  for(i1=0; i1 < 4; i1++)
+  {
+    WriteXmodemChar(pX->ser, 'C');
 
-    if((filesize - filepos) >= sizeof(pX->buf.xbuf.aDataBuf))
+    if(GetXmodemBlock(pX, &(pX->buf.xbuf.cSOH), 1) != 1)
     {
-#ifdef ARDUINO
-      i1 = pX->file.read(pX->buf.xbuf.aDataBuf, sizeof(pX->buf.xcbuf.aDataBuf));
-#else  // ARDUINO
-      i1 = read(pX->file, pX->buf.xbuf.aDataBuf, sizeof(pX->buf.xcbuf.aDataBuf));
-#endif // ARDUINO
+      continue;
+    }
 
-      if(i1 != sizeof(pX->buf.xcbuf.aDataBuf))
+    if(pX->buf.xbuf.cSOH == _EOT_) // my ACK of the EOT was lost
+    {
+      if(pX->bWindow)
       {
-        // TODO:  read error - send a ctrl+x ?
+        SendWindowAck(pX, 0, NULL, _ACK_);
+      }
+      else
+      {
+        WriteXmodemChar(pX->ser, _ACK_);
       }
     }
-    else
+    else if(pX->buf.xbuf.cSOH == _SOH_ &&
+            GetXmodemBlock(pX, ((char *)&(pX->buf.xcbuf)) + 1, sizeof(pX->buf.xcbuf) - 1)
+              == sizeof(pX->buf.xcbuf) - 1 &&
+            !CorruptBlock(pX, sizeof(pX->buf.xcbuf.aDataBuf)) && pX->buf.xcbuf.aSEQ == 0)
     {
-      memset(pX->buf.xcbuf.aDataBuf, '\x1a', sizeof(pX->buf.xcbuf.aDataBuf)); // fill with ctrl+z which is what the spec says
-#ifdef ARDUINO
-      i1 = pX->file.read(pX->buf.xbuf.aDataBuf, filesize - filepos);
-#else  // ARDUINO
-      i1 = read(pX->file, pX->buf.xbuf.aDataBuf, filesize - filepos);
-#endif // ARDUINO
-
-      if(i1 != (filesize - filepos))
+      if(pX->buf.xcbuf.aDataBuf[0])
       {
-        // TODO:  read error - send a ctrl+x ?
+        pX->bNext = 1;
+      }
+      else
+      {
+        WriteXmodemChar(pX->ser, _ACK_);
       }
+      return;
     }
-
-    if(pX->buf.xbuf.cSOH == 'C' ||  // XMODEM CRC 'NAK' (first time only, typically)
-       ((pX->buf.xbuf.cSOH == _ACK_ || pX->buf.xbuf.cSOH == _NAK_) && pX->bCRC)) // identifies ACK/NACK with XMODEM CRC
+    else
     {
-      pX->bCRC = 1; // make sure (only matters the first time, really)
+      XModemFlushInput(pX);
+    }
+  }
+}
 
-      // calculate the CRC, assign to the packet, and then send it
+// keeps a copy of block lBlock in the slot pRing has for it
+void KeepWindowBlock(char *pRing, long *aRingBlock, long lBlock, const char *pData)
+{
+  if(pRing)
+  {
+    memcpy(pRing + (lBlock % FEC_RING) * 1024, pData, 1024);
+    aRingBlock[lBlock % FEC_RING] = lBlock;
+  }
+}
 
-      pX->buf.xcbuf.cSOH = 1; // must send SOH as 1st char
-      pX->buf.xcbuf.wCRC = CalcCRC(pX->buf.xcbuf.aDataBuf, sizeof(pX->buf.xcbuf.aDataBuf));
+// the parity block in pX->buf covers a group with exactly one block that
+// has not arrived.  XORs the others, which are all in pRing, into it so it
+// becomes the missing block.  returns the missing block's number, or 0 if
+// the group is complete or more than one block of it is missing
+long RebuildWindowBlock(XMODEM *pX, const char *pRing, const long *aRingBlock,
+                        long lNext, long lBlocks)
+{
+long lFirst, lMissing, lBlock;
+int nCount, i1;
 
-      GenerateSEQC(&(pX->buf.xcbuf), block);
+  // the group may start before lNext, the seq# is taken as the nearest
+  lFirst = lNext + ((my_htons(pX->buf.xpbuf.wFirst) - lNext + 0x8000) & 0xffff) - 0x8000;
+  nCount = pX->buf.xpbuf.bCount;
 
-      // send it
+  if(!pRing || nCount < 1 || nCount > XFEC_GROUP_MAX || lFirst < 1 || lFirst + nCount - 1 > lBlocks)
+  {
+    return 0;
+  }
 
-      i1 = WriteXmodemBlock(pX->ser, &(pX->buf.xcbuf), sizeof(pX->buf.xcbuf));
-      if(i1 != sizeof(pX->buf.xcbuf)) // write error
+  lMissing = 0;
+  for(lBlock=lFirst; lBlock < lFirst + nCount; lBlock++)
+  {
+    if(aRingBlock[lBlock % FEC_RING] != lBlock)
+    {
+      if(lMissing)
       {
-        // TODO:  handle write error (send ctrl+X ?)
+        return 0;
       }
+      lMissing = lBlock;
     }
-    else if(pX->buf.xbuf.cSOH == _NAK_ || // 'NAK' (checksum method, may also be with CRC method)
-            (pX->buf.xbuf.cSOH == _ACK_ && !pX->bCRC)) // identifies ACK with XMODEM CHECKSUM
+  }
+
+  if(lMissing < lNext || lMissing - lNext >= WINDOW_MAX)
+  {
+    return 0;
+  }
+
+  for(lBlock=lFirst; lBlock < lFirst + nCount; lBlock++)
+  {
+    for(i1=0; lBlock != lMissing && i1 < (int)sizeof(pX->buf.xpbuf.aDataBuf); i1++)
     {
-      pX->bCRC = 0; // make sure (this ALSO allows me to switch modes on error)
+      pX->buf.xpbuf.aDataBuf[i1] ^= pRing[(lBlock % FEC_RING) * 1024 + i1];
+    }
+  }
 
-      // calculate the CHECKSUM, assign to the packet, and then send it
+  return lMissing;
+}
 
-      pX->buf.xbuf.cSOH = 1; // must send SOH as 1st char
-      pX->buf.xbuf.bCheckSum = CalcCheckSum(pX->buf.xbuf.aDataBuf, sizeof(pX->buf.xbuf.aDataBuf));
+// receives the file in sliding window mode, the first block's _WIN_ is in
+// pX->buf.  blocks are written where they belong in the file as they come,
+// so nothing has to be held back for the ones still missing.  pRing has
+// room for FEC_RING blocks, kept to rebuild a lost one from parity, or is
+// NULL
+int ReceiveWindowBlocks(XMODEM *pX, char *pRing)
+{
+unsigned char aHave[WINDOW_MAX]; // blocks after lNext that already arrived
+long aRingBlock[FEC_RING];       // which block each slot of pRing holds
+long lNext, lBlock, lBlocks, lPos;
+const char *pData;
+int ecount, i1, cbWrite;
+
+  memset(aHave, 0, sizeof(aHave));
+  memset(aRingBlock, 0, sizeof(aRingBlock));
+
+  pX->bWindow = 1;
+  lNext = 1;
+  lBlocks = (pX->lFileSize - pX->lOffset + sizeof(pX->buf.xwbuf.aDataBuf) - 1) / sizeof(pX->buf.xwbuf.aDataBuf);
+  ecount = 0;
 
-      GenerateSEQ(&(pX->buf.xbuf), block);
+  // ** already got the first '_WIN_' character on entry to this function **
 
-      // send it
+  while(ecount < TOTAL_ERROR_COUNT)
+  {
+    if(pX->buf.xwbuf.cSOH == _WIN_ || pX->buf.xwbuf.cSOH == _FEC_)
+    {
+      i1 = GetWindowBlock(pX, lNext <= lBlocks);
+      lBlock = 0;
+      pData = pX->buf.xwbuf.aDataBuf;
 
-      i1 = WriteXmodemBlock(pX->ser, &(pX->buf.xbuf), sizeof(pX->buf.xbuf));
-      if(i1 != sizeof(pX->buf.xbuf)) // write error
+      if(!i1 && pX->buf.xpbuf.cSOH == _FEC_)
       {
-        // TODO:  handle write error (send ctrl+X ?)
-      }
-    }
+        pX->stats.lParity++;
+        lBlock = RebuildWindowBlock(pX, pRing, aRingBlock, lNext, lBlocks);
+        pData = pX->buf.xpbuf.aDataBuf;
 
-    ec2 = 0;
+        if(lBlock)
+        {
+          pX->stats.lRepaired++;
+        }
+      }
+      else if(!i1)
+      {
+        pX->stats.lBlocks++;
+        lBlock = lNext + ((my_htons(pX->buf.xwbuf.wSEQ) - lNext) & 0xffff);
+      }
 
-    while(ecount < TOTAL_ERROR_COUNT && ec2 < ACK_ERROR_COUNT) // loop to get ACK or NACK
-    {
-      if(GetXmodemBlock(pX->ser, &(pX->buf.xbuf.cSOH), 1) == 1)
+      if(!i1)
       {
-        if(pX->buf.xbuf.cSOH == _CAN_) // ** CTRL-X - terminate
+        if(lBlock && lBlock - lNext < WINDOW_MAX && lBlock <= lBlocks && !aHave[lBlock % WINDOW_MAX])
         {
-          XmodemTerminate(pX);
+          // the last block is padded, the YMODEM size says how much of it is file
+          lPos = pX->lOffset + (lBlock - 1) * (long)sizeof(pX->buf.xwbuf.aDataBuf);
+          cbWrite = sizeof(pX->buf.xwbuf.aDataBuf);
+          if(lPos + cbWrite > pX->lFileSize)
+          {
+            cbWrite = (int)(pX->lFileSize - lPos);
+          }
 
-          return 1; // terminated
-        }
-        else if(pX->buf.xbuf.cSOH == _NAK_ || // ** NACK
-                pX->buf.xbuf.cSOH == 'C') // ** CRC NACK
-        {
-          break;  // exit inner loop and re-send packet
+          if(WriteXmodemData(pX, lPos, pData, cbWrite) != cbWrite)
+          {
+            XmodemTerminate(pX);
+            return -2; // write error on output file
+          }
+
+          KeepWindowBlock(pRing, aRingBlock, lBlock, pData);
+          aHave[lBlock % WINDOW_MAX] = 1;
+
+          while(aHave[lNext % WINDOW_MAX])
+          {
+            aHave[lNext % WINDOW_MAX] = 0;
+            lNext++;
+          }
+
+          lPos = pX->lOffset + (lNext - 1) * (long)sizeof(pX->buf.xwbuf.aDataBuf);
+          SaveProgress(pX, lPos < pX->lFileSize ? lPos : pX->lFileSize, 0);
+          ReportProgress(pX);
         }
-        else if(pX->buf.xbuf.cSOH == _ACK_) // ** ACK - sending next packet
-        {
-          filepos += sizeof(pX->buf.xbuf.aDataBuf);
-          block++; // increment file position and block count
 
-          break; // leave inner loop, send NEXT packet
+        // anything else is a repeat of a block I already have, or parity
+        // that was not needed
+        ecount = 0;
+      }
+      else
+      {
+        if(i1 > 0)
+        {
+          pX->stats.lBad++;
         }
         else
         {
-          XModemFlushInput(pX->ser);  // for now, do this here too
-          ec2++;
+          pX->stats.lTimeouts++;
         }
+        ecount++;
       }
-      else
+
+      // the sender holds back the blocks of a group until it hears how
+      // its parity went
+      SendWindowAck(pX, lNext, aHave, pX->buf.xpbuf.cSOH == _FEC_ ? _FEC_ : _ACK_);
+    }
+    else if(pX->buf.xwbuf.cSOH == _EOT_)
+    {
+      if(lNext > lBlocks)
       {
-        ecount++; // increase total error count, then loop back and re-send packet
-        break;
+        SendWindowAck(pX, lNext, NULL, _ACK_);
+        ReceiveYmodemEnd(pX);
+        return 0; // I am done
       }
+
+      SendWindowAck(pX, lNext, aHave, _ACK_); // the sender gave up too early
+      ecount++;
+    }
+    else if(pX->buf.xwbuf.cSOH == _CAN_) // ** CTRL-X 'CAN' - terminate
+    {
+      XmodemTerminate(pX);
+      return 1; // terminated
+    }
+    else if(lNext > lBlocks)
+    {
+      // what is left of a damaged block after the last one.  a block start
+      // in it would take the EOT in as data, so it all goes
+      XModemFlushInput(pX);
+      SendWindowAck(pX, lNext, aHave, _ACK_);
     }
 
-    if(ec2 >= ACK_ERROR_COUNT)
+    // anything else is what is left of a damaged block
+
+    if(GetXmodemBlock(pX, &(pX->buf.xwbuf.cSOH), 1) != 1)
+    {
+      SendWindowAck(pX, lNext, aHave, _ACK_); // nothing for a while, my ACK may be lost
+      pX->stats.lTimeouts++;
+      ecount++;
+    }
+  }
+
+  XmodemTerminate(pX);
+  return 1; // terminated
+}
+
+int ReceiveWindowed(XMODEM *pX)
+{
+char *pRing = NULL;
+int iRval;
+
+#ifndef ARDUINO
+  pRing = (char *)malloc(FEC_RING * sizeof(pX->buf.xwbuf.aDataBuf)); // without it no block is rebuilt
+#endif // ARDUINO
+
+  iRval = ReceiveWindowBlocks(pX, pRing);
+
+  free(pRing);
+  return iRval;
+}
+
+int ReceiveXmodem(XMODEM *pX)
+{
+int ecount, ec2, cbData, cbBlock, cbWrite, bOffered = 0;
+long etotal, filesize, block;
+unsigned char cY; // the char to send in response to a packet
+
+  ecount = 0;
+  etotal = 0;
+  filesize = 0;
+  block = 1;
+
+  pX->lFileSize = -1; // until a YMODEM header says otherwise
+
+  // ** already got the first 'SOH' or 'STX' character on entry to this function **
+
+  do
+  {
+    cbData = (pX->buf.xbuf.cSOH == _STX_ ? sizeof(pX->buf.x1kbuf.aDataBuf) : sizeof(pX->buf.xbuf.aDataBuf));
+    cbBlock = 3 + cbData + (pX->bCRC ? 2 : 1);
+
+    // the header of a file in a batch may have come at the end of the last one
+    if(!pX->bNext &&
+       (GetXmodemBlock(pX, ((char *)&(pX->buf)) + 1, cbBlock - 1) != cbBlock - 1 ||
+        CorruptBlock(pX, cbData)))
+    {
+      // did not receive properly
+
+#ifdef DEBUG_CODE
+      sprintf(szERR,"A%ld,%d,%d,%d",block,cbData,pX->buf.xbuf.aSEQ, pX->buf.xbuf.aNotSEQ);
+#endif // DEBUG_CODE
+
+      XModemFlushInput(pX);  // necessary to avoid problems
+
+      if(block > 1 || !pX->bCRC)
+      {
+        cY = _NAK_;
+      }
+      else
+      {
+        cY = 'C'; // send 'CRC' NAK (the character 'C') (to get the CRC version)
+      }
+      pX->stats.lBad++;
+      ecount ++; // for this packet
+      etotal ++;
+    }
+    else if(pX->buf.xbuf.aSEQ == 0 && block == 1 && pX->bCRC)
+    {
+      // YMODEM header, ACK it and then ask for the data with 'W', which
+      // offers the sliding window.  senders that do not know it take 'W'
+      // as the usual 'C'
+
+      pX->bNext = 0;
+      ParseYmodemHeader(pX);
+
+      if(pX->szName[0] && !bOffered && ResumeOffer(pX))
+      {
+        // part of this file is here from an earlier session.  the sender
+        // answers with the header again, stating where the data starts
+        bOffered = 1;
+        cY = 0;
+      }
+      else
+      {
+        WriteXmodemChar(pX->ser, _ACK_);
+
+        if(!pX->szName[0]) // empty batch
+        {
+          XmodemTerminate(pX);
+          return 0;
+        }
+
+        if(ResumeAccept(pX))
+        {
+          WriteXmodemChar(pX->ser, _CAN_);
+          XmodemTerminate(pX);
+          return 1; // terminated
+        }
+
+        pX->bYMODEM = 1;
+        filesize = pX->lOffset;
+        cY = (pX->lFileSize >= 0 ? 'W' : 'C');
+      }
+      ecount = 0;
+    }
+    else if(pX->buf.xbuf.aSEQ == ((block - 1) & 255))
+    {
+      // the sender missed my ACK and repeated the previous block
+      pX->stats.lBlocks++;
+      cY = _ACK_;
+    }
+    else if(pX->buf.xbuf.aSEQ != (block & 255))
+    {
+      XModemFlushInput(pX);  // out of sequence, ask again
+
+      pX->stats.lBad++;
+      cY = _NAK_;
+      ecount ++;
+      etotal ++;
+    }
+    else
+    {
+      // the last block is padded, the YMODEM size says how much of it is file
+      cbWrite = cbData;
+      if(pX->lFileSize >= 0 && filesize + cbWrite > pX->lFileSize)
+      {
+        cbWrite = (int)(pX->lFileSize - filesize);
+      }
+
+      if(WriteXmodemData(pX, filesize, pX->buf.x1kbuf.aDataBuf, cbWrite) != cbWrite)
+      {
+        XmodemTerminate(pX);
+        return -2; // write error on output file
+      }
+      pX->stats.lBlocks++;
+      cY = _ACK_; // send ACK
+      block ++;
+      filesize += cbWrite;
+      ecount = 0; // zero out error count for next packet
+
+      SaveProgress(pX, filesize, 0);
+      ReportProgress(pX);
+    }
+
+    fprintf(stderr, "block %ld  %ld bytes  %d errors\r\n", block, filesize, ecount);
+
+    ec2 = 0;   //  ** error count #2 **
+
+    while(ecount < TOTAL_ERROR_COUNT && ec2 < ACK_ERROR_COUNT) // ** loop to get SOH or EOT character **
+    {
+      if(cY) // nothing while waiting for the header again
+      {
+        WriteXmodemChar(pX->ser, cY); // ** output appropriate command char **
+      }
+
+      if(cY == _NAK_)
+      {
+        pX->stats.lNaks++;
+      }
+
+#ifndef ARDUINO
+      if(cY == 'W')
+      {
+        // this end rebuilds blocks from parity.  GetWindowAck takes the 'F'
+        // in window mode, the stop-and-wait ACK loop passes over it
+        WriteXmodemChar(pX->ser, 'F');
+      }
+#endif // ARDUINO
+
+      if(GetXmodemBlock(pX, &(pX->buf.xbuf.cSOH), 1) == 1)
+      {
+        if(pX->buf.xbuf.cSOH == _CAN_) // ** CTRL-X 'CAN' - terminate
+        {
+          XmodemTerminate(pX);
+          return 1; // terminated
+        }
+        else if(pX->buf.xbuf.cSOH == _EOT_) // ** EOT - end
+        {
+          WriteXmodemChar(pX->ser, _ACK_); // ** send an ACK (most XMODEM protocols expect THIS)
+//          WriteXmodemChar(pX->ser, _ENQ_); // ** send an ENQ
+
+          if(pX->bYMODEM)
+          {
+            ReceiveYmodemEnd(pX);
+          }
+
+          return 0; // I am done
+        }
+        else if(pX->buf.xbuf.cSOH == _SOH_ || // ** SOH - sending next packet
+                pX->buf.xbuf.cSOH == _STX_)   // ** STX - next packet is 1K
+        {
+          break; // leave this loop
+        }
+        else if(pX->buf.xbuf.cSOH == _WIN_ && cY == 'W') // ** sender took the window
+        {
+          return ReceiveWindowed(pX);
+        }
+        else
+        {
+          XModemFlushInput(pX);  // necessary to avoid problems (since the character was unexpected)
+          // if I was asking for the next block, and got an unexpected character, do a NAK; otherwise,
+          // just repeat what I did last time
+
+          if(cY == _ACK_) // ACK
+          {
+            cY = _NAK_; // NACK
+          }
+
+          ec2++;
+        }
+      }
+      else
+      {
+        pX->stats.lTimeouts++;
+        ecount++; // increase total error count, and try writing the 'ACK' or 'NACK' again
+      }
+    }
+
+    if(ec2 >= ACK_ERROR_COUNT) // wasn't able to get a packet
+    {
+      break;
+    }
+
+  } while(ecount < TOTAL_ERROR_COUNT);
+
+  XmodemTerminate(pX);
+  return 1; // terminated
+}
+
+// offers a YMODEM header.  returns 1 if the receiver accepted it and asked
+// for the data, 2 if it also offered the sliding window, 0 for a plain
+// XMODEM receiver (its answer is left in pX->buf.xbuf.cSOH), or -1 if the
+// transfer was canceled
+int SendYmodemHeader(XMODEM *pX, long filesize)
+{
+unsigned char aMsg[6];
+unsigned short wCRC;
+long lOffer;
+int i1, i2;
+
+  pX->bFec = 0; // until the receiver asks for it again
+
+  for(i1=0; i1 < 5; i1++)
+  {
+    MakeYmodemHeader(pX, pX->szName, filesize);
+    WriteXmodemBlock(pX->ser, &(pX->buf.xcbuf), sizeof(pX->buf.xcbuf));
+
+    if(GetXmodemBlock(pX, &(pX->buf.xbuf.cSOH), 1) != 1)
+    {
+      continue; // nothing came back, offer it again
+    }
+
+    if(pX->buf.xbuf.cSOH == _CAN_)
+    {
+      return -1;
+    }
+    else if(pX->buf.xbuf.cSOH == 'R' && pX->ullHash)
+    {
+      // the receiver has the start of the file from an earlier session.
+      // the header goes again, with the offset the data will start at
+      if(GetXmodemBlock(pX, (char *)aMsg, 6) == 6)
+      {
+        memcpy(&wCRC, aMsg + 4, 2);
+        lOffer = ((long)aMsg[0] << 24) | ((long)aMsg[1] << 16) | ((long)aMsg[2] << 8) | aMsg[3];
+
+        if(CalcCRC((const char *)aMsg, 4) == wCRC && lOffer <= filesize &&
+           !(lOffer % (long)sizeof(pX->buf.x1kbuf.aDataBuf)))
+        {
+          pX->lOffset = lOffer;
+          fprintf(stderr, "resume: receiver has %ld of %ld bytes\n", lOffer, filesize);
+        }
+      }
+    }
+    else if(pX->buf.xbuf.cSOH == _ACK_)
+    {
+      // the receiver asks for block 1 with a 'C' or 'W' of its own
+      for(i2=0; i2 < 4; i2++)
+      {
+        if(GetXmodemBlock(pX, &(pX->buf.xbuf.cSOH), 1) == 1 &&
+           (pX->buf.xbuf.cSOH == 'C' || pX->buf.xbuf.cSOH == 'W'))
+        {
+          break;
+        }
+      }
+
+      i2 = (pX->buf.xbuf.cSOH == 'W' ? 2 : 1);
+      pX->buf.xbuf.cSOH = 'C';
+      return i2;
+    }
+    else if((pX->buf.xbuf.cSOH == 'C' || pX->buf.xbuf.cSOH == _NAK_) && !pX->iFile)
+    {
+      return 0; // an XMODEM receiver rejecting block 0
+    }
+  }
+
+  pX->buf.xbuf.cSOH = 'C';
+  return 0;
+}
+
+// closes the YMODEM batch with an empty header.  repeated ACKs of the
+// last blocks may still be arriving, anything but 'C' and the final ACK
+// is skipped.  bAsked when the receiver's 'C' was already read
+void SendYmodemEnd(XMODEM *pX, int bAsked)
+{
+int i1, cb1, bSent;
+
+  if(bAsked)
+  {
+    MakeYmodemHeader(pX, NULL, 0);
+    WriteXmodemBlock(pX->ser, &(pX->buf.xcbuf), sizeof(pX->buf.xcbuf));
+  }
+
+  for(i1=0, cb1=0, bSent=bAsked; i1 < 4 && cb1 < 256; cb1++)
+  {
+    if(GetXmodemBlock(pX, &(pX->buf.xbuf.cSOH), 1) != 1)
+    {
+      i1++;
+    }
+    else if(pX->buf.xbuf.cSOH == _ACK_ && bSent)
+    {
+      return;
+    }
+    else if(pX->buf.xbuf.cSOH == 'C')
+    {
+      MakeYmodemHeader(pX, NULL, 0);
+      WriteXmodemBlock(pX->ser, &(pX->buf.xcbuf), sizeof(pX->buf.xcbuf));
+      bSent = 1;
+    }
+  }
+}
+
+// waits up to ulWait msecs for a sliding window ACK.  returns 1 with the
+// ACK in *pAck, 0 on timeout, or -1 if the receiver canceled.  the answer
+// to a parity block starts with _FEC_ in place of the _ACK_
+int GetWindowAck(XMODEM *pX, XMODEMW_ACK *pAck, unsigned long ulWait)
+{
+unsigned long ulStart = MyMillis(), ulNow;
+
+  for(;;)
+  {
+    ulNow = MyMillis() - ulStart;
+    if(ulNow >= ulWait ||
+       GetXmodemBlockWait(pX, &(pAck->cACK), 1, ulWait - ulNow) != 1)
+    {
+      return 0;
+    }
+
+    if(pAck->cACK == _CAN_)
+    {
+      return -1;
+    }
+
+#ifndef ARDUINO
+    if(pAck->cACK == 'F') // sent after the 'W', the receiver takes parity
+    {
+      pX->bFec = 1;
+    }
+#endif // ARDUINO
+
+    // anything before the ACK is what is left of a damaged one
+    if((pAck->cACK == _ACK_ || pAck->cACK == _FEC_) &&
+       GetXmodemBlock(pX, ((char *)pAck) + 1, sizeof(*pAck) - 1) == sizeof(*pAck) - 1 &&
+       CalcCRC(((char *)pAck) + 1, sizeof(*pAck) - 3) == pAck->wCRC)
+    {
+      return 1;
+    }
+  }
+}
+
+void SendWindowBlock(XMODEM *pX, long lBlock, long filesize)
+{
+long lPos = pX->lOffset + (lBlock - 1) * (long)sizeof(pX->buf.xwbuf.aDataBuf);
+int cbData = sizeof(pX->buf.xwbuf.aDataBuf);
+
+  if(filesize - lPos < cbData)
+  {
+    cbData = (int)(filesize - lPos);
+    memset(pX->buf.xwbuf.aDataBuf, '\x1a', sizeof(pX->buf.xwbuf.aDataBuf)); // fill with ctrl+z
+  }
+
+  if(ReadXmodemData(pX, lPos, pX->buf.xwbuf.aDataBuf, cbData) != cbData)
+  {
+    // TODO:  read error - send a ctrl+x ?
+  }
+
+  pX->buf.xwbuf.cSOH = _WIN_;
+  pX->buf.xwbuf.wSEQ = my_htons((unsigned short)lBlock);
+  pX->buf.xwbuf.wNotSEQ = ~pX->buf.xwbuf.wSEQ;
+  pX->buf.xwbuf.wCRC = CalcCRC(pX->buf.xwbuf.aDataBuf, sizeof(pX->buf.xwbuf.aDataBuf));
+
+  WriteXmodemBlock(pX->ser, &(pX->buf.xwbuf), sizeof(pX->buf.xwbuf));
+  pX->stats.lBlocks++;
+}
+
+// sends the XOR of the nCount blocks from lFirst, which is in aParity.
+// for a single block aParity may be the data of the block in pX->buf
+void SendParityBlock(XMODEM *pX, long lFirst, int nCount, const char *aParity)
+{
+  pX->buf.xpbuf.cSOH = _FEC_;
+  pX->buf.xpbuf.wFirst = my_htons((unsigned short)lFirst);
+  pX->buf.xpbuf.bCount = (unsigned char)nCount;
+  pX->buf.xpbuf.bNotCount = (unsigned char)~nCount;
+  memmove(pX->buf.xpbuf.aDataBuf, aParity, sizeof(pX->buf.xpbuf.aDataBuf));
+  pX->buf.xpbuf.wCRC = CalcCRC((const char *)&(pX->buf.xpbuf.wFirst), sizeof(pX->buf.xpbuf) - 3);
+
+  WriteXmodemBlock(pX->ser, &(pX->buf.xpbuf), sizeof(pX->buf.xpbuf));
+  pX->stats.lParity++;
+}
+
+// blocks per parity block for a share of ulLoss / 65536 blocks lost.  a
+// block lost in the window costs one more block when it is sent again, so
+// parity only pays for itself when losses are common enough to lose the
+// repeats too and wait out a timeout for them, from about one block in
+// seven.  a group is only rebuilt when it lost a single block, so it is
+// the largest that usually loses no more than one
+int FecGroup(unsigned long ulLoss)
+{
+int nGroup;
+
+  if(iFec >= 0)
+  {
+    return iFec;
+  }
+
+  if(ulLoss < 65536 / 7)
+  {
+    return 0;
+  }
+
+  for(nGroup=XFEC_GROUP_MAX; nGroup > 2 && ulLoss * nGroup > 65536; nGroup /= 2)
+  {
+  }
+
+  return nGroup;
+}
+
+// a block sent again, still in pX->buf, is as likely to be lost as it was
+// the first time and a timeout costs far more than a block.  while there is
+// parity it is followed by a copy of itself, as the parity of a group of
+// one, which guards it like a group
+void ResendParity(XMODEM *pX, long lBlock, unsigned long ulLoss, unsigned long *pulGuard,
+                  unsigned long *pulOrder)
+{
+#ifndef ARDUINO
+  if(pX->bFec && FecGroup(ulLoss) > 0)
+  {
+    SendParityBlock(pX, lBlock, 1, pX->buf.xwbuf.aDataBuf);
+    *pulGuard = ++*pulOrder;
+  }
+#endif // ARDUINO
+}
+
+// the later of two MyMillis() times
+static unsigned long LaterMillis(unsigned long ul1, unsigned long ul2)
+{
+  return (long)(ul1 - ul2) > 0 ? ul1 : ul2;
+}
+
+// sends the file with up to iWindow blocks in flight.  a block is sent
+// again when a block sent after it was acknowledged first, or when nothing
+// acknowledged it within the retransmit timeout.  the blocks written
+// together wait in the serial buffers and go out one after the other, so
+// the timer of the blocks in flight starts over whenever an ACK shows the
+// link is moving.  when the receiver takes parity, a block of a group is
+// only overtaken by the blocks sent after the group's parity
+int SendWindowed(XMODEM *pX, long filesize)
+{
+unsigned long aSent[WINDOW_MAX];  // when each block in flight was last sent
+unsigned long aOrder[WINDOW_MAX]; // send order, to tell which blocks were overtaken
+unsigned long aGuard[WINDOW_MAX]; // send order of the parity covering it, 0 if none
+unsigned char aAcked[WINDOW_MAX];
+unsigned char aRetry[WINDOW_MAX]; // sent more than once, not used for RTT
+unsigned char aLost[WINDOW_MAX];  // counted in ulLoss already
+unsigned long ulOrder, ulLatest, ulNow, ulWait, ulSRTT, ulRTO, ulAcked;
+unsigned long ulLoss;             // share of recent blocks lost, 65536 for all of them
+unsigned long ulSeen, ulParity;
+long lBase, lNext, lBlocks, lBlock, lAck, lPos, lGroup;
+XMODEMW_ACK ack;
+int ecount, i1, iRval, nGroup;
+
+  pX->bWindow = 1;
+  lBlocks = (filesize - pX->lOffset + sizeof(pX->buf.xwbuf.aDataBuf) - 1) / sizeof(pX->buf.xwbuf.aDataBuf);
+  lBase = lNext = 1;
+  ulOrder = 0;
+  ulSRTT = 0;
+  ulRTO = SILENCE_TIMEOUT; // until there is a round trip to go by
+  ulAcked = MyMillis();
+  ulLoss = ulLastLoss; // most likely the same link
+  lGroup = nGroup = 0; // no parity group open
+  ecount = 0;
+
+  while(lBase <= lBlocks)
+  {
+    // fill the window
+
+    while(lNext < lBase + iWindow && lNext <= lBlocks)
+    {
+      SendWindowBlock(pX, lNext, filesize);
+
+      aSent[lNext % WINDOW_MAX] = MyMillis();
+      aOrder[lNext % WINDOW_MAX] = ++ulOrder;
+      aAcked[lNext % WINDOW_MAX] = 0;
+      aRetry[lNext % WINDOW_MAX] = 0;
+      aLost[lNext % WINDOW_MAX] = 0;
+      aGuard[lNext % WINDOW_MAX] = 0;
+      ulLoss -= ulLoss / 32;
+
+#ifndef ARDUINO
+      if(pX->bFec && !nGroup && (nGroup = FecGroup(ulLoss)) > 0)
+      {
+        // blocks are still sent after the parity of a group, their ACKs
+        // tell whether the receiver rebuilt what the group lost
+        nGroup = nGroup < iWindow / 2 ? nGroup : iWindow / 2 > 1 ? iWindow / 2 : 1;
+        lGroup = lNext;
+        memset(pX->aParity, 0, sizeof(pX->aParity));
+      }
+
+      if(nGroup)
+      {
+        for(i1=0; i1 < (int)sizeof(pX->aParity); i1++)
+        {
+          pX->aParity[i1] ^= pX->buf.xwbuf.aDataBuf[i1];
+        }
+
+        aGuard[lNext % WINDOW_MAX] = ~0UL; // the parity is still to come
+
+        if(lNext - lGroup + 1 >= nGroup || lNext == lBlocks)
+        {
+          SendParityBlock(pX, lGroup, (int)(lNext - lGroup + 1), pX->aParity);
+          ++ulOrder;
+
+          for(lBlock=lGroup; lBlock <= lNext; lBlock++)
+          {
+            aGuard[lBlock % WINDOW_MAX] = ulOrder;
+          }
+
+          nGroup = 0;
+        }
+      }
+#endif // ARDUINO
+
+      lNext++;
+    }
+
+    fprintf(stderr, "block %ld-%ld of %ld  rto %lu  %d errors\r\n", lBase, lNext - 1, lBlocks, ulRTO, ecount);
+
+    // wait no longer than it takes the oldest block in flight to time out
+
+    ulNow = MyMillis();
+    ulWait = 1;
+    for(lBlock=lBase; lBlock < lNext; lBlock++)
+    {
+      if(!aAcked[lBlock % WINDOW_MAX])
+      {
+        ulWait = ulNow - LaterMillis(aSent[lBlock % WINDOW_MAX], ulAcked);
+        ulWait = ulWait < ulRTO ? ulRTO - ulWait : 1;
+        break;
+      }
+    }
+
+    iRval = GetWindowAck(pX, &ack, ulWait);
+
+    if(iRval < 0)
+    {
+      XmodemTerminate(pX);
+      return 1; // terminated
+    }
+
+    ulNow = MyMillis();
+
+    if(!iRval)
+    {
+      // timed out, send whatever has been waiting too long again
+
+      for(lBlock=lBase; lBlock < lNext; lBlock++)
+      {
+        if(!aAcked[lBlock % WINDOW_MAX] && ulNow - LaterMillis(aSent[lBlock % WINDOW_MAX], ulAcked) >= ulRTO)
+        {
+          if(!aLost[lBlock % WINDOW_MAX])
+          {
+            aLost[lBlock % WINDOW_MAX] = 1;
+            ulLoss += 65536 / 32;
+          }
+
+          SendWindowBlock(pX, lBlock, filesize);
+          pX->stats.lResent++;
+
+          aSent[lBlock % WINDOW_MAX] = MyMillis();
+          aOrder[lBlock % WINDOW_MAX] = ++ulOrder;
+          aRetry[lBlock % WINDOW_MAX] = 1;
+          ResendParity(pX, lBlock, ulLoss, &aGuard[lBlock % WINDOW_MAX], &ulOrder);
+        }
+      }
+
+      ulRTO = ulRTO * 2 < 4 * SILENCE_TIMEOUT ? ulRTO * 2 : 4 * SILENCE_TIMEOUT; // back off
+      pX->stats.lTimeouts++;
+
+      if(++ecount >= TOTAL_ERROR_COUNT)
+      {
+        break;
+      }
+
+      continue;
+    }
+
+    ecount = 0;
+
+    // everything before lAck arrived, and the blocks in the mask after it
+
+    lAck = lBase + ((my_htons(ack.wNext) - lBase) & 0xffff);
+    if(lAck > lNext)
+    {
+      continue; // not from this transfer
+    }
+
+    ulLatest = 0;
+    for(lBlock=lBase; lBlock < lNext; lBlock++)
+    {
+      i1 = (int)(lBlock - lAck - 1); // bit in the mask
+      if(aAcked[lBlock % WINDOW_MAX] ||
+         (lBlock >= lAck && (lBlock == lAck || !(ack.aMask[i1 / 8] & (1 << (i1 % 8))))))
+      {
+        continue;
+      }
+
+      aAcked[lBlock % WINDOW_MAX] = 1;
+      ulAcked = ulNow;
+
+      if(aOrder[lBlock % WINDOW_MAX] > ulLatest)
+      {
+        ulLatest = aOrder[lBlock % WINDOW_MAX];
+      }
+
+      if(!aRetry[lBlock % WINDOW_MAX])
+      {
+        ulWait = ulNow - aSent[lBlock % WINDOW_MAX];
+        ulSRTT = ulSRTT ? (7 * ulSRTT + ulWait) / 8 : ulWait;
+        CountRtt(pX, ulWait);
+        ulRTO = 2 * ulSRTT + 250;
+      }
+    }
+
+    while(lBase < lNext && aAcked[lBase % WINDOW_MAX])
+    {
+      lBase++;
+    }
+
+    // the receiver answered parity.  the first one sent after the latest
+    // block it has is taken, what that group still misses is lost.  the
+    // last WINDOW_MAX blocks sent, acknowledged or not, still have their
+    // slots, and a group is never larger
+
+    if(ack.cACK == _FEC_)
+    {
+      ulSeen = 0;
+      ulParity = ~0UL;
+      for(lBlock=lNext > WINDOW_MAX ? lNext - WINDOW_MAX : 1; lBlock < lNext; lBlock++)
+      {
+        if((lBlock < lBase || aAcked[lBlock % WINDOW_MAX]) && aOrder[lBlock % WINDOW_MAX] > ulSeen)
+        {
+          ulSeen = aOrder[lBlock % WINDOW_MAX];
+        }
+      }
+
+      for(lBlock=lNext > WINDOW_MAX ? lNext - WINDOW_MAX : 1; lBlock < lNext; lBlock++)
+      {
+        if(aGuard[lBlock % WINDOW_MAX] > ulSeen && aGuard[lBlock % WINDOW_MAX] < ulParity)
+        {
+          ulParity = aGuard[lBlock % WINDOW_MAX];
+        }
+      }
+
+      if(ulParity != ~0UL && ulParity > ulLatest)
+      {
+        ulLatest = ulParity;
+      }
+    }
+
+    lPos = pX->lOffset + (lBase - 1) * (long)sizeof(pX->buf.xwbuf.aDataBuf);
+    SaveProgress(pX, lPos < filesize ? lPos : filesize, 0);
+
+    // a block sent before one that was just acknowledged is lost.  if the
+    // parity of its group was not sent before that one the receiver may
+    // still rebuild it
+
+    for(lBlock=lBase; lBlock < lNext; lBlock++)
+    {
+      if(!aAcked[lBlock % WINDOW_MAX] && aOrder[lBlock % WINDOW_MAX] < ulLatest)
+      {
+        if(!aLost[lBlock % WINDOW_MAX])
+        {
+          aLost[lBlock % WINDOW_MAX] = 1;
+          ulLoss += 65536 / 32;
+        }
+
+        if(aGuard[lBlock % WINDOW_MAX] > ulLatest)
+        {
+          continue;
+        }
+
+        SendWindowBlock(pX, lBlock, filesize);
+        pX->stats.lResent++;
+
+        aSent[lBlock % WINDOW_MAX] = MyMillis();
+        aOrder[lBlock % WINDOW_MAX] = ++ulOrder;
+        aRetry[lBlock % WINDOW_MAX] = 1;
+        ResendParity(pX, lBlock, ulLoss, &aGuard[lBlock % WINDOW_MAX], &ulOrder);
+      }
+    }
+  }
+
+  ulLastLoss = ulLoss;
+
+  if(lBase <= lBlocks)
+  {
+    XmodemTerminate(pX);
+    fputs("SendXmodem fail (total error count)\n", stderr);
+    return -2; // exit on error
+  }
+
+  // the EOT is acknowledged with an all ones mask, the last bit is never
+  // set otherwise since it would be the first missing block itself
+
+  for(i1=0; i1 < 8; i1++)
+  {
+    WriteXmodemChar(pX->ser, _EOT_);
+
+    while((iRval = GetWindowAck(pX, &ack, ulRTO)) > 0 &&
+          !(ack.aMask[WINDOW_MAX / 8 - 1] & 0x80))
+    {
+    }
+
+    if(iRval)
+    {
+      break;
+    }
+  }
+
+  if(i1 < 8 && iRval > 0 && pX->bMore)
+  {
+    fputs("SendXmodem return 0, next file\n", stderr);
+    return 0; // the receiver asks for the next header with 'C'
+  }
+
+  if(i1 < 8 && iRval > 0)
+  {
+    SendYmodemEnd(pX, 0);
+  }
+
+  XmodemTerminate(pX);
+
+  fprintf(stderr, "SendXmodem return %d\n", i1 >= 8 || iRval < 0 ? 1 : 0);
+  return i1 >= 8 || iRval < 0 ? 1 : 0;
+}
+
+#ifndef ARDUINO
+// what stop-and-wait has seen of the block sizes it sends
+typedef struct _XBLOCK_SIZE_
+{
+  int bAdapt;            ///< the receiver takes 1K blocks and XSetBlockSize left it open
+  int cbBlock;           ///< 128 or 1024
+  int nAnswers;          ///< ACKs, NAKs and timeouts since the size was picked
+  unsigned long ulFail;  ///< share of blocks sent again, 65536 for all of them
+  unsigned long aOK[2];  ///< ms from writing a 128 or 1K block to its ACK, 0 until one came
+  unsigned long ulSpent; ///< ms a block sent again costs on top of that
+} XBLOCK_SIZE;
+
+// one answer to a block of the current size, bOK for an ACK
+static void BlockAnswer(XBLOCK_SIZE *pS, int bOK, unsigned long ulMs)
+{
+unsigned long *pulOK = &(pS->aOK[pS->cbBlock == 1024]);
+unsigned long ulSpent;
+
+  // an ACK that took more than twice as long as usual came after the
+  // receiver had trouble with the block, and costs what a retry does.  one
+  // that took less than half was held up less than the first ones were
+  if(bOK && *pulOK && ulMs > 2 * *pulOK)
+  {
+    bOK = 0;
+  }
+
+  pS->ulFail = pS->ulFail - (pS->ulFail >> 3) + (bOK ? 0 : 65536 >> 3);
+  pS->nAnswers++;
+
+  if(bOK)
+  {
+    *pulOK = (*pulOK && ulMs >= *pulOK / 2) ? *pulOK - (*pulOK >> 3) + (ulMs >> 3) : ulMs;
+    return;
+  }
+
+  if(*pulOK)
+  {
+    ulSpent = ulMs > *pulOK ? ulMs - *pulOK : 0;
+    pS->ulSpent = pS->ulSpent ? pS->ulSpent - (pS->ulSpent >> 3) + (ulSpent >> 3) : ulSpent;
+  }
+}
+
+// bytes per ms a size gets across when a block of it makes it with dOK
+static double BlockGoodput(int cbBlock, double dOK, double dTime, double dSpent)
+{
+  return cbBlock * dOK / (dTime + (1.0 - dOK) * dSpent);
+}
+
+// switches to the other size once it would get more across.  a block that
+// is n times as long gets through as often as n short ones in a row do.
+// until a block of the other size was ACKed its time is guessed in
+// proportion to the length, which leaves out the turnaround and so tries
+// it a little early; after that the time it really took counts.  a 10%
+// margin keeps the size from going back and forth.  non-zero if it switched
+static int BetterBlockSize(XBLOCK_SIZE *pS)
+{
+int cbOther = pS->cbBlock == 1024 ? 128 : 1024;
+double dWire = pS->cbBlock + 5, dOtherWire = cbOther + 5;
+double dOK = 1.0 - pS->ulFail / 65536.0, dOtherOK, dTime, dOtherTime;
+
+  dTime = pS->aOK[pS->cbBlock == 1024];
+
+  if(pS->nAnswers < 4 || !dTime)
+  {
+    return 0;
+  }
+
+  dOtherOK = pow(dOK, dOtherWire / dWire);
+  dOtherTime = pS->aOK[cbOther == 1024];
+  dOtherTime = dOtherTime ? dOtherTime : dTime * dOtherWire / dWire;
+
+  if(BlockGoodput(cbOther, dOtherOK, dOtherTime, pS->ulSpent)
+     < 1.1 * BlockGoodput(pS->cbBlock, dOK, dTime, pS->ulSpent))
+  {
+    return 0;
+  }
+
+  // carry on from the estimate for the new size
+  pS->cbBlock = cbOther;
+  pS->nAnswers = 0;
+  pS->ulFail = (unsigned long)((1.0 - dOtherOK) * 65536);
+
+  return 1;
+}
+
+// counts the answer to a block, unless it was a short tail, and lets
+// BetterBlockSize pick the size of the next block
+static void SizeAnswer(XMODEM *pX, XBLOCK_SIZE *pS, int cbData, int bOK, unsigned long ulWritten)
+{
+  if(!pS->bAdapt)
+  {
+    return;
+  }
+
+  if(cbData == pS->cbBlock)
+  {
+    BlockAnswer(pS, bOK, MyMillis() - ulWritten);
+  }
+
+  if(BetterBlockSize(pS))
+  {
+    pX->b1K = (pS->cbBlock == 1024);
+    fprintf(stderr, "SendXmodem %d byte blocks\n", pS->cbBlock);
+  }
+}
+#endif // ARDUINO
+
+int SendXmodem(XMODEM *pX)
+{
+int ecount, ec2, cbData, cbBuffered;
+short i1;
+long etotal, filesize, filepos, block, lBuffered;
+unsigned long ulWritten = 0;
+#ifdef ARDUINO
+int nak1K;  // 1K blocks NAKed in a row
+#else // ARDUINO
+XBLOCK_SIZE size;
+#endif // ARDUINO
+
+
+  lBuffered = -1; // file position of the data in the buffer
+  cbBuffered = 0;
+  ecount = 0;
+  etotal = 0;
+  filesize = 0;
+  filepos = 0;
+  block = 1;
+
+  pX->bCRC = 0; // MUST ASSIGN TO ZERO FIRST or XMODEM-CHECKSUM may not work properly
+
+  // ** already got first 'NAK' character on entry as pX->buf.xbuf.cSOH  **
+
+#ifdef ARDUINO
+
+  filesize = pX->file.size();
+
+#else // ARDUINO
+
+  filesize = pX->pStream ? pX->pStream->lSize : (long)lseek(pX->file, 0, SEEK_END);
+  if(filesize < 0) // not allowed
+  {
+    fputs("SendXmodem fail (file size)\n", stderr);
+    return -1;
+  }
+
+#endif // ARDUINO
+
+  pX->lFileSize = filesize;
+
+  // a CRC receiver may understand YMODEM, in which case 1K blocks are used
+
+  pX->b1K = 0;
+#ifdef ARDUINO
+  nak1K = 0;
+#endif // ARDUINO
+  cbData = sizeof(pX->buf.xbuf.aDataBuf);
+
+  if(bOfferYmodem && pX->buf.xbuf.cSOH == 'C')
+  {
+    i1 = SendYmodemHeader(pX, filesize);
+
+    if(i1 < 0)
+    {
+      XmodemTerminate(pX);
+      return 1; // terminated
+    }
+
+    pX->bYMODEM = pX->b1K = (i1 > 0);
+
+    if(!i1)
+    {
+      pX->lOffset = 0; // a plain XMODEM receiver starts at the beginning
+    }
+
+    filepos = pX->lDone = pX->lOffset;
+
+    if(i1 == 2 && iWindow > 1)
+    {
+      return SendWindowed(pX, filesize);
+    }
+  }
+
+#ifndef ARDUINO
+  memset(&size, 0, sizeof(size));
+  size.bAdapt = pX->b1K && !iBlockSize;
+  size.cbBlock = (pX->b1K && iBlockSize != 128) ? 1024 : 128;
+  pX->b1K = (size.cbBlock == 1024);
+#endif // ARDUINO
+
+  do
+  {
+    // ** depending on type of transfer, place the packet
+    // ** into pX->buf with all fields appropriately filled.
+
+    if(filepos >= filesize) // end of transfer
+    {
+      for(i1=0; i1 < 8; i1++)
+      {
+        WriteXmodemChar(pX->ser, _EOT_); // ** send an EOT marking end of transfer
+
+        if(GetXmodemBlock(pX, &(pX->buf.xbuf.cSOH), 1) != 1) // this takes up to 5 seconds
+        {
+          // nothing returned - try again?
+          // break; // for now I loop, uncomment to bail out
+        }
+        else if(pX->buf.xbuf.cSOH == _ENQ_    // an 'ENQ' (apparently some expect this)
+                || pX->buf.xbuf.cSOH == _ACK_ // an 'ACK' (most XMODEM implementations expect this)
+                || pX->buf.xbuf.cSOH == _CAN_) // CTRL-X = TERMINATE
+        {
+          // both normal and 'abnormal' termination.
+          break;
+        }
+      }
+
+      if(i1 < 8 && pX->buf.xbuf.cSOH == _ACK_ && pX->bYMODEM && pX->bMore)
+      {
+        fputs("SendXmodem return 0, next file\n", stderr);
+        return 0; // the receiver asks for the next header with 'C'
+      }
+
+      if(i1 < 8 && pX->buf.xbuf.cSOH == _ACK_ && pX->bYMODEM)
+      {
+        SendYmodemEnd(pX, 0);
+      }
+
+      XmodemTerminate(pX);
+
+      fprintf(stderr, "SendXmodem return %d\n", i1 >= 8 ? 1 : 0);
+      return i1 >= 8 ? 1 : 0; // return 1 if receiver choked on the 'EOT' marker, else 0 for 'success'
+    }
+
+//  TODO:  progress indicator [can be LCD for arduino, blinky lights, ???  and of course stderr for everyone else]
+//  If filesize& <> 0 Then Form2!Label1.FloodPercent = 100 * filepos& / filesize&
+
+    if(ecount > 25)
+    {
+	return 99;
+    }
+    fprintf(stderr, "block %ld  %ld of %ld bytes  %d errors\r\n", block, filepos, filesize, ecount);
+
+    if(pX->buf.xbuf.cSOH != 'C' // XMODEM CRC
+       && pX->buf.xbuf.cSOH != (char)_NAK_) // NAK
+    {
+      // increase error count, bail if it's too much
+
+      ec2++;
+    }
+
+    // fortunately, xbuf, xcbuf and x1kbuf are the same up to 'aDataBuf' so
+    // I can read the file NOW using 'xbuf' for both CRC and CHECKSUM versions.
+    // a short tail goes in a 128 byte block rather than a mostly padded 1K one
+
+    if(pX->b1K && (filesize - filepos) > (long)sizeof(pX->buf.xbuf.aDataBuf))
+    {
+      cbData = sizeof(pX->buf.x1kbuf.aDataBuf);
+    }
+    else
+    {
+      cbData = sizeof(pX->buf.xbuf.aDataBuf);
+    }
+
+    // a retry sends the block that is still in the buffer, only the header
+    // and the CRC or checksum after the data were written since
+    if(filepos == lBuffered && cbData == cbBuffered)
+    {
+      pX->stats.lResent++; // already there
+    }
+    else if((filesize - filepos) >= cbData)
+    {
+      i1 = ReadXmodemData(pX, filepos, pX->buf.x1kbuf.aDataBuf, cbData);
+
+      if(i1 != cbData)
+      {
+        // TODO:  read error - send a ctrl+x ?
+      }
+    }
+    else
+    {
+      memset(pX->buf.x1kbuf.aDataBuf, '\x1a', cbData); // fill with ctrl+z which is what the spec says
+      i1 = ReadXmodemData(pX, filepos, pX->buf.x1kbuf.aDataBuf, filesize - filepos);
+
+      if(i1 != (filesize - filepos))
+      {
+        // TODO:  read error - send a ctrl+x ?
+      }
+    }
+
+    lBuffered = filepos;
+    cbBuffered = cbData;
+    pX->stats.lBlocks++;
+
+    if(pX->buf.xbuf.cSOH == 'C' ||  // XMODEM CRC 'NAK' (first time only, typically)
+       ((pX->buf.xbuf.cSOH == _ACK_ || pX->buf.xbuf.cSOH == _NAK_) && pX->bCRC)) // identifies ACK/NACK with XMODEM CRC
+    {
+      pX->bCRC = 1; // make sure (only matters the first time, really)
+
+      // calculate the CRC, assign to the packet, and then send it
+
+      GenerateSEQC(&(pX->buf.xcbuf), block);
+
+      if(cbData == sizeof(pX->buf.x1kbuf.aDataBuf))
+      {
+        pX->buf.x1kbuf.cSOH = _STX_; // 1K packet
+        pX->buf.x1kbuf.wCRC = CalcCRC(pX->buf.x1kbuf.aDataBuf, sizeof(pX->buf.x1kbuf.aDataBuf));
+
+        i1 = WriteXmodemBlock(pX->ser, &(pX->buf.x1kbuf), sizeof(pX->buf.x1kbuf));
+        if(i1 != sizeof(pX->buf.x1kbuf)) // write error
+        {
+          // TODO:  handle write error (send ctrl+X ?)
+        }
+      }
+      else
+      {
+        pX->buf.xcbuf.cSOH = 1; // must send SOH as 1st char
+        pX->buf.xcbuf.wCRC = CalcCRC(pX->buf.xcbuf.aDataBuf, sizeof(pX->buf.xcbuf.aDataBuf));
+
+        // send it
+
+        i1 = WriteXmodemBlock(pX->ser, &(pX->buf.xcbuf), sizeof(pX->buf.xcbuf));
+        if(i1 != sizeof(pX->buf.xcbuf)) // write error
+        {
+          // TODO:  handle write error (send ctrl+X ?)
+        }
+      }
+    }
+    else if(pX->buf.xbuf.cSOH == _NAK_ || // 'NAK' (checksum method, may also be with CRC method)
+            (pX->buf.xbuf.cSOH == _ACK_ && !pX->bCRC)) // identifies ACK with XMODEM CHECKSUM
+    {
+      pX->bCRC = 0; // make sure (this ALSO allows me to switch modes on error)
+
+      // calculate the CHECKSUM, assign to the packet, and then send it
+
+      pX->buf.xbuf.cSOH = 1; // must send SOH as 1st char
+      pX->buf.xbuf.bCheckSum = CalcCheckSum(pX->buf.xbuf.aDataBuf, sizeof(pX->buf.xbuf.aDataBuf));
+
+      GenerateSEQ(&(pX->buf.xbuf), block);
+
+      // send it
+
+      i1 = WriteXmodemBlock(pX->ser, &(pX->buf.xbuf), sizeof(pX->buf.xbuf));
+      if(i1 != sizeof(pX->buf.xbuf)) // write error
+      {
+        // TODO:  handle write error (send ctrl+X ?)
+      }
+    }
+
+    ec2 = 0;
+    ulWritten = MyMillis();
+
+    while(ecount < TOTAL_ERROR_COUNT && ec2 < ACK_ERROR_COUNT) // loop to get ACK or NACK
+    {
+      if(GetXmodemBlock(pX, &(pX->buf.xbuf.cSOH), 1) == 1)
+      {
+        if(pX->buf.xbuf.cSOH == _CAN_) // ** CTRL-X - terminate
+        {
+          XmodemTerminate(pX);
+
+          return 1; // terminated
+        }
+        else if(pX->buf.xbuf.cSOH == _NAK_ || // ** NACK
+                pX->buf.xbuf.cSOH == 'C') // ** CRC NACK
+        {
+          pX->stats.lNaks++;
+
+#ifdef ARDUINO
+          // a link that keeps losing 1K blocks does better with short ones
+          if(cbData == sizeof(pX->buf.x1kbuf.aDataBuf) && ++nak1K >= 3)
+          {
+            pX->b1K = 0;
+          }
+#else // ARDUINO
+          SizeAnswer(pX, &size, cbData, 0, ulWritten);
+#endif // ARDUINO
+
+          break;  // exit inner loop and re-send packet
+        }
+        else if(pX->buf.xbuf.cSOH == _ACK_) // ** ACK - sending next packet
+        {
+          filepos += cbData;
+          block++; // increment file position and block count
+          CountRtt(pX, MyMillis() - ulWritten);
+#ifdef ARDUINO
+          nak1K = 0;
+#else // ARDUINO
+          SizeAnswer(pX, &size, cbData, 1, ulWritten);
+#endif // ARDUINO
+
+          SaveProgress(pX, filepos < filesize ? filepos : filesize, 0);
+
+          break; // leave inner loop, send NEXT packet
+        }
+#ifndef ARDUINO
+        else if(pX->buf.xbuf.cSOH == 'F')
+        {
+          // the receiver's parity offer after its 'W'.  flushing here would
+          // throw away the ACK right behind it
+        }
+#endif // ARDUINO
+        else
+        {
+          XModemFlushInput(pX);  // for now, do this here too
+          ec2++;
+        }
+      }
+      else
+      {
+        pX->stats.lTimeouts++;
+        ecount++; // increase total error count, then loop back and re-send packet
+#ifndef ARDUINO
+        SizeAnswer(pX, &size, cbData, 0, ulWritten);
+#endif // ARDUINO
+        break;
+      }
+    }
+
+    if(ec2 >= ACK_ERROR_COUNT)
+    {
+      break;  // that's it, I'm done with this
+    }
+
+  } while(ecount < TOTAL_ERROR_COUNT * 2); // twice error count allowed for sending
+
+   // ** at this point it is important to indicate the errors
+   // ** and flush all buffers, and terminate process!
+
+  XmodemTerminate(pX);
+  fputs("SendXmodem fail (total error count)\n", stderr);
+  return -2; // exit on error
+}
+
+int XReceiveSub(XMODEM *pX)
+{
+int i1;
+
+  // start with CRC mode [try 8 times to get CRC]
+
+  pX->bCRC = 1;
+
+  for(i1=0; i1 < 8; i1++)
+  {
+    WriteXmodemChar(pX->ser, 'C'); // start with NAK for XMODEM CRC
+
+    if(GetXmodemBlock(pX, &(pX->buf.xbuf.cSOH), 1) == 1)
+    {
+      if(pX->buf.xbuf.cSOH == _SOH_ || // SOH - packet is on its way
+         pX->buf.xbuf.cSOH == _STX_)   // STX - 1K packet
+      {
+        return ReceiveXmodem(pX);
+      }
+      else if(pX->buf.xbuf.cSOH == _EOT_) // an EOT [blank file?  allow this?]
+      {
+        return 0; // for now, do this
+      }
+      else if(pX->buf.xbuf.cSOH == _CAN_) // cancel
+      {
+        return 1; // canceled
+      }
+    }
+  }
+
+  pX->bCRC = 0;
+
+  // try again, this time using XMODEM CHECKSUM
+  for(i1=0; i1 < 8; i1++)
+  {
+    WriteXmodemChar(pX->ser, _NAK_); // switch to NAK for XMODEM Checksum
+
+    if(GetXmodemBlock(pX, &(pX->buf.xbuf.cSOH), 1) == 1)
+    {
+      if(pX->buf.xbuf.cSOH == _SOH_ || // SOH - packet is on its way
+         pX->buf.xbuf.cSOH == _STX_)   // STX - 1K packet
+      {
+        return ReceiveXmodem(pX);
+      }
+      else if(pX->buf.xbuf.cSOH == _EOT_) // an EOT [blank file?  allow this?]
+      {
+        return 0; // for now, do this
+      }
+      else if(pX->buf.xbuf.cSOH == _CAN_) // cancel
+      {
+        return 1; // canceled
+      }
+    }
+  }
+
+  XmodemTerminate(pX);
+
+  return -3; // fail
+}
+
+int XSendSub(XMODEM *pX)
+{
+unsigned long ulStart;
+
+  // waiting up to 30 seconds for transfer to start.  this is part of the spec?
+
+
+#ifdef ARDUINO
+  ulStart = millis();
+#else // ARDUINO
+  ulStart = MyMillis();
+#endif // ARDUINO
+
+  do
+  {
+    if(GetXmodemBlock(pX, &(pX->buf.xbuf.cSOH), 1) == 1)
+    {
+      if(pX->buf.xbuf.cSOH == 'C' || // XMODEM CRC
+         pX->buf.xbuf.cSOH == _NAK_) // NAK - XMODEM CHECKSUM
+      {
+//#ifdef STAND_ALONE
+        fprintf(stderr, "Got %d, continuing\n", pX->buf.xbuf.cSOH);
+//#endif // STAND_ALONE
+        return SendXmodem(pX);
+      }
+      else if(pX->buf.xbuf.cSOH == _CAN_) // cancel
+      {
+//#ifdef STAND_ALONE
+        fputs("XSendSub fail (cancel)\n", stderr);
+//endif // STAND_ALONE
+        return 1; // canceled
+      }
+    }
+  }    
+#ifdef ARDUINO
+  while((short)(millis() - ulStart) < 30000);   // 30 seconds
+#else // ARDUINO
+  while((int)(MyMillis() - ulStart) < 30000);
+#endif // ARDUINO
+
+  XmodemTerminate(pX);
+
+//#ifdef STAND_ALONE
+  fputs("XSendSub fail (timeout)\n", stderr);
+//#endif // STAND_ALONE
+  return -3; // fail
+}
+
+#ifdef ARDUINO
+
+short XReceive(SDClass *pSD, HardwareSerial *pSer, const char *szFilename)
+{
+short iRval;
+XMODEM xx;
+
+  memset(&xx, 0, sizeof(xx));
+  xx.ulStart = MyMillis();
+
+  xx.ser = pSer;
+
+  if(pSD->exists((char *)szFilename))
+  {
+    pSD->remove((char *)szFilename);
+  }
+
+  xx.file = pSD->open((char *)szFilename, FILE_WRITE);
+  if(!xx.file)
+  {
+    return -9; // can't create file
+  }
+
+  iRval = XReceiveSub(&xx);  
+
+  xx.file.close();
+  KeepStats(&xx);
+
+  if(iRval)
+  {
+    WriteXmodemChar(pSer, _CAN_); // cancel (make sure)
+
+    pSD->remove((char *)szFilename); // delete file on error
+  }
+
+  return iRval;
+}
+
+int XSend(SDClass *pSD, HardwareSerial *pSer, const char *szFilename)
+{
+short iRval;
+XMODEM xx;
+
+  memset(&xx, 0, sizeof(xx));
+  xx.ulStart = MyMillis();
+
+  xx.ser = pSer;
+
+  xx.file = pSD->open(szFilename, FILE_READ);
+  if(!xx.file)
+  {
+    return -9; // can't open file
+  }
+
+  iRval = XSendSub(&xx);  
+
+  xx.file.close();
+  KeepStats(&xx);
+
+  return iRval;
+}
+
+#else // ARDUINO
+
+// opens the file a transfer is about to write
+int ReceiveOpen(XMODEM *pX, const char *szFilename, int nMode)
+{
+  strncpy(pX->szPath, szFilename, sizeof(pX->szPath) - 1);
+
+  ResumeSetAside(szFilename); // a partial file by that name is kept for later
+  unlink(szFilename); // make sure it does not exist, first
+  pX->file = open(szFilename, O_CREAT | O_TRUNC | O_WRONLY, nMode);
+
+  if(pX->file < 0)
+  {
+//#ifdef STAND_ALONE
+    fprintf(stderr, "XReceive fail \"%s\"  errno=%d\n", szFilename, errno);
+//#endif // STAND_ALONE
+    return -9; // can't create file
+  }
+
+  return 0;
+}
+
+// closes the file once the transfer returned iRval.  what arrived of a
+// failed one is kept for the next session
+void ReceiveClose(XMODEM *pX, int iRval)
+{
+  if(iRval)
+  {
+    SaveProgress(pX, pX->lDone, 1);
+  }
+
+  close(pX->file);
+
+  if(iRval && pX->lSaved > 0)
+  {
+    ResumeSetAside(pX->szPath);
+  }
+  else if(iRval)
+  {
+    unlink(pX->szPath); // delete file on error
+  }
+  else if(pX->szRecord[0])
+  {
+    unlink(pX->szRecord); // nothing left to resume
+  }
+}
+
+// opens a file to send
+int SendOpen(XMODEM *pX, const char *szFilename)
+{
+  pX->file = open(szFilename, O_RDONLY, 0);
+
+  // the YMODEM header carries the name without the path
+  strncpy(pX->szName, strrchr(szFilename, '/') ? strrchr(szFilename, '/') + 1 : szFilename, sizeof(pX->szName) - 1);
+
+  if(pX->file < 0)
+  {
+    fprintf(stderr, "XSend fail \"%s\"  errno=%d\n", szFilename, errno);
+    return -9; // can't open file
+  }
+
+  // the hash in the header lets the receiver tell if what it kept from
+  // an earlier session is this file
+  if(bOfferYmodem && bResume)
+  {
+    pX->ullHash = XResumeHash(pX->file);
+    strncpy(pX->szPath, szFilename, sizeof(pX->szPath) - 1);
+    XResumeSenderRecord(szFilename, pX->szRecord, sizeof(pX->szRecord));
+  }
+
+  return 0;
+}
+
+void SendClose(XMODEM *pX, int iRval)
+{
+  if(iRval)
+  {
+    SaveProgress(pX, pX->lDone, 1);
+  }
+  else if(pX->szRecord[0])
+  {
+    unlink(pX->szRecord);
+  }
+
+  close(pX->file);
+}
+
+// the hash of a stream for the YMODEM header
+unsigned long long StreamHash(XMODEM_STREAM *pStream)
+{
+unsigned long long ullHash = XRESUME_HASH_INIT;
+char aBuf[1024];
+long lPos;
+int cb1;
+
+  for(lPos=0; lPos < pStream->lSize; lPos += cb1)
+  {
+    cb1 = pStream->lSize - lPos < (long)sizeof(aBuf) ? (int)(pStream->lSize - lPos) : (int)sizeof(aBuf);
+    cb1 = pStream->pfnRead(pStream->pCtx, lPos, aBuf, cb1);
+    if(cb1 <= 0)
+    {
+      break;
+    }
+
+    ullHash = XResumeHashUpdate(ullHash, aBuf, cb1);
+  }
+
+  return ullHash ? ullHash : 1;
+}
+
+// forgets the file that was just sent or received, so the next one in the
+// batch can start.  the serial side and the CRC mode stay, and so does
+// 'buf', which may already hold the header of the next file
+void NextFile(XMODEM *pX)
+{
+  pX->file = -1;
+  pX->pStream = NULL;
+  pX->b1K = pX->bYMODEM = pX->bWindow = pX->bMore = 0;
+  pX->lFileSize = -1;
+  pX->szName[0] = 0;
+  pX->ullHash = 0;
+  pX->lOffset = pX->lDone = pX->lResumable = pX->lSaved = 0;
+  pX->szPath[0] = pX->szRecord[0] = 0;
+}
+
+int XReceive(SERIAL_TYPE hSer, const char *szFilename, int nMode)
+{
+int iRval, iFlags;
+XMODEM xx;
+
+#ifdef DEBUG_CODE
+  szERR[0]=0;
+#endif // DEBUG_CODE
+  memset(&xx, 0, sizeof(xx));
+  xx.ulStart = MyMillis();
+
+  xx.ser = hSer;
+
+  iRval = ReceiveOpen(&xx, szFilename, nMode);
+  if(iRval)
+  {
+    return iRval;
+  }
+
+  iFlags = fcntl(hSer, F_GETFL);
+  XReaderInit(&(xx.reader), hSer);
+
+  iRval = XReceiveSub(&xx);  
+
+  if(!iRval && xx.bNext)
+  {
+    WriteXmodemChar(hSer, _CAN_); // the sender has more files, only one was asked for
+  }
+
+  if(iFlags == -1 || fcntl(hSer, F_SETFL, iFlags) == -1)
+  {
+    fprintf(stderr, "Warning:  'fcntl' call to restore flags failed, errno=%d\n", errno);
+  }
+
+  ReceiveClose(&xx, iRval);
+  KeepStats(&xx);
+
+  fprintf(stderr, "XReceive returns %d\n", iRval);
+  return iRval;
+}
+
+int XReceiveBatch(SERIAL_TYPE hSer, const char *szDir, int nMode, XMODEM_DONE pfnDone, void *pCtx)
+{
+char szTemp[300], szFinal[400];
+const char *szName;
+int iRval, iFlags, nFiles;
+XMODEM xx;
+
+#ifdef DEBUG_CODE
+  szERR[0]=0;
+#endif // DEBUG_CODE
+  memset(&xx, 0, sizeof(xx));
+  xx.ulStart = MyMillis();
+
+  xx.ser = hSer;
+
+  // every file arrives under the same name, so its progress record can
+  // find it whatever the header calls it
+  snprintf(szTemp, sizeof(szTemp), "%s/.xbatch", szDir);
+
+  iFlags = fcntl(hSer, F_GETFL);
+  XReaderInit(&(xx.reader), hSer);
+
+  for(nFiles=0; ; nFiles++)
+  {
+    if(nFiles)
+    {
+      NextFile(&xx);
+    }
+
+    iRval = ReceiveOpen(&xx, szTemp, nMode);
+    if(iRval)
+    {
+      WriteXmodemChar(hSer, _CAN_);
+      break;
+    }
+
+    iRval = nFiles ? ReceiveXmodem(&xx) : XReceiveSub(&xx);
+    ReceiveClose(&xx, iRval);
+
+    if(iRval)
+    {
+      break;
+    }
+
+    if(!xx.szName[0] && !xx.lDone) // an empty batch
+    {
+      unlink(szTemp);
+      break;
+    }
+
+    // the name is the sender's, but the file stays in szDir
+    szName = strrchr(xx.szName, '/') ? strrchr(xx.szName, '/') + 1 : xx.szName;
+    if(!szName[0] || szName[0] == '.')
+    {
+      snprintf(szFinal, sizeof(szFinal), "%s/file%d", szDir, nFiles);
+    }
+    else
+    {
+      snprintf(szFinal, sizeof(szFinal), "%s/%s", szDir, szName);
+    }
+
+    if(rename(szTemp, szFinal))
+    {
+      fprintf(stderr, "XReceiveBatch fail \"%s\"  errno=%d\n", szFinal, errno);
+    }
+    else if(pfnDone)
+    {
+      pfnDone(pCtx, szFinal, xx.lFileSize >= 0 ? xx.lFileSize : xx.lDone);
+    }
+
+    if(!xx.bNext)
+    {
+      nFiles++;
+      break;
+    }
+  }
+
+  if(iFlags == -1 || fcntl(hSer, F_SETFL, iFlags) == -1)
+  {
+    fprintf(stderr, "Warning:  'fcntl' call to restore flags failed, errno=%d\n", errno);
+  }
+
+  KeepStats(&xx);
+
+  fprintf(stderr, "XReceiveBatch returns %d after %d files\n", iRval, nFiles);
+  return iRval;
+}
+
+// what the receiver sent while XSendQueue waited for its next file.  it
+// asks for the header with a 'C' every SILENCE_TIMEOUT, all of them are
+// read so that only one header answers them.  1 if it asked, with the 'C'
+// or NAK in buf as SendXmodem expects it, -1 if it canceled, 0 if nothing
+// came
+static int StaleAsk(XMODEM *pX)
+{
+char c1;
+int iRval = 0;
+
+  while(GetXmodemBlockWait(pX, &c1, 1, 10) == 1) // what has come, not more
+  {
+    if(c1 == _CAN_)
     {
-      break;  // that's it, I'm done with this
+      iRval = -1;
     }
+    else if(iRval >= 0 && (c1 == 'C' || c1 == _NAK_))
+    {
+      pX->buf.xbuf.cSOH = c1;
+      iRval = 1;
+    }
+  }
 
-  } while(ecount < TOTAL_ERROR_COUNT * 2); // twice error count allowed for sending
-
-   // ** at this point it is important to indicate the errors
-   // ** and flush all buffers, and terminate process!
-
-  XmodemTerminate(pX);
-  fputs("SendXmodem fail (total error count)\n", stderr);
-  return -2; // exit on error
+  return iRval;
 }
 
-int XReceiveSub(XMODEM *pX)
+int XSendQueue(SERIAL_TYPE hSer, XMODEM_NEXT pfnNext, XMODEM_SENT pfnSent, void *pCtx)
 {
-int i1;
+int i1, iRval, iFlags, iAsk, bOpen, nSent;
+XMODEM_ITEM *pItem;
+XMODEM xx;
 
-  // start with CRC mode [try 8 times to get CRC]
+#ifdef DEBUG_CODE
+  szERR[0]=0;
+#endif // DEBUG_CODE
+  memset(&xx, 0, sizeof(xx));
+  xx.ulStart = MyMillis();
 
-  pX->bCRC = 1;
+  xx.ser = hSer;
 
-  for(i1=0; i1 < 8; i1++)
+  iFlags = fcntl(hSer, F_GETFL);
+  XReaderInit(&(xx.reader), hSer);
+
+  for(iRval=0, iAsk=0, bOpen=0, nSent=0; (pItem = pfnNext(pCtx)) != NULL; )
   {
-    WriteXmodemChar(pX->ser, 'C'); // start with NAK for XMODEM CRC
+    if(nSent)
+    {
+      NextFile(&xx);
+      i1 = StaleAsk(&xx);
+      iAsk = i1 ? i1 : iAsk; // a 'C' read before a file that would not open still stands
+    }
 
-    if(GetXmodemBlock(pX->ser, &(pX->buf.xbuf.cSOH), 1) == 1)
+    if(iAsk < 0)
     {
-      if(pX->buf.xbuf.cSOH == _SOH_) // SOH - packet is on its way
-      {
-        return ReceiveXmodem(pX);
-      }
-      else if(pX->buf.xbuf.cSOH == _EOT_) // an EOT [blank file?  allow this?]
-      {
-        return 0; // for now, do this
-      }
-      else if(pX->buf.xbuf.cSOH == _CAN_) // cancel
+      pItem->iResult = 1; // canceled while the file was made ready
+    }
+    else if(pItem->szPath)
+    {
+      pItem->iResult = SendOpen(&xx, pItem->szPath);
+    }
+    else
+    {
+      pItem->iResult = 0;
+      xx.pStream = pItem->pStream;
+      if(bOfferYmodem && bResume)
       {
-        return 1; // canceled
+        xx.ullHash = StreamHash(xx.pStream);
       }
     }
-  }
-
-  pX->bCRC = 0;
-
-  // try again, this time using XMODEM CHECKSUM
-  for(i1=0; i1 < 8; i1++)
-  {
-    WriteXmodemChar(pX->ser, _NAK_); // switch to NAK for XMODEM Checksum
 
-    if(GetXmodemBlock(pX->ser, &(pX->buf.xbuf.cSOH), 1) == 1)
+    if(pItem->iResult)
     {
-      if(pX->buf.xbuf.cSOH == _SOH_) // SOH - packet is on its way
-      {
-        return ReceiveXmodem(pX);
-      }
-      else if(pX->buf.xbuf.cSOH == _EOT_) // an EOT [blank file?  allow this?]
+      iRval = iRval ? iRval : pItem->iResult;
+
+      if(pfnSent)
       {
-        return 0; // for now, do this
+        pfnSent(pCtx, pItem);
       }
-      else if(pX->buf.xbuf.cSOH == _CAN_) // cancel
+
+      if(iAsk < 0)
       {
-        return 1; // canceled
+        bOpen = 0;
+        break;
       }
+
+      continue; // the receiver still waits for the next header
     }
-  }
 
-  XmodemTerminate(pX);
+    if(pItem->szName)
+    {
+      strncpy(xx.szName, pItem->szName, sizeof(xx.szName) - 1);
+    }
 
-  return -3; // fail
-}
+    // the queue may hold more, if it turns out not to an empty header
+    // closes the batch
+    xx.bMore = 1;
+    xx.iFile = nSent++;
 
-int XSendSub(XMODEM *pX)
-{
-unsigned long ulStart;
+    pItem->iResult = iAsk > 0 ? SendXmodem(&xx) : XSendSub(&xx);
+    iAsk = 0;
 
-  // waiting up to 30 seconds for transfer to start.  this is part of the spec?
+    if(xx.pStream)
+    {
+      xx.pStream->lDone = pItem->iResult ? xx.lDone : xx.pStream->lSize;
+    }
+    else
+    {
+      SendClose(&xx, pItem->iResult);
+    }
 
+    iRval = iRval ? iRval : pItem->iResult;
 
-#ifdef ARDUINO
-  ulStart = millis();
-#else // ARDUINO
-  ulStart = MyMillis();
-#endif // ARDUINO
+    if(pfnSent)
+    {
+      pfnSent(pCtx, pItem);
+    }
 
-  do
-  {
-    if(GetXmodemBlock(pX->ser, &(pX->buf.xbuf.cSOH), 1) == 1)
+    // only a YMODEM receiver takes more than one file
+    bOpen = !pItem->iResult && xx.bYMODEM;
+    if(!bOpen)
     {
-      if(pX->buf.xbuf.cSOH == 'C' || // XMODEM CRC
-         pX->buf.xbuf.cSOH == _NAK_) // NAK - XMODEM CHECKSUM
-      {
-//#ifdef STAND_ALONE
-        fprintf(stderr, "Got %d, continuing\n", pX->buf.xbuf.cSOH);
-//#endif // STAND_ALONE
-        return SendXmodem(pX);
-      }
-      else if(pX->buf.xbuf.cSOH == _CAN_) // cancel
-      {
-//#ifdef STAND_ALONE
-        fputs("XSendSub fail (cancel)\n", stderr);
-//endif // STAND_ALONE
-        return 1; // canceled
-      }
+      break;
     }
-  }    
-#ifdef ARDUINO
-  while((short)(millis() - ulStart) < 30000);   // 30 seconds
-#else // ARDUINO
-  while((int)(MyMillis() - ulStart) < 30000);
-#endif // ARDUINO
+  }
 
-  XmodemTerminate(pX);
+  if(bOpen)
+  {
+    SendYmodemEnd(&xx, StaleAsk(&xx) > 0 || iAsk > 0);
+    XmodemTerminate(&xx);
+  }
 
-//#ifdef STAND_ALONE
-  fputs("XSendSub fail (timeout)\n", stderr);
-//#endif // STAND_ALONE
-  return -3; // fail
+  if(iFlags == -1 || fcntl(hSer, F_SETFL, iFlags) == -1)
+  {
+    fprintf(stderr, "Warning:  'fcntl' call to restore flags failed, errno=%d\n", errno);
+  }
+
+  KeepStats(&xx);
+
+  fprintf(stderr, "XSendQueue returning %d after %d files\n", iRval, nSent);
+  return iRval;
 }
 
-#ifdef ARDUINO
+// the files of XSendBatch, given to XSendQueue one at a time
+typedef struct _XMODEM_ARRAY_
+{
+  XMODEM_ITEM *aItems; ///< the batch
+  int nItems;          ///< files in it
+  int iNext;           ///< the one to send next
+} XMODEM_ARRAY;
 
-short XReceive(SDClass *pSD, HardwareSerial *pSer, const char *szFilename)
+static XMODEM_ITEM *ArrayNext(void *pCtx)
 {
-short iRval;
-XMODEM xx;
+XMODEM_ARRAY *pA = (XMODEM_ARRAY *)pCtx;
 
-  memset(&xx, 0, sizeof(xx));
+  return pA->iNext < pA->nItems ? pA->aItems + pA->iNext++ : NULL;
+}
 
-  xx.ser = pSer;
+int XSendBatch(SERIAL_TYPE hSer, XMODEM_ITEM *aItems, int nItems)
+{
+XMODEM_ARRAY array;
+int i1;
 
-  if(pSD->exists((char *)szFilename))
+  for(i1=0; i1 < nItems; i1++)
   {
-    pSD->remove((char *)szFilename);
+    aItems[i1].iResult = -10; // not sent
   }
 
-  xx.file = pSD->open((char *)szFilename, FILE_WRITE);
-  if(!xx.file)
-  {
-    return -9; // can't create file
-  }
+  array.aItems = aItems;
+  array.nItems = nItems;
+  array.iNext = 0;
 
-  iRval = XReceiveSub(&xx);  
+  return XSendQueue(hSer, ArrayNext, NULL, &array);
+}
 
-  xx.file.close();
+int XSend(SERIAL_TYPE hSer, const char *szFilename)
+{
+XMODEM_ITEM item;
 
-  if(iRval)
-  {
-    WriteXmodemChar(pSer, _CAN_); // cancel (make sure)
+  memset(&item, 0, sizeof(item));
+  item.szPath = szFilename;
 
-    pSD->remove((char *)szFilename); // delete file on error
-  }
+  return XSendBatch(hSer, &item, 1);
+}
 
-  return iRval;
+int XSendStream(SERIAL_TYPE hSer, const char *szName, XMODEM_STREAM *pStream)
+{
+XMODEM_ITEM item;
+
+  memset(&item, 0, sizeof(item));
+  item.szName = szName;
+  item.pStream = pStream;
+
+  return XSendBatch(hSer, &item, 1);
 }
 
-int XSend(SDClass *pSD, HardwareSerial *pSer, const char *szFilename)
+int XReceiveStream(SERIAL_TYPE hSer, XMODEM_STREAM *pStream)
 {
-short iRval;
+int iRval, iFlags;
 XMODEM xx;
 
+#ifdef DEBUG_CODE
+  szERR[0]=0;
+#endif // DEBUG_CODE
   memset(&xx, 0, sizeof(xx));
+  xx.ulStart = MyMillis();
 
-  xx.ser = pSer;
+  xx.ser = hSer;
+  xx.pStream = pStream;
 
-  xx.file = pSD->open(szFilename, FILE_READ);
-  if(!xx.file)
+  iFlags = fcntl(hSer, F_GETFL);
+  XReaderInit(&(xx.reader), hSer);
+
+  iRval = XReceiveSub(&xx);
+
+  if(!iRval && xx.bNext)
   {
-    return -9; // can't open file
+    WriteXmodemChar(hSer, _CAN_); // the sender has more files, only one was asked for
   }
 
-  iRval = XSendSub(&xx);  
+  if(iFlags == -1 || fcntl(hSer, F_SETFL, iFlags) == -1)
+  {
+    fprintf(stderr, "Warning:  'fcntl' call to restore flags failed, errno=%d\n", errno);
+  }
 
-  xx.file.close();
+  pStream->lSize = xx.bYMODEM ? xx.lFileSize : -1;
+  pStream->lDone = xx.lDone;
+  KeepStats(&xx);
 
+  fprintf(stderr, "XReceiveStream returns %d\n", iRval);
   return iRval;
 }
 
-#else // ARDUINO
-
-int XReceive(SERIAL_TYPE hSer, const char *szFilename, int nMode)
+static int BufferRead(void *pCtx, long lPos, void *pBuf, int cbBuf)
 {
-int iRval;
-XMODEM xx;
-#ifndef ARDUINO
-int iFlags;
-#endif // !ARDUINO
+  memcpy(pBuf, (const unsigned char *)pCtx + lPos, cbBuf);
+  return cbBuf;
+}
 
-#ifdef DEBUG_CODE
-  szERR[0]=0;
-#endif // DEBUG_CODE
-  memset(&xx, 0, sizeof(xx));
+void XBufferStream(XMODEM_STREAM *pStream, const void *pBuf, long cbBuf)
+{
+  memset(pStream, 0, sizeof(*pStream));
+  pStream->pCtx = (void *)pBuf;
+  pStream->lSize = cbBuf;
+  pStream->pfnRead = BufferRead;
+}
 
-  xx.ser = hSer;
+// memory XReceiveBuffer collects the file in
+typedef struct _XMODEM_MEMORY_
+{
+  unsigned char *pData;
+  long cbData;  ///< bytes of file in pData
+  long cbAlloc; ///< size of pData
+} XMODEM_MEMORY;
 
-  unlink(szFilename); // make sure it does not exist, first
-  xx.file = open(szFilename, O_CREAT | O_TRUNC | O_WRONLY, nMode);
+static int MemoryWrite(void *pCtx, long lPos, const void *pBuf, int cbBuf)
+{
+XMODEM_MEMORY *pMem = (XMODEM_MEMORY *)pCtx;
+unsigned char *pNew;
+long cbNew;
 
-  if(!xx.file)
+  if(lPos + cbBuf > pMem->cbAlloc)
   {
-//#ifdef STAND_ALONE
-    fprintf(stderr, "XReceive fail \"%s\"  errno=%d\n", szFilename, errno);
-//#endif // STAND_ALONE
-    return -9; // can't create file
+    for(cbNew = pMem->cbAlloc ? pMem->cbAlloc : 65536; cbNew < lPos + cbBuf; cbNew *= 2)
+    {
+    }
+
+    pNew = (unsigned char *)realloc(pMem->pData, cbNew);
+    if(!pNew)
+    {
+      return -1;
+    }
+
+    pMem->pData = pNew;
+    pMem->cbAlloc = cbNew;
   }
 
-#ifndef ARDUINO
-  iFlags = fcntl(hSer, F_GETFL);
-#endif // !ARDUINO
+  // a window block may land past a gap the repeated blocks fill later
+  if(lPos > pMem->cbData)
+  {
+    memset(pMem->pData + pMem->cbData, 0, lPos - pMem->cbData);
+  }
 
-  iRval = XReceiveSub(&xx);  
+  memcpy(pMem->pData + lPos, pBuf, cbBuf);
 
-#ifndef ARDUINO
-  if(iFlags == -1 || fcntl(hSer, F_SETFL, iFlags) == -1)
+  if(lPos + cbBuf > pMem->cbData)
   {
-    fprintf(stderr, "Warning:  'fcntl' call to restore flags failed, errno=%d\n", errno);
+    pMem->cbData = lPos + cbBuf;
   }
-#endif // !ARDUINO
 
-  close(xx.file);
+  return cbBuf;
+}
 
-  if(iRval)
+int XSendBuffer(SERIAL_TYPE hSer, const char *szName, const void *pBuf, long cbBuf, long *plDone)
+{
+XMODEM_STREAM stream;
+int iRval;
+
+  XBufferStream(&stream, pBuf, cbBuf);
+
+  iRval = XSendStream(hSer, szName, &stream);
+
+  if(plDone)
   {
-    unlink(szFilename); // delete file on error
+    *plDone = stream.lDone;
   }
 
-  fprintf(stderr, "XReceive returns %d\n", iRval);
   return iRval;
 }
 
-int XSend(SERIAL_TYPE hSer, const char *szFilename)
+int XReceiveBuffer(SERIAL_TYPE hSer, void **ppBuf, long *pcbBuf)
 {
+XMODEM_MEMORY mem;
+XMODEM_STREAM stream;
 int iRval;
-XMODEM xx;
-#ifndef ARDUINO
-int iFlags;
-#endif // !ARDUINO
 
-#ifdef DEBUG_CODE
-  szERR[0]=0;
-#endif // DEBUG_CODE
-  memset(&xx, 0, sizeof(xx));
+  memset(&mem, 0, sizeof(mem));
+  memset(&stream, 0, sizeof(stream));
+  stream.pCtx = &mem;
+  stream.pfnWrite = MemoryWrite;
 
-  xx.ser = hSer;
-
-  xx.file = open(szFilename, O_RDONLY, 0);
+  iRval = XReceiveStream(hSer, &stream);
 
-  if(!xx.file)
+  if(iRval)
   {
-    fprintf(stderr, "XSend fail \"%s\"  errno=%d\n", szFilename, errno);
-    return -9; // can't open file
+    free(mem.pData);
+    mem.pData = NULL;
+    mem.cbData = 0;
+  }
+  else if(stream.lSize >= 0)
+  {
+    mem.cbData = stream.lSize; // the YMODEM size, without the padding
   }
 
-#ifndef ARDUINO
-  iFlags = fcntl(hSer, F_GETFL);
-#endif // !ARDUINO
+  *ppBuf = mem.pData;
+  *pcbBuf = mem.cbData;
 
-  iRval = XSendSub(&xx);  
+  return iRval;
+}
 
-  if(iFlags == -1 || fcntl(hSer, F_SETFL, iFlags) == -1)
+long XSendProgress(const char *szFilename)
+{
+char szRecord[300];
+XRESUME r;
+int file;
+
+  XResumeSenderRecord(szFilename, szRecord, sizeof(szRecord));
+  if(XResumeRead(szRecord, &r))
   {
-    fprintf(stderr, "Warning:  'fcntl' call to restore flags failed, errno=%d\n", errno);
+    return -1;
+  }
+
+  // the record only counts while the file is what was sent
+  file = open(szFilename, O_RDONLY);
+  if(file < 0)
+  {
+    return -1;
   }
 
-  close(xx.file);
+  if(XResumeHash(file) != r.ullHash)
+  {
+    r.lOffset = -1;
+  }
 
-  fprintf(stderr, "XSend returning %d\n", iRval);
-//  fprintf(stderr, "Test output");
-  return iRval;
+  close(file);
+  return r.lOffset;
 }
 
 #endif // ARDUINO
@@ -1307,6 +3314,7 @@ int i1;
 int main(int argc, char *argv[])
 {
 int hSer;
+XMODEM xx; // only for flushing the input
 char tbuf[256];
 int i1, iSR = 0;
 
@@ -1345,6 +3353,11 @@ int i1, iSR = 0;
   fputs("TTYCONFIG\n", stderr);
   ttyconfig(hSer, 9600, 0, 8, 1);
 
+  memset(&xx, 0, sizeof(xx));
+  xx.ulStart = MyMillis();
+  xx.ser = hSer;
+  XReaderInit(&(xx.reader), hSer);
+
   reset_arduino(hSer);
 
   fprintf(stderr, "Sleeping for 10 seconds to allow reset\n");
@@ -1352,7 +3365,7 @@ int i1, iSR = 0;
 //  usleep(10000000);
   for(i1=0; i1 < 10; i1++)
   {
-    XModemFlushInput(hSer);  
+    XModemFlushInput(&xx);  
   }
 
   for(i1=0; i1 < 3; i1++)
@@ -1364,7 +3377,7 @@ int i1, iSR = 0;
     WriteXmodemBlock(hSer, tbuf, strlen(tbuf));
 
     fputs("flush input\n", stderr);
-    XModemFlushInput(hSer);  
+    XModemFlushInput(&xx);  
 
     // wait for an LF response
 
@@ -1399,7 +3412,7 @@ int i1, iSR = 0;
     else
     {
       // test function
-      XModemFlushInput(hSer); // continue doing this
+      XModemFlushInput(&xx); // continue doing this
       break; // done (once only)
     }
   }
@@ -1,3 +1,6 @@
+#ifndef XMODEM_H
+#define XMODEM_H
+
 #ifdef ARDUINO
 #else // ARDUINO
 #endif // ARDUINO
@@ -32,6 +35,7 @@
 // win32 includes
 #include <Windows.h>
 #include <io.h>
+#include "xcrc.h"
 #else // POSIX
 // posix includes
 #include <stdio.h>
@@ -42,6 +46,11 @@
 #include <sys/time.h>
 #include <sys/ioctl.h> // for IOCTL definitions
 #include <memory.h>
+#include <string.h>
+#include "xreader.h"
+#include "xresume.h"
+#include <math.h>
+#include "xcrc.h"
 #endif // OS-dependent includes
 
 
@@ -82,6 +91,9 @@ short XReceive(SDClass *pSD, HardwareSerial *pSer, const char *szFilename);
 
 int XSend(SDClass *pSD, HardwareSerial *pSer, const char *szFilename);
 
+void XSetYmodem(int bEnable);
+void XSetWindow(int nBlocks);
+
 #ifdef DEBUG_CODE
 const char *XMGetError(void);
 #endif // DEBUG_CODE
@@ -96,6 +108,144 @@ int XReceive(SERIAL_TYPE hSer, const char *szFilename, int nMode);
 
 int XSend(SERIAL_TYPE hSer, const char *szFilename);
 
+// XSend offers YMODEM-1K (a header with the name and size, then 1024 byte
+// blocks) and falls back to 128 byte XMODEM if the receiver does not take
+// it.  clearing this sends plain XMODEM.  XReceive accepts either
+void XSetYmodem(int bEnable);
+
+// after the YMODEM header XReceive offers a sliding window: 1024 byte
+// blocks with 16 bit sequence numbers, acknowledged cumulatively and
+// selectively so only lost blocks are sent again.  XSend keeps this many
+// blocks in flight (default 8, at most 32), 1 keeps to stop-and-wait
+void XSetWindow(int nBlocks);
+
+// a YMODEM transfer that fails keeps what got across.  both ends record
+// the offset the receiver has with a hash of the file, and the next
+// XSend of the same file starts there, even after a power cut.  XReceive
+// looks for the record in the directory it receives into
+void XSetResume(int bEnable);
+
+// in window mode a receiver that can rebuild a lost block from parity
+// says so, and XSend follows each group of this many blocks with their
+// XOR, and each block it sends again with a copy.  any one block of a
+// group that is lost or damaged is rebuilt from the others instead of
+// being sent again, and a repeat that is lost does not wait for a
+// timeout.  XFEC_ADAPTIVE (the default) picks the group from the share of
+// blocks the ACKs show missing, and sends no parity until about one in
+// seven is, when repeats cost less.  the share carries over to the next
+// XSend on the thread, calling this starts it over.  0 never sends parity
+#define XFEC_ADAPTIVE -1
+#define XFEC_GROUP_MAX 16
+void XSetFec(int nGroup);
+
+// stop-and-wait YMODEM sends 1024 byte blocks, or 128 byte ones while so
+// many 1K blocks have to be sent again that short ones get more across.
+// the choice weighs the share of blocks sent again against the time a
+// block of each size takes to be ACKed, and comes back to 1K once short
+// blocks hardly fail.  0 (the default) adapts, 128 or 1024 keeps to
+// that size.  the window mode always sends 1K blocks
+void XSetBlockSize(int cbBlock);
+
+// called each time the receiver's data grows, with the bytes it has from
+// the start and the size in the YMODEM header (-1 if there was none).
+// szPath is the file being written, empty for a stream
+typedef void (*XMODEM_PROGRESS)(void *pCtx, const char *szPath, const char *szName, long lDone, long lSize);
+void XSetProgress(XMODEM_PROGRESS pfn, void *pCtx);
+
+// buckets of the sender's ACK times, the first for under 32 ms and each
+// one after it twice as wide, the last for 2 s and more
+#define XSTATS_RTT_BUCKETS 8
+
+// what the link cost the last transfer
+typedef struct _XMODEM_STATS_
+{
+  long lBlocks;   ///< data blocks sent, every try counted, or received intact
+  long lResent;   ///< blocks the sender sent again
+  long lTimeouts; ///< waits for an ACK or a block that ran out
+  long lBad;      ///< blocks the receiver threw away, damaged or out of sequence
+  long lParity;   ///< parity blocks sent or received intact
+  long lRepaired; ///< blocks the receiver rebuilt from parity
+  long lNaks;     ///< NAKs the stop-and-wait sender got or the receiver sent
+  long lBytes;    ///< bytes of the files that got across in this call
+  long lMillis;   ///< how long the call took
+  long lRate;     ///< lBytes per second of lMillis
+  long aRtt[XSTATS_RTT_BUCKETS]; ///< blocks ACKed after 0-31 ms, 32-63 ms .. 2 s and more
+} XMODEM_STATS;
+
+// the counts of the last XSend.. or XReceive.. call on this thread, over
+// all the files of a batch
+void XGetStats(XMODEM_STATS *pStats);
+
+// bytes of the file the receiver acknowledged in an unfinished XSend, or
+// -1 if there is none (or the file changed since)
+long XSendProgress(const char *szFilename);
+
+// a source or sink in place of the file.  pfnRead copies up to cbBuf
+// bytes from lPos and returns how many, the same bytes may be asked for
+// again when a block is repeated.  pfnWrite stores cbBuf bytes at lPos
+// and returns how many it stored.  in window mode blocks can arrive out
+// of order, so lPos may skip ahead and come back to fill the gap
+typedef struct _XMODEM_STREAM_
+{
+  void *pCtx;  ///< passed to the callbacks
+  long lSize;  ///< bytes in the source, or from the YMODEM header for a sink (-1 if unknown)
+  long lDone;  ///< on return, the bytes the receiver has
+  int (*pfnRead)(void *pCtx, long lPos, void *pBuf, int cbBuf);
+  int (*pfnWrite)(void *pCtx, long lPos, const void *pBuf, int cbBuf);
+} XMODEM_STREAM;
+
+// a read-only stream of cbBuf bytes at pBuf
+void XBufferStream(XMODEM_STREAM *pStream, const void *pBuf, long cbBuf);
+
+// XSend and XReceive with a stream.  the header of a stream that is sent
+// carries a hash, so a receiver that writes a file can still resume it,
+// but neither end keeps a progress record for the stream itself
+int XSendStream(SERIAL_TYPE hSer, const char *szName, XMODEM_STREAM *pStream);
+int XReceiveStream(SERIAL_TYPE hSer, XMODEM_STREAM *pStream);
+
+// the same from and to memory.  XReceiveBuffer returns the file in a
+// malloc'd buffer the caller frees.  if plDone is not NULL XSendBuffer
+// stores the bytes the receiver has in it, a failed send that got some of
+// them across resumes when it is sent again
+int XSendBuffer(SERIAL_TYPE hSer, const char *szName, const void *pBuf, long cbBuf, long *plDone);
+int XReceiveBuffer(SERIAL_TYPE hSer, void **ppBuf, long *pcbBuf);
+
+// one file of a batch, a file on disk or a stream
+typedef struct _XMODEM_ITEM_
+{
+  const char *szPath;     ///< file to send, or NULL to send pStream
+  const char *szName;     ///< name in the YMODEM header, NULL for the file's own
+  XMODEM_STREAM *pStream; ///< source when szPath is NULL
+  int iResult;            ///< on return, as XSend returns for one file, -10 if it was not sent
+} XMODEM_ITEM;
+
+// called by XReceiveBatch with each file that arrived
+typedef void (*XMODEM_DONE)(void *pCtx, const char *szPath, long lSize);
+
+// a YMODEM batch: the receiver is asked for 'C' once, then every file
+// goes with its name and size in a header right after the last one, and
+// one empty header closes the batch.  XSendBatch returns 0 or the first
+// failure, files after a failed transfer are not sent.  a plain XMODEM
+// receiver takes only the first file
+int XSendBatch(SERIAL_TYPE hSer, XMODEM_ITEM *aItems, int nItems);
+
+// for XSendQueue: pfnNext gives the next file of the batch, waiting for
+// it if need be, or NULL when there are no more.  pfnSent is told of each
+// file once its iResult is set
+typedef XMODEM_ITEM *(*XMODEM_NEXT)(void *pCtx);
+typedef void (*XMODEM_SENT)(void *pCtx, XMODEM_ITEM *pItem);
+
+// XSendBatch with the files handed over one by one, so the batch can
+// start before the last of them is ready.  the receiver asks for the next
+// header every SILENCE_TIMEOUT ms and gives up after TOTAL_ERROR_COUNT
+// times, which bounds the wait in pfnNext.  0 or the first failure,
+// pfnNext is not called again after a failed transfer.  pfnSent may be NULL
+int XSendQueue(SERIAL_TYPE hSer, XMODEM_NEXT pfnNext, XMODEM_SENT pfnSent, void *pCtx);
+
+// receives a batch into szDir, each file under the name in its header
+// (without any path).  pfnDone, if not NULL, is told about each one
+int XReceiveBatch(SERIAL_TYPE hSer, const char *szDir, int nMode, XMODEM_DONE pfnDone, void *pCtx);
+
 #ifdef DEBUG_CODE
 const char *XMGetError(void);
 #endif // DEBUG_CODE
@@ -106,4 +256,4 @@ const char *XMGetError(void);
 
 #endif // ARDUINO
 
-
+#endif // XMODEM_H
@@ -0,0 +1,154 @@
+#include "xoutbox.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static void OutboxPath(char *szPath, int cbPath, const char *szDir, const char *szName)
+{
+  snprintf(szPath, cbPath, "%s/%s", szDir, szName);
+}
+
+// writes the list in place of the one there.  0 or -1
+static int WriteList(const char *szDir, const XOUTBOX_ENTRY *aEntries, int nEntries)
+{
+char szList[300], szTemp[310];
+FILE *pF;
+int i1;
+
+  OutboxPath(szList, sizeof(szList), szDir, XOUTBOX_LIST);
+  snprintf(szTemp, sizeof(szTemp), "%s.tmp", szList);
+
+  pF = fopen(szTemp, "wb");
+  if(!pF)
+  {
+    return -1;
+  }
+
+  for(i1=0; i1 < nEntries; i1++)
+  {
+    fprintf(pF, "%d %s\n", aEntries[i1].iPriority, aEntries[i1].szName);
+  }
+
+  if(fclose(pF) || rename(szTemp, szList))
+  {
+    remove(szTemp);
+    return -1;
+  }
+
+  return 0;
+}
+
+// where szName is in the list, -1 if it is not
+static int Find(const XOUTBOX_ENTRY *aEntries, int nEntries, const char *szName)
+{
+int i1;
+
+  for(i1=0; i1 < nEntries && strcmp(aEntries[i1].szName, szName); i1++)
+  {
+  }
+
+  return i1 < nEntries ? i1 : -1;
+}
+
+int XOutboxList(const char *szDir, XOUTBOX_ENTRY *aEntries, int nMax)
+{
+char szList[300], szLine[XOUTBOX_NAME + 32];
+FILE *pF;
+int n1 = 0;
+
+  OutboxPath(szList, sizeof(szList), szDir, XOUTBOX_LIST);
+
+  pF = fopen(szList, "rb");
+  if(!pF)
+  {
+    return 0;
+  }
+
+  while(n1 < nMax && fgets(szLine, sizeof(szLine), pF))
+  {
+    if(sscanf(szLine, "%d %63s", &(aEntries[n1].iPriority), aEntries[n1].szName) == 2)
+    {
+      n1++;
+    }
+  }
+
+  fclose(pF);
+
+  return n1;
+}
+
+int XOutboxPut(const char *szDir, const char *szName, int iPriority, const void *pBuf, long cbBuf)
+{
+XOUTBOX_ENTRY aEntries[XOUTBOX_MAX];
+char szPath[300];
+FILE *pF;
+int nEntries, i1;
+
+  if(!szName[0] || strlen(szName) >= XOUTBOX_NAME || strchr(szName, ' ') || strchr(szName, '/'))
+  {
+    return -1;
+  }
+
+  mkdir(szDir, 0775);
+  nEntries = XOutboxList(szDir, aEntries, XOUTBOX_MAX);
+
+  i1 = Find(aEntries, nEntries, szName);
+  if(i1 >= 0) // the new one goes at the end
+  {
+    memmove(aEntries + i1, aEntries + i1 + 1, (nEntries - i1 - 1) * sizeof(*aEntries));
+    nEntries--;
+  }
+
+  if(nEntries == XOUTBOX_MAX) // the oldest makes room
+  {
+    OutboxPath(szPath, sizeof(szPath), szDir, aEntries[0].szName);
+    remove(szPath);
+    memmove(aEntries, aEntries + 1, (nEntries - 1) * sizeof(*aEntries));
+    nEntries--;
+  }
+
+  // the file first, a line without its file is worse than a file without
+  // its line
+  OutboxPath(szPath, sizeof(szPath), szDir, szName);
+  pF = fopen(szPath, "wb");
+
+  if(pF && fwrite(pBuf, 1, cbBuf, pF) != (size_t)cbBuf)
+  {
+    fclose(pF);
+    pF = NULL;
+  }
+
+  if(!pF || fclose(pF))
+  {
+    remove(szPath);
+    WriteList(szDir, aEntries, nEntries);
+    return -1;
+  }
+
+  aEntries[nEntries].iPriority = iPriority;
+  strcpy(aEntries[nEntries].szName, szName);
+
+  return WriteList(szDir, aEntries, nEntries + 1);
+}
+
+int XOutboxRemove(const char *szDir, const char *szName)
+{
+XOUTBOX_ENTRY aEntries[XOUTBOX_MAX];
+char szPath[300];
+int nEntries, i1;
+
+  nEntries = XOutboxList(szDir, aEntries, XOUTBOX_MAX);
+
+  i1 = Find(aEntries, nEntries, szName);
+  if(i1 >= 0)
+  {
+    memmove(aEntries + i1, aEntries + i1 + 1, (nEntries - i1 - 1) * sizeof(*aEntries));
+    nEntries--;
+  }
+
+  OutboxPath(szPath, sizeof(szPath), szDir, szName);
+  remove(szPath);
+
+  return WriteList(szDir, aEntries, nEntries);
+}
@@ -0,0 +1,47 @@
+#ifndef XOUTBOX_H
+#define XOUTBOX_H
+
+/* Files the field unit did not get across before it shut down, kept on
+the SD card for the next cycle.
+
+Each file is in the outbox directory under the name it is to be sent
+with, and the list XOUTBOX_LIST there has a line for each,
+
+  <priority> <name>
+
+oldest first.  The list is written next to itself and renamed over, as
+the link log is, so a power cut leaves either the old or the new one.  At
+most XOUTBOX_MAX files are kept, the oldest make room.
+*/
+
+#define XOUTBOX_LIST "outbox.txt"
+#define XOUTBOX_MAX 32
+#define XOUTBOX_NAME 64 /* longest name, with the NUL, no spaces */
+
+typedef struct _XOUTBOX_ENTRY_
+{
+  int iPriority;              ///< as given to XAsyncSend
+  char szName[XOUTBOX_NAME];  ///< the file in the outbox directory
+} XOUTBOX_ENTRY;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// the files in the outbox, oldest first.  returns how many were put in
+// aEntries, up to nMax, 0 if there is no outbox
+int XOutboxList(const char *szDir, XOUTBOX_ENTRY *aEntries, int nMax);
+
+// keeps cbBuf bytes from pBuf as szName, in place of a file of that name.
+// 0, or -1 if it could not be kept
+int XOutboxPut(const char *szDir, const char *szName, int iPriority, const void *pBuf, long cbBuf);
+
+// forgets a file that went across.  0, or -1 if the list could not be
+// written
+int XOutboxRemove(const char *szDir, const char *szName);
+
+#ifdef __cplusplus
+};
+#endif // __cplusplus
+
+#endif // XOUTBOX_H
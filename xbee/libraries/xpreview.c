@@ -0,0 +1,232 @@
+#include "xpreview.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// what the parser expects next
+#define PREVIEW_SOI      0  ///< the 0xFF of the SOI marker
+#define PREVIEW_SOI2     1  ///< the 0xD8 of the SOI marker
+#define PREVIEW_MARKER   2  ///< the 0xFF of the next marker
+#define PREVIEW_CODE     3  ///< the code after a 0xFF
+#define PREVIEW_LENGTH   4  ///< the high byte of a segment length
+#define PREVIEW_LENGTH2  5  ///< the low byte of a segment length
+#define PREVIEW_SKIP     6  ///< segment bytes, lLeft of them to go
+#define PREVIEW_DATA     7  ///< entropy coded data of a scan
+#define PREVIEW_DATA_FF  8  ///< a 0xFF in entropy coded data
+
+void XPreviewInit(XPREVIEW *pP)
+{
+  memset(pP, 0, sizeof(*pP));
+}
+
+// the code of a marker.  returns the state after it
+static int PreviewCode(XPREVIEW *pP, unsigned char bCode)
+{
+  if(bCode == 0xff) // fill byte before the code
+  {
+    return PREVIEW_CODE;
+  }
+
+  if(bCode == 0xd9) // EOI, the file is complete
+  {
+    pP->bDone = 1;
+    return PREVIEW_MARKER;
+  }
+
+  if(bCode == 0x01 || (bCode >= 0xd0 && bCode <= 0xd8)) // no length follows
+  {
+    return PREVIEW_MARKER;
+  }
+
+  pP->bScan = bCode == 0xda; // SOS, entropy coded data follows the header
+
+  return PREVIEW_LENGTH;
+}
+
+// one more byte of the file, at lPos
+static void PreviewByte(XPREVIEW *pP, long lPos, unsigned char bVal)
+{
+  switch(pP->iState)
+  {
+    case PREVIEW_SOI:
+      pP->iState = bVal == 0xff ? PREVIEW_SOI2 : -1;
+      break;
+
+    case PREVIEW_SOI2:
+      pP->iState = bVal == 0xd8 ? PREVIEW_MARKER : -1;
+      break;
+
+    case PREVIEW_MARKER:
+      pP->iState = bVal == 0xff ? PREVIEW_CODE : -1;
+      break;
+
+    case PREVIEW_CODE:
+      pP->iState = PreviewCode(pP, bVal);
+      break;
+
+    case PREVIEW_LENGTH:
+      pP->lLeft = (long)bVal << 8;
+      pP->iState = PREVIEW_LENGTH2;
+      break;
+
+    case PREVIEW_LENGTH2:
+      pP->lLeft += bVal - 2; // the length counts its own two bytes
+      if(pP->lLeft > 0)
+      {
+        pP->iState = PREVIEW_SKIP;
+      }
+      else
+      {
+        pP->iState = pP->bScan ? PREVIEW_DATA : PREVIEW_MARKER;
+      }
+      break;
+
+    case PREVIEW_SKIP:
+      if(--pP->lLeft <= 0)
+      {
+        pP->iState = pP->bScan ? PREVIEW_DATA : PREVIEW_MARKER;
+      }
+      break;
+
+    case PREVIEW_DATA:
+      if(bVal == 0xff)
+      {
+        pP->lMarker = lPos;
+        pP->iState = PREVIEW_DATA_FF;
+      }
+      break;
+
+    case PREVIEW_DATA_FF:
+      if(bVal == 0x00 || (bVal >= 0xd0 && bVal <= 0xd7)) // stuffed zero or restart
+      {
+        pP->iState = PREVIEW_DATA;
+      }
+      else if(bVal != 0xff)
+      {
+        // a marker that is not part of the data ends the scan
+        if(bVal != 0xd9)
+        {
+          pP->nScans++;
+          pP->lScanEnd = pP->lMarker;
+        }
+        pP->iState = PreviewCode(pP, bVal);
+      }
+      break;
+  }
+
+  if(pP->iState < 0)
+  {
+    pP->bDone = 1; // not a JPEG
+  }
+}
+
+// copies the first lEnd bytes of szPartial to szPreview with an EOI after
+// them.  the preview is complete whenever it is there
+static int PreviewWrite(const char *szPartial, long lEnd, const char *szPreview)
+{
+static const unsigned char aEOI[2] = { 0xff, 0xd9 };
+unsigned char aBuf[4096];
+char szTemp[300];
+long lPos;
+int fIn, fOut, cb1, iRval;
+
+  fIn = open(szPartial, O_RDONLY);
+  if(fIn < 0)
+  {
+    return -1;
+  }
+
+  snprintf(szTemp, sizeof(szTemp), "%s.tmp", szPreview);
+
+  fOut = open(szTemp, O_WRONLY | O_CREAT | O_TRUNC, 0664);
+  if(fOut < 0)
+  {
+    close(fIn);
+    return -1;
+  }
+
+  iRval = 0;
+
+  for(lPos=0; !iRval && lPos < lEnd; lPos += cb1)
+  {
+    cb1 = lEnd - lPos < (long)sizeof(aBuf) ? (int)(lEnd - lPos) : (int)sizeof(aBuf);
+    cb1 = pread(fIn, aBuf, cb1, lPos);
+    if(cb1 <= 0 || write(fOut, aBuf, cb1) != cb1)
+    {
+      iRval = -1;
+    }
+  }
+
+  if(!iRval && write(fOut, aEOI, sizeof(aEOI)) != sizeof(aEOI))
+  {
+    iRval = -1;
+  }
+
+  close(fIn);
+  close(fOut);
+
+  if(iRval || rename(szTemp, szPreview))
+  {
+    unlink(szTemp);
+    return -1;
+  }
+
+  return 0;
+}
+
+int XPreviewUpdate(XPREVIEW *pP, const char *szPartial, long lHave, const char *szPreview)
+{
+unsigned char aBuf[4096];
+int file, cb1, i1;
+
+  if(strncmp(pP->szPartial, szPartial, sizeof(pP->szPartial)) || lHave < pP->lParsed)
+  {
+    XPreviewInit(pP);
+    strncpy(pP->szPartial, szPartial, sizeof(pP->szPartial) - 1);
+  }
+
+  if(pP->bDone || lHave <= pP->lParsed)
+  {
+    return 0;
+  }
+
+  file = open(szPartial, O_RDONLY);
+  if(file < 0)
+  {
+    return 0;
+  }
+
+  while(!pP->bDone && pP->lParsed < lHave)
+  {
+    cb1 = lHave - pP->lParsed < (long)sizeof(aBuf) ? (int)(lHave - pP->lParsed) : (int)sizeof(aBuf);
+    cb1 = pread(file, aBuf, cb1, pP->lParsed);
+    if(cb1 <= 0)
+    {
+      break;
+    }
+
+    for(i1=0; i1 < cb1 && !pP->bDone; i1++)
+    {
+      PreviewByte(pP, pP->lParsed++, aBuf[i1]);
+    }
+  }
+
+  close(file);
+
+  // the complete file is better than any preview of it
+  if(pP->nScans <= pP->nWritten || pP->bDone)
+  {
+    return 0;
+  }
+
+  if(PreviewWrite(szPartial, pP->lScanEnd, szPreview))
+  {
+    return 0;
+  }
+
+  pP->nWritten = pP->nScans;
+
+  return pP->nScans;
+}
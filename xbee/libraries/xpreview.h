@@ -0,0 +1,49 @@
+#ifndef XPREVIEW_H
+#define XPREVIEW_H
+
+/* Previews of a progressive JPEG that is still arriving.
+
+A progressive JPEG is a series of scans, the first with the DC values of
+every block and the later ones refining the AC coefficients. Everything
+up to the end of a scan, with an EOI marker after it, decodes to the
+whole picture at a lower quality. XPreviewUpdate follows the markers in
+the part of the file that has arrived, reading each byte once, and writes
+such a preview whenever another scan is complete.
+
+A baseline JPEG has one scan, which only ends at the EOI, so there is
+never a preview of one.
+*/
+
+typedef struct _XPREVIEW_
+{
+  char szPartial[256];  ///< file the data is arriving in
+  long lParsed;         ///< bytes of it parsed so far
+  int iState;           ///< where the parser is in the marker structure
+  long lLeft;           ///< bytes left in the segment being skipped
+  int bScan;            ///< that segment is a scan header, data follows it
+  long lMarker;         ///< offset of the last 0xFF in a scan's data
+  int nScans;           ///< complete scans so far
+  long lScanEnd;        ///< where the last complete scan ends
+  int nWritten;         ///< scans in the preview written last, 0 if none
+  int bDone;            ///< the EOI arrived or the data is not a JPEG
+} XPREVIEW;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// forgets the file followed so far
+void XPreviewInit(XPREVIEW *pP);
+
+// parses szPartial up to lHave bytes, which must only grow while the name
+// stays the same, and writes szPreview when another scan is complete.  a
+// new name starts over.  the files of a YMODEM batch all arrive under the
+// same name, so XPreviewInit has to be called at the end of each.  returns
+// the scans in szPreview if it was written now, or 0
+int XPreviewUpdate(XPREVIEW *pP, const char *szPartial, long lHave, const char *szPreview);
+
+#ifdef __cplusplus
+};
+#endif // __cplusplus
+
+#endif // XPREVIEW_H
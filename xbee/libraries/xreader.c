@@ -0,0 +1,159 @@
+#include "xreader.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+
+unsigned long XReaderMillis(void)
+{
+struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (unsigned long)ts.tv_sec * 1000UL + (unsigned long)ts.tv_nsec / 1000000UL;
+}
+
+void XReaderInit(XREADER *pR, int fd)
+{
+int iFlags;
+
+  pR->fd = fd;
+  pR->iHead = 0;
+  pR->cbData = 0;
+
+  // poll() does the waiting, so reads and writes may as well block
+  iFlags = fcntl(fd, F_GETFL);
+  if(iFlags != -1 && (iFlags & O_NONBLOCK))
+  {
+    fcntl(fd, F_SETFL, iFlags & ~O_NONBLOCK);
+  }
+}
+
+// waits up to iWait msecs for input and reads all of it that fits.
+// returns the number of bytes added, 0 on timeout, -1 on error
+static int XReaderFill(XREADER *pR, int iWait)
+{
+struct pollfd pfd;
+int iTail, cbRoom, i1;
+
+  if(pR->cbData >= XREADER_SIZE)
+  {
+    return 0; // full, the caller has to take some first
+  }
+
+  pfd.fd = pR->fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+
+  i1 = poll(&pfd, 1, iWait);
+  if(i1 <= 0)
+  {
+    return (i1 < 0 && errno != EINTR) ? -1 : 0;
+  }
+
+  if(!(pfd.revents & POLLIN))
+  {
+    return (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) ? -1 : 0;
+  }
+
+  // one read up to the end of the ring, the wrapped part comes next time
+  iTail = (pR->iHead + pR->cbData) % XREADER_SIZE;
+  cbRoom = XREADER_SIZE - pR->cbData;
+  if(cbRoom > XREADER_SIZE - iTail)
+  {
+    cbRoom = XREADER_SIZE - iTail;
+  }
+
+  i1 = read(pR->fd, pR->aBuf + iTail, cbRoom);
+  if(i1 < 0)
+  {
+    return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+  }
+
+  pR->cbData += i1;
+  return i1;
+}
+
+static int XReaderTake(XREADER *pR, unsigned char *pBuf, int cbSize)
+{
+int cb1, cbTotal = 0;
+
+  while(cbSize > 0 && pR->cbData > 0)
+  {
+    cb1 = XREADER_SIZE - pR->iHead; // up to the end of the ring
+    if(cb1 > pR->cbData)
+    {
+      cb1 = pR->cbData;
+    }
+    if(cb1 > cbSize)
+    {
+      cb1 = cbSize;
+    }
+
+    memcpy(pBuf, pR->aBuf + pR->iHead, cb1);
+
+    pR->iHead = (pR->iHead + cb1) % XREADER_SIZE;
+    pR->cbData -= cb1;
+    pBuf += cb1;
+    cbSize -= cb1;
+    cbTotal += cb1;
+  }
+
+  return cbTotal;
+}
+
+int XReaderRead(XREADER *pR, void *pBuf, int cbSize, unsigned long ulSilence)
+{
+unsigned char *p1 = (unsigned char *)pBuf;
+unsigned long ulNow, ulSilent, ulEnd;
+int cb1 = 0, i1;
+
+  ulNow = XReaderMillis();
+  ulSilent = ulNow + ulSilence;     // deadline for the next byte
+  ulEnd = ulNow + 10 * ulSilence;   // deadline for the whole block
+
+  for(;;)
+  {
+    i1 = XReaderTake(pR, p1 + cb1, cbSize - cb1);
+    cb1 += i1;
+
+    if(cb1 >= cbSize)
+    {
+      break;
+    }
+
+    ulNow = XReaderMillis();
+    if(i1 > 0)
+    {
+      ulSilent = ulNow + ulSilence; // silence starts over
+    }
+
+    if((long)(ulSilent - ulNow) <= 0 || (long)(ulEnd - ulNow) <= 0)
+    {
+      break;
+    }
+
+    if(XReaderFill(pR, (int)((long)(ulSilent - ulNow) < (long)(ulEnd - ulNow) ? ulSilent - ulNow : ulEnd - ulNow)) < 0)
+    {
+      break; // read error
+    }
+  }
+
+  return cb1;
+}
+
+void XReaderDrain(XREADER *pR, unsigned long ulQuiet)
+{
+  pR->iHead = 0;
+  pR->cbData = 0;
+
+  while(XReaderFill(pR, (int)ulQuiet) > 0)
+  {
+    pR->iHead = 0; // don't care about the data
+    pR->cbData = 0;
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef XREADER_H
+#define XREADER_H
+
+/* Buffered serial input for the xmodem code. Whatever the port has is
+pulled into a ring buffer with one read() after poll() says it is there,
+so waiting costs no CPU and a byte is seen as soon as it arrives. Timeouts
+are deadlines on the monotonic clock rather than counted sleeps.
+*/
+
+#define XREADER_SIZE 4096 /* bytes buffered, a few blocks' worth */
+
+typedef struct _XREADER_
+{
+  int fd;                  ///< serial port file descriptor
+  int iHead;               ///< oldest buffered byte
+  int cbData;              ///< bytes buffered
+  unsigned char aBuf[XREADER_SIZE];
+} XREADER;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// starts with an empty buffer, the port is left blocking
+void XReaderInit(XREADER *pR, int fd);
+
+// copies cbSize bytes to pBuf, giving up after ulSilence msecs without a
+// byte or 10 times that in total.  returns how many bytes were copied
+int XReaderRead(XREADER *pR, void *pBuf, int cbSize, unsigned long ulSilence);
+
+// discards input until ulQuiet msecs pass without any
+void XReaderDrain(XREADER *pR, unsigned long ulQuiet);
+
+// monotonic milliseconds
+unsigned long XReaderMillis(void);
+
+#ifdef __cplusplus
+};
+#endif // __cplusplus
+
+#endif // XREADER_H
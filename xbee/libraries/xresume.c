@@ -0,0 +1,112 @@
+#include "xresume.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+unsigned long long XResumeHashUpdate(unsigned long long ullHash, const void *pBuf, long cbBuf)
+{
+const unsigned char *p1 = (const unsigned char *)pBuf;
+long i1;
+
+  for(i1=0; i1 < cbBuf; i1++)
+  {
+    ullHash = (ullHash ^ p1[i1]) * 0x100000001b3ULL;
+  }
+
+  return ullHash;
+}
+
+unsigned long long XResumeHash(int fd)
+{
+unsigned long long ullHash = XRESUME_HASH_INIT;
+unsigned char aBuf[4096];
+int cb1;
+
+  lseek(fd, 0, SEEK_SET);
+
+  while((cb1 = read(fd, aBuf, sizeof(aBuf))) > 0)
+  {
+    ullHash = XResumeHashUpdate(ullHash, aBuf, cb1);
+  }
+
+  lseek(fd, 0, SEEK_SET);
+
+  return ullHash ? ullHash : 1;
+}
+
+int XResumeRead(const char *szRecord, XRESUME *pR)
+{
+FILE *pF;
+int i1;
+
+  memset(pR, 0, sizeof(*pR));
+
+  pF = fopen(szRecord, "r");
+  if(!pF)
+  {
+    return -1;
+  }
+
+  i1 = fscanf(pF, "%llx %ld %ld %255[^\n]", &(pR->ullHash), &(pR->lSize), &(pR->lOffset), pR->szPath);
+  fclose(pF);
+
+  if(i1 != 4 || !pR->ullHash || pR->lOffset < 0 || pR->lOffset > pR->lSize)
+  {
+    memset(pR, 0, sizeof(*pR));
+    return -1;
+  }
+
+  return 0;
+}
+
+int XResumeWrite(const char *szRecord, const XRESUME *pR)
+{
+char szTemp[300];
+FILE *pF;
+int iRval;
+
+  snprintf(szTemp, sizeof(szTemp), "%s.tmp", szRecord);
+
+  pF = fopen(szTemp, "w");
+  if(!pF)
+  {
+    return -1;
+  }
+
+  iRval = fprintf(pF, "%016llx %ld %ld %s\n", pR->ullHash, pR->lSize, pR->lOffset, pR->szPath) > 0 ? 0 : -1;
+
+  // the new record has to be on the card before it replaces the old one
+  if(fflush(pF) || fsync(fileno(pF)))
+  {
+    iRval = -1;
+  }
+
+  if(fclose(pF) || iRval || rename(szTemp, szRecord))
+  {
+    unlink(szTemp);
+    return -1;
+  }
+
+  return 0;
+}
+
+void XResumeSenderRecord(const char *szFilename, char *szRecord, int cbRecord)
+{
+  snprintf(szRecord, cbRecord, "%s" XRESUME_SUFFIX, szFilename);
+}
+
+void XResumeReceiverRecord(const char *szFilename, char *szRecord, int cbRecord)
+{
+const char *p1 = strrchr(szFilename, '/');
+
+  if(p1)
+  {
+    snprintf(szRecord, cbRecord, "%.*s/" XRESUME_SUFFIX, (int)(p1 - szFilename), szFilename);
+  }
+  else
+  {
+    snprintf(szRecord, cbRecord, XRESUME_SUFFIX);
+  }
+}
@@ -0,0 +1,54 @@
+#ifndef XRESUME_H
+#define XRESUME_H
+
+/* Progress records for resuming a transfer in a later session.
+
+A record is one line: the content hash of the file, its size, the offset
+up to which the far end has it, and the path of the (partial) file. It
+is replaced with rename(), so a power cut leaves either the old record
+or the new one, and the data it vouches for is synced before it.
+
+The sender keeps its record next to the file as <file>.xresume. The
+receiver keeps one per directory as .xresume, since the next session may
+receive into a different name.
+*/
+
+#define XRESUME_SUFFIX ".xresume"
+#define XRESUME_EVERY 8192 /* bytes of progress between records */
+#define XRESUME_HASH_INIT 0xcbf29ce484222325ULL
+
+typedef struct _XRESUME_
+{
+  unsigned long long ullHash; ///< content hash of the whole file, 0 if none
+  long lSize;                 ///< file size
+  long lOffset;               ///< bytes the receiver has, from the start
+  char szPath[256];           ///< file the record is about
+} XRESUME;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // __cplusplus
+
+// 64 bit FNV-1a of everything in the file, which is left at its start.
+// never 0, so 0 can mean no hash
+unsigned long long XResumeHash(int fd);
+
+// adds bytes to a hash that starts at XRESUME_HASH_INIT, for data that is
+// not in a file.  a final 0 counts as 1, like XResumeHash
+unsigned long long XResumeHashUpdate(unsigned long long ullHash, const void *pBuf, long cbBuf);
+
+// returns 0 and the record, or -1 if there is none
+int XResumeRead(const char *szRecord, XRESUME *pR);
+
+// writes the record in place of the old one, -1 on error
+int XResumeWrite(const char *szRecord, const XRESUME *pR);
+
+// record names for a file being sent, and for a directory receiving
+void XResumeSenderRecord(const char *szFilename, char *szRecord, int cbRecord);
+void XResumeReceiverRecord(const char *szFilename, char *szRecord, int cbRecord);
+
+#ifdef __cplusplus
+};
+#endif // __cplusplus
+
+#endif // XRESUME_H
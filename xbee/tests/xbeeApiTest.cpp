@@ -0,0 +1,139 @@
+#include "xbeeapi.h"
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+
+//checks the API frame encoder and decoder, then sends frames through a
+//pseudo-terminal the way the radio hands them over
+
+static int failures = 0;
+
+static void check(bool ok, const char* what){
+	std::cout << (ok ? "pass  " : "FAIL  ") << what << "\n";
+	if(!ok)
+		failures++;
+}
+
+//feeds bytes to the decoder, returns the number of complete frames
+static int decodeAll(XAPI_DECODER* d, const unsigned char* buf, int count){
+	int frames = 0;
+	for(int i = 0; i < count; i++)
+		frames += XApiDecode(d, buf[i]);
+	return frames;
+}
+
+int main(){
+	const unsigned char dest[8] = {0x00, 0x13, 0xA2, 0x00, 0x40, 0x0A, 0x01, 0x27};
+	unsigned char payload[XAPI_RF_PAYLOAD];
+	unsigned char frame[XAPI_MAX_FRAME];
+	unsigned char out[2 * (XAPI_MAX_FRAME + 4)];
+	XAPI_DECODER d;
+	XAPI_STATUS status;
+	XAPI_RX rx;
+	int length, count;
+
+	//the example from the XBee manual, AT command "NJ" with frame ID 0x52
+	const unsigned char at[] = {0x08, 0x52, 0x4E, 0x4A};
+	count = XApiEncode(at, sizeof(at), 0, out);
+	const unsigned char expected[] = {0x7E, 0x00, 0x04, 0x08, 0x52, 0x4E, 0x4A, 0x0D};
+	check(count == sizeof(expected) && !memcmp(out, expected, count), "checksum of the manual's example");
+
+	//every byte that needs escaping, in the payload and in the checksum
+	for(int i = 0; i < XAPI_RF_PAYLOAD; i++)
+		payload[i] = (i % 4 == 0 ? 0x7E : i % 4 == 1 ? 0x7D : i % 4 == 2 ? 0x11 : 0x13);
+	length = XApiTxRequest(0x7D, dest, payload, XAPI_RF_PAYLOAD, frame);
+	count = XApiEncode(frame, length, 1, out);
+
+	bool clean = true;
+	for(int i = 1; i < count; i++)
+		if(out[i] == 0x7E || out[i] == 0x11 || out[i] == 0x13)
+			clean = false;
+	check(clean, "escaped frame has no start or flow control bytes after the first");
+
+	XApiDecoderInit(&d, 1);
+	check(decodeAll(&d, out, count) == 1 && d.cbFrame == length && !memcmp(d.aFrame, frame, length),
+	      "escaped TX request decodes to the same frame data");
+
+	//a TX status and an RX packet back to back, with noise in front
+	unsigned char stream[512];
+	int total = 0;
+	stream[total++] = 0x55;
+	stream[total++] = 0x13;
+	length = XApiTxStatus(0x11, 2, XAPI_DELIVERED, frame);
+	total += XApiEncode(frame, length, 1, stream + total);
+	length = XApiRxPacket(dest, "hello", 5, frame);
+	total += XApiEncode(frame, length, 1, stream + total);
+
+	XApiDecoderInit(&d, 1);
+	count = 0;
+	for(int i = 0; i < total; i++){
+		if(!XApiDecode(&d, stream[i]))
+			continue;
+		count++;
+		if(count == 1)
+			check(XApiParseTxStatus(d.aFrame, d.cbFrame, &status) && status.bFrameId == 0x11 &&
+			      status.bRetries == 2 && status.bDelivery == XAPI_DELIVERED, "TX status parses");
+		else
+			check(XApiParseRx(d.aFrame, d.cbFrame, &rx) && rx.cbData == 5 &&
+			      !memcmp(rx.pData, "hello", 5) && !memcmp(rx.aSource64, dest, 8), "RX packet parses");
+	}
+	check(count == 2 && d.lErrors == 0, "noise before a frame is skipped");
+
+	//a corrupted byte fails the checksum, a cut frame is dropped at the next start
+	length = XApiRxPacket(dest, "hello", 5, frame);
+	count = XApiEncode(frame, length, 1, out);
+	out[count - 3] ^= 0x01;
+	XApiDecoderInit(&d, 1);
+	check(decodeAll(&d, out, count) == 0 && d.lErrors == 1, "bad checksum is rejected");
+
+	XApiDecoderInit(&d, 1);
+	count = XApiEncode(frame, length, 1, out);
+	decodeAll(&d, out, count / 2);
+	check(decodeAll(&d, out, count) == 1 && d.lErrors == 1, "cut frame is dropped and the next one decodes");
+
+	//frames through a pty, written in odd sized pieces
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	grantpt(master);
+	unlockpt(master);
+	int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+	struct termios options;
+	tcgetattr(slave, &options);
+	cfmakeraw(&options);
+	tcsetattr(slave, TCSANOW, &options);
+
+	total = 0;
+	for(int i = 0; i < 20; i++){
+		for(int j = 0; j < XAPI_RF_PAYLOAD; j++)
+			payload[j] = (unsigned char)(i * 31 + j * 7);
+		length = XApiRxPacket(dest, payload, XAPI_RF_PAYLOAD, frame);
+		count = XApiEncode(frame, length, 1, out);
+		for(int j = 0; j < count; j += 7)
+			total += write(master, out + j, (j + 7 > count ? count - j : 7));
+	}
+
+	XApiDecoderInit(&d, 1);
+	unsigned char buf[64];
+	count = 0;
+	int bad = 0, n;
+	while(total > 0 && (n = read(slave, buf, sizeof(buf))) > 0){
+		total -= n;
+		for(int i = 0; i < n; i++){
+			if(!XApiDecode(&d, buf[i]))
+				continue;
+			if(!XApiParseRx(d.aFrame, d.cbFrame, &rx) || rx.cbData != XAPI_RF_PAYLOAD ||
+			   rx.pData[1] != (unsigned char)(count * 31 + 7))
+				bad++;
+			count++;
+		}
+	}
+	check(count == 20 && bad == 0, "20 full size frames through a pty");
+
+	close(slave);
+	close(master);
+
+	std::cout << (failures ? "some checks failed\n" : "all checks passed\n");
+	return failures ? 1 : 0;
+}
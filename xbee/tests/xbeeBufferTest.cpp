@@ -0,0 +1,508 @@
+#include "xmodem.h"
+#include "xlog.h"
+#include "xasync.h"
+#include "xoutbox.h"
+#include "xframe.h"
+#include "xpreview.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <pthread.h>
+
+//sends files from memory and from a callback source over a pseudo-terminal
+//and checks what arrives in memory and on disk, what the sender counted,
+//the link log, batches fed from the async queue, the outbox and gusset
+//frames parsed as they arrive, and previews of the files of a batch
+
+static int failures = 0;
+
+static void check(bool ok, const char* what){
+	std::cout << (ok ? "pass  " : "FAIL  ") << what << "\n";
+	if(!ok)
+		failures++;
+}
+
+static int openRaw(const char* path){
+	int fd = open(path, O_RDWR | O_NOCTTY);
+	struct termios options;
+	tcgetattr(fd, &options);
+	cfmakeraw(&options);
+	tcsetattr(fd, TCSANOW, &options);
+	return fd;
+}
+
+//the receiving end, in memory or into a file
+struct Receiver {
+	int fd;
+	const char* path;
+	void* data;
+	long size;
+	int result;
+};
+
+static void* receive(void* p){
+	Receiver* r = (Receiver*)p;
+	if(r->path)
+		r->result = XReceive(r->fd, r->path, 0664);
+	else
+		r->result = XReceiveBuffer(r->fd, &r->data, &r->size);
+	return NULL;
+}
+
+//a source that counts how often it is read
+struct Counted {
+	const std::vector<unsigned char>* data;
+	long reads;
+};
+
+static int countedRead(void* ctx, long pos, void* buf, int count){
+	Counted* c = (Counted*)ctx;
+	c->reads++;
+	if(pos >= (long)c->data->size())
+		return 0;
+	if(count > (long)c->data->size() - pos)
+		count = (int)(c->data->size() - pos);
+	memcpy(buf, &(*c->data)[pos], count);
+	return count;
+}
+
+//one transfer across a fresh pty pair, the sender on this thread
+static int transfer(Receiver& r, const std::vector<unsigned char>& data, Counted* source){
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	grantpt(master);
+	unlockpt(master);
+	int slave = openRaw(ptsname(master));
+	struct termios options;
+	tcgetattr(master, &options);
+	cfmakeraw(&options);
+	tcsetattr(master, TCSANOW, &options);
+
+	pthread_t thread;
+	r.fd = slave;
+	r.data = NULL;
+	r.size = 0;
+	pthread_create(&thread, NULL, receive, &r);
+
+	int result;
+	if(source){
+		XMODEM_STREAM stream;
+		memset(&stream, 0, sizeof(stream));
+		stream.pCtx = source;
+		stream.lSize = data.size();
+		stream.pfnRead = countedRead;
+		result = XSendStream(master, "stream.bin", &stream);
+	}
+	else
+		result = XSendBuffer(master, "buffer.bin", &data[0], data.size(), NULL);
+
+	pthread_join(thread, NULL);
+	close(slave);
+	close(master);
+	return result;
+}
+
+//the receiving end of a batch and the names of the files in the order
+//they came
+struct Batch {
+	int fd;
+	const char* dir;
+	int result;
+	std::vector<std::string> names;
+};
+
+//previews of what arrives, every file of a batch comes in the same
+//staging file, so the receivers start over at the end of each one
+static XPREVIEW preview;
+static int previewScans;
+
+static void previewed(void*, const char* received, const char*, long done, long){
+	if(!received[0])
+		return;
+	int scans = XPreviewUpdate(&preview, received, done, "/tmp/xbeeBufferTest.preview.jpeg");
+	if(scans)
+		previewScans = scans;
+}
+
+static void arrived(void* ctx, const char* path, long size){
+	((Batch*)ctx)->names.push_back(strrchr(path, '/') + 1);
+	XPreviewInit(&preview);
+}
+
+static void* receiveBatch(void* p){
+	Batch* b = (Batch*)p;
+	b->result = XReceiveBatch(b->fd, b->dir, 0664, arrived, b);
+	return NULL;
+}
+
+//a fresh pty pair with a batch receiver at the far end, returns this end
+static int startBatch(Batch& b, pthread_t& thread){
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	grantpt(master);
+	unlockpt(master);
+	b.fd = openRaw(ptsname(master));
+	b.result = -1;
+	struct termios options;
+	tcgetattr(master, &options);
+	cfmakeraw(&options);
+	tcsetattr(master, TCSANOW, &options);
+	pthread_create(&thread, NULL, receiveBatch, &b);
+	return master;
+}
+
+//what the async queue reported
+struct Reported {
+	int batches;
+	volatile int done;
+};
+
+static void asyncEnd(void* ctx, int fd, int result){
+	((Reported*)ctx)->batches++;
+}
+
+static void asyncDone(void* ctx, XMODEM_ITEM* item){
+	((Reported*)ctx)->done++;
+}
+
+//what a frame parser handed over, in order
+struct Parsed {
+	XFRAME_HEADER head;
+	bool headFirst;		//the header came before any data
+	int headers;
+	std::vector<unsigned char> thumb, payload;
+	std::string ends;	//the types whose data ended
+};
+
+static void frameHeader(void* ctx, const XFRAME_HEADER* head){
+	Parsed* p = (Parsed*)ctx;
+	p->head = *head;
+	p->headFirst = p->thumb.empty() && p->payload.empty();
+	p->headers++;
+}
+
+static void frameData(void* ctx, int type, const void* data, long size){
+	Parsed* p = (Parsed*)ctx;
+	std::vector<unsigned char>& to = (type == XFRAME_THUMBNAIL ? p->thumb : p->payload);
+	to.insert(to.end(), (const unsigned char*)data, (const unsigned char*)data + size);
+}
+
+static void frameEnd(void* ctx, int type){
+	((Parsed*)ctx)->ends += (char)type;
+}
+
+static bool sameFile(const char* path, const std::vector<unsigned char>& data){
+	std::vector<unsigned char> file(data.size() + 1);
+	int fd = open(path, O_RDONLY);
+	long count = (fd >= 0 ? read(fd, &file[0], file.size()) : -1);
+	if(fd >= 0)
+		close(fd);
+	unlink(path);
+	return count == (long)data.size() && !memcmp(&file[0], &data[0], data.size());
+}
+
+static bool same(const Receiver& r, const std::vector<unsigned char>& data){
+	return r.result == 0 && r.size == (long)data.size() && !memcmp(r.data, &data[0], data.size());
+}
+
+//the sender's counts of the last transfer add up: every byte once, and one
+//ACK time for every block that was not sent again
+static bool counted(const std::vector<unsigned char>& data){
+	XMODEM_STATS stats;
+	long acked = 0;
+	XGetStats(&stats);
+	for(int i = 0; i < XSTATS_RTT_BUCKETS; i++)
+		acked += stats.aRtt[i];
+	return stats.lBytes == (long)data.size() && acked > 0 && acked <= stats.lBlocks &&
+	       stats.lMillis > 0 && stats.lRate == (long)(stats.lBytes * 1000.0 / stats.lMillis);
+}
+
+//the last transfer waited out no ACK and took well under one ACK timeout,
+//anything the sender mistakes for noise before an ACK costs it a timeout
+static bool quick(){
+	XMODEM_STATS stats;
+	XGetStats(&stats);
+	return stats.lTimeouts == 0 && stats.lMillis < 2000;
+}
+
+int main(){
+	std::vector<unsigned char> data(20000);
+	Receiver r;
+	Counted source;
+
+	srand(1);
+	for(size_t i = 0; i < data.size(); i++)
+		data[i] = rand() & 0xFF;
+
+	memset(&r, 0, sizeof(r));
+	XSetResume(0);
+
+	XSetWindow(8);
+	check(transfer(r, data, NULL) == 0 && same(r, data), "window mode, memory to memory");
+	check(counted(data), "window mode counts the bytes and ACK times");
+	free(r.data);
+
+	XSetWindow(1);
+	check(transfer(r, data, NULL) == 0 && same(r, data), "stop-and-wait YMODEM-1K, memory to memory");
+	check(counted(data), "stop-and-wait counts the bytes and ACK times");
+	check(quick(), "stop-and-wait passes over the parity offer without a timeout");
+	free(r.data);
+
+	//plain XMODEM has no size, the last block arrives padded
+	XSetYmodem(0);
+	check(transfer(r, data, NULL) == 0 && r.size == 20096 && !memcmp(r.data, &data[0], data.size()),
+	      "plain XMODEM, memory to memory with the padding");
+	free(r.data);
+	XSetYmodem(1);
+
+	//every 1K block is read once, a stop-and-wait retry sends the buffered block
+	source.data = &data;
+	source.reads = 0;
+	check(transfer(r, data, &source) == 0 && same(r, data) && source.reads == 20,
+	      "callback source is read once per block");
+	free(r.data);
+
+	//a buffer to a receiver that writes a file
+	const char* path = "/tmp/xbeeBufferTest.bin";
+	r.path = path;
+	XSetWindow(8);
+	XSetResume(1);
+	int result = transfer(r, data, NULL);
+	r.path = NULL;
+
+	std::vector<unsigned char> file(data.size() + 1);
+	int fd = open(path, O_RDONLY);
+	long count = (fd >= 0 ? read(fd, &file[0], file.size()) : -1);
+	if(fd >= 0)
+		close(fd);
+	unlink(path);
+	check(result == 0 && r.result == 0 && count == (long)data.size() && !memcmp(&file[0], &data[0], data.size()),
+	      "memory to a file");
+
+	//two buffers queued far enough apart that the receiver asks for the
+	//second header more than once, which must not upset the batch
+	const char* dir = "/tmp/xbeeBufferTest.d";
+	mkdir(dir, 0775);
+	Batch b;
+	b.dir = dir;
+	pthread_t thread;
+	int master = startBatch(b, thread);
+
+	std::vector<unsigned char> second(data.rbegin(), data.rend());
+	XMODEM_STREAM streams[2];
+	XMODEM_ITEM items[2];
+	memset(items, 0, sizeof(items));
+	XBufferStream(&streams[0], &data[0], data.size());
+	XBufferStream(&streams[1], &second[0], second.size());
+	items[0].szName = "first.bin";
+	items[0].pStream = &streams[0];
+	items[1].szName = "second.bin";
+	items[1].pStream = &streams[1];
+
+	Reported reported = { 0, 0 };
+	XASYNC_CALLS calls = { NULL, asyncEnd, asyncDone };
+	XASYNC* async = XAsyncOpen(master, &calls, &reported);
+	XAsyncSend(async, &items[0], 0);
+	sleep(SILENCE_TIMEOUT / 1000 + 2);
+	XAsyncSend(async, &items[1], 0);
+	result = XAsyncClose(async);
+	pthread_join(thread, NULL);
+	close(b.fd);
+	close(master);
+	check(result == 0 && b.result == 0 && reported.batches == 1 && reported.done == 2 &&
+	      sameFile("/tmp/xbeeBufferTest.d/first.bin", data) && sameFile("/tmp/xbeeBufferTest.d/second.bin", second),
+	      "async queue sends what comes late in the same batch");
+
+	//files held back by the deadline go by priority and then size once it
+	//moves, one queued after it has passed is handed back unsent
+	std::vector<unsigned char> small(data.begin(), data.begin() + 2000);
+	std::vector<unsigned char> medium(data.begin(), data.begin() + 8000);
+	XMODEM_STREAM queued[5];
+	XMODEM_ITEM ranked[5];
+	const char* names[5] = { "raw.bin", "full.bin", "small.bin", "thumb.bin", "late.bin" };
+	const int priorities[5] = { 2, 1, 1, 0, 0 };
+	memset(ranked, 0, sizeof(ranked));
+	XBufferStream(&queued[0], &data[0], data.size());
+	XBufferStream(&queued[1], &second[0], second.size());
+	XBufferStream(&queued[2], &medium[0], medium.size());
+	XBufferStream(&queued[3], &small[0], small.size());
+	XBufferStream(&queued[4], &small[0], small.size());
+	for(int i = 0; i < 5; i++){
+		ranked[i].szName = names[i];
+		ranked[i].pStream = &queued[i];
+	}
+
+	b.names.clear();
+	master = startBatch(b, thread);
+	reported.batches = reported.done = 0;
+	async = XAsyncOpen(master, &calls, &reported);
+	XAsyncDeadline(async, 0);
+	for(int i = 0; i < 4; i++)
+		XAsyncSend(async, &ranked[i], priorities[i]);
+	XAsyncDeadline(async, 60000);
+	for(int i = 0; i < 1000 && reported.done < 4; i++)
+		usleep(10000);
+	XAsyncDeadline(async, 0);
+	XAsyncSend(async, &ranked[4], priorities[4]);
+	result = XAsyncClose(async);
+	pthread_join(thread, NULL);
+	close(b.fd);
+	close(master);
+	bool ordered = b.names.size() == 4;
+	for(int i = 0; i < 4 && ordered; i++){
+		ordered = b.names[i] == names[3 - i] && ranked[i].iResult == 0;
+		unlink((std::string(dir) + "/" + b.names[i]).c_str());
+	}
+	check(ordered && b.result == 0 && result == -10 && ranked[4].iResult == -10 && reported.done == 5,
+	      "async queue goes by priority and size and keeps to the deadline");
+	rmdir(dir);
+
+	//the link log keeps whole lines and stays under its limit
+	const char* log = "/tmp/xbeeBufferTest.log";
+	XMODEM_STATS stats;
+	bool written = true;
+	unlink(log);
+	XGetStats(&stats);
+	for(int i = 0; i < 400; i++)
+		written = XLogStats(log, "test", i, &stats) == 0 && written;
+	std::ifstream in(log);
+	std::string line, first, last;
+	long lines = 0, bytes = 0;
+	while(std::getline(in, line)){
+		if(!lines++)
+			first = line;
+		last = line;
+		bytes += line.size() + 1;
+	}
+	unlink(log);
+	check(written && bytes <= XLOG_MAX && lines > 50 && first.find(" test ") != std::string::npos &&
+	      last.find(" test 399 20000 ") != std::string::npos,
+	      "link log is trimmed to whole lines");
+
+	//a short sidecar ahead of a progressive JPEG in one batch, the JPEG is
+	//previewed though both arrive in the same staging file
+	std::vector<unsigned char> sidecar(data.begin(), data.begin() + 30);
+	std::vector<unsigned char> jpeg;
+	jpeg.push_back(0xFF);
+	jpeg.push_back(0xD8);
+	for(int scan = 0; scan < 4; scan++){
+		unsigned char sos[4] = { 0xFF, 0xDA, 0x00, 0x02 };
+		jpeg.insert(jpeg.end(), sos, sos + 4);
+		for(int i = 0; i < 4000; i++)
+			jpeg.push_back(data[i] & 0x7F);
+	}
+	jpeg.push_back(0xFF);
+	jpeg.push_back(0xD9);
+	XMODEM_STREAM pair[2];
+	XMODEM_ITEM files[2];
+	memset(files, 0, sizeof(files));
+	XBufferStream(&pair[0], &sidecar[0], sidecar.size());
+	XBufferStream(&pair[1], &jpeg[0], jpeg.size());
+	files[0].szName = "temp0.warp";
+	files[0].pStream = &pair[0];
+	files[1].szName = "temp0.jpeg";
+	files[1].pStream = &pair[1];
+
+	mkdir(dir, 0775);
+	b.names.clear();
+	XPreviewInit(&preview);
+	previewScans = 0;
+	XSetProgress(previewed, NULL);
+	master = startBatch(b, thread);
+	result = XSendBatch(master, files, 2);
+	pthread_join(thread, NULL);
+	close(b.fd);
+	close(master);
+	XSetProgress(NULL, NULL);
+	unlink("/tmp/xbeeBufferTest.preview.jpeg");
+	check(result == 0 && b.result == 0 && b.names.size() == 2 && previewScans > 0 &&
+	      sameFile("/tmp/xbeeBufferTest.d/temp0.warp", sidecar) && sameFile("/tmp/xbeeBufferTest.d/temp0.jpeg", jpeg),
+	      "the second file of a batch is previewed after a short first one");
+	rmdir(dir);
+
+	//the outbox keeps the newest files in the order they were put, one put
+	//again goes to the end
+	const char* box = "/tmp/xbeeBufferTest.outbox";
+	bool kept = true;
+	for(int i = 0; i < XOUTBOX_MAX + 2; i++)
+		kept = XOutboxPut(box, ("f" + std::to_string(i)).c_str(), i % 3, &data[i], 100) == 0 && kept;
+	kept = XOutboxPut(box, "f5", 7, &data[0], 100) == 0 && XOutboxRemove(box, "f10") == 0 && kept;
+	XOUTBOX_ENTRY entries[XOUTBOX_MAX];
+	int listed = XOutboxList(box, entries, XOUTBOX_MAX);
+	struct stat st;
+	kept = kept && listed == XOUTBOX_MAX - 1 && !strcmp(entries[0].szName, "f2") &&
+	       !strcmp(entries[listed - 1].szName, "f5") && entries[listed - 1].iPriority == 7 &&
+	       stat("/tmp/xbeeBufferTest.outbox/f1", &st) && stat("/tmp/xbeeBufferTest.outbox/f10", &st) &&
+	       !stat("/tmp/xbeeBufferTest.outbox/f2", &st) && st.st_size == 100;
+	for(int i = 0; i < listed; i++)
+		XOutboxRemove(box, entries[i].szName);
+	kept = kept && XOutboxList(box, entries, XOUTBOX_MAX) == 0;
+	unlink("/tmp/xbeeBufferTest.outbox/" XOUTBOX_LIST);
+	rmdir(box);
+	check(kept, "outbox keeps the newest files in order");
+
+	//a frame fed a few bytes at a time gives the header first, then the
+	//thumbnail and the payload, and one damaged byte in the header fails it
+	XFRAME_HEADER head;
+	memset(&head, 0, sizeof(head));
+	head.iFlags = XFRAME_CORRECTED | XFRAME_WARP;
+	head.iLocation = 3;
+	head.iPan = 1712;
+	head.iTilt = 2048;
+	head.iBatteryMv = 12480;
+	head.ulCaptured = 1792396800UL;
+	int corners[8] = {301, 200, 261, 780, 1049, 819, -4, 151};
+	memcpy(head.aiCorners, corners, sizeof(corners));
+	head.iWidth = 762;
+	head.iHeight = 581;
+	float H[9] = {1.40576959f, 0.0969496518f, -442.526581f, 0.0884461701f, 1.26171017f, -278.964325f,
+	              0.00024804601f, 0.000244705734f, 1};
+	memcpy(head.afH, H, sizeof(H));
+	std::vector<unsigned char> frame(XFrameBuild(NULL, &head, &data[0], 300, &data[300], 9000));
+	long built = XFrameBuild(&frame[0], &head, &data[0], 300, &data[300], 9000);
+	static const XFRAME_CALLS frameCalls = { frameHeader, frameData, frameEnd };
+	Parsed parsed;
+	parsed.headers = 0;
+	XFRAME_PARSER parser;
+	XFrameParseInit(&parser, &frameCalls, &parsed);
+	int parsing = 0;
+	for(long at = 0; at < built && parsing == 0; at += 7)
+		parsing = XFrameParse(&parser, &frame[at], built - at < 7 ? built - at : 7);
+	unsigned char sent[XFRAME_HEADER_SIZE], got[XFRAME_HEADER_SIZE];
+	XFrameHeader(sent, &head);
+	XFrameHeader(got, &parsed.head);
+	bool framed = built == (long)frame.size() && built == XFRAME_HEADER_SIZE + 3 * XFRAME_CHUNK_SIZE + 9300 &&
+	              parsing == 1 && parsed.headers == 1 && parsed.headFirst &&
+	              !memcmp(got, sent, sizeof(sent)) && parsed.head.aiCorners[6] == -4 && parsed.ends == "TPE" &&
+	              parsed.thumb == std::vector<unsigned char>(&data[0], &data[300]) &&
+	              parsed.payload == std::vector<unsigned char>(&data[300], &data[9300]);
+	frame[30] ^= 1;
+	parsed.headers = 0;
+	XFrameParseInit(&parser, &frameCalls, &parsed);
+	framed = framed && XFrameParse(&parser, &frame[0], built) == -1 && parsed.headers == 0;
+	check(framed, "frame parses as it arrives and a damaged header is refused");
+
+	//chunk headers have no CRC, a length no frame has fails the parse
+	//rather than leaving the parser waiting or stepping back
+	frame[30] ^= 1;
+	long payloadChunk = XFRAME_HEADER_SIZE + XFRAME_CHUNK_SIZE + 300;
+	frame[XFRAME_HEADER_SIZE + 5] = 0x80;
+	parsed.thumb.clear();
+	parsed.payload.clear();
+	XFrameParseInit(&parser, &frameCalls, &parsed);
+	framed = XFrameParse(&parser, &frame[0], built) == -1 && parsed.thumb.empty();
+	frame[XFRAME_HEADER_SIZE + 5] = 0;
+	frame[payloadChunk + 5] = 0xFF;
+	XFrameParseInit(&parser, &frameCalls, &parsed);
+	framed = framed && XFrameParse(&parser, &frame[0], built) == -1 && parsed.thumb.size() == 300 &&
+	         parsed.payload.empty();
+	check(framed, "a damaged chunk length is refused");
+
+	std::cout << (failures ? "some checks failed\n" : "all checks passed\n");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+#include "xcrc.h"
+#include <iostream>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+//checks every CRC engine and the checksum against the bit by bit routines
+//xmodem.c used to have, then times each engine on 128 byte, 1K and 1M buffers
+//usage: xbeeCrcBench [megabytes per timing]
+
+extern "C" unsigned short CalcCRC(const char *lpBuf, short cbBuf);
+extern "C" unsigned char CalcCheckSum(const char *lpBuf, short cbBuf);
+
+static int failures = 0;
+
+static void check(bool ok, const char* what){
+	std::cout << (ok ? "pass  " : "FAIL  ") << what << "\n";
+	if(!ok)
+		failures++;
+}
+
+//the CRC of xmodem.c before the tables, without the byte swap
+static unsigned short oldCRC(const char *lpBuf, short cbBuf){
+	unsigned short wCRC = 0;
+	short i1, i2, iAX;
+	char cAL;
+
+	for(i1=0; i1 < cbBuf; i1++){
+		cAL = lpBuf[i1];
+		iAX = (unsigned short)cAL << 8;
+		wCRC = iAX ^ wCRC;
+		for(i2=0; i2 < 8; i2++){
+			iAX = wCRC;
+			if(iAX & 0x8000){
+				wCRC <<= 1;
+				wCRC ^= 0x1021;
+			}
+			else
+				wCRC <<= 1;
+		}
+	}
+	return wCRC;
+}
+
+static unsigned char oldCheckSum(const char *lpBuf, short cbBuf){
+	short iC = 0, i1;
+
+	for(i1 = 0; i1 < cbBuf; i1++)
+		iC += lpBuf[i1];
+	return (unsigned char)(iC & 0xff);
+}
+
+static double now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv){
+	const XCRC16_ENGINE* engines;
+	int count = XCrc16Engines(&engines);
+	double megabytes = argc > 1 ? atof(argv[1]) : 64;
+	std::vector<char> data(1 << 20);
+
+	srand(1);
+	for(size_t i = 0; i < data.size(); i++)
+		data[i] = rand() & 0xFF;
+
+	check(XCrc16(0, "123456789", 9) == 0x31C3, "XCrc16 of \"123456789\" is 0x31C3");
+
+	//every length up to a few folds, at every alignment, whole and in two pieces
+	for(int e = 0; e < count; e++){
+		bool whole = true, pieces = true;
+		for(int offset = 0; offset < 16; offset++){
+			for(int length = 0; length <= 600; length++){
+				const char* p = &data[offset * 4099];
+				unsigned short expected = oldCRC(p, length);
+				if(engines[e].pfn(0, p, length) != expected)
+					whole = false;
+				int split = length * offset / 16;
+				if(engines[e].pfn(engines[e].pfn(0, p, split), p + split, length - split) != expected)
+					pieces = false;
+			}
+		}
+		check(whole, (std::string(engines[e].szName) + " matches the old CRC").c_str());
+		check(pieces, (std::string(engines[e].szName) + " carries on across calls").c_str());
+	}
+
+	bool crc = true, sum = true;
+	for(int offset = 0; offset < 64; offset++){
+		for(int length = 0; length <= 1024; length += 7){
+			const char* p = &data[offset * 1031];
+			if(CalcCRC(p, length) != htons(oldCRC(p, length)))
+				crc = false;
+			if(CalcCheckSum(p, length) != oldCheckSum(p, length) ||
+			   XCheckSum(XCheckSum(0, p, length / 3), p + length / 3, length - length / 3) != oldCheckSum(p, length))
+				sum = false;
+		}
+	}
+	check(crc, "CalcCRC matches the old CRC, high endian");
+	check(sum, "CalcCheckSum and XCheckSum match the old checksum");
+
+	std::cout << "\nXCrc16 uses " << XCrc16Name() << "\n";
+	printf("%10s %12s %12s %12s   MB/s\n", "engine", "128 B", "1 KB", "1 MB");
+	static const long sizes[] = { 128, 1024, 1 << 20 };
+	for(int e = 0; e < count; e++){
+		printf("%10s", engines[e].szName);
+		for(int s = 0; s < 3; s++){
+			long rounds = (long)(megabytes * (1 << 20) / sizes[s]);
+			//the bitwise engine is slow enough that a sixteenth is plenty
+			if(engines[e].pfn == XCrc16Bitwise)
+				rounds = rounds / 16 + 1;
+			volatile unsigned short sink = 0;
+			double start = now();
+			for(long r = 0; r < rounds; r++)
+				sink = sink + engines[e].pfn(0, &data[(r * 64) % (data.size() - sizes[s] + 1)], sizes[s]);
+			double seconds = now() - start;
+			printf(" %12.0f", rounds * sizes[s] / seconds / (1 << 20));
+		}
+		printf("\n");
+	}
+
+	std::cout << "\n" << (failures ? "some checks failed\n" : "all checks passed\n");
+	return failures ? 1 : 0;
+}
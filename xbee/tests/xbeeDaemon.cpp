@@ -0,0 +1,583 @@
+#include "xmodem.h"
+#include "xresume.h"
+#include "xpreview.h"
+#include "xbaud.h"
+#include "xlog.h"
+#include "xframe.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+
+//the base station receiver for any number of radios
+//
+//usage: xbeeDaemon [-o dir] [-b baud] [-m max baud] [-w workers] [device ...]
+//
+//one thread waits in epoll on every device, so an idle base station uses
+//no CPU.  the signal byte a field unit sends before its images ('1' or
+//'7') hands that device to a worker thread, which receives the YMODEM
+//batch while the other radios keep being served.  each device has its
+//own directories under the output directory (default "."):
+//
+//  <dir>/.incoming/<device>/   files arriving, with their resume records
+//  <dir>/<device>/             finished images and their .meta files, and
+//                              the field unit's link.log after each batch
+//
+//a finished image is moved into place with a rename after its .meta file,
+//so whatever sees the image can read where and when it came from.  while
+//a progressive JPEG arrives <dir>/<device>/<name>.preview.jpeg shows the
+//scans so far.  a gusset frame (see xframe.h) is parsed while it
+//arrives, its header is reported as soon as it is in and its thumbnail
+//is written as <name>.thumb.jpeg before the payload has come.  a device
+//that goes away is opened again every few
+//seconds.  SIGINT or SIGTERM stops after the transfers under way
+//
+//a field unit may offer a faster serial rate first ('8', see xbaud.h),
+//up to -m (default 115200).  the worker then stays with that device for
+//the images at that rate and puts it back on the usual rate once it is
+//quiet
+
+struct Device {
+	std::string path;	//serial device
+	std::string name;	//its file name, names its directories
+	std::string dir;	//finished images
+	std::string staging;	//files arriving
+	int fd;			//-1 while it is not open
+	int sessions;		//sessions so far
+};
+
+struct Session {
+	Device* device;
+	char signal;		//'1' for an image, '7' for a batch, '8' for a rate
+	int number;		//sessions on this device before this one
+	struct timespec start;
+	XPREVIEW preview;
+	int files;		//files finished so far
+	XFRAME_PARSER frame;	//of the gusset frame arriving
+	std::string frameName;	//its name, empty if none
+	long frameParsed;	//bytes of it parsed so far
+	int frameResult;	//what XFrameParse returned last
+	std::vector<unsigned char> thumb;	//its thumbnail so far
+};
+
+static std::string outDir = ".";
+static int baud = XBAUD_DEFAULT;
+static long maxBaud = XBAUD_MAX;
+static int epollFd = -1;
+static std::vector<Device*> devices;
+
+//sessions waiting for a worker
+static std::deque<Session*> queue;
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueReady = PTHREAD_COND_INITIALIZER;
+static bool stopping = false;	//under queueLock
+
+//the workers print whole lines
+static pthread_mutex_t logLock = PTHREAD_MUTEX_INITIALIZER;
+
+//the session the calling worker is receiving, for the progress callback
+static __thread Session* current = NULL;
+
+static void report(const Device* device, const std::string& line){
+	pthread_mutex_lock(&logLock);
+	std::cout << device->name << ": " << line << std::endl;
+	pthread_mutex_unlock(&logLock);
+}
+
+static double secondsSince(const struct timespec& start){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+static bool makeDir(const std::string& path){
+	return mkdir(path.c_str(), 0775) == 0 || errno == EEXIST;
+}
+
+static speed_t speedOf(int rate){
+	switch(rate){
+		case 9600:	return B9600;
+		case 19200:	return B19200;
+		case 38400:	return B38400;
+		case 57600:	return B57600;
+		case 115200:	return B115200;
+		case 230400:	return B230400;
+		default:	return B57600;
+	}
+}
+
+//the device in raw mode at the baud rate, false if it is not there
+static bool openDevice(Device* device){
+	struct termios options;
+	struct epoll_event event;
+
+	device->fd = open(device->path.c_str(), O_RDWR | O_NOCTTY);
+	if(device->fd < 0)
+		return false;
+
+	if(tcgetattr(device->fd, &options) == 0){
+		cfmakeraw(&options);
+		cfsetispeed(&options, speedOf(baud));
+		cfsetospeed(&options, speedOf(baud));
+		options.c_cflag |= CLOCAL | CREAD;
+		options.c_cc[VMIN] = 1;
+		options.c_cc[VTIME] = 0;
+		tcsetattr(device->fd, TCSANOW, &options);
+	}
+
+	//one event per wakeup, a worker arms it again after a session
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLONESHOT;
+	event.data.ptr = device;
+	if(epoll_ctl(epollFd, EPOLL_CTL_ADD, device->fd, &event)){
+		close(device->fd);
+		device->fd = -1;
+		return false;
+	}
+
+	report(device, "listening on " + device->path);
+	return true;
+}
+
+static void closeDevice(Device* device){
+	report(device, "lost " + device->path);
+	close(device->fd);	//which also takes it out of epoll
+	device->fd = -1;
+}
+
+static void armDevice(Device* device){
+	struct epoll_event event;
+
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN | EPOLLONESHOT;
+	event.data.ptr = device;
+	epoll_ctl(epollFd, EPOLL_CTL_MOD, device->fd, &event);
+}
+
+//"temp0.jpeg" becomes "temp0.preview.jpeg"
+static std::string previewPath(const Device* device, std::string name){
+	size_t dot = name.find_last_of('.');
+	if(name.empty())
+		name = "image.jpeg";
+	else if(dot != std::string::npos && dot > 0)
+		name = name.substr(0, dot) + ".preview" + name.substr(dot);
+	else
+		name += ".preview";
+	return device->dir + "/" + name;
+}
+
+//writes data, a .meta file or a thumbnail, in a temporary file that is
+//renamed into place at path, so a reader sees all of it or nothing
+static bool writeAtomic(const std::string& path, const std::string& data){
+	std::string temp = path + ".tmp";
+	FILE* f = fopen(temp.c_str(), "wb");
+
+	if(!f)
+		return false;
+
+	bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+	ok = fflush(f) == 0 && fsync(fileno(f)) == 0 && ok;
+	fclose(f);
+
+	if(!ok || rename(temp.c_str(), path.c_str())){
+		unlink(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+static void frameHeader(void* ctx, const XFRAME_HEADER* head){
+	Session* session = (Session*)ctx;
+	char stamp[32];
+	time_t captured = head->ulCaptured;
+	struct tm utc;
+	std::ostringstream oss;
+
+	gmtime_r(&captured, &utc);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", &utc);
+	oss << "frame " << session->frameName << " of location " << head->iLocation << ", pan " << head->iPan
+	    << " tilt " << head->iTilt << ", captured " << stamp;
+	if(head->iBatteryMv)
+		oss << ", battery " << head->iBatteryMv << " mV";
+	if(head->iFlags & XFRAME_WARP)
+		oss << ", " << head->iWidth << "x" << head->iHeight << (head->iFlags & XFRAME_CORRECTED ? " corrected" : " to correct");
+	report(session->device, oss.str());
+}
+
+static void frameData(void* ctx, int type, const void* data, long size){
+	Session* session = (Session*)ctx;
+	if(type == XFRAME_THUMBNAIL)
+		session->thumb.insert(session->thumb.end(), (const unsigned char*)data, (const unsigned char*)data + size);
+}
+
+//the thumbnail is in, it is shown while the payload is still coming
+static void frameEnd(void* ctx, int type){
+	Session* session = (Session*)ctx;
+	if(type != XFRAME_THUMBNAIL)
+		return;
+
+	std::string name = session->frameName.substr(0, session->frameName.size() - 6) + ".thumb.jpeg";
+	std::string path = session->device->dir + "/" + name;
+	std::string thumb(session->thumb.begin(), session->thumb.end());
+	if(writeAtomic(path, thumb))
+		report(session->device, "thumbnail of " + session->frameName + " in " + path);
+	session->thumb.clear();
+}
+
+//feeds what arrived of a frame since the last call to its parser
+static void parseFrame(Session* session, const char* received, const char* name, long done){
+	static const XFRAME_CALLS calls = { frameHeader, frameData, frameEnd };
+	unsigned char buffer[4096];
+
+	if(session->frameName != name){
+		session->frameName = name;
+		session->frameParsed = 0;
+		session->frameResult = 0;
+		session->thumb.clear();
+		XFrameParseInit(&session->frame, &calls, session);
+	}
+
+	int before = session->frameResult;
+	int fd = open(received, O_RDONLY);
+	while(fd >= 0 && session->frameResult == 0 && session->frameParsed < done){
+		long want = done - session->frameParsed < (long)sizeof(buffer) ? done - session->frameParsed : (long)sizeof(buffer);
+		ssize_t got = pread(fd, buffer, want, session->frameParsed);
+		if(got <= 0)
+			break;
+		session->frameResult = XFrameParse(&session->frame, buffer, got);
+		session->frameParsed += got;
+	}
+	if(fd >= 0)
+		close(fd);
+
+	if(session->frameResult < 0 && before == 0)
+		report(session->device, std::string(name) + " is not a gusset frame");
+}
+
+static void previewImage(void*, const char* received, const char* name, long done, long size){
+	if(!current || !received[0])
+		return;
+
+	size_t length = strlen(name);
+	if(length > 6 && !strcmp(name + length - 6, ".frame")){
+		parseFrame(current, received, name, done);
+		return;
+	}
+
+	int scans = XPreviewUpdate(&current->preview, received, done, previewPath(current->device, name).c_str());
+	if(scans){
+		std::ostringstream oss;
+		oss << "preview of " << name << ", " << scans << " scans in " << done << " of " << size << " bytes";
+		report(current->device, oss.str());
+	}
+}
+
+//a file of the batch is complete in the staging directory
+static void publishImage(void* ctx, const char* received, long size){
+	Session* session = (Session*)ctx;
+	Device* device = session->device;
+	std::string name = strrchr(received, '/') ? strrchr(received, '/') + 1 : received;
+	char stamp[32];
+	time_t now = time(NULL);
+	struct tm utc;
+	unsigned long long hash = 0;
+	int fd;
+
+	//the next file arrives in the same staging file
+	XPreviewInit(&session->preview);
+
+	gmtime_r(&now, &utc);
+	strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &utc);
+
+	//the session number keeps two sessions in the same second apart
+	std::ostringstream target;
+	target << device->dir << "/" << stamp << "-" << session->number << "-" << name;
+
+	fd = open(received, O_RDONLY);
+	if(fd >= 0){
+		hash = XResumeHash(fd);
+		close(fd);
+	}
+
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", &utc);
+	std::ostringstream meta;
+	char hex[20];
+	snprintf(hex, sizeof(hex), "%016llx", hash);
+	meta << "device=" << device->path << "\n"
+	     << "name=" << name << "\n"
+	     << "bytes=" << size << "\n"
+	     << "received=" << stamp << "\n"
+	     << "session=" << session->number << "\n"
+	     << "file=" << session->files << "\n"
+	     << "seconds=" << secondsSince(session->start) << "\n"
+	     << "hash=" << hex << "\n";
+
+	if(!writeAtomic(target.str() + ".meta", meta.str()) || rename(received, target.str().c_str())){
+		report(device, "unable to move " + name + " to " + target.str());
+		return;
+	}
+
+	unlink(previewPath(device, name).c_str());
+	session->files++;
+
+	std::ostringstream oss;
+	oss << "received " << target.str() << ", " << size << " bytes";
+	report(device, oss.str());
+}
+
+//asks the field unit for its link log (see xlog.h) once a batch is in.  it
+//waits for the request only after its last batch, one that failed may
+//still be sent again
+static void receiveLog(Device* device){
+	std::string staging = device->staging + "/link.log";
+	std::string target = device->dir + "/link.log";
+	char c = '5';
+
+	usleep(XLOG_ASK * 1000);
+	if(write(device->fd, &c, 1) != 1 || XReceive(device->fd, staging.c_str(), 0664) != 0){
+		report(device, "no link log");
+		return;
+	}
+
+	if(rename(staging.c_str(), target.c_str()))
+		report(device, "unable to move the link log to " + target);
+	else
+		report(device, "link log in " + target);
+}
+
+static void receiveBatch(Session* session){
+	Device* device = session->device;
+	std::ostringstream oss;
+
+	clock_gettime(CLOCK_MONOTONIC, &session->start);
+	XPreviewInit(&session->preview);
+	session->files = 0;
+	session->frameName.clear();
+	current = session;
+
+	report(device, session->signal == '7' ? "receiving a batch" : "receiving an image");
+
+	//a single image is a batch of one, this way it also keeps its name
+	int result = XReceiveBatch(device->fd, device->staging.c_str(), 0664, publishImage, session);
+
+	current = NULL;
+	oss << "session " << session->number << " returned " << result << " after " << session->files
+	    << " files in " << secondsSince(session->start) << " s";
+	report(device, oss.str());
+
+	if(result == 0 && session->signal == '7')
+		receiveLog(device);
+}
+
+//the next byte while the device is at another rate, 0 once it is quiet
+static char nextSignal(Device* device){
+	struct pollfd pfd = { device->fd, POLLIN, 0 };
+	char c;
+
+	if(poll(&pfd, 1, XBAUD_SILENCE) <= 0 || read(device->fd, &c, 1) != 1)
+		return 0;
+	return c;
+}
+
+static void runSession(Session* session){
+	Device* device = session->device;
+
+	if(session->signal != '8'){
+		receiveBatch(session);
+		return;
+	}
+
+	std::ostringstream oss;
+	oss << "serial rate " << XBaudAnswer(device->fd, maxBaud);
+	report(device, oss.str());
+
+	//a batch sent again after a failure comes at the new rate as well, so
+	//the usual one is only back once the field unit is quiet
+	char c;
+	while(XBaudPort(device->fd) != baud && (c = nextSignal(device))){
+		if(c == '1' || c == '7'){
+			session->signal = c;
+			receiveBatch(session);
+		}
+	}
+
+	if(XBaudPort(device->fd) != baud){
+		if(XBaudSet(device->fd, baud))
+			report(device, "unable to put the radio back on the usual rate");
+		else
+			report(device, "back on the usual rate");
+	}
+}
+
+static void* worker(void*){
+	for(;;){
+		pthread_mutex_lock(&queueLock);
+		while(queue.empty() && !stopping)
+			pthread_cond_wait(&queueReady, &queueLock);
+		if(queue.empty()){
+			pthread_mutex_unlock(&queueLock);
+			return NULL;
+		}
+		Session* session = queue.front();
+		queue.pop_front();
+		pthread_mutex_unlock(&queueLock);
+
+		runSession(session);
+		armDevice(session->device);
+		delete session;
+	}
+}
+
+//the device has something to say while no session is running on it
+static void deviceReady(Device* device){
+	char c;
+
+	if(read(device->fd, &c, 1) != 1){
+		closeDevice(device);
+		return;
+	}
+
+	if(c != '1' && c != '7' && c != '8'){
+		armDevice(device);	//noise, or a message the base station does not take
+		return;
+	}
+
+	Session* session = new Session;
+	session->device = device;
+	session->signal = c;
+	session->number = device->sessions++;
+
+	pthread_mutex_lock(&queueLock);
+	queue.push_back(session);
+	pthread_cond_signal(&queueReady);
+	pthread_mutex_unlock(&queueLock);
+}
+
+int main(int argc, char* argv[]){
+	int workers = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "o:b:m:w:")) != -1){
+		if(opt == 'o')
+			outDir = optarg;
+		else if(opt == 'b')
+			baud = atoi(optarg);
+		else if(opt == 'm')
+			maxBaud = atol(optarg);
+		else if(opt == 'w')
+			workers = atoi(optarg);
+		else{
+			std::cout << "usage: xbeeDaemon [-o dir] [-b baud] [-m max baud] [-w workers] [device ...]\n";
+			return 1;
+		}
+	}
+
+	for(int i = optind; i < argc; i++){
+		Device* device = new Device;
+		device->path = argv[i];
+		devices.push_back(device);
+	}
+	if(devices.empty()){
+		Device* device = new Device;
+		device->path = "/dev/ttyUSB0";
+		devices.push_back(device);
+	}
+
+	//one worker per radio unless told otherwise
+	if(workers < 1)
+		workers = devices.size();
+
+	makeDir(outDir);
+	makeDir(outDir + "/.incoming");
+	for(size_t i = 0; i < devices.size(); i++){
+		Device* device = devices[i];
+		device->name = device->path.substr(device->path.find_last_of('/') + 1);
+		device->dir = outDir + "/" + device->name;
+		device->staging = outDir + "/.incoming/" + device->name;
+		device->fd = -1;
+		device->sessions = 0;
+		if(!makeDir(device->dir) || !makeDir(device->staging)){
+			std::cout << "unable to make the directories for " << device->path << "\n";
+			return 1;
+		}
+	}
+
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+	//SIGINT and SIGTERM arrive through epoll like the radios
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+	int signalFd = signalfd(-1, &mask, SFD_CLOEXEC);
+
+	struct epoll_event event;
+	memset(&event, 0, sizeof(event));
+	event.events = EPOLLIN;
+	event.data.ptr = NULL;
+	if(epollFd < 0 || signalFd < 0 || epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &event)){
+		std::cout << "unable to set up epoll\n";
+		return 1;
+	}
+
+	XSetProgress(previewImage, NULL);
+
+	std::vector<pthread_t> threads(workers);
+	for(int i = 0; i < workers; i++)
+		pthread_create(&threads[i], NULL, worker, NULL);
+
+	bool stop = false;
+	while(!stop){
+		//only wake up on a timer while a device has to be opened again
+		int down = 0;
+		for(size_t i = 0; i < devices.size(); i++)
+			if(devices[i]->fd < 0 && !openDevice(devices[i]))
+				down++;
+
+		struct epoll_event events[16];
+		int n = epoll_wait(epollFd, events, 16, down ? 5000 : -1);
+
+		for(int i = 0; i < n; i++){
+			if(!events[i].data.ptr){
+				struct signalfd_siginfo info;
+				if(read(signalFd, &info, sizeof(info)) == sizeof(info))
+					stop = true;
+			}
+			else
+				deviceReady((Device*)events[i].data.ptr);
+		}
+	}
+
+	std::cout << "stopping after the transfers under way\n";
+	pthread_mutex_lock(&queueLock);
+	stopping = true;
+	pthread_cond_broadcast(&queueReady);
+	pthread_mutex_unlock(&queueLock);
+	for(int i = 0; i < workers; i++)
+		pthread_join(threads[i], NULL);
+
+	for(size_t i = 0; i < devices.size(); i++){
+		if(devices[i]->fd >= 0)
+			close(devices[i]->fd);
+		delete devices[i];
+	}
+	close(signalFd);
+	close(epollFd);
+	return 0;
+}
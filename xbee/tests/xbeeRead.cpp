@@ -1,16 +1,113 @@
 #include "xMessage.hpp"
+#include "xpreview.h"
+#include "xframe.h"
+#include <stdio.h>
+#include <string.h>
+#include <poll.h>
+
+static int imageCounter = 1;
+static int batchCounter = 1;
+static XPREVIEW preview;
+
+//a progressive image can be looked at before all of it is here
+static std::string previewName(){
+	std::ostringstream oss;
+	oss << "Image" << imageCounter << ".preview.jpeg";
+	return oss.str();
+}
+
+static bool isFrame(const char* name){
+	size_t length = strlen(name);
+	return length > 6 && !strcmp(name + length - 6, ".frame");
+}
+
+static void previewImage(void*, const char* received, const char* sent, long done, long size){
+	if(!received[0] || isFrame(sent))
+		return;
+	std::string name = previewName();
+	int scans = XPreviewUpdate(&preview, received, done, name.c_str());
+	if(scans)
+		std::cout << "Preview " << name << ", " << scans << " scans in " << done << " of " << size << " bytes\n";
+}
+
+static void frameHeader(void*, const XFRAME_HEADER* head){
+	std::cout << "Frame of location " << head->iLocation << ", pan " << head->iPan << " tilt " << head->iTilt << "\n";
+}
+
+static void frameData(void* ctx, int type, const void* data, long size){
+	if(type == XFRAME_THUMBNAIL)
+		((std::string*)ctx)->append((const char*)data, size);
+}
+
+//a gusset frame (see xframe.h) that is in is reported and its thumbnail
+//written next to it as <name>.thumb.jpeg, xbeeDaemon does this while the
+//frame arrives
+static void unpackFrame(const std::string& path){
+	static const XFRAME_CALLS calls = { frameHeader, frameData, NULL };
+	XFRAME_PARSER parser;
+	std::string thumb;
+	char buffer[4096];
+	size_t got;
+	int result = 0;
+
+	XFrameParseInit(&parser, &calls, &thumb);
+	FILE* f = fopen(path.c_str(), "rb");
+	while(f && result == 0 && (got = fread(buffer, 1, sizeof(buffer), f)) > 0)
+		result = XFrameParse(&parser, buffer, got);
+	if(f)
+		fclose(f);
+
+	if(result != 1){
+		std::cout << path << " is not a gusset frame\n";
+		return;
+	}
+	if(thumb.empty())
+		return;
+
+	std::string name = path.substr(0, path.size() - 6) + ".thumb.jpeg";
+	f = fopen(name.c_str(), "wb");
+	if(f && fwrite(thumb.data(), 1, thumb.size(), f) == thumb.size())
+		std::cout << "Thumbnail " << name << "\n";
+	if(f)
+		fclose(f);
+}
+
+//each file of a batch keeps the sender's name behind the batch number,
+//like xbeeDaemon, so a capture and its temp<n>.warp or thumbnail stay
+//together and keep their extension.  a .frame is unpacked once it is in
+static void batchImage(void*, const char* path, long size){
+	remove(previewName().c_str());
+	XPreviewInit(&preview); //the next file arrives under the same name
+	imageCounter++;
+	const char* name = strrchr(path, '/');
+	std::ostringstream oss;
+	oss << "Batch" << batchCounter << "-" << (name ? name + 1 : path);
+	if(rename(path, oss.str().c_str()) == 0){
+		std::cout << "Received " << oss.str() << ", " << size << " bytes\n";
+		if(isFrame(path))
+			unpackFrame(oss.str());
+	}
+}
 
 int main(){
 
         char *device = (char *)"/dev/ttyUSB0";
-        Serial xbee(device, 57600);
-        int fd = xbee.Open();
-	static int imageCounter = 1;
+        Serial xbee(device, XBAUD_DEFAULT);
+	XSetProgress(previewImage, NULL);
 	const char* fileName;
 	std::string tempFileName;
         std::ostringstream oss;
 for(;;)
 {
+	//sleeps until the radio has something, xbeeDaemon serves several radios.
+	//after a session at a faster rate the radio goes back to the usual one
+	//once the field unit is quiet
+	struct pollfd radio = { xbee.Fd(), POLLIN, 0 };
+	if(poll(&radio, 1, xbee.GetBaud() == XBAUD_DEFAULT ? -1 : XBAUD_SILENCE) == 0){
+	  xbee.SetBaud(XBAUD_DEFAULT);
+	  continue;
+	}
+
     	while (xbee.DataAvail() > 0)
     	{
 	  char temp = xbee.GetChar();
@@ -24,13 +121,35 @@ for(;;)
 //	    snprintf(fileName, "Image%03d.jpeg", imageCounter);
 
 //	    fileName = ("image%d.jpeg", imageCounter);
-	    int result = XReceive(fd, fileName, 0777);
-	    if(result == 0)
+	    int result = XReceive(xbee.Fd(), fileName, 0777);
+	    if(result == 0){
 		std::cout << "Image receive success!\n";
+		remove(previewName().c_str());
+	    }
 	    else
 		std::cout << "error during image receive\n";
 	    imageCounter++;
 	  }
+	  else if(temp == '7')
+	  {
+	    std::cout << "Attempting to receive a batch\n";
+	    int result = XReceiveBatch(xbee.Fd(), ".", 0777, batchImage, NULL);
+	    batchCounter++;
+	    if(result == 0){
+		std::cout << "Batch receive success!\n";
+		//the field unit sends what its transfers cost once a batch is in
+		Message msg(xbee);
+		usleep(XLOG_ASK * 1000);
+		if(msg.receiveLog("link.log") == 0)
+		    std::cout << "Received link.log\n";
+	    }
+	    else
+		std::cout << "error during batch receive\n";
+	  }
+	  else if(temp == '8')
+	  {
+	    std::cout << "Serial rate " << XBaudAnswer(xbee.Fd(), XBAUD_MAX) << "\n";
+	  }
 
 //	  fflush(stdout);
     	}
@@ -3,16 +3,16 @@ int main(){
 
 	char *device = (char *)"/dev/ttyUSB0";
 
-	Serial xbee(device, 57600);
-	Message msg(device);
+	Serial xbee(device, XBAUD_DEFAULT);
+	Message msg(xbee);
 
-	int fd = xbee.Open();
+	std::cout << "Serial rate " << msg.negotiateBaud(XBAUD_MAX) << "\n";
 
 	std::cout << "Send Image signal\n";
 	msg.sendingImage();
 
 	std::cout << "Transmitting Image\n";
-	int result = XSend(fd, "../../images/testing0.jpeg");
+	int result = XSend(xbee.Fd(), "../../images/testing0.jpeg");
 
 	if(result == 0){
 		std::cout << "Image transmitted successfully\n";
@@ -21,7 +21,6 @@ int main(){
 		std::cout << "Error during image transmission\n";
 	}
 
-	xbee.Close();
 	return 0;
 }
 